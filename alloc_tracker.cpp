@@ -0,0 +1,451 @@
+#include "alloc_tracker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if __has_include(<execinfo.h>)
+#include <execinfo.h>
+#define ALLOC_TRACKER_STACKS
+#endif
+
+// Replacing malloc means forwarding to the allocator underneath, which
+// only glibc exports under names of its own
+#if defined(GLSANDBOX_ALLOC_TRACKING) && defined(__GLIBC__)
+#include <malloc.h>
+#define ALLOC_TRACKER_MALLOC
+extern "C" {
+void *__libc_malloc(std::size_t size);
+void *__libc_calloc(std::size_t count, std::size_t size);
+void *__libc_realloc(void *pointer, std::size_t size);
+void *__libc_memalign(std::size_t alignment, std::size_t size);
+void __libc_free(void *pointer);
+}
+#endif
+
+AllocCounts &AllocCounts::operator+=(const AllocCounts &other) {
+  news += other.news;
+  newBytes += other.newBytes;
+  deletes += other.deletes;
+  mallocs += other.mallocs;
+  mallocBytes += other.mallocBytes;
+  frees += other.frees;
+  return *this;
+}
+
+AllocCounts AllocCounts::operator-(const AllocCounts &other) const {
+  return {news - other.news,       newBytes - other.newBytes,
+          deletes - other.deletes, mallocs - other.mallocs,
+          mallocBytes - other.mallocBytes, frees - other.frees};
+}
+
+namespace {
+
+// Everything here is zero initialized static storage: it has to work
+// before main and from inside malloc
+struct alignas(64) AllocSlot {
+  std::atomic<std::uint64_t> news;
+  std::atomic<std::uint64_t> newBytes;
+  std::atomic<std::uint64_t> deletes;
+  std::atomic<std::uint64_t> mallocs;
+  std::atomic<std::uint64_t> mallocBytes;
+  std::atomic<std::uint64_t> frees;
+};
+
+AllocSlot allocSlots[allocTrackerMaxThreads];
+std::atomic<std::size_t> allocSlotCount;
+thread_local AllocSlot *currentAllocSlot = nullptr;
+
+constexpr int stackDepth = 24;
+constexpr std::size_t maxStacks = 16;
+
+struct StackRecord {
+  void *frames[stackDepth];
+  int depth;
+  std::size_t bytes;
+};
+
+StackRecord stackRecords[maxStacks];
+std::atomic<std::size_t> stackCount;
+std::atomic<bool> capturingStacks;
+// backtrace() allocates the first time it runs
+thread_local bool inBacktrace = false;
+
+[[maybe_unused]] AllocSlot &allocSlot() {
+  AllocSlot *slot = currentAllocSlot;
+  if (slot == nullptr) {
+    std::size_t index = allocSlotCount.fetch_add(1, std::memory_order_relaxed);
+    slot = &allocSlots[std::min(index, allocTrackerMaxThreads - 1)];
+    currentAllocSlot = slot;
+  }
+  return *slot;
+}
+
+[[maybe_unused]] void noteNew(std::size_t size) {
+  AllocSlot &slot = allocSlot();
+  slot.news.fetch_add(1, std::memory_order_relaxed);
+  slot.newBytes.fetch_add(size, std::memory_order_relaxed);
+#ifdef ALLOC_TRACKER_STACKS
+  if (capturingStacks.load(std::memory_order_relaxed) && !inBacktrace) {
+    std::size_t index = stackCount.fetch_add(1, std::memory_order_relaxed);
+    if (index < maxStacks) {
+      inBacktrace = true;
+      StackRecord &record = stackRecords[index];
+      record.depth = backtrace(record.frames, stackDepth);
+      record.bytes = size;
+      inBacktrace = false;
+    }
+  }
+#endif
+}
+
+[[maybe_unused]] void noteDelete(void *pointer) {
+  if (pointer != nullptr) {
+    allocSlot().deletes.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+[[maybe_unused]] void noteMalloc(std::size_t size) {
+  AllocSlot &slot = allocSlot();
+  slot.mallocs.fetch_add(1, std::memory_order_relaxed);
+  slot.mallocBytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+[[maybe_unused]] void noteFree(void *pointer) {
+  if (pointer != nullptr) {
+    allocSlot().frees.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+} // namespace
+
+#ifdef GLSANDBOX_ALLOC_TRACKING
+
+namespace {
+
+// Underneath operator new, without going through the counting malloc
+void *rawMalloc(std::size_t size) {
+#ifdef ALLOC_TRACKER_MALLOC
+  return __libc_malloc(size);
+#else
+  return std::malloc(size);
+#endif
+}
+
+void *rawAlignedMalloc(std::size_t size, std::size_t alignment) {
+#ifdef ALLOC_TRACKER_MALLOC
+  return __libc_memalign(alignment, size);
+#else
+  // aligned_alloc wants a multiple of the alignment
+  return std::aligned_alloc(alignment,
+                            (size + alignment - 1) / alignment * alignment);
+#endif
+}
+
+void rawFree(void *pointer) {
+#ifdef ALLOC_TRACKER_MALLOC
+  __libc_free(pointer);
+#else
+  std::free(pointer);
+#endif
+}
+
+void *trackedNew(std::size_t size, std::size_t alignment, bool nothrow) {
+  if (size == 0) {
+    size = 1;
+  }
+  void *pointer = alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__
+                      ? rawAlignedMalloc(size, alignment)
+                      : rawMalloc(size);
+  if (pointer == nullptr) {
+    if (nothrow) {
+      return nullptr;
+    }
+    throw std::bad_alloc();
+  }
+  noteNew(size);
+  return pointer;
+}
+
+void trackedDelete(void *pointer) {
+  noteDelete(pointer);
+  rawFree(pointer);
+}
+
+} // namespace
+
+void *operator new(std::size_t size) { return trackedNew(size, 0, false); }
+void *operator new[](std::size_t size) { return trackedNew(size, 0, false); }
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  return trackedNew(size, 0, true);
+}
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+  return trackedNew(size, 0, true);
+}
+void *operator new(std::size_t size, std::align_val_t alignment) {
+  return trackedNew(size, std::size_t(alignment), false);
+}
+void *operator new[](std::size_t size, std::align_val_t alignment) {
+  return trackedNew(size, std::size_t(alignment), false);
+}
+void *operator new(std::size_t size, std::align_val_t alignment,
+                   const std::nothrow_t &) noexcept {
+  return trackedNew(size, std::size_t(alignment), true);
+}
+void *operator new[](std::size_t size, std::align_val_t alignment,
+                     const std::nothrow_t &) noexcept {
+  return trackedNew(size, std::size_t(alignment), true);
+}
+
+void operator delete(void *pointer) noexcept { trackedDelete(pointer); }
+void operator delete[](void *pointer) noexcept { trackedDelete(pointer); }
+void operator delete(void *pointer, std::size_t) noexcept {
+  trackedDelete(pointer);
+}
+void operator delete[](void *pointer, std::size_t) noexcept {
+  trackedDelete(pointer);
+}
+void operator delete(void *pointer, const std::nothrow_t &) noexcept {
+  trackedDelete(pointer);
+}
+void operator delete[](void *pointer, const std::nothrow_t &) noexcept {
+  trackedDelete(pointer);
+}
+void operator delete(void *pointer, std::align_val_t) noexcept {
+  trackedDelete(pointer);
+}
+void operator delete[](void *pointer, std::align_val_t) noexcept {
+  trackedDelete(pointer);
+}
+void operator delete(void *pointer, std::size_t, std::align_val_t) noexcept {
+  trackedDelete(pointer);
+}
+void operator delete[](void *pointer, std::size_t,
+                       std::align_val_t) noexcept {
+  trackedDelete(pointer);
+}
+void operator delete(void *pointer, std::align_val_t,
+                     const std::nothrow_t &) noexcept {
+  trackedDelete(pointer);
+}
+void operator delete[](void *pointer, std::align_val_t,
+                       const std::nothrow_t &) noexcept {
+  trackedDelete(pointer);
+}
+
+#endif
+
+#ifdef ALLOC_TRACKER_MALLOC
+
+extern "C" {
+
+void *malloc(std::size_t size) noexcept {
+  noteMalloc(size);
+  return __libc_malloc(size);
+}
+
+void *calloc(std::size_t count, std::size_t size) noexcept {
+  noteMalloc(count * size);
+  return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, std::size_t size) noexcept {
+  noteMalloc(size);
+  return __libc_realloc(pointer, size);
+}
+
+void *memalign(std::size_t alignment, std::size_t size) noexcept {
+  noteMalloc(size);
+  return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(std::size_t alignment, std::size_t size) noexcept {
+  noteMalloc(size);
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **pointer, std::size_t alignment,
+                   std::size_t size) noexcept {
+  if (alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0) {
+    return EINVAL;
+  }
+  noteMalloc(size);
+  void *result = __libc_memalign(alignment, size);
+  if (result == nullptr && size != 0) {
+    return ENOMEM;
+  }
+  *pointer = result;
+  return 0;
+}
+
+void free(void *pointer) noexcept {
+  noteFree(pointer);
+  __libc_free(pointer);
+}
+
+} // extern "C"
+
+#endif
+
+bool allocTrackerCompiled() {
+#ifdef GLSANDBOX_ALLOC_TRACKING
+  return true;
+#else
+  return false;
+#endif
+}
+
+std::size_t allocTrackerSnapshot(std::span<AllocCounts> threads) {
+  std::size_t count =
+      std::min({allocSlotCount.load(std::memory_order_relaxed),
+                allocTrackerMaxThreads, threads.size()});
+  for (std::size_t i = 0; i < count; i++) {
+    const AllocSlot &slot = allocSlots[i];
+    threads[i] = {slot.news.load(std::memory_order_relaxed),
+                  slot.newBytes.load(std::memory_order_relaxed),
+                  slot.deletes.load(std::memory_order_relaxed),
+                  slot.mallocs.load(std::memory_order_relaxed),
+                  slot.mallocBytes.load(std::memory_order_relaxed),
+                  slot.frees.load(std::memory_order_relaxed)};
+  }
+  return count;
+}
+
+void allocTrackerCaptureStacks(bool enable) {
+#ifdef ALLOC_TRACKER_STACKS
+  if (enable) {
+    // Pays backtrace()'s first-use allocations up front
+    void *frames[1];
+    inBacktrace = true;
+    backtrace(frames, 1);
+    inBacktrace = false;
+  }
+  capturingStacks.store(enable, std::memory_order_relaxed);
+#else
+  (void)enable;
+#endif
+}
+
+std::size_t allocTrackerPrintStacks() {
+  std::size_t recorded = stackCount.exchange(0, std::memory_order_relaxed);
+  std::size_t printed = std::min(recorded, maxStacks);
+#ifdef ALLOC_TRACKER_STACKS
+  for (std::size_t i = 0; i < printed; i++) {
+    const StackRecord &record = stackRecords[i];
+    std::fprintf(stderr, "operator new(%zu) from:\n", record.bytes);
+    std::fflush(stderr);
+    // Skips noteNew and trackedNew themselves
+    int skip = std::min(record.depth, 2);
+    backtrace_symbols_fd(record.frames + skip, record.depth - skip, 2);
+  }
+#endif
+  if (recorded > printed) {
+    std::fprintf(stderr, "%zu more stacks not recorded\n",
+                 recorded - printed);
+  }
+  return printed;
+}
+
+AllocationMonitorOptions allocationMonitorOptionsFromEnv() {
+  AllocationMonitorOptions options;
+  if (const char *strict = std::getenv("GLSANDBOX_ALLOC_STRICT")) {
+    options.strictAfterFrames = std::strtoull(strict, nullptr, 10);
+  }
+  if (const char *frames = std::getenv("GLSANDBOX_BENCHMARK")) {
+    options.benchmarkFrames = std::strtoull(frames, nullptr, 10);
+  }
+  return options;
+}
+
+AllocationMonitor::AllocationMonitor(const AllocationMonitorOptions &options)
+    : options(options) {
+  if ((options.strictAfterFrames > 0 || options.benchmarkFrames > 0) &&
+      !allocTrackerCompiled()) {
+    std::fprintf(stderr, "Allocations are not counted in this build, "
+                         "configure with -Dalloc_tracking=true\n");
+  }
+  threadCount = allocTrackerSnapshot(baseline);
+  frameStart = Clock::now();
+}
+
+void AllocationMonitor::report(const char *label, double cpuMs,
+                               double gpuMs) const {
+  std::fprintf(stderr,
+               "%s %llu: cpu %.3f ms, gpu %.3f ms, new %llu (%llu B), "
+               "delete %llu, malloc %llu (%llu B), free %llu\n",
+               label, (unsigned long long)frame, cpuMs, gpuMs,
+               (unsigned long long)frameTotal.news,
+               (unsigned long long)frameTotal.newBytes,
+               (unsigned long long)frameTotal.deletes,
+               (unsigned long long)frameTotal.mallocs,
+               (unsigned long long)frameTotal.mallocBytes,
+               (unsigned long long)frameTotal.frees);
+}
+
+void AllocationMonitor::summarize() const {
+  double frames = double(std::max<std::uint64_t>(frame, 1));
+  std::fprintf(stderr,
+               "Benchmark: %llu frames, cpu %.3f ms avg %.3f ms max, "
+               "gpu %.3f ms avg, %.2f new and %.2f malloc per frame, "
+               "%llu frames called new\n",
+               (unsigned long long)frame, cpuMsSum / frames, cpuMsMax,
+               gpuMsSum / frames, double(benchmarkTotal.news) / frames,
+               double(benchmarkTotal.mallocs) / frames,
+               (unsigned long long)allocatingFrames);
+}
+
+bool AllocationMonitor::endFrame(double gpuMs) {
+  Clock::time_point now = Clock::now();
+  double cpuMs =
+      std::chrono::duration<double, std::milli>(now - frameStart).count();
+  std::size_t count = allocTrackerSnapshot(current);
+  frameTotal = {};
+  for (std::size_t i = 0; i < count; i++) {
+    // Threads that first allocated this frame start from zero
+    frameThreads[i] = current[i] - (i < threadCount ? baseline[i]
+                                                     : AllocCounts{});
+    frameTotal += frameThreads[i];
+  }
+  frame++;
+
+  bool keepRunning = true;
+  if (options.strictAfterFrames > 0 && frame > options.strictAfterFrames &&
+      frameTotal.news > 0) {
+    failed = true;
+    keepRunning = false;
+    report("Steady state frame allocated, frame", cpuMs, gpuMs);
+    for (std::size_t i = 0; i < count; i++) {
+      if (frameThreads[i].news > 0) {
+        std::fprintf(stderr, "  thread %zu: new %llu (%llu B)\n", i + 1,
+                     (unsigned long long)frameThreads[i].news,
+                     (unsigned long long)frameThreads[i].newBytes);
+      }
+    }
+    allocTrackerPrintStacks();
+  }
+  if (options.strictAfterFrames > 0 && frame == options.strictAfterFrames) {
+    // Warmed up: from here on every allocation is an error worth a stack
+    allocTrackerCaptureStacks(true);
+  }
+  if (options.benchmarkFrames > 0) {
+    cpuMsSum += cpuMs;
+    cpuMsMax = std::max(cpuMsMax, cpuMs);
+    gpuMsSum += gpuMs;
+    benchmarkTotal += frameTotal;
+    allocatingFrames += frameTotal.news > 0 ? 1 : 0;
+    report("Frame", cpuMs, gpuMs);
+    if (frame >= options.benchmarkFrames) {
+      summarize();
+      keepRunning = false;
+    }
+  }
+
+  // Reporting may allocate too; the next frame starts after it
+  threadCount = allocTrackerSnapshot(baseline);
+  frameStart = Clock::now();
+  return keepRunning;
+}
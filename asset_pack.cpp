@@ -0,0 +1,464 @@
+#include "asset_pack.h"
+#include "cpu_profiler.h"
+#include "mesh_import.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ASSET_PACK_MMAP
+#endif
+
+std::string_view AssetPackEntry::nameView() const {
+  return std::string_view(name, strnlen(name, assetPackMaxName));
+}
+
+// Bytes of one level, 0 for formats the pack does not know
+static std::size_t textureLevelSize(GLenum internalFormat, std::size_t width,
+                                    std::size_t height) {
+  std::size_t blocks = ((width + 3) / 4) * ((height + 3) / 4);
+  switch (internalFormat) {
+  case GL_RGBA8:
+    return width * height * 4;
+  case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+  case GL_COMPRESSED_RED_RGTC1:
+    return blocks * 8;
+  case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+  case GL_COMPRESSED_RG_RGTC2:
+    return blocks * 16;
+  default:
+    return 0;
+  }
+}
+
+// Whether a mesh entry has a known index type and both arrays lie within
+// its blob
+static bool meshFits(const AssetPackEntry &entry) {
+  const AssetPackMesh &mesh = entry.mesh;
+  if (mesh.indexType != GL_UNSIGNED_SHORT &&
+      mesh.indexType != GL_UNSIGNED_INT) {
+    return false;
+  }
+  std::size_t indexSize = mesh.indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+  std::size_t vertexBytes = std::size_t(mesh.vertexCount) * sizeof(Vertex);
+  std::size_t indexBytes = std::size_t(mesh.indexCount) * indexSize;
+  return vertexBytes <= mesh.indexOffset && mesh.indexOffset <= entry.size &&
+         indexBytes <= entry.size - mesh.indexOffset;
+}
+
+AssetPack::~AssetPack() { close(); }
+
+bool AssetPack::open(std::string_view path) {
+  CPU_ZONE("AssetPack::open");
+  close();
+  std::string pathString(path);
+#ifdef ASSET_PACK_MMAP
+  int fd = ::open(pathString.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "Failed to open asset pack " << path << std::endl;
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0) {
+    std::cerr << "Failed to stat asset pack " << path << std::endl;
+    ::close(fd);
+    return false;
+  }
+  void *mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping keeps its own reference to the file
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    std::cerr << "Failed to map asset pack " << path << std::endl;
+    return false;
+  }
+  // Start reading ahead now, blobs get touched in whatever order the
+  // caller uploads them
+  madvise(mapping, info.st_size, MADV_WILLNEED);
+  base = static_cast<const std::uint8_t *>(mapping);
+  size = info.st_size;
+#else
+  if (!readFile(path, fallback)) {
+    std::cerr << "Failed to read asset pack " << path << std::endl;
+    return false;
+  }
+  base = fallback.data();
+  size = fallback.size();
+#endif
+
+  AssetPackHeader header;
+  bool valid = size >= sizeof(header);
+  if (valid) {
+    std::memcpy(&header, base, sizeof(header));
+    valid = std::memcmp(header.magic, assetPackMagic, sizeof(header.magic)) ==
+                0 &&
+            header.fileSize == size && header.tocOffset % 8 == 0 &&
+            header.tocOffset <= size &&
+            header.entryCount <=
+                (size - header.tocOffset) / sizeof(AssetPackEntry);
+  }
+  if (!valid) {
+    std::cerr << "Not an asset pack or truncated: " << path << std::endl;
+    close();
+    return false;
+  }
+  if (header.version != assetPackVersion) {
+    std::cerr << "Asset pack " << path << " has version " << header.version
+              << ", expected " << assetPackVersion << std::endl;
+    close();
+    return false;
+  }
+  toc = std::span(
+      reinterpret_cast<const AssetPackEntry *>(base + header.tocOffset),
+      header.entryCount);
+  for (const auto &entry : toc) {
+    if (entry.offset > size || entry.size > size - entry.offset) {
+      std::cerr << "Asset pack " << path << ": entry " << entry.nameView()
+                << " is out of bounds" << std::endl;
+      close();
+      return false;
+    }
+    if (entry.kind == AssetKind::Mesh && !meshFits(entry)) {
+      std::cerr << "Asset pack " << path << ": mesh " << entry.nameView()
+                << " is malformed" << std::endl;
+      close();
+      return false;
+    }
+  }
+  return true;
+}
+
+void AssetPack::close() {
+#ifdef ASSET_PACK_MMAP
+  if (base != nullptr) {
+    munmap(const_cast<std::uint8_t *>(base), size);
+  }
+#endif
+  base = nullptr;
+  size = 0;
+  toc = {};
+  fallback = {};
+}
+
+const AssetPackEntry *AssetPack::find(std::string_view name) const {
+  auto it = std::lower_bound(toc.begin(), toc.end(), name,
+                             [](const AssetPackEntry &entry,
+                                std::string_view name) {
+                               return entry.nameView() < name;
+                             });
+  if (it == toc.end() || it->nameView() != name) {
+    return nullptr;
+  }
+  return &*it;
+}
+
+std::span<const std::uint8_t>
+AssetPack::data(const AssetPackEntry &entry) const {
+  return std::span(base + entry.offset, entry.size);
+}
+
+std::string_view AssetPack::shaderSource(const AssetPackEntry &entry) const {
+  if (entry.kind != AssetKind::Shader || entry.size == 0) {
+    return {};
+  }
+  // The terminator stays in the mapping, so data() can go to GL as is
+  return std::string_view(reinterpret_cast<const char *>(base + entry.offset),
+                          entry.size - 1);
+}
+
+std::vector<MeshLod> AssetPack::meshLods(const AssetPackEntry &entry) const {
+  if (entry.kind != AssetKind::Mesh) {
+    return {};
+  }
+  const AssetPackMesh &mesh = entry.mesh;
+  std::vector<MeshLod> lods(mesh.lodCount);
+  std::size_t bytes = lods.size() * sizeof(MeshLod);
+  if (mesh.lodOffset > entry.size || bytes > entry.size - mesh.lodOffset) {
+    lods.clear();
+  } else {
+    std::memcpy(lods.data(), base + entry.offset + mesh.lodOffset, bytes);
+  }
+  for (const auto &lod : lods) {
+    if (lod.indexOffset > mesh.indexCount ||
+        lod.indexCount > mesh.indexCount - lod.indexOffset) {
+      lods.clear();
+      break;
+    }
+  }
+  if (lods.empty()) {
+    lods.push_back({0, mesh.indexCount, 0.0f});
+  }
+  return lods;
+}
+
+// The start of a mesh blob, after checking its arrays lie within it
+static const std::uint8_t *meshBlob(const std::uint8_t *base,
+                                    const AssetPackEntry &entry) {
+  if (entry.kind != AssetKind::Mesh) {
+    std::cerr << "Asset " << entry.nameView() << " is not a mesh"
+              << std::endl;
+    return nullptr;
+  }
+  if (!meshFits(entry)) {
+    std::cerr << "Mesh " << entry.nameView() << " is malformed" << std::endl;
+    return nullptr;
+  }
+  return base + entry.offset;
+}
+
+bool AssetPack::uploadMesh(const AssetPackEntry &entry, GLuint vbo,
+                           GLuint ibo, GLenum usage) const {
+  const std::uint8_t *blob = meshBlob(base, entry);
+  if (blob == nullptr) {
+    return false;
+  }
+  const AssetPackMesh &mesh = entry.mesh;
+  std::size_t indexSize = mesh.indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+  GLCall(glBindBuffer(GL_ARRAY_BUFFER, vbo));
+  GLCall(glBufferData(GL_ARRAY_BUFFER,
+                      std::size_t(mesh.vertexCount) * sizeof(Vertex), blob,
+                      usage));
+  GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo));
+  GLCall(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                      std::size_t(mesh.indexCount) * indexSize,
+                      blob + mesh.indexOffset, usage));
+  return true;
+}
+
+ArenaMesh AssetPack::uploadMesh(const AssetPackEntry &entry,
+                                GeometryArena &arena) const {
+  const std::uint8_t *blob = meshBlob(base, entry);
+  if (blob == nullptr) {
+    return {};
+  }
+  // Blobs start on assetPackAlignment and the writer puts the indices on
+  // a 4 byte boundary, so both arrays can be read in place
+  const AssetPackMesh &mesh = entry.mesh;
+  std::span<const Vertex> vertices(
+      reinterpret_cast<const Vertex *>(blob), mesh.vertexCount);
+  const std::uint8_t *indices = blob + mesh.indexOffset;
+  if (mesh.indexType == GL_UNSIGNED_SHORT) {
+    return arena.add(
+        vertices,
+        std::span(reinterpret_cast<const std::uint16_t *>(indices),
+                  mesh.indexCount),
+        mesh.primitiveMode);
+  }
+  return arena.add(vertices,
+                   std::span(reinterpret_cast<const std::uint32_t *>(indices),
+                             mesh.indexCount));
+}
+
+bool AssetPack::uploadTexture(const AssetPackEntry &entry,
+                              GLenum target) const {
+  if (entry.kind != AssetKind::Texture) {
+    std::cerr << "Asset " << entry.nameView() << " is not a texture"
+              << std::endl;
+    return false;
+  }
+  const AssetPackTexture &texture = entry.texture;
+  if (texture.levelCount == 0) {
+    std::cerr << "Texture " << entry.nameView() << " has no levels"
+              << std::endl;
+    return false;
+  }
+  bool compressed = texture.internalFormat != GL_RGBA8;
+  std::size_t offset = 0;
+  GLCall(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+  for (std::uint32_t level = 0; level < texture.levelCount; level++) {
+    std::size_t width = std::max<std::size_t>(1, texture.width >> level);
+    std::size_t height = std::max<std::size_t>(1, texture.height >> level);
+    std::size_t levelSize =
+        textureLevelSize(texture.internalFormat, width, height);
+    if (levelSize == 0 || levelSize > entry.size - offset) {
+      std::cerr << "Texture " << entry.nameView() << " is malformed"
+                << std::endl;
+      return false;
+    }
+    const std::uint8_t *pixels = base + entry.offset + offset;
+    if (compressed) {
+      GLCall(glCompressedTexImage2D(target, level, texture.internalFormat,
+                                    width, height, 0, levelSize, pixels));
+    } else {
+      GLCall(glTexImage2D(target, level, GL_RGBA8, width, height, 0, GL_RGBA,
+                          GL_UNSIGNED_BYTE, pixels));
+    }
+    offset += levelSize;
+  }
+  GLCall(glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0));
+  GLCall(glTexParameteri(target, GL_TEXTURE_MAX_LEVEL,
+                         texture.levelCount - 1));
+  return true;
+}
+
+AssetPackWriter::Pending &AssetPackWriter::add(std::string_view name,
+                                               AssetKind kind) {
+  Pending &item = pending.emplace_back();
+  std::memset(&item.entry, 0, sizeof(item.entry));
+  // One byte short keeps names printable with %s
+  if (name.size() >= assetPackMaxName) {
+    std::cerr << "Asset name too long: " << name << std::endl;
+    nameTooLong = true;
+  }
+  std::memcpy(item.entry.name, name.data(),
+              std::min(name.size(), assetPackMaxName - 1));
+  item.entry.kind = kind;
+  return item;
+}
+
+void AssetPackWriter::addMesh(std::string_view name,
+                              std::span<const Vertex> vertices,
+                              std::span<const std::uint32_t> indices,
+                              GLenum primitiveMode,
+                              std::span<const MeshLod> lods) {
+  Pending &item = add(name, AssetKind::Mesh);
+  // The restart index narrows to 0xFFFF, which must not be a vertex
+  bool strip = primitiveMode == GL_TRIANGLE_STRIP;
+  bool shortIndices = meshIndexType(vertices.size() + strip) ==
+                      GL_UNSIGNED_SHORT;
+  std::size_t vertexBytes = vertices.size_bytes();
+  std::size_t indexOffset = (vertexBytes + 3) & ~std::size_t(3);
+  std::size_t indexSize = shortIndices ? 2 : 4;
+  std::size_t lodOffset = (indexOffset + indices.size() * indexSize + 3) &
+                          ~std::size_t(3);
+  item.data.resize(lodOffset + lods.size_bytes());
+  std::memcpy(item.data.data(), vertices.data(), vertexBytes);
+  if (!lods.empty()) {
+    std::memcpy(&item.data[lodOffset], lods.data(), lods.size_bytes());
+  }
+  if (shortIndices) {
+    for (std::size_t i = 0; i < indices.size(); i++) {
+      std::uint16_t index = indices[i];
+      std::memcpy(&item.data[indexOffset + i * 2], &index, 2);
+    }
+  } else {
+    std::memcpy(&item.data[indexOffset], indices.data(), indices.size_bytes());
+  }
+  item.entry.mesh.vertexCount = vertices.size();
+  item.entry.mesh.indexCount = indices.size();
+  item.entry.mesh.indexType = shortIndices ? GL_UNSIGNED_SHORT
+                                           : GL_UNSIGNED_INT;
+  item.entry.mesh.indexOffset = indexOffset;
+  item.entry.mesh.primitiveMode = primitiveMode;
+  item.entry.mesh.lodCount = lods.size();
+  item.entry.mesh.lodOffset = lodOffset;
+}
+
+void AssetPackWriter::addTexture(std::string_view name,
+                                 std::span<const Image> levels) {
+  Pending &item = add(name, AssetKind::Texture);
+  for (const auto &image : levels) {
+    std::size_t rowBytes = std::size_t(image.width) * 4;
+    for (int y = image.height - 1; y >= 0; y--) {
+      const std::uint8_t *row = &image.pixels[y * rowBytes];
+      item.data.insert(item.data.end(), row, row + rowBytes);
+    }
+  }
+  item.entry.texture.width = levels.empty() ? 0 : levels[0].width;
+  item.entry.texture.height = levels.empty() ? 0 : levels[0].height;
+  item.entry.texture.levelCount = levels.size();
+  item.entry.texture.internalFormat = GL_RGBA8;
+}
+
+void AssetPackWriter::addCompressedTexture(
+    std::string_view name, std::span<const CompressedImage> levels) {
+  Pending &item = add(name, AssetKind::Texture);
+  for (const auto &level : levels) {
+    item.data.insert(item.data.end(), level.data.begin(), level.data.end());
+  }
+  item.entry.texture.width = levels.empty() ? 0 : levels[0].width;
+  item.entry.texture.height = levels.empty() ? 0 : levels[0].height;
+  item.entry.texture.levelCount = levels.size();
+  item.entry.texture.internalFormat =
+      levels.empty() ? 0 : blockFormatInternalFormat(levels[0].format);
+}
+
+void AssetPackWriter::addShader(std::string_view name, GLenum stage,
+                                std::string_view source) {
+  Pending &item = add(name, AssetKind::Shader);
+  item.data.assign(source.begin(), source.end());
+  item.data.push_back('\0');
+  item.entry.shader.stage = stage;
+}
+
+void AssetPackWriter::addBlob(std::string_view name,
+                              std::span<const std::uint8_t> bytes) {
+  Pending &item = add(name, AssetKind::Blob);
+  item.data.assign(bytes.begin(), bytes.end());
+}
+
+static std::size_t alignOffset(std::size_t offset) {
+  return (offset + assetPackAlignment - 1) & ~(assetPackAlignment - 1);
+}
+
+bool AssetPackWriter::write(std::string_view path) const {
+  if (nameTooLong) {
+    return false;
+  }
+  std::vector<AssetPackEntry> toc;
+  for (const auto &item : pending) {
+    toc.push_back(item.entry);
+  }
+  std::vector<std::size_t> order(pending.size());
+  for (std::size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  // Sorted so the runtime can binary search the table in place
+  std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+    return toc[a].nameView() < toc[b].nameView();
+  });
+  for (std::size_t i = 1; i < order.size(); i++) {
+    if (toc[order[i - 1]].nameView() == toc[order[i]].nameView()) {
+      std::cerr << "Duplicate asset name " << toc[order[i]].nameView()
+                << std::endl;
+      return false;
+    }
+  }
+
+  AssetPackHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, assetPackMagic, sizeof(header.magic));
+  header.version = assetPackVersion;
+  header.entryCount = pending.size();
+  header.tocOffset = sizeof(header);
+  std::size_t offset =
+      alignOffset(header.tocOffset + toc.size() * sizeof(AssetPackEntry));
+  std::vector<AssetPackEntry> sorted;
+  for (std::size_t index : order) {
+    AssetPackEntry entry = toc[index];
+    entry.offset = offset;
+    entry.size = pending[index].data.size();
+    offset = alignOffset(offset + entry.size);
+    sorted.push_back(entry);
+  }
+  header.fileSize = offset;
+
+  std::FILE *file = std::fopen(std::string(path).c_str(), "wb");
+  if (file == nullptr) {
+    std::cerr << "Failed to create " << path << std::endl;
+    return false;
+  }
+  bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+            std::fwrite(sorted.data(), sizeof(AssetPackEntry), sorted.size(),
+                        file) == sorted.size();
+  const char zeros[assetPackAlignment] = {};
+  std::size_t written = header.tocOffset + sorted.size() * sizeof(sorted[0]);
+  for (std::size_t i = 0; ok && i < sorted.size(); i++) {
+    const auto &data = pending[order[i]].data;
+    ok = std::fwrite(zeros, 1, sorted[i].offset - written, file) ==
+             sorted[i].offset - written &&
+         std::fwrite(data.data(), 1, data.size(), file) == data.size();
+    written = sorted[i].offset + data.size();
+  }
+  ok = ok && std::fwrite(zeros, 1, offset - written, file) == offset - written;
+  ok = std::fclose(file) == 0 && ok;
+  if (!ok) {
+    std::cerr << "Failed to write " << path << std::endl;
+  }
+  return ok;
+}
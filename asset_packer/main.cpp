@@ -0,0 +1,206 @@
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "asset_pack.h"
+#include "image.h"
+#include "mesh_import.h"
+#include "mesh_lod.h"
+#include "mesh_optimizer.h"
+#include "mipmap.h"
+#include "texture_compression.h"
+#include "thread_pool.h"
+
+static std::string_view extension(std::string_view path) {
+  std::size_t dot = path.rfind('.');
+  return dot == std::string_view::npos ? std::string_view()
+                                       : path.substr(dot + 1);
+}
+
+static std::string_view baseName(std::string_view path) {
+  std::size_t slash = path.find_last_of("/\\");
+  return slash == std::string_view::npos ? path : path.substr(slash + 1);
+}
+
+struct Options {
+  bool optimize = false;
+  bool strips = false;
+  bool lods = false;
+  bool mips = false;
+  bool compress = false;
+  BlockFormat format = BlockFormat::BC1;
+};
+
+static bool addTexture(AssetPackWriter &writer, std::string_view name,
+                       std::string_view path, const Options &options,
+                       ThreadPool &pool) {
+  Image image;
+  if (!loadImage(path, image)) {
+    return false;
+  }
+  std::vector<Image> levels;
+  if (options.mips) {
+    generateMipChain(image, MipOptions{}, levels, &pool);
+  } else {
+    levels.push_back(std::move(image));
+  }
+  if (!options.compress) {
+    writer.addTexture(name, levels);
+    return true;
+  }
+  std::vector<CompressedImage> compressed(levels.size());
+  for (std::size_t level = 0; level < levels.size(); level++) {
+    compressImage(levels[level], options.format, CompressionQuality::High,
+                  compressed[level], &pool);
+  }
+  writer.addCompressedTexture(name, compressed);
+  return true;
+}
+
+static bool addInput(AssetPackWriter &writer, std::string_view argument,
+                     const Options &options, ThreadPool &pool) {
+  // name=path, or just path to name the asset after the file
+  std::size_t equals = argument.find('=');
+  std::string_view path =
+      equals == std::string_view::npos ? argument : argument.substr(equals + 1);
+  std::string_view name =
+      equals == std::string_view::npos ? baseName(path)
+                                       : argument.substr(0, equals);
+  std::string_view type = extension(path);
+
+  if (type == "qoi" || type == "tga" || type == "ppm" || type == "pgm") {
+    return addTexture(writer, name, path, options, pool);
+  }
+  if (type == "obj" || type == "glb") {
+    Mesh mesh;
+    auto start = std::chrono::steady_clock::now();
+    if (!importMesh(path, mesh, &pool)) {
+      return false;
+    }
+    double ms = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+    std::printf("%.*s: %zu triangles, %zu vertices, imported in %.1f ms\n",
+                int(path.size()), path.data(), mesh.indices.size() / 3,
+                mesh.vertices.size(), ms);
+    if (!options.optimize && !options.strips && !options.lods) {
+      writer.addMesh(name, mesh.vertices, mesh.indices);
+      return true;
+    }
+    VertexCacheStats before =
+        analyzeVertexCache(mesh.indices, mesh.vertices.size());
+    optimizeMesh(mesh);
+    VertexCacheStats after =
+        analyzeVertexCache(mesh.indices, mesh.vertices.size());
+    std::printf("  ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", before.acmr,
+                after.acmr, before.atvr, after.atvr);
+    std::vector<MeshLod> lods;
+    if (options.lods) {
+      generateLodChain(mesh, lods);
+      for (std::size_t level = 0; level < lods.size(); level++) {
+        std::printf("  LOD %zu: %u triangles, error %g\n", level,
+                    lods[level].indexCount / 3, lods[level].error);
+      }
+    }
+    if (!options.strips) {
+      writer.addMesh(name, mesh.vertices, mesh.indices, GL_TRIANGLES, lods);
+      return true;
+    }
+    // Each level becomes its own run of strips
+    std::vector<std::uint32_t> strip;
+    std::vector<std::uint32_t> levelStrip;
+    for (auto &lod : lods) {
+      buildTriangleStrips(std::span(mesh.indices)
+                              .subspan(lod.indexOffset, lod.indexCount),
+                          levelStrip);
+      lod.indexOffset = strip.size();
+      lod.indexCount = levelStrip.size();
+      strip.insert(strip.end(), levelStrip.begin(), levelStrip.end());
+    }
+    if (lods.empty()) {
+      buildTriangleStrips(mesh.indices, strip);
+    }
+    std::printf("  %zu strip indices for %zu list indices\n", strip.size(),
+                mesh.indices.size());
+    writer.addMesh(name, mesh.vertices, strip, GL_TRIANGLE_STRIP, lods);
+    return true;
+  }
+  std::vector<std::uint8_t> data;
+  if (!readFile(path, data)) {
+    std::cerr << "Failed to read " << path << std::endl;
+    return false;
+  }
+  if (type == "vert" || type == "frag") {
+    writer.addShader(name,
+                     type == "vert" ? GL_VERTEX_SHADER : GL_FRAGMENT_SHADER,
+                     std::string_view((const char *)data.data(), data.size()));
+  } else {
+    writer.addBlob(name, data);
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  int arg = 1;
+  for (; arg < argc && argv[arg][0] == '-'; arg++) {
+    std::string_view option = argv[arg];
+    if (option == "--optimize") {
+      options.optimize = true;
+    } else if (option == "--strips") {
+      options.strips = true;
+    } else if (option == "--lods") {
+      options.lods = true;
+    } else if (option == "--mips") {
+      options.mips = true;
+    } else if (option == "--bc1" || option == "--bc3" || option == "--bc4" ||
+               option == "--bc5") {
+      const BlockFormat formats[] = {BlockFormat::BC1, BlockFormat::BC3,
+                                     BlockFormat::BC4, BlockFormat::BC5};
+      options.compress = true;
+      options.format = formats[option == "--bc1"   ? 0
+                               : option == "--bc3" ? 1
+                               : option == "--bc4" ? 2
+                                                   : 3];
+    } else {
+      std::cerr << "Unknown option " << option << std::endl;
+      return 1;
+    }
+  }
+  if (argc - arg < 2) {
+    std::cerr << "Usage: " << argv[0]
+              << " [--optimize] [--strips] [--lods] [--mips]"
+                 " [--bc1|--bc3|--bc4|--bc5] <out.pack> [name=]<file>...\n"
+                 "  .qoi .tga .ppm .pgm  texture\n"
+                 "  .obj .glb            mesh\n"
+                 "  .vert .frag          shader source\n"
+                 "  anything else        raw blob"
+              << std::endl;
+    return 1;
+  }
+
+  ThreadPool pool;
+  AssetPackWriter writer;
+  const char *outputPath = argv[arg++];
+  for (; arg < argc; arg++) {
+    if (!addInput(writer, argv[arg], options, pool)) {
+      return 1;
+    }
+  }
+  if (!writer.write(outputPath)) {
+    return 1;
+  }
+
+  AssetPack pack;
+  if (!pack.open(outputPath)) {
+    return 1;
+  }
+  for (const auto &entry : pack.entries()) {
+    std::printf("%-32.*s %10llu bytes\n", int(entry.nameView().size()),
+                entry.nameView().data(), (unsigned long long)entry.size);
+  }
+  return 0;
+}
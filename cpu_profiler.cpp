@@ -0,0 +1,71 @@
+#include "cpu_profiler.h"
+
+#include <memory>
+#include <mutex>
+
+struct CpuZoneRegistry {
+  std::mutex mutex;
+  std::vector<std::unique_ptr<CpuZoneBuffer>> buffers;
+  std::vector<TraceThread> threads;
+};
+
+static CpuZoneRegistry &cpuZoneRegistry() {
+  static CpuZoneRegistry registry;
+  return registry;
+}
+
+CpuZoneBuffer *registerCpuZoneThread() {
+  auto &registry = cpuZoneRegistry();
+  std::lock_guard lock(registry.mutex);
+  auto buffer = std::make_unique<CpuZoneBuffer>();
+  buffer->tid = registry.buffers.size() + 1;
+  registry.threads.push_back(
+      {buffer->tid, "Thread " + std::to_string(buffer->tid)});
+  currentCpuZoneBuffer = buffer.get();
+  registry.buffers.push_back(std::move(buffer));
+  return currentCpuZoneBuffer;
+}
+
+void cpuProfilerSetThreadName(std::string name) {
+  CpuZoneBuffer *buffer = currentCpuZoneBuffer;
+  if (buffer == nullptr) {
+    buffer = registerCpuZoneThread();
+  }
+  auto &registry = cpuZoneRegistry();
+  std::lock_guard lock(registry.mutex);
+  for (auto &thread : registry.threads) {
+    if (thread.tid == buffer->tid) {
+      thread.name = std::move(name);
+      break;
+    }
+  }
+}
+
+void cpuProfilerCollect(std::vector<TraceEvent> &out) {
+  auto &registry = cpuZoneRegistry();
+  std::lock_guard lock(registry.mutex);
+  for (auto &buffer : registry.buffers) {
+    std::uint32_t tail = buffer->tail.load(std::memory_order_relaxed);
+    std::uint32_t head = buffer->head.load(std::memory_order_acquire);
+    for (; tail != head; tail++) {
+      out.push_back(buffer->records[tail % CpuZoneBuffer::capacity]);
+    }
+    buffer->tail.store(tail, std::memory_order_release);
+  }
+}
+
+std::vector<TraceThread> cpuProfilerThreads() {
+  auto &registry = cpuZoneRegistry();
+  std::lock_guard lock(registry.mutex);
+  return registry.threads;
+}
+
+std::uint64_t cpuProfilerDroppedZones() {
+  auto &registry = cpuZoneRegistry();
+  std::lock_guard lock(registry.mutex);
+  std::uint64_t dropped = 0;
+  for (auto &buffer : registry.buffers) {
+    dropped += buffer->dropped.load(std::memory_order_relaxed);
+  }
+  return dropped;
+}
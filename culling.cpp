@@ -0,0 +1,236 @@
+#include "culling.h"
+#include "cpu_profiler.h"
+#include "frame_arena.h"
+
+#include <array>
+#include <cmath>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define CULLING_AVX2
+#endif
+
+namespace {
+
+// Objects per parallelFor chunk, a multiple of eight
+constexpr std::size_t cullGrain = 16384;
+
+bool insidePlanes(const Frustum &frustum, const BoundsView &bounds,
+                  std::size_t i) {
+  for (const auto &plane : frustum.planes) {
+    float distance = plane.x * bounds.centerX[i] +
+                     plane.y * bounds.centerY[i] +
+                     plane.z * bounds.centerZ[i] + plane.w;
+    float boxReach = std::fabs(plane.x) * bounds.extentX[i] +
+                     std::fabs(plane.y) * bounds.extentY[i] +
+                     std::fabs(plane.z) * bounds.extentZ[i];
+    if (distance < -std::min(boxReach, bounds.radius[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::size_t cullScalar(const Frustum &frustum, const BoundsView &bounds,
+                       std::size_t begin, std::uint32_t firstIndex,
+                       std::uint32_t *visible) {
+  std::size_t count = 0;
+  for (std::size_t i = begin; i < bounds.count; i++) {
+    visible[count] = firstIndex + i;
+    count += insidePlanes(frustum, bounds, i);
+  }
+  return count;
+}
+
+#ifdef CULLING_AVX2
+
+// For every 8-bit lane mask, the set lanes' positions packed to the front
+// one per byte, expanded to a permutation with vpmovzxbd
+constexpr std::array<std::uint64_t, 256> compactTable = []() {
+  std::array<std::uint64_t, 256> table{};
+  for (unsigned mask = 0; mask < 256; mask++) {
+    unsigned slot = 0;
+    for (unsigned lane = 0; lane < 8; lane++) {
+      if (mask & (1u << lane)) {
+        table[mask] |= std::uint64_t(lane) << (slot++ * 8);
+      }
+    }
+  }
+  return table;
+}();
+
+__attribute__((target("avx2"))) std::size_t
+cullAvx2(const Frustum &frustum, const BoundsView &bounds,
+         std::uint32_t firstIndex, std::uint32_t *visible) {
+  __m256 signMask = _mm256_set1_ps(-0.0f);
+  __m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+  __m256 absX[6], absY[6], absZ[6];
+  for (int p = 0; p < 6; p++) {
+    const glm::vec4 &plane = frustum.planes[p];
+    planeX[p] = _mm256_set1_ps(plane.x);
+    planeY[p] = _mm256_set1_ps(plane.y);
+    planeZ[p] = _mm256_set1_ps(plane.z);
+    planeW[p] = _mm256_set1_ps(plane.w);
+    absX[p] = _mm256_andnot_ps(signMask, planeX[p]);
+    absY[p] = _mm256_andnot_ps(signMask, planeY[p]);
+    absZ[p] = _mm256_andnot_ps(signMask, planeZ[p]);
+  }
+
+  std::size_t count = 0;
+  std::size_t i = 0;
+  __m256i lanes = _mm256_add_epi32(_mm256_set1_epi32(firstIndex),
+                                   _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+  __m256i step = _mm256_set1_epi32(8);
+  for (; i + 8 <= bounds.count; i += 8) {
+    __m256 cx = _mm256_loadu_ps(bounds.centerX + i);
+    __m256 cy = _mm256_loadu_ps(bounds.centerY + i);
+    __m256 cz = _mm256_loadu_ps(bounds.centerZ + i);
+    __m256 ex = _mm256_loadu_ps(bounds.extentX + i);
+    __m256 ey = _mm256_loadu_ps(bounds.extentY + i);
+    __m256 ez = _mm256_loadu_ps(bounds.extentZ + i);
+    __m256 radius = _mm256_loadu_ps(bounds.radius + i);
+    __m256 outside = _mm256_setzero_ps();
+    for (int p = 0; p < 6; p++) {
+      __m256 distance = _mm256_add_ps(
+          _mm256_add_ps(_mm256_mul_ps(planeX[p], cx),
+                        _mm256_mul_ps(planeY[p], cy)),
+          _mm256_add_ps(_mm256_mul_ps(planeZ[p], cz), planeW[p]));
+      __m256 boxReach = _mm256_add_ps(
+          _mm256_add_ps(_mm256_mul_ps(absX[p], ex), _mm256_mul_ps(absY[p], ey)),
+          _mm256_mul_ps(absZ[p], ez));
+      __m256 reach = _mm256_min_ps(boxReach, radius);
+      outside = _mm256_or_ps(
+          outside, _mm256_cmp_ps(_mm256_add_ps(distance, reach),
+                                 _mm256_setzero_ps(), _CMP_LT_OQ));
+    }
+    unsigned mask = ~unsigned(_mm256_movemask_ps(outside)) & 0xFF;
+    __m256i order = _mm256_cvtepu8_epi32(
+        _mm_cvtsi64_si128(static_cast<long long>(compactTable[mask])));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(visible + count),
+                        _mm256_permutevar8x32_epi32(lanes, order));
+    count += __builtin_popcount(mask);
+    lanes = _mm256_add_epi32(lanes, step);
+  }
+  return count + cullScalar(frustum, bounds, i, firstIndex, visible + count);
+}
+
+bool cpuHasAvx2() {
+  static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+  return hasAvx2;
+}
+
+#endif
+
+} // namespace
+
+Frustum extractFrustum(const glm::mat4 &viewProjection) {
+  // glm is column major, row r is m[0][r], m[1][r], m[2][r], m[3][r]
+  auto row = [&](int r) {
+    return glm::vec4(viewProjection[0][r], viewProjection[1][r],
+                     viewProjection[2][r], viewProjection[3][r]);
+  };
+  glm::vec4 x = row(0), y = row(1), z = row(2), w = row(3);
+  Frustum frustum{{w + x, w - x, w + y, w - y, w + z, w - z}};
+  for (auto &plane : frustum.planes) {
+    plane /= glm::length(glm::vec3(plane));
+  }
+  return frustum;
+}
+
+std::uint32_t BoundsArrays::add(glm::vec3 center, glm::vec3 extent) {
+  std::uint32_t index = size();
+  centerX.push_back(center.x);
+  centerY.push_back(center.y);
+  centerZ.push_back(center.z);
+  extentX.push_back(extent.x);
+  extentY.push_back(extent.y);
+  extentZ.push_back(extent.z);
+  radius.push_back(glm::length(extent));
+  return index;
+}
+
+std::uint32_t BoundsArrays::addSphere(glm::vec3 center, float sphereRadius) {
+  std::uint32_t index = add(center, glm::vec3(sphereRadius));
+  radius.back() = sphereRadius;
+  return index;
+}
+
+void BoundsArrays::set(std::uint32_t index, glm::vec3 center,
+                       glm::vec3 extent, float sphereRadius) {
+  centerX[index] = center.x;
+  centerY[index] = center.y;
+  centerZ[index] = center.z;
+  extentX[index] = extent.x;
+  extentY[index] = extent.y;
+  extentZ[index] = extent.z;
+  radius[index] = sphereRadius;
+}
+
+void BoundsArrays::reserve(std::size_t count) {
+  for (auto *array : {&centerX, &centerY, &centerZ, &extentX, &extentY,
+                      &extentZ, &radius}) {
+    array->reserve(count);
+  }
+}
+
+void BoundsArrays::clear() {
+  for (auto *array : {&centerX, &centerY, &centerZ, &extentX, &extentY,
+                      &extentZ, &radius}) {
+    array->clear();
+  }
+}
+
+BoundsView BoundsArrays::view() const {
+  return {centerX.data(), centerY.data(), centerZ.data(), extentX.data(),
+          extentY.data(), extentZ.data(), radius.data(),  size()};
+}
+
+std::size_t cullFrustum(const Frustum &frustum, const BoundsView &bounds,
+                        std::uint32_t firstIndex, std::uint32_t *visible) {
+#ifdef CULLING_AVX2
+  if (cpuHasAvx2()) {
+    return cullAvx2(frustum, bounds, firstIndex, visible);
+  }
+#endif
+  return cullScalar(frustum, bounds, 0, firstIndex, visible);
+}
+
+void cullFrustum(const Frustum &frustum, const BoundsView &bounds,
+                 std::vector<std::uint32_t> &visible, ThreadPool *pool) {
+  CPU_ZONE("cullFrustum");
+  visible.resize(bounds.count);
+  if (pool == nullptr || bounds.count <= cullGrain) {
+    visible.resize(cullFrustum(frustum, bounds, 0, visible.data()));
+    return;
+  }
+  // Every chunk compacts into its own slice of `visible`, then the slices
+  // close ranks
+  std::size_t chunkCount = (bounds.count + cullGrain - 1) / cullGrain;
+  std::pmr::vector<std::size_t> chunkVisible(chunkCount, frameResource());
+  pool->parallelFor(bounds.count, cullGrain,
+                    [&](std::size_t begin, std::size_t end) {
+                      CPU_ZONE("cullFrustum chunk");
+                      BoundsView chunk = bounds;
+                      chunk.centerX += begin;
+                      chunk.centerY += begin;
+                      chunk.centerZ += begin;
+                      chunk.extentX += begin;
+                      chunk.extentY += begin;
+                      chunk.extentZ += begin;
+                      chunk.radius += begin;
+                      chunk.count = end - begin;
+                      chunkVisible[begin / cullGrain] = cullFrustum(
+                          frustum, chunk, begin, visible.data() + begin);
+                    });
+  std::size_t total = 0;
+  for (std::size_t chunk = 0; chunk < chunkCount; chunk++) {
+    std::size_t begin = chunk * cullGrain;
+    if (total != begin) {
+      std::memmove(visible.data() + total, visible.data() + begin,
+                   chunkVisible[chunk] * sizeof(std::uint32_t));
+    }
+    total += chunkVisible[chunk];
+  }
+  visible.resize(total);
+}
@@ -0,0 +1,243 @@
+#include "debug_output.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+static constexpr std::size_t debugQueueCapacity = 1024;
+static constexpr auto repeatReportInterval = std::chrono::seconds(2);
+
+static const char *debugSourceName(GLenum source) {
+  switch (source) {
+  case GL_DEBUG_SOURCE_API:
+    return "API";
+  case GL_DEBUG_SOURCE_WINDOW_SYSTEM:
+    return "WINDOW_SYSTEM";
+  case GL_DEBUG_SOURCE_SHADER_COMPILER:
+    return "SHADER_COMPILER";
+  case GL_DEBUG_SOURCE_THIRD_PARTY:
+    return "THIRD_PARTY";
+  case GL_DEBUG_SOURCE_APPLICATION:
+    return "APPLICATION";
+  default:
+    return "OTHER";
+  }
+}
+
+static const char *debugTypeName(GLenum type) {
+  switch (type) {
+  case GL_DEBUG_TYPE_ERROR:
+    return "GL_ERROR";
+  case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR:
+    return "DEPRECATED";
+  case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:
+    return "UNDEFINED";
+  case GL_DEBUG_TYPE_PORTABILITY:
+    return "PORTABILITY";
+  case GL_DEBUG_TYPE_PERFORMANCE:
+    return "PERFORMANCE";
+  case GL_DEBUG_TYPE_MARKER:
+    return "MARKER";
+  case GL_DEBUG_TYPE_PUSH_GROUP:
+    return "PUSH_GROUP";
+  case GL_DEBUG_TYPE_POP_GROUP:
+    return "POP_GROUP";
+  default:
+    return "OTHER";
+  }
+}
+
+static const char *debugSeverityName(GLenum severity) {
+  switch (severity) {
+  case GL_DEBUG_SEVERITY_HIGH:
+    return "HIGH";
+  case GL_DEBUG_SEVERITY_MEDIUM:
+    return "MEDIUM";
+  case GL_DEBUG_SEVERITY_LOW:
+    return "LOW";
+  default:
+    return "NOTIFICATION";
+  }
+}
+
+// Higher is more severe
+static int debugSeverityRank(GLenum severity) {
+  switch (severity) {
+  case GL_DEBUG_SEVERITY_HIGH:
+    return 3;
+  case GL_DEBUG_SEVERITY_MEDIUM:
+    return 2;
+  case GL_DEBUG_SEVERITY_LOW:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+DebugOutput::DebugOutput(const DebugOutputOptions &options)
+    : queue(debugQueueCapacity) {
+  if (!GLAD_GL_KHR_debug) {
+    std::cerr << "GL_KHR_debug is not available, debug output disabled"
+              << std::endl;
+    running = false;
+    return;
+  }
+  logThread = std::thread(&DebugOutput::logLoop, this);
+
+  glEnable(GL_DEBUG_OUTPUT);
+  if (options.synchronous) {
+    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+  } else {
+    glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+  }
+
+  // Filter in the driver, so dropped severities are never even generated
+  const GLenum severities[] = {GL_DEBUG_SEVERITY_HIGH, GL_DEBUG_SEVERITY_MEDIUM,
+                               GL_DEBUG_SEVERITY_LOW,
+                               GL_DEBUG_SEVERITY_NOTIFICATION};
+  for (GLenum severity : severities) {
+    GLboolean enabled = debugSeverityRank(severity) >=
+                                debugSeverityRank(options.minSeverity)
+                            ? GL_TRUE
+                            : GL_FALSE;
+    glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, severity, 0, nullptr,
+                          enabled);
+  }
+  // Our own profiler groups would otherwise echo back as notifications
+  glDebugMessageControl(GL_DEBUG_SOURCE_APPLICATION, GL_DEBUG_TYPE_PUSH_GROUP,
+                        GL_DONT_CARE, 0, nullptr, GL_FALSE);
+  glDebugMessageControl(GL_DEBUG_SOURCE_APPLICATION, GL_DEBUG_TYPE_POP_GROUP,
+                        GL_DONT_CARE, 0, nullptr, GL_FALSE);
+
+  glDebugMessageCallback(&DebugOutput::callback, this);
+  installed = true;
+}
+
+DebugOutput::~DebugOutput() {
+  if (installed) {
+    glDebugMessageCallback(nullptr, nullptr);
+    // Asynchronous callbacks may still be in flight until the driver is idle
+    glFinish();
+  }
+  running = false;
+  if (logThread.joinable()) {
+    logThread.join();
+  }
+}
+
+void GLAPIENTRY DebugOutput::callback(GLenum source, GLenum type, GLuint id,
+                                      GLenum severity, GLsizei length,
+                                      const GLchar *message,
+                                      const void *userParam) {
+  auto *self = static_cast<DebugOutput *>(const_cast<void *>(userParam));
+  DebugMessage entry;
+  entry.source = source;
+  entry.type = type;
+  entry.id = id;
+  entry.severity = severity;
+  std::size_t len =
+      length >= 0 ? static_cast<std::size_t>(length) : std::strlen(message);
+  len = std::min(len, sizeof(entry.text) - 1);
+  std::memcpy(entry.text, message, len);
+  entry.text[len] = '\0';
+  if (!self->queue.push(entry)) {
+    self->dropped.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void DebugOutput::logLoop() {
+  struct Seen {
+    std::uint64_t count;
+    std::uint64_t reported;
+    std::string text;
+  };
+  std::unordered_map<std::uint64_t, Seen> seen;
+  std::string out;
+  auto lastRepeatReport = std::chrono::steady_clock::now();
+  std::uint64_t reportedDropped = 0;
+
+  auto reportRepeats = [&]() {
+    for (auto &[key, entry] : seen) {
+      if (entry.count > entry.reported) {
+        out += "GL_DEBUG: (repeated ";
+        out += std::to_string(entry.count - entry.reported);
+        out += "x) ";
+        out += entry.text;
+        out += '\n';
+        entry.reported = entry.count;
+      }
+    }
+  };
+
+  for (;;) {
+    bool stopping = !running.load(std::memory_order_acquire);
+    DebugMessage message;
+    while (queue.pop(message)) {
+      // id is only unique within a (source, type) pair
+      std::uint64_t key = (std::uint64_t(message.source & 0xFFFF) << 48) |
+                          (std::uint64_t(message.type & 0xFFFF) << 32) |
+                          message.id;
+      auto [it, inserted] = seen.try_emplace(key);
+      it->second.count++;
+      if (!inserted) {
+        continue;
+      }
+      it->second.reported = 1;
+      it->second.text = std::string("[") + debugSourceName(message.source) +
+                        ' ' + debugTypeName(message.type) + ' ' +
+                        debugSeverityName(message.severity) + ' ' +
+                        std::to_string(message.id) + "] " + message.text;
+      out += "GL_DEBUG: ";
+      out += it->second.text;
+      out += '\n';
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (stopping || now - lastRepeatReport >= repeatReportInterval) {
+      reportRepeats();
+      lastRepeatReport = now;
+      std::uint64_t droppedNow = dropped.load(std::memory_order_relaxed);
+      if (droppedNow != reportedDropped) {
+        out += "GL_DEBUG: " + std::to_string(droppedNow - reportedDropped) +
+               " messages dropped, queue full\n";
+        reportedDropped = droppedNow;
+      }
+    }
+    if (!out.empty()) {
+      std::cerr << out << std::flush;
+      out.clear();
+    }
+    if (stopping) {
+      return;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+}
+
+DebugOutputOptions debugOutputOptionsFromEnv() {
+  DebugOutputOptions options;
+  if (const char *sync = std::getenv("GLSANDBOX_GL_DEBUG_SYNC")) {
+    options.synchronous = std::string_view(sync) != "0";
+  }
+  if (const char *severity = std::getenv("GLSANDBOX_GL_DEBUG_SEVERITY")) {
+    std::string_view value(severity);
+    if (value == "high") {
+      options.minSeverity = GL_DEBUG_SEVERITY_HIGH;
+    } else if (value == "medium") {
+      options.minSeverity = GL_DEBUG_SEVERITY_MEDIUM;
+    } else if (value == "low") {
+      options.minSeverity = GL_DEBUG_SEVERITY_LOW;
+    } else if (value == "notification") {
+      options.minSeverity = GL_DEBUG_SEVERITY_NOTIFICATION;
+    } else {
+      std::cerr << "Unknown GLSANDBOX_GL_DEBUG_SEVERITY: " << value
+                << std::endl;
+    }
+  }
+  return options;
+}
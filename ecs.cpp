@@ -0,0 +1,233 @@
+#include "ecs.h"
+#include "cpu_profiler.h"
+#include "frame_arena.h"
+
+#include <bit>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+
+namespace {
+
+// Chunks per parallelFor job
+constexpr std::size_t chunkGrain = 4;
+
+constexpr std::uint32_t cacheLine = 64;
+
+// Fixed size, so lookups need no lock while other types register
+struct ComponentRegistry {
+  std::mutex mutex;
+  std::array<ComponentInfo, maxComponents> infos;
+  std::uint32_t count = 0;
+};
+
+ComponentRegistry &registry() {
+  static ComponentRegistry instance;
+  return instance;
+}
+
+std::uint32_t alignUp(std::uint32_t value) {
+  return (value + cacheLine - 1) & ~(cacheLine - 1);
+}
+
+// Copies every component of row `from` over row `to`
+void copyRow(const Archetype &archetype, EntityChunk &toChunk,
+             std::uint32_t to, const EntityChunk &fromChunk,
+             std::uint32_t from) {
+  std::memcpy(toChunk.data + to * sizeof(Entity),
+              fromChunk.data + from * sizeof(Entity), sizeof(Entity));
+  for (ComponentId id : archetype.components) {
+    const ComponentInfo &info = componentInfo(id);
+    std::uint32_t offset = archetype.offsets[id];
+    if (info.fields == 0) {
+      std::memcpy(toChunk.data + offset + to * info.size,
+                  fromChunk.data + offset + from * info.size, info.size);
+      continue;
+    }
+    for (std::uint32_t f = 0; f < info.fields; f++) {
+      std::uint32_t fieldOffset = offset + f * archetype.capacity * 4;
+      std::memcpy(toChunk.data + fieldOffset + to * 4,
+                  fromChunk.data + fieldOffset + from * 4, 4);
+    }
+  }
+}
+
+} // namespace
+
+ComponentId registerComponent(const ComponentInfo &info) {
+  ComponentRegistry &instance = registry();
+  std::lock_guard lock(instance.mutex);
+  if (instance.count == maxComponents) {
+    std::cerr << "More than " << maxComponents << " component types"
+              << std::endl;
+    std::abort();
+  }
+  instance.infos[instance.count] = info;
+  return instance.count++;
+}
+
+const ComponentInfo &componentInfo(ComponentId id) {
+  return registry().infos[id];
+}
+
+std::uint32_t World::archetypeFor(ComponentMask mask) {
+  auto found = archetypeIndex.find(mask);
+  if (found != archetypeIndex.end()) {
+    return found->second;
+  }
+  auto archetype = std::make_unique<Archetype>();
+  archetype->mask = mask;
+  std::uint32_t rowBytes = sizeof(Entity);
+  for (ComponentMask bits = mask; bits != 0; bits &= bits - 1) {
+    ComponentId id = std::countr_zero(bits);
+    archetype->components.push_back(id);
+    rowBytes += componentInfo(id).size;
+  }
+  // Every array may lose up to a cache line to alignment
+  std::uint32_t padding = cacheLine * (archetype->components.size() + 1);
+  std::uint32_t capacity = (entityChunkBytes - padding) / rowBytes & ~7u;
+  if (capacity == 0) {
+    std::cerr << "Components of " << rowBytes
+              << " bytes do not fit in a chunk" << std::endl;
+    std::abort();
+  }
+  archetype->capacity = capacity;
+  std::uint32_t offset = alignUp(sizeof(Entity) * capacity);
+  for (ComponentId id : archetype->components) {
+    archetype->offsets[id] = offset;
+    offset = alignUp(offset + componentInfo(id).size * capacity);
+  }
+
+  std::uint32_t index = archetypes.size();
+  archetypes.push_back(std::move(archetype));
+  archetypeIndex.emplace(mask, index);
+  return index;
+}
+
+World::Location World::allocate(ComponentMask mask) {
+  std::uint32_t archetypeIndex = archetypeFor(mask);
+  Archetype &archetype = *archetypes[archetypeIndex];
+  if (archetype.chunks.empty() ||
+      archetype.chunks.back()->count == archetype.capacity) {
+    archetype.chunks.push_back(std::make_unique<EntityChunk>());
+  }
+  EntityChunk &chunk = *archetype.chunks.back();
+
+  std::uint32_t index;
+  if (!freeIndices.empty()) {
+    index = freeIndices.back();
+    freeIndices.pop_back();
+  } else {
+    index = records.size();
+    records.emplace_back();
+  }
+  Record &record = records[index];
+  record.archetype = archetypeIndex;
+  record.chunk = archetype.chunks.size() - 1;
+  record.row = chunk.count++;
+  Entity entity = {index, record.generation};
+  std::memcpy(chunk.data + record.row * sizeof(Entity), &entity,
+              sizeof(Entity));
+  entityCount++;
+  return {&archetype, record.chunk, record.row};
+}
+
+World::Location World::locate(Entity entity) const {
+  const Record &record = records[entity.index];
+  return {archetypes[record.archetype].get(), record.chunk, record.row};
+}
+
+bool World::alive(Entity entity) const {
+  return entity.index < records.size() &&
+         records[entity.index].generation == entity.generation;
+}
+
+void World::destroy(Entity entity) {
+  if (!alive(entity)) {
+    return;
+  }
+  Record &record = records[entity.index];
+  Archetype &archetype = *archetypes[record.archetype];
+  EntityChunk &last = *archetype.chunks.back();
+  std::uint32_t lastRow = last.count - 1;
+  EntityChunk &chunk = *archetype.chunks[record.chunk];
+  if (&chunk != &last || record.row != lastRow) {
+    copyRow(archetype, chunk, record.row, last, lastRow);
+    Entity moved;
+    std::memcpy(&moved, chunk.data + record.row * sizeof(Entity),
+                sizeof(Entity));
+    records[moved.index].chunk = record.chunk;
+    records[moved.index].row = record.row;
+  }
+  if (--last.count == 0) {
+    archetype.chunks.pop_back();
+  }
+  record.generation++;
+  freeIndices.push_back(entity.index);
+  entityCount--;
+}
+
+std::pmr::vector<ChunkView>
+World::chunks(ComponentMask include,
+              std::pmr::memory_resource *resource) const {
+  std::pmr::vector<ChunkView> views(resource);
+  for (const auto &archetype : archetypes) {
+    if ((archetype->mask & include) != include) {
+      continue;
+    }
+    for (const auto &chunk : archetype->chunks) {
+      views.emplace_back(archetype.get(), chunk.get());
+    }
+  }
+  return views;
+}
+
+void World::forEachChunk(ComponentMask include,
+                         const std::function<void(const ChunkView &)> &fn,
+                         ThreadPool *pool) const {
+  std::pmr::vector<ChunkView> views = chunks(include, frameResource());
+  if (pool == nullptr) {
+    for (const ChunkView &view : views) {
+      fn(view);
+    }
+    return;
+  }
+  pool->parallelFor(views.size(), chunkGrain,
+                    [&](std::size_t begin, std::size_t end) {
+                      for (std::size_t i = begin; i < end; i++) {
+                        fn(views[i]);
+                      }
+                    });
+}
+
+void SystemScheduler::add(const char *name, ComponentMask reads,
+                          ComponentMask writes,
+                          std::function<void(World &)> run) {
+  bool conflicts = phases.empty() ||
+                   (writes & (phases.back().reads | phases.back().writes)) ||
+                   (reads & phases.back().writes);
+  if (conflicts) {
+    phases.emplace_back();
+  }
+  Phase &phase = phases.back();
+  phase.reads |= reads;
+  phase.writes |= writes;
+  phase.systems.push_back({name, reads, writes, std::move(run)});
+}
+
+void SystemScheduler::run(World &world, ThreadPool *pool) {
+  CPU_ZONE("SystemScheduler::run");
+  for (auto &phase : phases) {
+    auto runSystems = [&](std::size_t begin, std::size_t end) {
+      for (std::size_t i = begin; i < end; i++) {
+        CPU_ZONE(phase.systems[i].name);
+        phase.systems[i].run(world);
+      }
+    };
+    if (pool == nullptr || phase.systems.size() == 1) {
+      runSystems(0, phase.systems.size());
+    } else {
+      pool->parallelFor(phase.systems.size(), 1, runSystems);
+    }
+  }
+}
@@ -0,0 +1,494 @@
+#include "font.h"
+#include "image.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace {
+
+// Big-endian reads that return 0 past the end, so a truncated table reads
+// as empty instead of out of bounds
+std::uint8_t readU8(std::span<const std::uint8_t> data, std::size_t offset) {
+  return offset < data.size() ? data[offset] : 0;
+}
+std::uint16_t readU16(std::span<const std::uint8_t> data,
+                      std::size_t offset) {
+  if (offset + 2 > data.size()) {
+    return 0;
+  }
+  return std::uint16_t(data[offset] << 8 | data[offset + 1]);
+}
+std::int16_t readI16(std::span<const std::uint8_t> data, std::size_t offset) {
+  return std::int16_t(readU16(data, offset));
+}
+std::uint32_t readU32(std::span<const std::uint8_t> data,
+                      std::size_t offset) {
+  return std::uint32_t(readU16(data, offset)) << 16 |
+         readU16(data, offset + 2);
+}
+// 2.14 fixed point, used for component scales
+float readF2Dot14(std::span<const std::uint8_t> data, std::size_t offset) {
+  return readI16(data, offset) / 16384.0f;
+}
+
+constexpr std::uint32_t tableTag(const char (&name)[5]) {
+  return std::uint32_t(std::uint8_t(name[0])) << 24 |
+         std::uint32_t(std::uint8_t(name[1])) << 16 |
+         std::uint32_t(std::uint8_t(name[2])) << 8 |
+         std::uint32_t(std::uint8_t(name[3]));
+}
+
+// Simple glyph point flags
+constexpr std::uint8_t onCurvePoint = 0x01;
+constexpr std::uint8_t xShortVector = 0x02;
+constexpr std::uint8_t yShortVector = 0x04;
+constexpr std::uint8_t repeatFlag = 0x08;
+constexpr std::uint8_t xSameOrPositive = 0x10;
+constexpr std::uint8_t ySameOrPositive = 0x20;
+
+// Composite glyph component flags
+constexpr std::uint16_t argsAreWords = 0x0001;
+constexpr std::uint16_t argsAreXYValues = 0x0002;
+constexpr std::uint16_t haveScale = 0x0008;
+constexpr std::uint16_t moreComponents = 0x0020;
+constexpr std::uint16_t haveXYScale = 0x0040;
+constexpr std::uint16_t haveTwoByTwo = 0x0080;
+
+// Composites referring to composites, deeper than any real font goes
+constexpr int maxComponentDepth = 8;
+
+// Turns one contour's points into segments. Two off-curve points in a row
+// imply an on-curve point halfway between them.
+void addContour(std::span<const glm::vec2> points,
+                std::span<const std::uint8_t> flags,
+                std::vector<OutlineSegment> &segments) {
+  std::size_t count = points.size();
+  if (count < 2) {
+    return;
+  }
+  auto onCurve = [&](std::size_t i) { return flags[i] & onCurvePoint; };
+  // Start on an on-curve point, or if there is none, halfway between the
+  // last and first points
+  std::size_t first = 0;
+  while (first < count && !onCurve(first)) {
+    first++;
+  }
+  glm::vec2 start;
+  std::size_t begin;
+  std::size_t steps;
+  if (first < count) {
+    start = points[first];
+    begin = first + 1;
+    steps = count - 1;
+  } else {
+    start = (points[count - 1] + points[0]) * 0.5f;
+    begin = 0;
+    steps = count;
+  }
+
+  auto line = [&](glm::vec2 from, glm::vec2 to) {
+    if (from.x != to.x || from.y != to.y) {
+      segments.push_back({from, from, to, false});
+    }
+  };
+  glm::vec2 current = start;
+  glm::vec2 control;
+  bool haveControl = false;
+  for (std::size_t step = 0; step < steps; step++) {
+    std::size_t i = (begin + step) % count;
+    glm::vec2 point = points[i];
+    if (onCurve(i)) {
+      if (haveControl) {
+        segments.push_back({current, control, point, true});
+      } else {
+        line(current, point);
+      }
+      current = point;
+      haveControl = false;
+    } else if (haveControl) {
+      glm::vec2 middle = (control + point) * 0.5f;
+      segments.push_back({current, control, middle, true});
+      current = middle;
+      control = point;
+    } else {
+      control = point;
+      haveControl = true;
+    }
+  }
+  if (haveControl) {
+    segments.push_back({current, control, start, true});
+  } else {
+    line(current, start);
+  }
+}
+
+} // namespace
+
+bool Font::decode(std::vector<std::uint8_t> bytes) {
+  *this = Font();
+  data = std::move(bytes);
+  std::span<const std::uint8_t> file = data;
+
+  std::uint32_t version = readU32(file, 0);
+  if (version == tableTag("ttcf")) {
+    std::cerr << "Font: font collections are not supported" << std::endl;
+    return false;
+  }
+  if (version == tableTag("OTTO")) {
+    std::cerr << "Font: CFF outlines are not supported" << std::endl;
+    return false;
+  }
+  if (version != 0x00010000 && version != tableTag("true")) {
+    std::cerr << "Font: not a TrueType font" << std::endl;
+    return false;
+  }
+
+  std::size_t head = 0;
+  std::size_t hhea = 0;
+  std::size_t maxp = 0;
+  std::size_t kern = 0;
+  std::size_t kernLength = 0;
+  std::uint16_t tableCount = readU16(file, 4);
+  for (std::uint16_t i = 0; i < tableCount; i++) {
+    std::size_t record = 12 + std::size_t(i) * 16;
+    std::uint32_t tag = readU32(file, record);
+    std::size_t offset = readU32(file, record + 8);
+    std::size_t length = readU32(file, record + 12);
+    if (record + 16 > file.size() || offset + length > file.size()) {
+      std::cerr << "Font: table directory out of bounds" << std::endl;
+      return false;
+    }
+    if (tag == tableTag("head")) {
+      head = offset;
+    } else if (tag == tableTag("hhea")) {
+      hhea = offset;
+    } else if (tag == tableTag("maxp")) {
+      maxp = offset;
+    } else if (tag == tableTag("hmtx")) {
+      hmtx = offset;
+    } else if (tag == tableTag("loca")) {
+      loca = offset;
+    } else if (tag == tableTag("glyf")) {
+      glyf = offset;
+      glyfLength = length;
+    } else if (tag == tableTag("cmap")) {
+      cmap = offset;
+    } else if (tag == tableTag("kern")) {
+      kern = offset;
+      kernLength = length;
+    }
+  }
+  if (head == 0 || hhea == 0 || maxp == 0 || hmtx == 0 || loca == 0 ||
+      glyf == 0 || cmap == 0) {
+    std::cerr << "Font: missing a required table" << std::endl;
+    return false;
+  }
+
+  emUnits = readU16(file, head + 18);
+  longOffsets = readI16(file, head + 50) != 0;
+  ascender = readI16(file, hhea + 4);
+  descender = readI16(file, hhea + 6);
+  gap = readI16(file, hhea + 8);
+  horizontalMetrics = readU16(file, hhea + 34);
+  glyphs = readU16(file, maxp + 4);
+  if (emUnits == 0 || glyphs == 0 || horizontalMetrics == 0) {
+    std::cerr << "Font: empty head, hhea or maxp table" << std::endl;
+    return false;
+  }
+
+  // A Unicode subtable, format 12 covers more than format 4
+  std::uint16_t subtableCount = readU16(file, cmap + 2);
+  std::size_t chosen = 0;
+  for (std::uint16_t i = 0; i < subtableCount; i++) {
+    std::size_t record = cmap + 4 + std::size_t(i) * 8;
+    std::uint16_t platform = readU16(file, record);
+    std::uint16_t encoding = readU16(file, record + 2);
+    std::size_t subtable = cmap + readU32(file, record + 4);
+    bool unicode =
+        platform == 0 || (platform == 3 && (encoding == 1 || encoding == 10));
+    std::uint16_t format = readU16(file, subtable);
+    if (!unicode || (format != 4 && format != 12)) {
+      continue;
+    }
+    if (format > cmapFormat) {
+      chosen = subtable;
+      cmapFormat = format;
+    }
+  }
+  if (cmapFormat == 0) {
+    std::cerr << "Font: no Unicode cmap subtable" << std::endl;
+    return false;
+  }
+  cmap = chosen;
+
+  // The first horizontal format 0 subtable of the Microsoft kern table
+  if (kern != 0 && readU16(file, kern) == 0 && readU16(file, kern + 2) > 0) {
+    std::size_t subtable = kern + 4;
+    std::uint16_t coverage = readU16(file, subtable + 4);
+    std::uint16_t pairs = readU16(file, subtable + 6);
+    if ((coverage & 0xFF07) == 0x0001 &&
+        subtable + 14 + std::size_t(pairs) * 6 <= kern + kernLength) {
+      kernPairs = subtable + 14;
+      kernPairCount = pairs;
+    }
+  }
+  return true;
+}
+
+bool Font::load(std::string_view path) {
+  std::vector<std::uint8_t> bytes;
+  if (!readFile(path, bytes)) {
+    return false;
+  }
+  if (!decode(std::move(bytes))) {
+    std::cerr << "Font: could not read " << path << std::endl;
+    return false;
+  }
+  return true;
+}
+
+std::uint32_t Font::glyphIndex(char32_t codepoint) const {
+  std::span<const std::uint8_t> file = data;
+  std::uint32_t glyph = 0;
+  if (cmapFormat == 12) {
+    // Sequential map groups, sorted by start code
+    std::uint32_t lo = 0;
+    std::uint32_t hi = readU32(file, cmap + 12);
+    while (lo < hi) {
+      std::uint32_t mid = lo + (hi - lo) / 2;
+      std::size_t group = cmap + 16 + std::size_t(mid) * 12;
+      if (readU32(file, group + 4) < codepoint) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    std::size_t group = cmap + 16 + std::size_t(lo) * 12;
+    if (lo < readU32(file, cmap + 12) && readU32(file, group) <= codepoint) {
+      glyph = readU32(file, group + 8) + (codepoint - readU32(file, group));
+    }
+  } else if (cmapFormat == 4 && codepoint <= 0xFFFF) {
+    // Segments sorted by end code, in parallel arrays
+    std::uint32_t segmentBytes = readU16(file, cmap + 6);
+    std::uint32_t segments = segmentBytes / 2;
+    std::size_t endCodes = cmap + 14;
+    std::size_t startCodes = endCodes + segmentBytes + 2;
+    std::size_t deltas = startCodes + segmentBytes;
+    std::size_t rangeOffsets = deltas + segmentBytes;
+    std::uint32_t lo = 0;
+    std::uint32_t hi = segments;
+    while (lo < hi) {
+      std::uint32_t mid = lo + (hi - lo) / 2;
+      if (readU16(file, endCodes + mid * 2) < codepoint) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    std::uint16_t start = readU16(file, startCodes + lo * 2);
+    if (lo < segments && start <= codepoint) {
+      std::uint16_t delta = readU16(file, deltas + lo * 2);
+      std::uint16_t rangeOffset = readU16(file, rangeOffsets + lo * 2);
+      if (rangeOffset == 0) {
+        glyph = (codepoint + delta) & 0xFFFF;
+      } else {
+        // Offset from the rangeOffset entry itself into glyphIdArray
+        std::size_t at = rangeOffsets + lo * 2 + rangeOffset +
+                         (codepoint - start) * 2;
+        glyph = readU16(file, at);
+        if (glyph != 0) {
+          glyph = (glyph + delta) & 0xFFFF;
+        }
+      }
+    }
+  }
+  return glyph < glyphs ? glyph : 0;
+}
+
+std::span<const std::uint8_t> Font::glyphData(std::uint32_t glyph) const {
+  if (glyph >= glyphs) {
+    return {};
+  }
+  std::span<const std::uint8_t> file = data;
+  std::size_t begin;
+  std::size_t end;
+  if (longOffsets) {
+    begin = readU32(file, loca + std::size_t(glyph) * 4);
+    end = readU32(file, loca + std::size_t(glyph) * 4 + 4);
+  } else {
+    begin = std::size_t(readU16(file, loca + std::size_t(glyph) * 2)) * 2;
+    end = std::size_t(readU16(file, loca + std::size_t(glyph) * 2 + 2)) * 2;
+  }
+  if (end <= begin || end > glyfLength) {
+    return {};
+  }
+  return file.subspan(glyf + begin, end - begin);
+}
+
+GlyphMetrics Font::metrics(std::uint32_t glyph) const {
+  std::span<const std::uint8_t> file = data;
+  GlyphMetrics metrics;
+  std::uint32_t metric = std::min(glyph, horizontalMetrics - 1);
+  metrics.advance = readU16(file, hmtx + std::size_t(metric) * 4);
+  std::span<const std::uint8_t> bytes = glyphData(glyph);
+  if (bytes.size() >= 10) {
+    metrics.xMin = readI16(bytes, 2);
+    metrics.yMin = readI16(bytes, 4);
+    metrics.xMax = readI16(bytes, 6);
+    metrics.yMax = readI16(bytes, 8);
+  }
+  return metrics;
+}
+
+int Font::kerning(std::uint32_t left, std::uint32_t right) const {
+  if (kernPairCount == 0 || left > 0xFFFF || right > 0xFFFF) {
+    return 0;
+  }
+  std::span<const std::uint8_t> file = data;
+  // Pairs are sorted by the left and right glyph as one 32-bit key
+  std::uint32_t key = left << 16 | right;
+  std::uint32_t lo = 0;
+  std::uint32_t hi = kernPairCount;
+  while (lo < hi) {
+    std::uint32_t mid = lo + (hi - lo) / 2;
+    std::uint32_t pairKey = readU32(file, kernPairs + std::size_t(mid) * 6);
+    if (pairKey < key) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  std::size_t pair = kernPairs + std::size_t(lo) * 6;
+  if (lo < kernPairCount && readU32(file, pair) == key) {
+    return readI16(file, pair + 4);
+  }
+  return 0;
+}
+
+bool Font::outline(std::uint32_t glyph,
+                   std::vector<OutlineSegment> &segments) const {
+  return appendGlyph(glyph, Transform(), 0, segments);
+}
+
+bool Font::appendGlyph(std::uint32_t glyph, const Transform &transform,
+                       int depth, std::vector<OutlineSegment> &segments) const {
+  std::span<const std::uint8_t> bytes = glyphData(glyph);
+  if (bytes.empty()) {
+    return true;
+  }
+  if (bytes.size() < 10 || depth > maxComponentDepth) {
+    return false;
+  }
+  std::int16_t contourCount = readI16(bytes, 0);
+
+  if (contourCount < 0) {
+    std::size_t at = 10;
+    std::uint16_t flags;
+    do {
+      flags = readU16(bytes, at);
+      std::uint16_t component = readU16(bytes, at + 2);
+      at += 4;
+      glm::vec2 offset(0.0f);
+      if (flags & argsAreWords) {
+        offset = glm::vec2(readI16(bytes, at), readI16(bytes, at + 2));
+        at += 4;
+      } else {
+        offset = glm::vec2(std::int8_t(readU8(bytes, at)),
+                           std::int8_t(readU8(bytes, at + 1)));
+        at += 2;
+      }
+      if (!(flags & argsAreXYValues)) {
+        // Placement by matching points is rare, leave the component as is
+        offset = glm::vec2(0.0f);
+      }
+      Transform local;
+      local.offset = offset;
+      if (flags & haveScale) {
+        float scale = readF2Dot14(bytes, at);
+        local.x = glm::vec2(scale, 0.0f);
+        local.y = glm::vec2(0.0f, scale);
+        at += 2;
+      } else if (flags & haveXYScale) {
+        local.x = glm::vec2(readF2Dot14(bytes, at), 0.0f);
+        local.y = glm::vec2(0.0f, readF2Dot14(bytes, at + 2));
+        at += 4;
+      } else if (flags & haveTwoByTwo) {
+        local.x = glm::vec2(readF2Dot14(bytes, at), readF2Dot14(bytes, at + 2));
+        local.y =
+            glm::vec2(readF2Dot14(bytes, at + 4), readF2Dot14(bytes, at + 6));
+        at += 8;
+      }
+      if (at > bytes.size()) {
+        return false;
+      }
+      Transform combined;
+      combined.x = transform.x * local.x.x + transform.y * local.x.y;
+      combined.y = transform.x * local.y.x + transform.y * local.y.y;
+      combined.offset = transform.apply(local.offset);
+      if (!appendGlyph(component, combined, depth + 1, segments)) {
+        return false;
+      }
+    } while (flags & moreComponents);
+    return true;
+  }
+
+  std::size_t contours = contourCount;
+  std::size_t pointCount =
+      contours == 0 ? 0 : readU16(bytes, 10 + (contours - 1) * 2) + 1;
+  std::size_t at = 10 + contours * 2;
+  at += 2 + readU16(bytes, at);
+  if (at > bytes.size()) {
+    return false;
+  }
+
+  std::vector<std::uint8_t> flags(pointCount);
+  for (std::size_t i = 0; i < pointCount;) {
+    std::uint8_t flag = readU8(bytes, at++);
+    std::size_t repeat = flag & repeatFlag ? readU8(bytes, at++) : 0;
+    for (std::size_t r = 0; r <= repeat && i < pointCount; r++) {
+      flags[i++] = flag;
+    }
+  }
+  std::vector<glm::vec2> points(pointCount);
+  int x = 0;
+  for (std::size_t i = 0; i < pointCount; i++) {
+    if (flags[i] & xShortVector) {
+      int dx = readU8(bytes, at++);
+      x += flags[i] & xSameOrPositive ? dx : -dx;
+    } else if (!(flags[i] & xSameOrPositive)) {
+      x += readI16(bytes, at);
+      at += 2;
+    }
+    points[i].x = x;
+  }
+  int y = 0;
+  for (std::size_t i = 0; i < pointCount; i++) {
+    if (flags[i] & yShortVector) {
+      int dy = readU8(bytes, at++);
+      y += flags[i] & ySameOrPositive ? dy : -dy;
+    } else if (!(flags[i] & ySameOrPositive)) {
+      y += readI16(bytes, at);
+      at += 2;
+    }
+    points[i].y = y;
+  }
+  if (at > bytes.size()) {
+    return false;
+  }
+  for (auto &point : points) {
+    point = transform.apply(point);
+  }
+
+  std::size_t start = 0;
+  for (std::size_t contour = 0; contour < contours; contour++) {
+    std::size_t end = readU16(bytes, 10 + contour * 2);
+    if (end < start || end >= pointCount) {
+      return false;
+    }
+    std::size_t count = end - start + 1;
+    addContour(std::span(points).subspan(start, count),
+               std::span(flags).subspan(start, count), segments);
+    start = end + 1;
+  }
+  return true;
+}
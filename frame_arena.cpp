@@ -0,0 +1,96 @@
+#include "frame_arena.h"
+
+#include <algorithm>
+#include <mutex>
+
+LinearArena::LinearArena(std::size_t initialBytes) {
+  if (initialBytes > 0) {
+    addBlock(initialBytes);
+  }
+}
+
+void LinearArena::addBlock(std::size_t minimumBytes) {
+  // Doubling keeps the number of blocks in one frame logarithmic
+  std::size_t size = std::max(minimumBytes,
+                              blocks.empty() ? 0 : blocks.back().size * 2);
+  blocks.push_back({std::make_unique<std::byte[]>(size), size});
+  capacity += size;
+  cursor = 0;
+  blockAllocations++;
+}
+
+void *LinearArena::allocate(std::size_t bytes, std::size_t alignment) {
+  if (!blocks.empty()) {
+    Block &block = blocks.back();
+    std::uintptr_t base = reinterpret_cast<std::uintptr_t>(block.data.get());
+    std::uintptr_t aligned =
+        (base + cursor + alignment - 1) & ~std::uintptr_t(alignment - 1);
+    std::size_t end = aligned - base + bytes;
+    if (end <= block.size) {
+      used += end - cursor;
+      cursor = end;
+      highWater = std::max(highWater, used);
+      return reinterpret_cast<void *>(aligned);
+    }
+  }
+  // make_unique<std::byte[]> only aligns to the default new alignment
+  std::size_t padding =
+      alignment > alignof(std::max_align_t) ? alignment - 1 : 0;
+  addBlock(bytes + padding);
+  return allocate(bytes, alignment);
+}
+
+void LinearArena::reset() {
+  if (blocks.size() > 1) {
+    // One block as large as this run needed, so the next one fits
+    std::size_t total = capacity;
+    blocks.clear();
+    capacity = 0;
+    addBlock(total);
+  }
+  cursor = 0;
+  used = 0;
+}
+
+struct FrameArenaRegistry {
+  std::mutex mutex;
+  std::vector<std::unique_ptr<FrameArenaThread>> threads;
+};
+
+static FrameArenaRegistry &frameArenaRegistry() {
+  static FrameArenaRegistry registry;
+  return registry;
+}
+
+FrameArenaThread *registerFrameArenaThread() {
+  auto &registry = frameArenaRegistry();
+  std::lock_guard lock(registry.mutex);
+  auto thread = std::make_unique<FrameArenaThread>();
+  thread->frame = frameArenaFrame.load(std::memory_order_acquire);
+  currentFrameArenaThread = thread.get();
+  registry.threads.push_back(std::move(thread));
+  return currentFrameArenaThread;
+}
+
+void frameArenaEndFrame() {
+  frameArenaFrame.fetch_add(1, std::memory_order_acq_rel);
+}
+
+FrameArenaStats frameArenaStats() {
+  auto &registry = frameArenaRegistry();
+  std::lock_guard lock(registry.mutex);
+  std::uint64_t frame = frameArenaFrame.load(std::memory_order_acquire);
+  FrameArenaStats stats;
+  stats.threads = registry.threads.size();
+  for (const auto &thread : registry.threads) {
+    if (thread->frame == frame) {
+      stats.usedBytes += thread->arenas[frame % 2].usedBytes();
+    }
+    for (const LinearArena &arena : thread->arenas) {
+      stats.capacityBytes += arena.capacityBytes();
+      stats.highWaterBytes += arena.highWaterBytes();
+      stats.heapAllocations += arena.heapAllocations();
+    }
+  }
+  return stats;
+}
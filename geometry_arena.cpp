@@ -0,0 +1,144 @@
+#include "geometry_arena.h"
+#include "cpu_profiler.h"
+
+#include <iostream>
+
+GeometryArena::GeometryArena(std::uint32_t vertexCapacity,
+                             std::uint32_t indexCapacity)
+    : vao(GLVertexArray::create()), vertexAllocator(vertexCapacity),
+      indexAllocator(indexCapacity) {
+  createGLHandles(buffers);
+  GLCall(glBindVertexArray(vao));
+
+  GLCall(glBindBuffer(GL_ARRAY_BUFFER, buffers[0]));
+  GLCall(glBufferData(GL_ARRAY_BUFFER,
+                      GLsizeiptr(vertexCapacity) * sizeof(Vertex), nullptr,
+                      GL_STATIC_DRAW));
+  GLCall(glEnableVertexAttribArray(0));
+  GLCall(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                               (const void *)offsetof(Vertex, pos)));
+  GLCall(glEnableVertexAttribArray(1));
+  GLCall(glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                               (const void *)offsetof(Vertex, color)));
+  GLCall(glEnableVertexAttribArray(2));
+  GLCall(glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                               (const void *)offsetof(Vertex, texCoord)));
+
+  GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]));
+  GLCall(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                      GLsizeiptr(indexCapacity) * sizeof(std::uint32_t),
+                      nullptr, GL_STATIC_DRAW));
+  GLCall(glBindVertexArray(0));
+}
+
+ArenaMesh GeometryArena::allocate(std::size_t vertexCount,
+                                  std::size_t indexCount) {
+  ArenaMesh mesh;
+  if (vertexCount == 0 || indexCount == 0 ||
+      vertexCount > vertexAllocator.capacity() ||
+      indexCount > indexAllocator.capacity()) {
+    std::cerr << "Geometry arena: cannot hold a mesh of " << vertexCount
+              << " vertices and " << indexCount << " indices" << std::endl;
+    return mesh;
+  }
+  mesh.vertices = vertexAllocator.allocate(std::uint32_t(vertexCount));
+  mesh.indices = indexAllocator.allocate(std::uint32_t(indexCount));
+  if (!mesh.vertices.valid() || !mesh.indices.valid()) {
+    std::cerr << "Geometry arena: out of "
+              << (mesh.vertices.valid() ? "index" : "vertex")
+              << " space for a mesh of " << vertexCount << " vertices and "
+              << indexCount << " indices" << std::endl;
+    vertexAllocator.free(mesh.vertices);
+    indexAllocator.free(mesh.indices);
+  }
+  return mesh;
+}
+
+void GeometryArena::uploadVertices(const ArenaMesh &mesh,
+                                   std::span<const Vertex> vertices) {
+  // The element array binding is VAO state, so the arena's VAO is bound
+  // first to keep the index upload off any other VAO's index buffer
+  GLCall(glBindVertexArray(vao));
+  GLCall(glBindBuffer(GL_ARRAY_BUFFER, buffers[0]));
+  GLCall(glBufferSubData(GL_ARRAY_BUFFER,
+                         GLintptr(mesh.vertices.offset) * sizeof(Vertex),
+                         vertices.size_bytes(), vertices.data()));
+}
+
+ArenaMesh GeometryArena::add(std::span<const Vertex> vertices,
+                             std::span<const std::uint32_t> indices) {
+  CPU_ZONE("Geometry arena add");
+  ArenaMesh mesh = allocate(vertices.size(), indices.size());
+  if (!mesh.valid()) {
+    return mesh;
+  }
+  uploadVertices(mesh, vertices);
+  GLCall(glBufferSubData(
+      GL_ELEMENT_ARRAY_BUFFER,
+      GLintptr(mesh.indices.offset) * sizeof(std::uint32_t),
+      indices.size_bytes(), indices.data()));
+  return mesh;
+}
+
+ArenaMesh GeometryArena::add(std::span<const Vertex> vertices,
+                             std::span<const std::uint16_t> indices,
+                             GLenum primitiveMode) {
+  CPU_ZONE("Geometry arena add");
+  ArenaMesh mesh = allocate(vertices.size(), indices.size());
+  if (!mesh.valid()) {
+    return mesh;
+  }
+  uploadVertices(mesh, vertices);
+  std::uint32_t restart =
+      primitiveMode == GL_TRIANGLE_STRIP ? 0xFFFFFFFF : 0xFFFF;
+  widened.resize(indices.size());
+  for (std::size_t i = 0; i < indices.size(); i++) {
+    widened[i] = indices[i] == 0xFFFF ? restart : indices[i];
+  }
+  GLCall(glBufferSubData(
+      GL_ELEMENT_ARRAY_BUFFER,
+      GLintptr(mesh.indices.offset) * sizeof(std::uint32_t),
+      widened.size() * sizeof(std::uint32_t), widened.data()));
+  return mesh;
+}
+
+void GeometryArena::remove(ArenaMesh &mesh) {
+  vertexAllocator.free(mesh.vertices);
+  indexAllocator.free(mesh.indices);
+}
+
+void GeometryArena::bind() const { GLCall(glBindVertexArray(vao)); }
+
+void GeometryArena::draw(GLenum mode, const ArenaMesh &mesh,
+                         std::uint32_t firstIndex,
+                         std::uint32_t indexCount) {
+  GLCall(glDrawElementsBaseVertex(
+      mode, indexCount, GL_UNSIGNED_INT,
+      (const void *)((std::size_t(mesh.firstIndex()) + firstIndex) *
+                     sizeof(std::uint32_t)),
+      mesh.baseVertex()));
+}
+
+GeometryArenaStats GeometryArena::stats() const {
+  return {vertexAllocator.stats(), indexAllocator.stats()};
+}
+
+void ArenaDrawList::add(const ArenaMesh &mesh, std::uint32_t firstIndex,
+                        std::uint32_t indexCount) {
+  counts.push_back(indexCount);
+  offsets.push_back(
+      (const void *)((std::size_t(mesh.firstIndex()) + firstIndex) *
+                     sizeof(std::uint32_t)));
+  baseVertices.push_back(mesh.baseVertex());
+}
+
+void ArenaDrawList::submit(GLenum mode) {
+  if (!counts.empty()) {
+    GLCall(glMultiDrawElementsBaseVertex(
+        mode, counts.data(), GL_UNSIGNED_INT, offsets.data(),
+        GLsizei(counts.size()), baseVertices.data()));
+  }
+  counts.clear();
+  offsets.clear();
+  baseVertices.clear();
+}
@@ -0,0 +1,295 @@
+#include "gl_counters.h"
+#include "glad/gl.h"
+
+#include <string_view>
+#include <type_traits>
+
+namespace {
+
+GLCounters totals;
+// Uploads from a bound unpack buffer pass an offset instead of a pointer
+GLuint unpackBuffer = 0;
+
+// The driver's entry point a wrapper forwards to
+template <auto &Entry> struct Original {
+  static inline std::remove_reference_t<decltype(Entry)> proc = nullptr;
+};
+
+template <auto &Entry>
+void installWrapper(std::remove_reference_t<decltype(Entry)> wrapper) {
+  // Not loaded by this context, or wrapped already
+  if (Entry == nullptr || Original<Entry>::proc != nullptr) {
+    return;
+  }
+  Original<Entry>::proc = Entry;
+  Entry = wrapper;
+}
+
+template <auto &Entry, std::uint64_t GLCounters::*Counter, class... Args>
+void GLAD_API_PTR countCall(Args... args) {
+  totals.*Counter += 1;
+  Original<Entry>::proc(args...);
+}
+
+// Counts every call of `Entry` in `Counter`
+template <auto &Entry, std::uint64_t GLCounters::*Counter, class... Args>
+void installCounter(void(GLAD_API_PTR *)(Args...)) {
+  installWrapper<Entry>(&countCall<Entry, Counter, Args...>);
+}
+
+// Unsized formats and types as glTexImage takes them
+std::uint64_t pixelBytes(GLenum format, GLenum type) {
+  std::uint64_t components;
+  switch (format) {
+  case GL_RED:
+  case GL_RED_INTEGER:
+  case GL_DEPTH_COMPONENT:
+  case GL_STENCIL_INDEX:
+    components = 1;
+    break;
+  case GL_RG:
+  case GL_RG_INTEGER:
+  case GL_DEPTH_STENCIL:
+    components = 2;
+    break;
+  case GL_RGB:
+  case GL_BGR:
+  case GL_RGB_INTEGER:
+    components = 3;
+    break;
+  default:
+    components = 4;
+    break;
+  }
+  switch (type) {
+  case GL_UNSIGNED_BYTE:
+  case GL_BYTE:
+    return components;
+  case GL_UNSIGNED_SHORT:
+  case GL_SHORT:
+  case GL_HALF_FLOAT:
+    return components * 2;
+  case GL_UNSIGNED_INT:
+  case GL_INT:
+  case GL_FLOAT:
+    return components * 4;
+  // Packed types hold a whole pixel
+  case GL_UNSIGNED_BYTE_3_3_2:
+  case GL_UNSIGNED_BYTE_2_3_3_REV:
+    return 1;
+  case GL_UNSIGNED_SHORT_5_6_5:
+  case GL_UNSIGNED_SHORT_5_6_5_REV:
+  case GL_UNSIGNED_SHORT_4_4_4_4:
+  case GL_UNSIGNED_SHORT_4_4_4_4_REV:
+  case GL_UNSIGNED_SHORT_5_5_5_1:
+  case GL_UNSIGNED_SHORT_1_5_5_5_REV:
+    return 2;
+  case GL_FLOAT_32_UNSIGNED_INT_24_8_REV:
+    return 8;
+  default:
+    return 4;
+  }
+}
+
+void countTexels(std::uint64_t texels, GLenum format, GLenum type,
+                 const void *pixels) {
+  if (pixels != nullptr || unpackBuffer != 0) {
+    totals.uploadBytes += texels * pixelBytes(format, type);
+  }
+}
+
+void GLAD_API_PTR countBindBuffer(GLenum target, GLuint buffer) {
+  totals.stateChanges++;
+  if (target == GL_PIXEL_UNPACK_BUFFER) {
+    unpackBuffer = buffer;
+  }
+  Original<glBindBuffer>::proc(target, buffer);
+}
+
+void GLAD_API_PTR countBufferData(GLenum target, GLsizeiptr size,
+                                  const void *data, GLenum usage) {
+  if (data != nullptr) {
+    totals.uploadBytes += size;
+  }
+  Original<glBufferData>::proc(target, size, data, usage);
+}
+
+void GLAD_API_PTR countBufferSubData(GLenum target, GLintptr offset,
+                                     GLsizeiptr size, const void *data) {
+  totals.uploadBytes += size;
+  Original<glBufferSubData>::proc(target, offset, size, data);
+}
+
+void GLAD_API_PTR countFlushMappedBufferRange(GLenum target, GLintptr offset,
+                                              GLsizeiptr length) {
+  totals.uploadBytes += length;
+  Original<glFlushMappedBufferRange>::proc(target, offset, length);
+}
+
+void GLAD_API_PTR countTexImage2D(GLenum target, GLint level,
+                                  GLint internalFormat, GLsizei width,
+                                  GLsizei height, GLint border, GLenum format,
+                                  GLenum type, const void *pixels) {
+  countTexels(std::uint64_t(width) * height, format, type, pixels);
+  Original<glTexImage2D>::proc(target, level, internalFormat, width, height,
+                               border, format, type, pixels);
+}
+
+void GLAD_API_PTR countTexSubImage2D(GLenum target, GLint level,
+                                     GLint xOffset, GLint yOffset,
+                                     GLsizei width, GLsizei height,
+                                     GLenum format, GLenum type,
+                                     const void *pixels) {
+  countTexels(std::uint64_t(width) * height, format, type, pixels);
+  Original<glTexSubImage2D>::proc(target, level, xOffset, yOffset, width,
+                                  height, format, type, pixels);
+}
+
+void GLAD_API_PTR countTexImage3D(GLenum target, GLint level,
+                                  GLint internalFormat, GLsizei width,
+                                  GLsizei height, GLsizei depth, GLint border,
+                                  GLenum format, GLenum type,
+                                  const void *pixels) {
+  countTexels(std::uint64_t(width) * height * depth, format, type, pixels);
+  Original<glTexImage3D>::proc(target, level, internalFormat, width, height,
+                               depth, border, format, type, pixels);
+}
+
+void GLAD_API_PTR countTexSubImage3D(GLenum target, GLint level,
+                                     GLint xOffset, GLint yOffset,
+                                     GLint zOffset, GLsizei width,
+                                     GLsizei height, GLsizei depth,
+                                     GLenum format, GLenum type,
+                                     const void *pixels) {
+  countTexels(std::uint64_t(width) * height * depth, format, type, pixels);
+  Original<glTexSubImage3D>::proc(target, level, xOffset, yOffset, zOffset,
+                                  width, height, depth, format, type, pixels);
+}
+
+void GLAD_API_PTR countCompressedTexImage2D(GLenum target, GLint level,
+                                            GLenum internalFormat,
+                                            GLsizei width, GLsizei height,
+                                            GLint border, GLsizei imageSize,
+                                            const void *data) {
+  totals.uploadBytes += imageSize;
+  Original<glCompressedTexImage2D>::proc(target, level, internalFormat, width,
+                                         height, border, imageSize, data);
+}
+
+void GLAD_API_PTR countCompressedTexSubImage2D(GLenum target, GLint level,
+                                               GLint xOffset, GLint yOffset,
+                                               GLsizei width, GLsizei height,
+                                               GLenum format,
+                                               GLsizei imageSize,
+                                               const void *data) {
+  totals.uploadBytes += imageSize;
+  Original<glCompressedTexSubImage2D>::proc(target, level, xOffset, yOffset,
+                                            width, height, format, imageSize,
+                                            data);
+}
+
+// GL_NVX_gpu_memory_info, in KiB
+constexpr GLenum gpuMemoryTotalNvx = 0x9048;
+constexpr GLenum gpuMemoryAvailableNvx = 0x9049;
+// GL_ATI_meminfo, free KiB first of four values
+constexpr GLenum textureFreeMemoryAti = 0x87FC;
+
+enum class GpuMemorySource { None, Nvx, Ati };
+
+GpuMemorySource findGpuMemorySource() {
+  GLint count = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+  GpuMemorySource source = GpuMemorySource::None;
+  for (GLint i = 0; i < count; i++) {
+    const auto *name =
+        reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, i));
+    if (name == nullptr) {
+      continue;
+    }
+    std::string_view extension = name;
+    if (extension == "GL_NVX_gpu_memory_info") {
+      return GpuMemorySource::Nvx;
+    }
+    if (extension == "GL_ATI_meminfo") {
+      source = GpuMemorySource::Ati;
+    }
+  }
+  return source;
+}
+
+} // namespace
+
+void installGLCounters() {
+  constexpr auto draws = &GLCounters::drawCalls;
+  installCounter<glDrawArrays, draws>(glDrawArrays);
+  installCounter<glDrawArraysInstanced, draws>(glDrawArraysInstanced);
+  installCounter<glDrawElements, draws>(glDrawElements);
+  installCounter<glDrawElementsInstanced, draws>(glDrawElementsInstanced);
+  installCounter<glDrawElementsBaseVertex, draws>(glDrawElementsBaseVertex);
+  installCounter<glDrawElementsInstancedBaseVertex, draws>(
+      glDrawElementsInstancedBaseVertex);
+  installCounter<glDrawRangeElements, draws>(glDrawRangeElements);
+  installCounter<glDrawRangeElementsBaseVertex, draws>(
+      glDrawRangeElementsBaseVertex);
+  installCounter<glMultiDrawArrays, draws>(glMultiDrawArrays);
+  installCounter<glMultiDrawElements, draws>(glMultiDrawElements);
+  installCounter<glMultiDrawElementsBaseVertex, draws>(
+      glMultiDrawElementsBaseVertex);
+
+  constexpr auto state = &GLCounters::stateChanges;
+  installCounter<glUseProgram, state>(glUseProgram);
+  installCounter<glBindVertexArray, state>(glBindVertexArray);
+  installCounter<glBindTexture, state>(glBindTexture);
+  installCounter<glActiveTexture, state>(glActiveTexture);
+  installCounter<glBindSampler, state>(glBindSampler);
+  installCounter<glBindBufferBase, state>(glBindBufferBase);
+  installCounter<glBindBufferRange, state>(glBindBufferRange);
+  installCounter<glBindFramebuffer, state>(glBindFramebuffer);
+  installCounter<glBindRenderbuffer, state>(glBindRenderbuffer);
+  installCounter<glEnable, state>(glEnable);
+  installCounter<glDisable, state>(glDisable);
+  installCounter<glBlendFunc, state>(glBlendFunc);
+  installCounter<glBlendFuncSeparate, state>(glBlendFuncSeparate);
+  installCounter<glBlendEquation, state>(glBlendEquation);
+  installCounter<glDepthFunc, state>(glDepthFunc);
+  installCounter<glDepthMask, state>(glDepthMask);
+  installCounter<glColorMask, state>(glColorMask);
+  installCounter<glCullFace, state>(glCullFace);
+  installCounter<glFrontFace, state>(glFrontFace);
+  installCounter<glPolygonMode, state>(glPolygonMode);
+  installCounter<glViewport, state>(glViewport);
+  installCounter<glScissor, state>(glScissor);
+  installWrapper<glBindBuffer>(&countBindBuffer);
+
+  installWrapper<glBufferData>(&countBufferData);
+  installWrapper<glBufferSubData>(&countBufferSubData);
+  installWrapper<glFlushMappedBufferRange>(&countFlushMappedBufferRange);
+  installWrapper<glTexImage2D>(&countTexImage2D);
+  installWrapper<glTexSubImage2D>(&countTexSubImage2D);
+  installWrapper<glTexImage3D>(&countTexImage3D);
+  installWrapper<glTexSubImage3D>(&countTexSubImage3D);
+  installWrapper<glCompressedTexImage2D>(&countCompressedTexImage2D);
+  installWrapper<glCompressedTexSubImage2D>(&countCompressedTexSubImage2D);
+}
+
+const GLCounters &glCounters() { return totals; }
+
+GpuMemoryInfo queryGpuMemory() {
+  static const GpuMemorySource source = findGpuMemorySource();
+  GpuMemoryInfo info;
+  if (source == GpuMemorySource::Nvx) {
+    GLint total = 0;
+    GLint available = 0;
+    glGetIntegerv(gpuMemoryTotalNvx, &total);
+    glGetIntegerv(gpuMemoryAvailableNvx, &available);
+    info.available = true;
+    info.totalBytes = std::uint64_t(total) << 10;
+    info.freeBytes = std::uint64_t(available) << 10;
+  } else if (source == GpuMemorySource::Ati) {
+    GLint free[4] = {};
+    glGetIntegerv(textureFreeMemoryAti, free);
+    info.available = true;
+    info.freeBytes = std::uint64_t(free[0]) << 10;
+  }
+  return info;
+}
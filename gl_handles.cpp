@@ -0,0 +1,106 @@
+#include "gl_handles.h"
+
+#include <algorithm>
+#include <array>
+
+namespace {
+
+// glad's entries are pointers loaded at runtime, so the pools call them
+// through lambdas instead of holding their values from before loading
+#define GL_NAME_POOL(gen, del)                                                 \
+  GLNamePool([](GLsizei count, GLuint *names) { gen(count, names); },         \
+             [](GLsizei count, const GLuint *names) { del(count, names); })
+
+// In GLObjectKind order
+std::array<GLNamePool, glObjectKindCount> &glNamePools() {
+  static std::array<GLNamePool, glObjectKindCount> pools = {
+      GL_NAME_POOL(glGenBuffers, glDeleteBuffers),
+      GL_NAME_POOL(glGenVertexArrays, glDeleteVertexArrays),
+      GL_NAME_POOL(glGenTextures, glDeleteTextures),
+      GL_NAME_POOL(glGenFramebuffers, glDeleteFramebuffers),
+      GL_NAME_POOL(glGenRenderbuffers, glDeleteRenderbuffers),
+      GL_NAME_POOL(glGenQueries, glDeleteQueries),
+      GL_NAME_POOL(glGenSamplers, glDeleteSamplers),
+  };
+  return pools;
+}
+
+#undef GL_NAME_POOL
+
+} // namespace
+
+GLNamePool::GLNamePool(GenerateFunction generate, DeleteFunction destroy)
+    : generate(generate), destroy(destroy) {}
+
+void GLNamePool::reserve(std::size_t count) {
+  if (spare.size() >= count) {
+    return;
+  }
+  std::size_t offset = spare.size();
+  std::size_t added = std::max(count - offset, batch);
+  spare.resize(offset + added);
+  generate(GLsizei(added), spare.data() + offset);
+  counters.generateCalls++;
+}
+
+GLuint GLNamePool::acquire() {
+  reserve(1);
+  GLuint name = spare.back();
+  spare.pop_back();
+  counters.acquired++;
+  return name;
+}
+
+void GLNamePool::release(GLuint name) {
+  released.push_back(name);
+  counters.released++;
+  if (released.size() >= batch) {
+    flush();
+  }
+}
+
+void GLNamePool::flush() {
+  if (released.empty()) {
+    return;
+  }
+  destroy(GLsizei(released.size()), released.data());
+  counters.deleteCalls++;
+  released.clear();
+}
+
+void GLNamePool::clear() {
+  flush();
+  if (!spare.empty()) {
+    destroy(GLsizei(spare.size()), spare.data());
+    counters.deleteCalls++;
+    spare.clear();
+  }
+}
+
+GLNamePool &glNamePool(GLObjectKind kind) {
+  return glNamePools()[std::size_t(kind)];
+}
+
+void flushGLNamePools() {
+  for (GLNamePool &pool : glNamePools()) {
+    pool.flush();
+  }
+}
+
+void clearGLNamePools() {
+  for (GLNamePool &pool : glNamePools()) {
+    pool.clear();
+  }
+}
+
+GLNamePoolStats glNamePoolStats() {
+  GLNamePoolStats total;
+  for (const GLNamePool &pool : glNamePools()) {
+    GLNamePoolStats stats = pool.stats();
+    total.acquired += stats.acquired;
+    total.released += stats.released;
+    total.generateCalls += stats.generateCalls;
+    total.deleteCalls += stats.deleteCalls;
+  }
+  return total;
+}
@@ -0,0 +1,142 @@
+#include "gpu_profiler.h"
+#include "utility.h"
+
+#include <algorithm>
+#include <iostream>
+
+static constexpr std::uint32_t skippedScope = UINT32_MAX;
+static constexpr std::uint64_t calibrationInterval = 64;
+
+GpuProfiler::GpuProfiler(unsigned latencyFrames, unsigned maxScopesPerFrame)
+    : frames(latencyFrames > 0 ? latencyFrames : 1) {
+  for (auto &frame : frames) {
+    // Begin and end timestamp for every scope plus the implicit frame scope
+    frame.queries.resize(2 * (maxScopesPerFrame + 1));
+    createGLHandles(frame.queries);
+    frame.scopes.reserve(maxScopesPerFrame + 1);
+  }
+  openScopes.reserve(32);
+  debugGroups = GLAD_GL_KHR_debug != 0;
+  calibrate();
+}
+
+void GpuProfiler::calibrate() {
+  GLint64 gpuNs = 0;
+  glGetInteger64v(GL_TIMESTAMP, &gpuNs);
+  std::uint64_t cpuNs = traceNowNs();
+  gpuToCpuOffsetNs = static_cast<std::int64_t>(cpuNs) - gpuNs;
+}
+
+std::uint32_t GpuProfiler::timestamp(Frame &frame) {
+  std::uint32_t index = frame.usedQueries++;
+  glQueryCounter(frame.queries[index], GL_TIMESTAMP);
+  return index;
+}
+
+void GpuProfiler::beginFrame() {
+  Frame &frame = frames[current];
+  if (frame.pending) {
+    resolve(frame);
+  }
+  frame.scopes.clear();
+  frame.usedQueries = 0;
+  openScopes.clear();
+
+  if (frameCount % calibrationInterval == 0) {
+    calibrate();
+  }
+  pushScope("Frame");
+}
+
+void GpuProfiler::endFrame() {
+  while (!openScopes.empty()) {
+    popScope();
+  }
+  frames[current].pending = true;
+  current = (current + 1) % frames.size();
+  frameCount++;
+}
+
+void GpuProfiler::pushScope(const char *name) {
+  if (debugGroups) {
+    glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+  }
+  Frame &frame = frames[current];
+  if (frame.usedQueries + 2 > frame.queries.size()) {
+    if (!overflowReported) {
+      std::cerr << "GpuProfiler: query pool exhausted, scope '" << name
+                << "' is not timed" << std::endl;
+      overflowReported = true;
+    }
+    openScopes.push_back(skippedScope);
+    return;
+  }
+  Scope scope;
+  scope.name = name;
+  scope.beginQuery = timestamp(frame);
+  scope.endQuery = scope.beginQuery;
+  scope.depth = openScopes.size();
+  openScopes.push_back(frame.scopes.size());
+  frame.scopes.push_back(scope);
+}
+
+void GpuProfiler::popScope() {
+  if (openScopes.empty()) {
+    return;
+  }
+  std::uint32_t scopeIndex = openScopes.back();
+  openScopes.pop_back();
+  if (scopeIndex != skippedScope) {
+    Frame &frame = frames[current];
+    frame.scopes[scopeIndex].endQuery = timestamp(frame);
+  }
+  if (debugGroups) {
+    glPopDebugGroup();
+  }
+}
+
+void GpuProfiler::resolve(Frame &frame) {
+  frame.pending = false;
+  if (frame.usedQueries == 0) {
+    return;
+  }
+  // The frame scope ends last, once it is available every other query is.
+  GLint available = GL_FALSE;
+  glGetQueryObjectiv(frame.queries[frame.usedQueries - 1],
+                     GL_QUERY_RESULT_AVAILABLE, &available);
+  if (available == GL_FALSE) {
+    dropped++;
+    return;
+  }
+
+  resolved.clear();
+  for (const auto &scope : frame.scopes) {
+    GLuint64 begin = 0;
+    GLuint64 end = 0;
+    glGetQueryObjectui64v(frame.queries[scope.beginQuery], GL_QUERY_RESULT,
+                          &begin);
+    glGetQueryObjectui64v(frame.queries[scope.endQuery], GL_QUERY_RESULT,
+                          &end);
+    // Some drivers report an end before its begin. Clamped here, every
+    // consumer can subtract them without wrapping around.
+    end = std::max(end, begin);
+    GpuScopeResult result;
+    result.name = scope.name;
+    result.beginNs = begin + gpuToCpuOffsetNs;
+    result.endNs = end + gpuToCpuOffsetNs;
+    result.depth = scope.depth;
+    resolved.push_back(result);
+
+    if (events.size() < maxTraceEvents) {
+      events.push_back({result.name, result.beginNs, result.endNs,
+                        gpuTraceThreadId, result.depth});
+    }
+  }
+  resolvedFrameNs =
+      resolved.empty() ? 0 : resolved.front().endNs - resolved.front().beginNs;
+}
+
+bool GpuProfiler::exportTrace(std::string_view path) const {
+  const TraceThread threads[] = {{gpuTraceThreadId, "GPU"}};
+  return writeChromeTrace(path, events, threads);
+}
@@ -1,15 +1,71 @@
 #include "glad/gl.h"
 
 #include <GLFW/glfw3.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <functional>
 #include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 #include <iostream>
+#include <span>
 #include <string_view>
 #include <vector>
 
+#include "alloc_tracker.h"
+#include "asset_pack.h"
+#include "cpu_profiler.h"
+#include "debug_output.h"
+#include "frame_arena.h"
+#include "geometry_arena.h"
+#include "gl_handles.h"
+#include "mesh_lod.h"
+#include "shader_permutations.h"
+#include "uniform_layout.h"
+#include "uniform_ring.h"
 #include "utility.h"
 
-int main() {
+namespace {
+
+// std140 mirrors of the quad shader's uniform blocks
+struct CameraBlock {
+  glm::mat4 viewProjection;
+  float time;
+  float padding[3];
+};
+constexpr UniformField cameraFields[] = {
+    UNIFORM_FIELD(CameraBlock, viewProjection),
+    UNIFORM_FIELD(CameraBlock, time),
+};
+static_assert(uniformLayoutMatches<CameraBlock>(UniformLayout::Std140,
+                                                cameraFields),
+              "CameraBlock does not match the Camera block");
+
+struct ObjectBlock {
+  glm::mat4 model;
+};
+constexpr UniformField objectFields[] = {
+    UNIFORM_FIELD(ObjectBlock, model),
+};
+static_assert(uniformLayoutMatches<ObjectBlock>(UniformLayout::Std140,
+                                                objectFields),
+              "ObjectBlock does not match the Object block");
+
+constexpr GLuint cameraBinding = 0;
+constexpr GLuint objectBinding = 1;
+
+} // namespace
+
+int main(int argc, char **argv) {
+  cpuProfilerSetThreadName("Main");
+
+  // An asset pack given on the command line replaces the built-in
+  // triangles with every mesh it contains
+  AssetPack assetPack;
+  if (argc > 1 && !assetPack.open(argv[1])) {
+    return 1;
+  }
 
   glfwSetErrorCallback([](int errorCode, const char *errorMsg) {
     std::cerr << "GLFW: " << errorMsg << std::endl;
@@ -42,17 +98,10 @@ int main() {
     }
     std::cerr << "Loaded OpenGL " << GLAD_VERSION_MAJOR(glversion) << '.'
               << GLAD_VERSION_MINOR(glversion) << std::endl;
-    glEnable(GL_DEBUG_OUTPUT);
-    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
-    glDebugMessageCallback(
-        [](GLenum source, GLenum type, GLuint id, GLenum severity,
-           GLsizei length, const GLchar *message, const void *) {
-          std::cerr << "GL_DEBUG: "
-                    << (type == GL_DEBUG_TYPE_ERROR ? "GL_ERROR" : "")
-                    << message << std::endl;
-        },
-        nullptr);
   }
+  // Runs after every GL handle below is gone, while the context lives
+  Defer deferGLNamePools([]() { clearGLNamePools(); });
+  DebugOutput debugOutput(debugOutputOptionsFromEnv());
   WindowUserData windowUserData;
   glfwGetWindowSize(window, &windowUserData.width, &windowUserData.height);
   glfwSetWindowUserPointer(window, &windowUserData);
@@ -73,8 +122,9 @@ int main() {
         windowUserData->shouldResizeViewport = true;
       });
 
+  // Variants are compiled as they are first drawn with
   // clang-format off
-  GLuint quadProgram = compileProgram(
+  ShaderPermutations quadShaders("quad",
   R"(
     #version 330 core
     
@@ -82,11 +132,19 @@ int main() {
     layout (location = 1) in vec4 color;
     layout (location = 2) in vec2 texCoord;
 
+    layout (std140) uniform Camera {
+      mat4 viewProjection;
+      float time;
+    };
+    layout (std140) uniform Object {
+      mat4 model;
+    };
+
     out vec4 fColor;
     out vec2 fTexCoord;
     
     void main(){
-      gl_Position = vec4(pos.xyz, 1.0);
+      gl_Position = viewProjection * model * vec4(pos.xyz, 1.0);
       fColor = color;
       fTexCoord = texCoord;
     }
@@ -97,50 +155,51 @@ int main() {
     in vec4 fColor;
     in vec2 fTexCoord;
 
+    #ifdef TEXTURED
     uniform sampler2D tex;
-    uniform bool enableTex;
+    #endif
 
     out vec4 FragColor;
 
     void main() {
+    #ifdef TEXTURED
+      FragColor = texture(tex, fTexCoord);
+    #else
       FragColor = fColor;
-      if(enableTex) {
-        FragColor = texture(tex, fTexCoord);
-      }
+    #endif
     }
-  )");
+  )",
+  {"TEXTURED"},
   // clang-format on
-  if (quadProgram == 0) {
+  [](GLuint program) {
+    if (!setUniformBlockBinding(program, "Camera", cameraBinding) ||
+        !setUniformBlockBinding(program, "Object", objectBinding)) {
+      return false;
+    }
+    // The static checks above hold the structs to the std140 rules; this
+    // holds the rules to the driver
+    return checkUniformBlockLayout(program, "Camera", cameraFields,
+                                   sizeof(CameraBlock)) &&
+           checkUniformBlockLayout(program, "Object", objectFields,
+                                   sizeof(ObjectBlock));
+  });
+  // Nothing here is textured
+  const ShaderFeatures quadFeatures = 0;
+  if (quadShaders.program(quadFeatures) == 0) {
     std::cerr << "Quad shader compilation failed!" << std::endl;
     return 2;
   }
+  // Camera once per frame, then one Object block per draw
+  UniformRing uniformRing;
+  std::vector<UniformAllocation> objectBlocks;
 
-  GLuint vao = 0;
-  GLuint vbo = 0;
-  GLuint ibo = 0;
-  GLCall(glGenVertexArrays(1, &vao));
-  GLCall(glBindVertexArray(vao));
-  GLCall(glGenBuffers(1, &vbo));
-  GLCall(glGenBuffers(1, &ibo));
-
-  GLCall(glBindBuffer(GL_ARRAY_BUFFER, vbo));
-  GLCall(glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * 1, nullptr,
-                      GL_DYNAMIC_DRAW));
-
-  GLCall(glEnableVertexAttribArray(0));
-  GLCall(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                               (const void *)offsetof(Vertex, pos)));
-  GLCall(glEnableVertexAttribArray(1));
-  GLCall(glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                               (const void *)offsetof(Vertex, color)));
-  GLCall(glEnableVertexAttribArray(2));
-  GLCall(glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                               (const void *)offsetof(Vertex, texCoord)));
-
-  GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo));
-  GLCall(glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * 1, nullptr,
-                      GL_DYNAMIC_DRAW));
-  GLCall(glBindVertexArray(0));
+  // Every mesh, built-in or from the pack, lives in these buffers and
+  // draws through one VAO
+  GeometryArena geometryArena;
+  // Strips restart at the all ones index. The arena only widens 0xFFFF
+  // to it in strips, so no triangle list index ever equals it
+  GLCall(glEnable(GL_PRIMITIVE_RESTART));
+  GLCall(glPrimitiveRestartIndex(0xFFFFFFFF));
 
   // glEnable(GL_DEPTH_TEST);
 
@@ -153,11 +212,75 @@ int main() {
       {{-0.0f, -0.5f, -0.1f}, {0.0f, 0.0f, 1.0f, 1.0f}},
   };
 
-  GLuint triangleIndexBuffer[] = {0, 1, 2, 3, 4, 5};
+  GLuint triangleIndexBuffer[] = {0, 1, 2};
+
+  // One mesh per triangle, both drawn with a single multi-draw
+  ArenaMesh triangles[] = {
+      geometryArena.add(std::span(triangleVertexBuffer).first(3),
+                        triangleIndexBuffer),
+      geometryArena.add(std::span(triangleVertexBuffer).subspan(3),
+                        triangleIndexBuffer),
+  };
+  if (!triangles[0].valid() || !triangles[1].valid()) {
+    return 2;
+  }
+  ArenaDrawList triangleDraws;
+
+  struct PackMesh {
+    ArenaMesh geometry;
+    GLenum primitiveMode;
+    std::vector<MeshLod> lods;
+    std::uint32_t lod;
+    // About the mesh origin, which it turns around
+    float radius;
+    // Of the origin along the view axis, this frame
+    float viewDistance;
+  };
+  std::vector<PackMesh> packMeshes;
+  for (const auto &entry : assetPack.entries()) {
+    if (entry.kind != AssetKind::Mesh) {
+      continue;
+    }
+    CPU_ZONE("Upload pack mesh");
+    PackMesh &mesh = packMeshes.emplace_back();
+    mesh.lods = assetPack.meshLods(entry);
+    mesh.lod = 0;
+    mesh.primitiveMode = entry.mesh.primitiveMode;
+    mesh.geometry = assetPack.uploadMesh(entry, geometryArena);
+    if (!mesh.geometry.valid()) {
+      return 1;
+    }
+    // The upload checked the vertices lie within the blob
+    const std::uint8_t *vertexBytes = assetPack.data(entry).data();
+    mesh.radius = 0.0f;
+    for (std::uint32_t v = 0; v < entry.mesh.vertexCount; v++) {
+      Vertex vertex;
+      std::memcpy(&vertex, vertexBytes + v * sizeof(Vertex), sizeof(Vertex));
+      mesh.radius = std::max(mesh.radius, glm::length(vertex.pos));
+    }
+  }
+  // Nothing reads the mapping after the uploads
+  assetPack.close();
+
+  const char *tracePath = std::getenv("GLSANDBOX_TRACE");
+  std::vector<TraceEvent> traceEvents;
 
-  GLCall(glBindVertexArray(vao));
+  // The camera dollies between these, so the meshes sweep from filling
+  // the view down to a few pixels and step through their levels
+  constexpr float nearDistance = 2.0f;
+  constexpr float farDistance = 64.0f;
+  constexpr float nearPlane = 0.1f;
+  const float fovY = glm::radians(60.0f);
+
+  geometryArena.bind();
+  // GLSANDBOX_BENCHMARK and GLSANDBOX_ALLOC_STRICT runs
+  AllocationMonitor allocationMonitor(allocationMonitorOptionsFromEnv());
   while (!shouldClose) {
-    glfwPollEvents();
+    CPU_ZONE("Frame");
+    {
+      CPU_ZONE("glfwPollEvents");
+      glfwPollEvents();
+    }
     if (glfwWindowShouldClose(window)) {
       shouldClose = true;
     }
@@ -167,25 +290,109 @@ int main() {
       GLCall(glViewport(0, 0, windowWidth, windowHeight));
       windowUserData.shouldResizeViewport = false;
     }
+    {
+      CPU_ZONE("Write uniform blocks");
+      uniformRing.beginFrame();
+      float time = glfwGetTime();
+      float aspect = float(windowUserData.width) /
+                     float(std::max(windowUserData.height, 1));
+      // Clip space corrected for the aspect ratio, with depth squeezed so
+      // meshes turning about y stay between the planes
+      glm::mat4 viewProjection =
+          glm::scale(glm::mat4(1.0f), glm::vec3(1.0f / aspect, 1.0f, 0.1f));
+      glm::mat4 view(1.0f);
+      if (!packMeshes.empty()) {
+        float dolly = 0.5f - 0.5f * std::cos(time * 0.4f);
+        float distance =
+            nearDistance * std::pow(farDistance / nearDistance, dolly);
+        view = glm::lookAt(glm::vec3(0.0f, 0.0f, distance), glm::vec3(0.0f),
+                           glm::vec3(0.0f, 1.0f, 0.0f));
+        viewProjection = glm::perspective(fovY, aspect, nearPlane,
+                                          farDistance * 2.0f) *
+                         view;
+      }
+      UniformAllocation camera =
+          uniformRing.push(CameraBlock{viewProjection, time, {}});
+      objectBlocks.clear();
+      if (packMeshes.empty()) {
+        objectBlocks.push_back(uniformRing.push(ObjectBlock{glm::mat4(1.0f)}));
+      }
+      // Pack meshes side by side, each turning
+      float spacing =
+          2.0f * aspect / std::max<std::size_t>(packMeshes.size(), 1);
+      for (std::size_t i = 0; i < packMeshes.size(); i++) {
+        glm::mat4 model = glm::translate(
+            glm::mat4(1.0f), glm::vec3(-aspect + spacing * (i + 0.5f), 0.0f,
+                                       0.0f));
+        packMeshes[i].viewDistance = -(view * model[3]).z;
+        model = glm::rotate(model, time * 0.5f + i,
+                            glm::vec3(0.0f, 1.0f, 0.0f));
+        objectBlocks.push_back(uniformRing.push(ObjectBlock{model}));
+      }
+      uniformRing.upload();
+      UniformRing::bind(cameraBinding, camera);
+    }
     /// ==== DRAW
 
     GLCall(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
     GLCall(glEnable(GL_DEPTH_TEST));
 
-    GLCall(glBindBuffer(GL_ARRAY_BUFFER, vbo));
-    GLCall(glBufferData(GL_ARRAY_BUFFER, sizeof(triangleVertexBuffer),
-                        triangleVertexBuffer, GL_DYNAMIC_DRAW));
-    GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo));
-    GLCall(glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(triangleIndexBuffer),
-                        triangleIndexBuffer, GL_DYNAMIC_DRAW));
-    GLCall(glUseProgram(quadProgram));
-    GLCall(glDrawElements(GL_TRIANGLES,
-                          sizeof(triangleIndexBuffer) / sizeof(GLuint),
-                          GL_UNSIGNED_INT, nullptr));
+    if (!packMeshes.empty()) {
+      CPU_ZONE("Draw pack meshes");
+      GLCall(glUseProgram(quadShaders.program(quadFeatures)));
+      for (std::size_t i = 0; i < packMeshes.size(); i++) {
+        PackMesh &mesh = packMeshes[i];
+        UniformRing::bind(objectBinding, objectBlocks[i]);
+        // Scaled for the bounding sphere's nearest point, the largest any
+        // error on the mesh can appear
+        float pixelsPerUnit = lodPixelsPerUnit(
+            std::max(mesh.viewDistance - mesh.radius, nearPlane), fovY,
+            float(windowUserData.height));
+        mesh.lod = selectLod(mesh.lods, pixelsPerUnit, mesh.lod);
+        const MeshLod &lod = mesh.lods[mesh.lod];
+        GeometryArena::draw(mesh.primitiveMode, mesh.geometry,
+                            lod.indexOffset, lod.indexCount);
+      }
+    } else {
+      CPU_ZONE("Draw triangles");
+      GLCall(glUseProgram(quadShaders.program(quadFeatures)));
+      UniformRing::bind(objectBinding, objectBlocks[0]);
+      for (const ArenaMesh &triangle : triangles) {
+        triangleDraws.add(triangle);
+      }
+      triangleDraws.submit(GL_TRIANGLES);
+    }
+    uniformRing.endFrame();
     /// ==== END DRAW
 
-    glfwSwapBuffers(window);
+    {
+      CPU_ZONE("glfwSwapBuffers");
+      glfwSwapBuffers(window);
+    }
+    // Frame scratch from two frames ago may be reused from here on
+    frameArenaEndFrame();
+    if (!allocationMonitor.endFrame()) {
+      shouldClose = true;
+    }
+    if (tracePath != nullptr) {
+      cpuProfilerCollect(traceEvents);
+    }
+  }
+
+  quadShaders.report(std::cerr);
+  {
+    GeometryArenaStats arenaStats = geometryArena.stats();
+    std::cerr << "Geometry arena: " << arenaStats.vertices.usedUnits
+              << " vertices in " << arenaStats.vertices.allocations
+              << " meshes, " << arenaStats.indices.usedUnits
+              << " indices, fragmentation "
+              << arenaStats.vertices.fragmentation << " / "
+              << arenaStats.indices.fragmentation << std::endl;
+  }
+  if (tracePath != nullptr) {
+    cpuProfilerCollect(traceEvents);
+    writeChromeTrace(tracePath, traceEvents, cpuProfilerThreads());
   }
 
-  return 0;
+  return allocationMonitor.exitCode();
 }
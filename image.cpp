@@ -0,0 +1,268 @@
+#include "image.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+// Refuse anything larger than GL_MAX_TEXTURE_SIZE could plausibly be
+static constexpr int maxImageDimension = 1 << 15;
+
+static bool validDimensions(int width, int height) {
+  return width > 0 && height > 0 && width <= maxImageDimension &&
+         height <= maxImageDimension;
+}
+
+bool decodeQoi(std::span<const std::uint8_t> data, Image &image) {
+  constexpr std::size_t headerSize = 14;
+  constexpr std::size_t paddingSize = 8;
+  if (data.size() < headerSize + paddingSize ||
+      std::memcmp(data.data(), "qoif", 4) != 0) {
+    return false;
+  }
+  auto readBe32 = [&](std::size_t at) {
+    return (std::uint32_t(data[at]) << 24) |
+           (std::uint32_t(data[at + 1]) << 16) |
+           (std::uint32_t(data[at + 2]) << 8) | std::uint32_t(data[at + 3]);
+  };
+  std::uint32_t width = readBe32(4);
+  std::uint32_t height = readBe32(8);
+  if (!validDimensions(width, height)) {
+    return false;
+  }
+  image.width = width;
+  image.height = height;
+  image.pixels.resize(std::size_t(width) * height * 4);
+
+  std::uint8_t index[64][4] = {};
+  std::uint8_t px[4] = {0, 0, 0, 255};
+  std::size_t pos = headerSize;
+  std::size_t end = data.size() - paddingSize;
+  int run = 0;
+  for (std::size_t out = 0; out < image.pixels.size(); out += 4) {
+    if (run > 0) {
+      run--;
+    } else if (pos < end) {
+      std::uint8_t b1 = data[pos++];
+      if (b1 == 0xFE) {
+        px[0] = data[pos];
+        px[1] = data[pos + 1];
+        px[2] = data[pos + 2];
+        pos += 3;
+      } else if (b1 == 0xFF) {
+        std::memcpy(px, &data[pos], 4);
+        pos += 4;
+      } else if ((b1 & 0xC0) == 0x00) {
+        std::memcpy(px, index[b1], 4);
+      } else if ((b1 & 0xC0) == 0x40) {
+        px[0] += ((b1 >> 4) & 0x03) - 2;
+        px[1] += ((b1 >> 2) & 0x03) - 2;
+        px[2] += (b1 & 0x03) - 2;
+      } else if ((b1 & 0xC0) == 0x80) {
+        std::uint8_t b2 = data[pos++];
+        int vg = (b1 & 0x3F) - 32;
+        px[0] += vg - 8 + ((b2 >> 4) & 0x0F);
+        px[1] += vg;
+        px[2] += vg - 8 + (b2 & 0x0F);
+      } else {
+        run = b1 & 0x3F;
+      }
+      int hash = (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64;
+      std::memcpy(index[hash], px, 4);
+    }
+    std::memcpy(&image.pixels[out], px, 4);
+  }
+  return true;
+}
+
+bool decodeTga(std::span<const std::uint8_t> data, Image &image) {
+  constexpr std::size_t headerSize = 18;
+  if (data.size() < headerSize) {
+    return false;
+  }
+  std::uint8_t idLength = data[0];
+  std::uint8_t colorMapType = data[1];
+  std::uint8_t imageType = data[2];
+  int width = data[12] | (data[13] << 8);
+  int height = data[14] | (data[15] << 8);
+  int bitsPerPixel = data[16];
+  bool topToBottom = (data[17] & 0x20) != 0;
+
+  bool rle = imageType == 10 || imageType == 11;
+  bool gray = imageType == 3 || imageType == 11;
+  if (colorMapType != 0 || !(imageType == 2 || imageType == 3 || rle) ||
+      !validDimensions(width, height)) {
+    return false;
+  }
+  int bytesPerPixel = bitsPerPixel / 8;
+  if (gray ? bytesPerPixel != 1 : (bytesPerPixel != 3 && bytesPerPixel != 4)) {
+    return false;
+  }
+
+  image.width = width;
+  image.height = height;
+  image.pixels.resize(std::size_t(width) * height * 4);
+
+  std::size_t pos = headerSize + idLength;
+  std::size_t pixelCount = std::size_t(width) * height;
+  auto readPixel = [&](std::uint8_t *out) {
+    if (pos + bytesPerPixel > data.size()) {
+      return false;
+    }
+    const std::uint8_t *in = &data[pos];
+    pos += bytesPerPixel;
+    if (gray) {
+      out[0] = out[1] = out[2] = in[0];
+      out[3] = 255;
+    } else {
+      // TGA stores BGR(A)
+      out[0] = in[2];
+      out[1] = in[1];
+      out[2] = in[0];
+      out[3] = bytesPerPixel == 4 ? in[3] : 255;
+    }
+    return true;
+  };
+  auto outPixel = [&](std::size_t i) {
+    std::size_t x = i % width;
+    std::size_t y = i / width;
+    if (!topToBottom) {
+      y = height - 1 - y;
+    }
+    return &image.pixels[(y * width + x) * 4];
+  };
+
+  std::size_t i = 0;
+  while (i < pixelCount) {
+    if (!rle) {
+      if (!readPixel(outPixel(i))) {
+        return false;
+      }
+      i++;
+      continue;
+    }
+    if (pos >= data.size()) {
+      return false;
+    }
+    std::uint8_t packet = data[pos++];
+    std::size_t count =
+        std::min<std::size_t>((packet & 0x7F) + 1, pixelCount - i);
+    if (packet & 0x80) {
+      std::uint8_t px[4];
+      if (!readPixel(px)) {
+        return false;
+      }
+      for (std::size_t j = 0; j < count; j++) {
+        std::memcpy(outPixel(i++), px, 4);
+      }
+    } else {
+      for (std::size_t j = 0; j < count; j++) {
+        if (!readPixel(outPixel(i++))) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+bool decodePpm(std::span<const std::uint8_t> data, Image &image) {
+  if (data.size() < 2 || data[0] != 'P' || (data[1] != '5' && data[1] != '6')) {
+    return false;
+  }
+  bool gray = data[1] == '5';
+  std::size_t pos = 2;
+  auto readNumber = [&](int &value) {
+    for (;;) {
+      while (pos < data.size() && std::isspace(data[pos])) {
+        pos++;
+      }
+      if (pos < data.size() && data[pos] == '#') {
+        while (pos < data.size() && data[pos] != '\n') {
+          pos++;
+        }
+        continue;
+      }
+      break;
+    }
+    if (pos >= data.size() || !std::isdigit(data[pos])) {
+      return false;
+    }
+    value = 0;
+    while (pos < data.size() && std::isdigit(data[pos]) && value < (1 << 20)) {
+      value = value * 10 + (data[pos++] - '0');
+    }
+    return true;
+  };
+  int width = 0;
+  int height = 0;
+  int maxValue = 0;
+  if (!readNumber(width) || !readNumber(height) || !readNumber(maxValue) ||
+      !validDimensions(width, height) || maxValue <= 0 || maxValue > 255) {
+    return false;
+  }
+  // Exactly one whitespace byte separates the header from the raster
+  pos++;
+  int channels = gray ? 1 : 3;
+  std::size_t pixelCount = std::size_t(width) * height;
+  if (pos + pixelCount * channels > data.size()) {
+    return false;
+  }
+
+  image.width = width;
+  image.height = height;
+  image.pixels.resize(pixelCount * 4);
+  const std::uint8_t *in = &data[pos];
+  for (std::size_t i = 0; i < pixelCount; i++, in += channels) {
+    std::uint8_t *out = &image.pixels[i * 4];
+    for (int c = 0; c < 3; c++) {
+      int value = in[gray ? 0 : c];
+      out[c] = maxValue == 255 ? value : value * 255 / maxValue;
+    }
+    out[3] = 255;
+  }
+  return true;
+}
+
+bool decodeImage(std::span<const std::uint8_t> data, Image &image) {
+  if (data.size() >= 4 && std::memcmp(data.data(), "qoif", 4) == 0) {
+    return decodeQoi(data, image);
+  }
+  if (data.size() >= 2 && data[0] == 'P') {
+    return decodePpm(data, image);
+  }
+  // TGA has no magic, it is the fallback
+  return decodeTga(data, image);
+}
+
+bool readFile(std::string_view path, std::vector<std::uint8_t> &data) {
+  std::FILE *file = std::fopen(std::string(path).c_str(), "rb");
+  if (file == nullptr) {
+    return false;
+  }
+  std::fseek(file, 0, SEEK_END);
+  long size = std::ftell(file);
+  std::fseek(file, 0, SEEK_SET);
+  bool ok = size >= 0;
+  if (ok) {
+    data.resize(size);
+    ok = std::fread(data.data(), 1, data.size(), file) == data.size();
+  }
+  std::fclose(file);
+  return ok;
+}
+
+bool loadImage(std::string_view path, Image &image) {
+  std::vector<std::uint8_t> data;
+  if (!readFile(path, data)) {
+    std::cerr << "Failed to read image " << path << std::endl;
+    return false;
+  }
+  if (!decodeImage(data, image)) {
+    std::cerr << "Failed to decode image " << path << std::endl;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,109 @@
+#ifndef ALLOC_TRACKER_H
+#define ALLOC_TRACKER_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// Heap allocation counting, compiled in with the alloc_tracking option.
+//
+// The global operator new and delete are replaced, and on glibc so are
+// malloc and friends, forwarding to glibc's own allocator. Both are
+// counted per thread, apart: operator new is this program's C++ code,
+// the malloc family also catches the GL driver and GLFW, which allocate
+// whenever they please. Counting takes a few relaxed atomic adds and
+// never allocates itself.
+
+struct AllocCounts {
+  // operator new and delete
+  std::uint64_t news = 0;
+  std::uint64_t newBytes = 0;
+  std::uint64_t deletes = 0;
+  // malloc, calloc, realloc and the aligned variants, and free
+  std::uint64_t mallocs = 0;
+  std::uint64_t mallocBytes = 0;
+  std::uint64_t frees = 0;
+
+  AllocCounts &operator+=(const AllocCounts &other);
+  AllocCounts operator-(const AllocCounts &other) const;
+};
+
+// Threads past this many share the last slot
+constexpr std::size_t allocTrackerMaxThreads = 64;
+
+// Whether allocations are counted in this build
+bool allocTrackerCompiled();
+// Copies the running totals of the threads seen so far, in the order
+// they first allocated, and returns how many there are
+std::size_t allocTrackerSnapshot(std::span<AllocCounts> threads);
+// While on, every operator new records its call stack, up to a fixed
+// number of stacks. Needs <execinfo.h>; a no-op without it.
+void allocTrackerCaptureStacks(bool enable);
+// Symbolizes the recorded stacks to stderr, forgets them, and returns
+// how many were printed
+std::size_t allocTrackerPrintStacks();
+
+struct AllocationMonitorOptions {
+  // Frames after this many must not call operator new; the first one
+  // that does is reported with call stacks and fails the run. 0 is off.
+  std::uint64_t strictAfterFrames = 0;
+  // Runs this many frames, printing each one's CPU time next to its
+  // allocations, then a summary. 0 is off.
+  std::uint64_t benchmarkFrames = 0;
+};
+
+// Reads GLSANDBOX_ALLOC_STRICT (warm-up frames before allocating fails)
+// and GLSANDBOX_BENCHMARK (frames to run)
+AllocationMonitorOptions allocationMonitorOptionsFromEnv();
+
+// Per-frame allocation counts of a render loop, for catching allocations
+// creeping into the steady state.
+//
+//   AllocationMonitor allocationMonitor(allocationMonitorOptionsFromEnv());
+//   while (!shouldClose) {
+//     ...
+//     if (!allocationMonitor.endFrame()) {
+//       shouldClose = true;
+//     }
+//   }
+//   return allocationMonitor.exitCode();
+class AllocationMonitor {
+public:
+  explicit AllocationMonitor(const AllocationMonitorOptions &options = {});
+
+  // Closes the frame. False once the loop should stop: the benchmark has
+  // run its frames, or the strict check failed.
+  bool endFrame(double gpuMs = 0.0);
+  // Counts of the frame endFrame() last closed, over all threads
+  const AllocCounts &lastFrame() const { return frameTotal; }
+  // 1 if the strict check failed
+  int exitCode() const { return failed ? 1 : 0; }
+
+private:
+  void report(const char *label, double cpuMs, double gpuMs) const;
+  void summarize() const;
+
+  using Clock = std::chrono::steady_clock;
+
+  AllocationMonitorOptions options;
+  std::uint64_t frame = 0;
+  Clock::time_point frameStart;
+  // Totals when the frame began, and the frame's share, per thread
+  std::array<AllocCounts, allocTrackerMaxThreads> baseline;
+  std::array<AllocCounts, allocTrackerMaxThreads> current;
+  std::array<AllocCounts, allocTrackerMaxThreads> frameThreads;
+  std::size_t threadCount = 0;
+  AllocCounts frameTotal;
+  bool failed = false;
+
+  // Benchmark totals
+  double cpuMsSum = 0.0;
+  double cpuMsMax = 0.0;
+  double gpuMsSum = 0.0;
+  AllocCounts benchmarkTotal;
+  std::uint64_t allocatingFrames = 0;
+};
+
+#endif
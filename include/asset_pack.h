@@ -0,0 +1,171 @@
+#ifndef ASSET_PACK_H
+#define ASSET_PACK_H
+
+#include "geometry_arena.h"
+#include "glad/gl.h"
+#include "image.h"
+#include "mesh_lod.h"
+#include "texture_compression.h"
+#include "utility.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Binary asset pack, little endian:
+//
+//   AssetPackHeader
+//   AssetPackEntry[entryCount], sorted by name
+//   blobs, each starting on an assetPackAlignment boundary
+//
+// Blobs are stored exactly as GL wants them, so the runtime maps the file
+// and hands pointers into the mapping straight to glBufferData and
+// glTexImage2D.
+constexpr char assetPackMagic[8] = {'G', 'L', 'S', 'B', 'P', 'A', 'C', 'K'};
+constexpr std::uint32_t assetPackVersion = 3;
+constexpr std::size_t assetPackAlignment = 64;
+constexpr std::size_t assetPackMaxName = 64;
+
+enum class AssetKind : std::uint32_t {
+  Blob = 0,
+  // Vertex array, the index array at indexOffset, then the MeshLod table
+  // at lodOffset
+  Mesh = 1,
+  // Levels from 0 down, rows bottom to top, no padding between levels
+  Texture = 2,
+  // Source text, NUL terminated
+  Shader = 3,
+};
+
+struct AssetPackHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t entryCount;
+  std::uint64_t tocOffset;
+  std::uint64_t fileSize;
+};
+
+struct AssetPackMesh {
+  std::uint32_t vertexCount;
+  std::uint32_t indexCount;
+  // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+  std::uint32_t indexType;
+  // From the start of the blob
+  std::uint32_t indexOffset;
+  // GL_TRIANGLES, or GL_TRIANGLE_STRIP restarting at the all ones index
+  std::uint32_t primitiveMode;
+  // 0 when the whole index array is the only level
+  std::uint32_t lodCount;
+  // From the start of the blob
+  std::uint32_t lodOffset;
+};
+
+struct AssetPackTexture {
+  std::uint32_t width;
+  std::uint32_t height;
+  std::uint32_t levelCount;
+  // GL_RGBA8 or one of the BlockFormat internal formats
+  std::uint32_t internalFormat;
+};
+
+struct AssetPackShader {
+  // GL_VERTEX_SHADER or GL_FRAGMENT_SHADER
+  std::uint32_t stage;
+};
+
+struct AssetPackEntry {
+  char name[assetPackMaxName];
+  AssetKind kind;
+  std::uint32_t reserved;
+  std::uint64_t offset;
+  std::uint64_t size;
+  union {
+    std::uint32_t params[10];
+    AssetPackMesh mesh;
+    AssetPackTexture texture;
+    AssetPackShader shader;
+  };
+
+  std::string_view nameView() const;
+};
+
+static_assert(sizeof(AssetPackHeader) == 32);
+static_assert(sizeof(AssetPackEntry) == 128);
+static_assert(sizeof(Vertex) == 36, "mesh blobs store Vertex as is");
+
+// Read-only view of a pack file, memory mapped where the platform allows.
+// Opening validates the header and the table of contents and nothing else;
+// blob contents are only touched when uploaded.
+class AssetPack {
+public:
+  AssetPack() = default;
+  ~AssetPack();
+
+  AssetPack(const AssetPack &) = delete;
+  AssetPack &operator=(const AssetPack &) = delete;
+
+  bool open(std::string_view path);
+  void close();
+
+  std::span<const AssetPackEntry> entries() const { return toc; }
+  const AssetPackEntry *find(std::string_view name) const;
+  std::span<const std::uint8_t> data(const AssetPackEntry &entry) const;
+  std::string_view shaderSource(const AssetPackEntry &entry) const;
+  // Levels of detail of a mesh, at least one covering all its indices
+  std::vector<MeshLod> meshLods(const AssetPackEntry &entry) const;
+
+  // Fills `vbo` and `ibo` straight from the mapping. Leaves both bound.
+  bool uploadMesh(const AssetPackEntry &entry, GLuint vbo, GLuint ibo,
+                  GLenum usage = GL_STATIC_DRAW) const;
+  // Adds the mesh to `arena`, invalid if it is malformed or does not fit
+  ArenaMesh uploadMesh(const AssetPackEntry &entry,
+                       GeometryArena &arena) const;
+  // Uploads every level to the texture bound to `target`
+  bool uploadTexture(const AssetPackEntry &entry,
+                     GLenum target = GL_TEXTURE_2D) const;
+
+private:
+  const std::uint8_t *base = nullptr;
+  std::size_t size = 0;
+  std::span<const AssetPackEntry> toc;
+  // Backing storage where mmap is not available
+  std::vector<std::uint8_t> fallback;
+};
+
+// Builds pack files offline. Blobs are converted to their GL layout here,
+// once, instead of at every startup.
+class AssetPackWriter {
+public:
+  // 16-bit indices are chosen when every vertex is reachable with them.
+  // Strips mark restarts with stripRestartIndex. `lods` ranges index into
+  // `indices`, as generateLodChain produces them.
+  void addMesh(std::string_view name, std::span<const Vertex> vertices,
+               std::span<const std::uint32_t> indices,
+               GLenum primitiveMode = GL_TRIANGLES,
+               std::span<const MeshLod> lods = {});
+  // Levels as produced by generateMipChain, rows are flipped on the way
+  void addTexture(std::string_view name, std::span<const Image> levels);
+  void addCompressedTexture(std::string_view name,
+                            std::span<const CompressedImage> levels);
+  void addShader(std::string_view name, GLenum stage,
+                 std::string_view source);
+  void addBlob(std::string_view name, std::span<const std::uint8_t> bytes);
+
+  // Fails on duplicate or too long names
+  bool write(std::string_view path) const;
+
+private:
+  struct Pending {
+    AssetPackEntry entry;
+    std::vector<std::uint8_t> data;
+  };
+  Pending &add(std::string_view name, AssetKind kind);
+
+  std::vector<Pending> pending;
+  bool nameTooLong = false;
+};
+
+#endif
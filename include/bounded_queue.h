@@ -0,0 +1,85 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+// Lock-free bounded multi-producer multi-consumer queue (Vyukov).
+// Every slot carries a sequence number telling whether it is free for the
+// producer of a given lap or holds a value for the matching consumer.
+// `capacity` has to be a power of two.
+template <typename T> class BoundedQueue {
+public:
+  explicit BoundedQueue(std::size_t capacity)
+      : cells(new Cell[capacity]), mask(capacity - 1) {
+    for (std::size_t i = 0; i < capacity; i++) {
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  BoundedQueue(const BoundedQueue &) = delete;
+  BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+  // Returns false when the queue is full
+  template <typename U> bool push(U &&value) {
+    std::size_t pos = enqueuePos.load(std::memory_order_relaxed);
+    Cell *cell;
+    for (;;) {
+      cell = &cells[pos & mask];
+      std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<std::ptrdiff_t>(seq - pos);
+      if (diff == 0) {
+        if (enqueuePos.compare_exchange_weak(pos, pos + 1,
+                                             std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueuePos.load(std::memory_order_relaxed);
+      }
+    }
+    cell->value = std::forward<U>(value);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Returns false when the queue is empty
+  bool pop(T &value) {
+    std::size_t pos = dequeuePos.load(std::memory_order_relaxed);
+    Cell *cell;
+    for (;;) {
+      cell = &cells[pos & mask];
+      std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<std::ptrdiff_t>(seq - (pos + 1));
+      if (diff == 0) {
+        if (dequeuePos.compare_exchange_weak(pos, pos + 1,
+                                             std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = dequeuePos.load(std::memory_order_relaxed);
+      }
+    }
+    value = std::move(cell->value);
+    cell->sequence.store(pos + mask + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  struct Cell {
+    std::atomic<std::size_t> sequence;
+    T value;
+  };
+
+  std::unique_ptr<Cell[]> cells;
+  std::size_t mask;
+  alignas(64) std::atomic<std::size_t> enqueuePos = 0;
+  alignas(64) std::atomic<std::size_t> dequeuePos = 0;
+};
+
+#endif
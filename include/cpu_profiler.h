@@ -0,0 +1,79 @@
+#ifndef CPU_PROFILER_H
+#define CPU_PROFILER_H
+
+#include "trace.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Single producer, single consumer ring of finished zones. The owning
+// thread is the only writer of `head`, the collector the only writer of
+// `tail`, so neither side takes a lock.
+struct CpuZoneBuffer {
+  static constexpr std::uint32_t capacity = 1 << 14;
+
+  alignas(64) std::atomic<std::uint32_t> head = 0;
+  alignas(64) std::atomic<std::uint32_t> tail = 0;
+  std::atomic<std::uint64_t> dropped = 0;
+  std::uint32_t tid = 0;
+  std::uint32_t depth = 0;
+  TraceEvent records[capacity];
+};
+
+inline thread_local CpuZoneBuffer *currentCpuZoneBuffer = nullptr;
+
+// Registers the calling thread, buffers outlive their threads so zones
+// recorded right before a thread exits are still collected.
+CpuZoneBuffer *registerCpuZoneThread();
+
+struct CpuZone {
+  explicit CpuZone(const char *name) : name(name) {
+    buffer = currentCpuZoneBuffer;
+    if (buffer == nullptr) {
+      buffer = registerCpuZoneThread();
+    }
+    depth = buffer->depth++;
+    beginNs = traceNowNs();
+  }
+  ~CpuZone() {
+    std::uint64_t endNs = traceNowNs();
+    buffer->depth--;
+    std::uint32_t head = buffer->head.load(std::memory_order_relaxed);
+    std::uint32_t tail = buffer->tail.load(std::memory_order_acquire);
+    if (head - tail >= CpuZoneBuffer::capacity) {
+      buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    buffer->records[head % CpuZoneBuffer::capacity] = {name, beginNs, endNs,
+                                                       buffer->tid, depth};
+    buffer->head.store(head + 1, std::memory_order_release);
+  }
+
+  CpuZone(const CpuZone &) = delete;
+  CpuZone &operator=(const CpuZone &) = delete;
+
+  const char *name;
+  CpuZoneBuffer *buffer;
+  std::uint64_t beginNs;
+  std::uint32_t depth;
+};
+
+// Names the calling thread in exported traces
+void cpuProfilerSetThreadName(std::string name);
+
+// Drains every registered thread's buffer into `out`
+void cpuProfilerCollect(std::vector<TraceEvent> &out);
+std::vector<TraceThread> cpuProfilerThreads();
+std::uint64_t cpuProfilerDroppedZones();
+
+#ifdef GLSANDBOX_PROFILING
+#define CPU_ZONE_CONCAT_(a, b) a##b
+#define CPU_ZONE_CONCAT(a, b) CPU_ZONE_CONCAT_(a, b)
+#define CPU_ZONE(name) CpuZone CPU_ZONE_CONCAT(cpuZone, __LINE__)(name)
+#else
+#define CPU_ZONE(name) ((void)0)
+#endif
+
+#endif
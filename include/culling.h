@@ -0,0 +1,72 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include "thread_pool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Six normalized planes, xyz pointing inside, w the distance term
+struct Frustum {
+  glm::vec4 planes[6];
+};
+
+// Gribb and Hartmann extraction from a projection * view matrix, so the
+// planes are in whatever space the matrix takes points from
+Frustum extractFrustum(const glm::mat4 &viewProjection);
+
+// Non-owning structure of arrays view of `count` bounding volumes. Each
+// object has an axis aligned box (center and half extent) and a sphere
+// around the same center; it is culled when either lies fully outside a
+// plane, so the tighter of the two decides per plane.
+struct BoundsView {
+  const float *centerX;
+  const float *centerY;
+  const float *centerZ;
+  const float *extentX;
+  const float *extentY;
+  const float *extentZ;
+  const float *radius;
+  std::size_t count;
+};
+
+// Owning storage for a BoundsView, one array per component so eight
+// objects load with one instruction each
+class BoundsArrays {
+public:
+  // Box, enclosed by a sphere of radius length(extent)
+  std::uint32_t add(glm::vec3 center, glm::vec3 extent);
+  std::uint32_t addSphere(glm::vec3 center, float radius);
+  void set(std::uint32_t index, glm::vec3 center, glm::vec3 extent,
+           float radius);
+
+  void reserve(std::size_t count);
+  void clear();
+  std::size_t size() const { return centerX.size(); }
+  BoundsView view() const;
+
+  std::vector<float> centerX;
+  std::vector<float> centerY;
+  std::vector<float> centerZ;
+  std::vector<float> extentX;
+  std::vector<float> extentY;
+  std::vector<float> extentZ;
+  std::vector<float> radius;
+};
+
+// Writes `firstIndex + i` of every object intersecting the frustum to
+// `visible`, in order, and returns how many. `visible` needs room for
+// bounds.count entries; groups of eight are stored whole, so entries past
+// the returned count are clobbered. Uses AVX2 when the CPU has it.
+std::size_t cullFrustum(const Frustum &frustum, const BoundsView &bounds,
+                        std::uint32_t firstIndex, std::uint32_t *visible);
+
+// Same over all of `bounds`, split across `pool` when given. `visible`
+// ends up holding exactly the visible indices, ascending.
+void cullFrustum(const Frustum &frustum, const BoundsView &bounds,
+                 std::vector<std::uint32_t> &visible,
+                 ThreadPool *pool = nullptr);
+
+#endif
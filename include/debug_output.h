@@ -0,0 +1,62 @@
+#ifndef DEBUG_OUTPUT_H
+#define DEBUG_OUTPUT_H
+
+#include "bounded_queue.h"
+#include "glad/gl.h"
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+struct DebugOutputOptions {
+  // Messages less severe than this are disabled in the driver
+  GLenum minSeverity = GL_DEBUG_SEVERITY_LOW;
+  // GL_DEBUG_OUTPUT_SYNCHRONOUS makes messages point at the offending call
+  // in a debugger, at the cost of serializing the driver. Opt-in only.
+  bool synchronous = false;
+};
+
+struct DebugMessage {
+  GLenum source;
+  GLenum type;
+  GLuint id;
+  GLenum severity;
+  char text[256];
+};
+
+// KHR_debug output that never formats or writes from the driver callback.
+// The callback copies the message into a lock-free queue, a logging thread
+// formats it and folds repeats of the same (source, type, id) into a
+// count that is reported periodically and on shutdown.
+class DebugOutput {
+public:
+  explicit DebugOutput(const DebugOutputOptions &options = {});
+  ~DebugOutput();
+
+  DebugOutput(const DebugOutput &) = delete;
+  DebugOutput &operator=(const DebugOutput &) = delete;
+
+  // Messages lost because the queue was full
+  std::uint64_t droppedMessages() const {
+    return dropped.load(std::memory_order_relaxed);
+  }
+
+private:
+  static void GLAPIENTRY callback(GLenum source, GLenum type, GLuint id,
+                                  GLenum severity, GLsizei length,
+                                  const GLchar *message,
+                                  const void *userParam);
+  void logLoop();
+
+  BoundedQueue<DebugMessage> queue;
+  std::atomic<std::uint64_t> dropped = 0;
+  std::atomic<bool> running = true;
+  std::thread logThread;
+  bool installed = false;
+};
+
+// Reads DebugOutputOptions from GLSANDBOX_GL_DEBUG_SYNC and
+// GLSANDBOX_GL_DEBUG_SEVERITY (high, medium, low, notification)
+DebugOutputOptions debugOutputOptionsFromEnv();
+
+#endif
@@ -0,0 +1,273 @@
+#ifndef ECS_H
+#define ECS_H
+
+#include "thread_pool.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// Archetype entity storage.
+//
+// Entities with the same set of components share an archetype, which
+// keeps them in fixed size chunks with one array per component, each
+// array starting on a cache line. Queries walk chunks, not entities, so
+// the inner loops run over plain arrays and vectorize. Components must be
+// trivially copyable; they are moved around with memcpy.
+//
+// A component declaring `static constexpr bool splitFields = true` and
+// made of floats only is stored one field per array instead, for SIMD
+// code that wants eight entities' x in one load.
+
+constexpr std::size_t maxComponents = 64;
+constexpr std::size_t entityChunkBytes = 16 * 1024;
+
+using ComponentId = std::uint32_t;
+using ComponentMask = std::uint64_t;
+
+struct ComponentInfo {
+  std::uint32_t size;
+  std::uint32_t alignment;
+  // Float fields stored apart, 0 for components stored whole
+  std::uint32_t fields;
+};
+
+ComponentId registerComponent(const ComponentInfo &info);
+const ComponentInfo &componentInfo(ComponentId id);
+
+template <class T> constexpr std::uint32_t componentFields() {
+  if constexpr (requires { T::splitFields; }) {
+    static_assert(sizeof(T) % sizeof(float) == 0 &&
+                      alignof(T) == alignof(float),
+                  "split components are made of floats only");
+    return T::splitFields ? sizeof(T) / sizeof(float) : 0;
+  } else {
+    return 0;
+  }
+}
+
+template <class T> ComponentId componentId() {
+  if constexpr (!std::is_same_v<T, std::remove_cv_t<T>>) {
+    // const T is the same component, not a new one
+    return componentId<std::remove_cv_t<T>>();
+  } else {
+    static_assert(std::is_trivially_copyable_v<T>,
+                  "components are moved with memcpy");
+    static const ComponentId id =
+        registerComponent({sizeof(T), alignof(T), componentFields<T>()});
+    return id;
+  }
+}
+
+template <class... Ts> ComponentMask componentMask() {
+  return (ComponentMask(0) | ... | (ComponentMask(1) << componentId<Ts>()));
+}
+
+struct Entity {
+  std::uint32_t index;
+  // Bumped when the index is reused, so stale handles are detected
+  std::uint32_t generation;
+
+  bool operator==(const Entity &) const = default;
+};
+
+constexpr Entity noEntity = {0xFFFFFFFF, 0};
+
+struct alignas(64) EntityChunk {
+  std::byte data[entityChunkBytes];
+  std::uint32_t count = 0;
+};
+
+struct Archetype {
+  ComponentMask mask = 0;
+  std::vector<ComponentId> components;
+  // Byte offset of every component's array in a chunk, by ComponentId
+  std::array<std::uint32_t, maxComponents> offsets{};
+  // Entities per chunk, a multiple of eight
+  std::uint32_t capacity = 0;
+  // All full but the last
+  std::vector<std::unique_ptr<EntityChunk>> chunks;
+};
+
+// One chunk's component arrays
+class ChunkView {
+public:
+  ChunkView(const Archetype *archetype, EntityChunk *chunk)
+      : archetype(archetype), chunk(chunk) {}
+
+  std::size_t size() const { return chunk->count; }
+  std::size_t capacity() const { return archetype->capacity; }
+  const Entity *entities() const {
+    return reinterpret_cast<const Entity *>(chunk->data);
+  }
+
+  template <class T> bool has() const {
+    return archetype->mask & componentMask<T>();
+  }
+  // `T` must be in the archetype and not split
+  template <class T> T *array() const {
+    static_assert(componentFields<std::remove_cv_t<T>>() == 0,
+                  "split components are read with field()");
+    return reinterpret_cast<T *>(chunk->data +
+                                 archetype->offsets[componentId<T>()]);
+  }
+  // Array of the `field`th float of every entity's `T`
+  template <class T> float *field(std::size_t field) const {
+    static_assert(componentFields<std::remove_cv_t<T>>() != 0,
+                  "whole components are read with array()");
+    return reinterpret_cast<float *>(chunk->data +
+                                     archetype->offsets[componentId<T>()]) +
+           field * archetype->capacity;
+  }
+
+  template <class T> T get(std::size_t row) const {
+    T value;
+    if constexpr (componentFields<T>() == 0) {
+      value = array<T>()[row];
+    } else {
+      float fields[componentFields<T>()];
+      for (std::size_t f = 0; f < componentFields<T>(); f++) {
+        fields[f] = field<T>(f)[row];
+      }
+      std::memcpy(&value, fields, sizeof(T));
+    }
+    return value;
+  }
+  template <class T> void set(std::size_t row, const T &value) const {
+    if constexpr (componentFields<T>() == 0) {
+      array<T>()[row] = value;
+    } else {
+      float fields[componentFields<T>()];
+      std::memcpy(fields, &value, sizeof(T));
+      for (std::size_t f = 0; f < componentFields<T>(); f++) {
+        field<T>(f)[row] = fields[f];
+      }
+    }
+  }
+
+private:
+  const Archetype *archetype;
+  EntityChunk *chunk;
+};
+
+class World {
+public:
+  World() = default;
+  World(const World &) = delete;
+  World &operator=(const World &) = delete;
+
+  template <class... Ts> Entity create(const Ts &...components) {
+    static_assert(sizeof...(Ts) > 0, "entities need a component");
+    ComponentMask mask = componentMask<Ts...>();
+    Location location = allocate(mask);
+    ChunkView view = location.view();
+    (view.set<Ts>(location.row, components), ...);
+    return view.entities()[location.row];
+  }
+  // Fills the hole with the archetype's last entity, so chunks stay dense
+  void destroy(Entity entity);
+  bool alive(Entity entity) const;
+  std::size_t size() const { return entityCount; }
+
+  template <class T> bool has(Entity entity) const {
+    return locate(entity).view().has<T>();
+  }
+  // `entity` must be alive and have a `T`
+  template <class T> T get(Entity entity) const {
+    Location location = locate(entity);
+    return location.view().get<T>(location.row);
+  }
+  template <class T> void set(Entity entity, const T &value) {
+    Location location = locate(entity);
+    location.view().set<T>(location.row, value);
+  }
+
+  // Chunks of every archetype with at least the components in `include`,
+  // in a vector from `resource`
+  std::pmr::vector<ChunkView>
+  chunks(ComponentMask include,
+         std::pmr::memory_resource *resource =
+             std::pmr::get_default_resource()) const;
+  // Chunks are handed to `fn` in parallel when `pool` is given. Nothing
+  // may create or destroy entities meanwhile.
+  void forEachChunk(ComponentMask include,
+                    const std::function<void(const ChunkView &)> &fn,
+                    ThreadPool *pool = nullptr) const;
+  // fn(T &...) for every entity with all of `Ts`, inlined into one loop
+  // per chunk
+  template <class... Ts, class Fn> void each(Fn &&fn) const {
+    for (const ChunkView &chunk : chunks(componentMask<Ts...>())) {
+      std::tuple<Ts *...> arrays(chunk.array<Ts>()...);
+      std::size_t count = chunk.size();
+      for (std::size_t i = 0; i < count; i++) {
+        fn(std::get<Ts *>(arrays)[i]...);
+      }
+    }
+  }
+
+private:
+  struct Record {
+    std::uint32_t generation = 0;
+    std::uint32_t archetype = 0;
+    std::uint32_t chunk = 0;
+    std::uint32_t row = 0;
+  };
+  struct Location {
+    Archetype *archetype;
+    std::uint32_t chunk;
+    std::uint32_t row;
+
+    ChunkView view() const {
+      return ChunkView(archetype, archetype->chunks[chunk].get());
+    }
+  };
+
+  Location allocate(ComponentMask mask);
+  Location locate(Entity entity) const;
+  std::uint32_t archetypeFor(ComponentMask mask);
+
+  // Pointers so chunk views stay valid as archetypes are added
+  std::vector<std::unique_ptr<Archetype>> archetypes;
+  std::unordered_map<ComponentMask, std::uint32_t> archetypeIndex;
+  std::vector<Record> records;
+  std::vector<std::uint32_t> freeIndices;
+  std::size_t entityCount = 0;
+};
+
+// Runs systems with declared component access. Systems are kept in the
+// order added and grouped into phases: a system joins the current phase
+// unless it writes something the phase reads or writes, or reads
+// something the phase writes. The systems of a phase run concurrently,
+// phases one after the other.
+class SystemScheduler {
+public:
+  // `name` is not copied, use string literals
+  void add(const char *name, ComponentMask reads, ComponentMask writes,
+           std::function<void(World &)> run);
+  void run(World &world, ThreadPool *pool = nullptr);
+  std::size_t phaseCount() const { return phases.size(); }
+
+private:
+  struct System {
+    const char *name;
+    ComponentMask reads;
+    ComponentMask writes;
+    std::function<void(World &)> run;
+  };
+  struct Phase {
+    ComponentMask reads = 0;
+    ComponentMask writes = 0;
+    std::vector<System> systems;
+  };
+  std::vector<Phase> phases;
+};
+
+#endif
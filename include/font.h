@@ -0,0 +1,91 @@
+#ifndef FONT_H
+#define FONT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// Piece of a glyph outline in font units, y up. Lines have `curve` unset
+// and ignore `control`.
+struct OutlineSegment {
+  glm::vec2 from;
+  glm::vec2 control;
+  glm::vec2 to;
+  bool curve = false;
+};
+
+struct GlyphMetrics {
+  int advance = 0;
+  // Outline bounds, all 0 for empty glyphs such as the space
+  int xMin = 0;
+  int yMin = 0;
+  int xMax = 0;
+  int yMax = 0;
+};
+
+// TrueType font with glyf outlines, read from the file's bytes on demand.
+// Covers cmap formats 4 and 12, simple and composite glyphs and kern
+// format 0 pairs. CFF outlines, font collections and GPOS kerning are
+// not supported.
+//
+// The const members only read, so one Font may serve many threads.
+class Font {
+public:
+  bool decode(std::vector<std::uint8_t> data);
+  bool load(std::string_view path);
+
+  // 0, the missing glyph, if the font does not map `codepoint`
+  std::uint32_t glyphIndex(char32_t codepoint) const;
+  GlyphMetrics metrics(std::uint32_t glyph) const;
+  // Advance adjustment between two glyphs, in font units
+  int kerning(std::uint32_t left, std::uint32_t right) const;
+  // Appends the glyph's closed contours to `segments`. False if the glyph
+  // data is malformed.
+  bool outline(std::uint32_t glyph,
+               std::vector<OutlineSegment> &segments) const;
+
+  int unitsPerEm() const { return emUnits; }
+  // Above and below the baseline, descent is negative
+  int ascent() const { return ascender; }
+  int descent() const { return descender; }
+  int lineGap() const { return gap; }
+  std::uint32_t glyphCount() const { return glyphs; }
+
+private:
+  // Composite glyph component placement, x and y are the columns
+  struct Transform {
+    glm::vec2 x = glm::vec2(1.0f, 0.0f);
+    glm::vec2 y = glm::vec2(0.0f, 1.0f);
+    glm::vec2 offset = glm::vec2(0.0f);
+
+    glm::vec2 apply(glm::vec2 p) const { return x * p.x + y * p.y + offset; }
+  };
+
+  bool appendGlyph(std::uint32_t glyph, const Transform &transform,
+                   int depth, std::vector<OutlineSegment> &segments) const;
+  // Byte range of a glyph in glyf, empty for glyphs without outline
+  std::span<const std::uint8_t> glyphData(std::uint32_t glyph) const;
+
+  std::vector<std::uint8_t> data;
+  int emUnits = 0;
+  int ascender = 0;
+  int descender = 0;
+  int gap = 0;
+  std::uint32_t glyphs = 0;
+  std::uint32_t horizontalMetrics = 0;
+  bool longOffsets = false;
+  // Table offsets into data, 0 if absent
+  std::size_t hmtx = 0;
+  std::size_t loca = 0;
+  std::size_t glyf = 0;
+  std::size_t glyfLength = 0;
+  std::size_t cmap = 0;
+  std::uint16_t cmapFormat = 0;
+  std::size_t kernPairs = 0;
+  std::uint32_t kernPairCount = 0;
+};
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <type_traits>
+#include <vector>
+
+// Bump allocator. Allocating moves a cursor, freeing does nothing and
+// reset() forgets everything at once.
+//
+// Memory comes in blocks from the heap. An allocation that does not fit
+// the current block starts a larger one; the next reset() merges all
+// blocks into a single one as large as all of them, so a workload that
+// repeats, such as a frame, stops touching the heap after its first run.
+class LinearArena {
+public:
+  explicit LinearArena(std::size_t initialBytes = 64 << 10);
+
+  LinearArena(const LinearArena &) = delete;
+  LinearArena &operator=(const LinearArena &) = delete;
+
+  void *allocate(std::size_t bytes,
+                 std::size_t alignment = alignof(std::max_align_t));
+  // Uninitialized storage for `count` objects that need no destructor
+  template <class T> T *allocateArray(std::size_t count) {
+    static_assert(std::is_trivially_destructible_v<T>,
+                  "arena memory is reclaimed without running destructors");
+    return static_cast<T *>(allocate(count * sizeof(T), alignof(T)));
+  }
+  void reset();
+
+  std::size_t usedBytes() const { return used; }
+  std::size_t capacityBytes() const { return capacity; }
+  // Most bytes ever in use between two resets
+  std::size_t highWaterBytes() const { return highWater; }
+  // Blocks taken from the heap so far
+  std::uint64_t heapAllocations() const { return blockAllocations; }
+
+private:
+  struct Block {
+    std::unique_ptr<std::byte[]> data;
+    std::size_t size;
+  };
+
+  void addBlock(std::size_t minimumBytes);
+
+  std::vector<Block> blocks;
+  // Into blocks.back()
+  std::size_t cursor = 0;
+  std::size_t used = 0;
+  std::size_t capacity = 0;
+  std::size_t highWater = 0;
+  std::uint64_t blockAllocations = 0;
+};
+
+// std::pmr adapter, so standard containers can live in a LinearArena:
+//
+//   std::pmr::vector<std::uint32_t> rows(frameResource());
+//
+// Deallocation is a no-op; the memory comes back at the arena's reset().
+class LinearArenaResource : public std::pmr::memory_resource {
+public:
+  explicit LinearArenaResource(LinearArena &arena) : arena(&arena) {}
+
+private:
+  void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+    return arena->allocate(bytes, alignment);
+  }
+  void do_deallocate(void *, std::size_t, std::size_t) override {}
+  bool do_is_equal(const std::pmr::memory_resource &other)
+      const noexcept override {
+    return this == &other;
+  }
+
+  LinearArena *arena;
+};
+
+// Frame arenas: one pair of LinearArenas per thread, used on alternate
+// frames. An allocation made during frame N stays valid until the end of
+// frame N + 1, long enough for data built while updating one frame to be
+// consumed by the GPU submission of the next. Each thread resets its own
+// arena the first time it allocates in a frame, so threads never share an
+// arena and nothing takes a lock past the first use on a thread.
+struct FrameArenaThread {
+  LinearArena arenas[2];
+  LinearArenaResource resources[2] = {LinearArenaResource(arenas[0]),
+                                      LinearArenaResource(arenas[1])};
+  // The frame the thread last allocated in
+  std::uint64_t frame = 0;
+};
+
+inline std::atomic<std::uint64_t> frameArenaFrame = 0;
+inline thread_local FrameArenaThread *currentFrameArenaThread = nullptr;
+
+// Registers the calling thread. Arenas outlive their threads.
+FrameArenaThread *registerFrameArenaThread();
+
+// The calling thread's arena for the current frame
+inline LinearArena &frameArena() {
+  FrameArenaThread *thread = currentFrameArenaThread;
+  if (thread == nullptr) {
+    thread = registerFrameArenaThread();
+  }
+  std::uint64_t frame = frameArenaFrame.load(std::memory_order_acquire);
+  if (thread->frame != frame) {
+    // The other arena holds the previous frame, still in use; this one
+    // holds frame - 2 or older
+    thread->frame = frame;
+    thread->arenas[frame % 2].reset();
+  }
+  return thread->arenas[frame % 2];
+}
+
+// frameArena() as a memory resource
+inline std::pmr::memory_resource *frameResource() {
+  LinearArena &arena = frameArena();
+  FrameArenaThread *thread = currentFrameArenaThread;
+  return &thread->resources[&arena == &thread->arenas[0] ? 0 : 1];
+}
+
+// Starts the next frame. Called once a frame, by one thread, once no
+// other thread still allocates for the frame that ends.
+void frameArenaEndFrame();
+
+struct FrameArenaStats {
+  std::size_t threads = 0;
+  // By the current frame, over all threads
+  std::size_t usedBytes = 0;
+  // Summed over both arenas of every thread
+  std::size_t capacityBytes = 0;
+  std::size_t highWaterBytes = 0;
+  std::uint64_t heapAllocations = 0;
+};
+
+// Meant for between frames, while no other thread allocates
+FrameArenaStats frameArenaStats();
+
+#endif
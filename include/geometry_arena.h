@@ -0,0 +1,104 @@
+#ifndef GEOMETRY_ARENA_H
+#define GEOMETRY_ARENA_H
+
+#include "glad/gl.h"
+#include "gl_handles.h"
+#include "tlsf_allocator.h"
+#include "utility.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// A mesh's place in a GeometryArena
+struct ArenaMesh {
+  TlsfAllocation vertices;
+  TlsfAllocation indices;
+
+  bool valid() const { return vertices.valid(); }
+  std::uint32_t baseVertex() const { return vertices.offset; }
+  std::uint32_t firstIndex() const { return indices.offset; }
+  std::uint32_t indexCount() const { return indices.size; }
+};
+
+struct GeometryArenaStats {
+  TlsfStats vertices;
+  TlsfStats indices;
+};
+
+// Every mesh in one vertex buffer and one index buffer behind one VAO.
+//
+// Both buffers are allocated once at their full capacity and suballocated
+// with a TlsfAllocator, in vertices and indices. Indices stay relative to
+// their mesh and are offset by glDrawElementsBaseVertex at draw time, so a
+// mesh's data is uploaded as is and any number of meshes draw without
+// rebinding a VAO or buffer. Indices are always 32-bit so draws of
+// different meshes can share one glMultiDrawElementsBaseVertex.
+//
+// Freed ranges may be handed out again while earlier frames still draw
+// from them: the glBufferSubData that refills them is ordered after those
+// draws by the GL.
+class GeometryArena {
+public:
+  explicit GeometryArena(std::uint32_t vertexCapacity = 1 << 20,
+                         std::uint32_t indexCapacity = 4 << 20);
+
+  GeometryArena(const GeometryArena &) = delete;
+  GeometryArena &operator=(const GeometryArena &) = delete;
+
+  // Allocates and uploads a mesh, leaving the arena bound. Prints why and
+  // returns an invalid mesh if either buffer has no room left.
+  ArenaMesh add(std::span<const Vertex> vertices,
+                std::span<const std::uint32_t> indices);
+  // 16-bit indices are widened. In a GL_TRIANGLE_STRIP the 0xFFFF restart
+  // index becomes 0xFFFFFFFF; in a triangle list it is vertex 65535
+  ArenaMesh add(std::span<const Vertex> vertices,
+                std::span<const std::uint16_t> indices,
+                GLenum primitiveMode);
+  void remove(ArenaMesh &mesh);
+
+  // Binds the VAO every arena draw goes through
+  void bind() const;
+  // `firstIndex` counts from the start of the mesh's indices. The arena
+  // must be bound.
+  static void draw(GLenum mode, const ArenaMesh &mesh,
+                   std::uint32_t firstIndex, std::uint32_t indexCount);
+
+  GLuint vertexArray() const { return vao; }
+  GeometryArenaStats stats() const;
+
+private:
+  ArenaMesh allocate(std::size_t vertexCount, std::size_t indexCount);
+  void uploadVertices(const ArenaMesh &mesh,
+                      std::span<const Vertex> vertices);
+
+  GLVertexArray vao;
+  GLBuffer buffers[2];
+  TlsfAllocator vertexAllocator;
+  TlsfAllocator indexAllocator;
+  // Widening buffer for 16-bit indices
+  std::vector<std::uint32_t> widened;
+};
+
+// Draws of one primitive mode from a GeometryArena, submitted together
+// with one glMultiDrawElementsBaseVertex. Keeps its arrays between
+// submissions, so a steady frame does not allocate.
+class ArenaDrawList {
+public:
+  void add(const ArenaMesh &mesh, std::uint32_t firstIndex,
+           std::uint32_t indexCount);
+  void add(const ArenaMesh &mesh) { add(mesh, 0, mesh.indexCount()); }
+  // Draws everything added so far and starts over. The arena must be
+  // bound.
+  void submit(GLenum mode);
+
+  std::size_t size() const { return counts.size(); }
+
+private:
+  std::vector<GLsizei> counts;
+  std::vector<const void *> offsets;
+  std::vector<GLint> baseVertices;
+};
+
+#endif
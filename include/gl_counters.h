@@ -0,0 +1,39 @@
+#ifndef GL_COUNTERS_H
+#define GL_COUNTERS_H
+
+#include <cstdint>
+
+// Running totals of GL calls, counted in front of glad's entry points
+struct GLCounters {
+  // A multi-draw counts once, it is one call
+  std::uint64_t drawCalls = 0;
+  // Binds, enables and other fixed-function state calls
+  std::uint64_t stateChanges = 0;
+  // Data handed to buffer and texture uploads, and flushed mapped ranges.
+  // Unpack row padding is not counted.
+  std::uint64_t uploadBytes = 0;
+
+  GLCounters operator-(const GLCounters &other) const {
+    return {drawCalls - other.drawCalls, stateChanges - other.stateChanges,
+            uploadBytes - other.uploadBytes};
+  }
+};
+
+// Replaces glad's draw, state and upload entry points with counting
+// wrappers around the driver's. Call once after loading GL, on the GL
+// thread; calls made before are not counted.
+void installGLCounters();
+const GLCounters &glCounters();
+
+struct GpuMemoryInfo {
+  // False without GL_NVX_gpu_memory_info and GL_ATI_meminfo
+  bool available = false;
+  // 0 when the driver only tells what is free
+  std::uint64_t totalBytes = 0;
+  std::uint64_t freeBytes = 0;
+};
+
+// Asks the driver, which may take a while; not for every frame
+GpuMemoryInfo queryGpuMemory();
+
+#endif
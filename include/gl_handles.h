@@ -0,0 +1,149 @@
+#ifndef GL_HANDLES_H
+#define GL_HANDLES_H
+
+#include "glad/gl.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// GL object kinds named with glGen* and freed with glDelete*
+enum class GLObjectKind {
+  Buffer,
+  VertexArray,
+  Texture,
+  Framebuffer,
+  Renderbuffer,
+  Query,
+  Sampler,
+};
+constexpr std::size_t glObjectKindCount = 7;
+
+struct GLNamePoolStats {
+  // Names handed out and given back
+  std::uint64_t acquired = 0;
+  std::uint64_t released = 0;
+  // Driver calls made for them
+  std::uint64_t generateCalls = 0;
+  std::uint64_t deleteCalls = 0;
+};
+
+// Names of one object kind, generated and deleted in batches.
+//
+// A name from glGen* is only reserved; the object behind it is created
+// when the name is first bound, so spare names cost nothing to keep.
+// Released names are not reused, since their objects still hold storage
+// and state, but queued and deleted together once `batch` are waiting
+// or at flush().
+//
+// Pools are global, one per kind, and belong to the one GL context.
+class GLNamePool {
+public:
+  using GenerateFunction = void (*)(GLsizei count, GLuint *names);
+  using DeleteFunction = void (*)(GLsizei count, const GLuint *names);
+
+  GLNamePool(GenerateFunction generate, DeleteFunction destroy);
+
+  GLuint acquire();
+  // Makes sure the next `count` acquire() calls need no glGen* call,
+  // with at most one now
+  void reserve(std::size_t count);
+  void release(GLuint name);
+  // Deletes the queued names
+  void flush();
+  // Also deletes the spare names, before the context goes away
+  void clear();
+
+  GLNamePoolStats stats() const { return counters; }
+
+  static constexpr std::size_t batch = 64;
+
+private:
+  GenerateFunction generate;
+  DeleteFunction destroy;
+  std::vector<GLuint> spare;
+  std::vector<GLuint> released;
+  GLNamePoolStats counters;
+};
+
+GLNamePool &glNamePool(GLObjectKind kind);
+// Deletes every pool's queued names
+void flushGLNamePools();
+// Deletes all queued and spare names. Call while the context is current,
+// after the last handle is gone.
+void clearGLNamePools();
+// Summed over all kinds
+GLNamePoolStats glNamePoolStats();
+
+// Move-only owner of one GL object name, taken from the kind's pool and
+// given back to it on destruction. Converts to GLuint to pass to GL.
+template <GLObjectKind Kind> class GLHandle {
+public:
+  static constexpr GLObjectKind kind = Kind;
+
+  GLHandle() = default;
+  static GLHandle create() { return GLHandle(glNamePool(Kind).acquire()); }
+  ~GLHandle() { reset(); }
+
+  GLHandle(GLHandle &&other) noexcept : name(other.release()) {}
+  GLHandle &operator=(GLHandle &&other) noexcept {
+    if (this != &other) {
+      reset();
+      name = other.release();
+    }
+    return *this;
+  }
+  GLHandle(const GLHandle &) = delete;
+  GLHandle &operator=(const GLHandle &) = delete;
+
+  GLuint get() const { return name; }
+  operator GLuint() const { return name; }
+  explicit operator bool() const { return name != 0; }
+
+  // Gives the name back to the pool and leaves the handle empty
+  void reset() {
+    if (name != 0) {
+      glNamePool(Kind).release(name);
+      name = 0;
+    }
+  }
+  // Stops owning the name without deleting it
+  GLuint release() { return std::exchange(name, 0); }
+
+private:
+  explicit GLHandle(GLuint name) : name(name) {}
+
+  GLuint name = 0;
+};
+
+using GLBuffer = GLHandle<GLObjectKind::Buffer>;
+using GLVertexArray = GLHandle<GLObjectKind::VertexArray>;
+using GLTexture = GLHandle<GLObjectKind::Texture>;
+using GLFramebuffer = GLHandle<GLObjectKind::Framebuffer>;
+using GLRenderbuffer = GLHandle<GLObjectKind::Renderbuffer>;
+using GLQuery = GLHandle<GLObjectKind::Query>;
+using GLSampler = GLHandle<GLObjectKind::Sampler>;
+
+// Fills every empty handle in `handles`, an array or container of one
+// handle type, with at most one glGen* call
+template <class Handles> void createGLHandles(Handles &handles) {
+  using Handle = std::remove_cvref_t<decltype(*std::begin(handles))>;
+  std::size_t missing = 0;
+  for (const auto &handle : handles) {
+    missing += handle ? 0 : 1;
+  }
+  if (missing == 0) {
+    return;
+  }
+  glNamePool(Handle::kind).reserve(missing);
+  for (auto &handle : handles) {
+    if (!handle) {
+      handle = Handle::create();
+    }
+  }
+}
+
+#endif
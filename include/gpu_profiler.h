@@ -0,0 +1,97 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include "glad/gl.h"
+#include "gl_handles.h"
+#include "trace.h"
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+struct GpuScopeResult {
+  const char *name;
+  std::uint64_t beginNs;
+  std::uint64_t endNs;
+  std::uint32_t depth;
+};
+
+// Measures nested GPU scopes with GL_TIMESTAMP queries.
+//
+// Queries are taken from per-frame pools and read back `latencyFrames`
+// frames later, once the slot is about to be reused. Results that are
+// still not available at that point are dropped instead of stalling the
+// pipeline. Every scope is also pushed as a KHR_debug group so frame
+// debuggers show the same names.
+class GpuProfiler {
+public:
+  GpuProfiler(unsigned latencyFrames = 3, unsigned maxScopesPerFrame = 128);
+
+  GpuProfiler(const GpuProfiler &) = delete;
+  GpuProfiler &operator=(const GpuProfiler &) = delete;
+
+  void beginFrame();
+  void endFrame();
+
+  // `name` is not copied, use string literals
+  void pushScope(const char *name);
+  void popScope();
+
+  // Scopes of the most recently resolved frame, in submission order
+  const std::vector<GpuScopeResult> &lastFrame() const { return resolved; }
+  std::uint64_t lastFrameGpuNs() const { return resolvedFrameNs; }
+  std::uint64_t droppedFrames() const { return dropped; }
+
+  // Resolved scopes on the CPU timeline, kept until `maxTraceEvents`
+  const std::vector<TraceEvent> &traceEvents() const { return events; }
+  bool exportTrace(std::string_view path) const;
+
+  std::size_t maxTraceEvents = 1 << 20;
+
+private:
+  struct Scope {
+    const char *name;
+    std::uint32_t beginQuery;
+    std::uint32_t endQuery;
+    std::uint32_t depth;
+  };
+  struct Frame {
+    std::vector<GLQuery> queries;
+    std::vector<Scope> scopes;
+    std::uint32_t usedQueries = 0;
+    bool pending = false;
+  };
+
+  void resolve(Frame &frame);
+  void calibrate();
+  std::uint32_t timestamp(Frame &frame);
+
+  std::vector<Frame> frames;
+  std::vector<std::uint32_t> openScopes;
+  std::vector<GpuScopeResult> resolved;
+  std::vector<TraceEvent> events;
+  unsigned current = 0;
+  std::uint64_t frameCount = 0;
+  std::uint64_t resolvedFrameNs = 0;
+  std::uint64_t dropped = 0;
+  // cpuNs = gpuNs + gpuToCpuOffsetNs
+  std::int64_t gpuToCpuOffsetNs = 0;
+  bool debugGroups = false;
+  bool overflowReported = false;
+};
+
+struct GpuScope {
+  GpuScope(GpuProfiler &profiler, const char *name) : profiler(profiler) {
+    profiler.pushScope(name);
+  }
+  ~GpuScope() { profiler.popScope(); }
+
+  GpuProfiler &profiler;
+};
+
+#define GPU_SCOPE_CONCAT_(a, b) a##b
+#define GPU_SCOPE_CONCAT(a, b) GPU_SCOPE_CONCAT_(a, b)
+#define GPU_SCOPE(profiler, name)                                              \
+  GpuScope GPU_SCOPE_CONCAT(gpuScope, __LINE__)(profiler, name)
+
+#endif
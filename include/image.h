@@ -0,0 +1,27 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// 8-bit RGBA pixels, rows stored top to bottom
+struct Image {
+  int width = 0;
+  int height = 0;
+  std::vector<std::uint8_t> pixels;
+};
+
+bool decodeQoi(std::span<const std::uint8_t> data, Image &image);
+bool decodeTga(std::span<const std::uint8_t> data, Image &image);
+// Binary P5 (grayscale) and P6 (RGB) with maxval up to 255
+bool decodePpm(std::span<const std::uint8_t> data, Image &image);
+
+// Picks the decoder from the file's magic bytes
+bool decodeImage(std::span<const std::uint8_t> data, Image &image);
+bool loadImage(std::string_view path, Image &image);
+
+bool readFile(std::string_view path, std::vector<std::uint8_t> &data);
+
+#endif
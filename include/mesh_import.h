@@ -0,0 +1,44 @@
+#ifndef MESH_IMPORT_H
+#define MESH_IMPORT_H
+
+#include "glad/gl.h"
+#include "thread_pool.h"
+#include "utility.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// Indexed triangle list, every vertex unique
+struct Mesh {
+  std::vector<Vertex> vertices;
+  std::vector<std::uint32_t> indices;
+};
+
+// GL_UNSIGNED_SHORT when every vertex is reachable with 16 bits
+inline GLenum meshIndexType(std::size_t vertexCount) {
+  return vertexCount <= 0x10000 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+// Wavefront OBJ, positions and texture coordinates. The file is cut into
+// line-aligned chunks parsed on `pool`, polygons are fanned into triangles.
+bool importObj(std::span<const std::uint8_t> data, Mesh &mesh,
+               ThreadPool *pool = nullptr);
+// glTF 2.0 binary, every triangle primitive of every mesh merged in mesh
+// space. POSITION, TEXCOORD_0 and COLOR_0 are read.
+bool importGlb(std::span<const std::uint8_t> data, Mesh &mesh,
+               ThreadPool *pool = nullptr);
+// Picks the importer from the file's magic bytes
+bool importMesh(std::string_view path, Mesh &mesh, ThreadPool *pool = nullptr);
+
+// Builds `mesh` from an unindexed corner list, merging bitwise identical
+// vertices
+void weldVertices(std::span<const Vertex> corners, Mesh &mesh);
+
+// Parses a decimal float like strtof without needing a terminator.
+// Returns the end of the number, or `begin` when there is none.
+const char *parseFloat(const char *begin, const char *end, float &value);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef MESH_LOD_H
+#define MESH_LOD_H
+
+#include "mesh_import.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// One level of detail: a range of the mesh's index buffer. Every level
+// indexes the same vertices, so switching levels only changes the range
+// passed to glDrawElements.
+struct MeshLod {
+  std::uint32_t indexOffset;
+  std::uint32_t indexCount;
+  // Worst geometric deviation from level 0, in mesh units
+  float error;
+};
+
+struct LodOptions {
+  // Triangle count of each level relative to the one before
+  float ratio = 0.5f;
+  std::size_t minTriangles = 64;
+  unsigned maxLevels = 8;
+  // Simplification stops before any deviation beyond this fraction of
+  // the mesh's bounding radius
+  float maxError = 0.05f;
+};
+
+// Quadric error metric edge collapses onto existing vertices (Garland and
+// Heckbert), so all levels share the vertex buffer. Open borders only
+// collapse along themselves and texture seams stay put. Appends every
+// coarser level to mesh.indices, each cache-optimized, and describes the
+// chain in `lods`, level 0 being the original indices.
+void generateLodChain(Mesh &mesh, std::vector<MeshLod> &lods,
+                      const LodOptions &options = {});
+
+// Pixels covered by one mesh unit at `distance` from a perspective camera
+float lodPixelsPerUnit(float distance, float fovY, float viewportHeight);
+
+// Picks the coarsest level whose error projects to at most
+// `maxPixelError`. Coarser levels are only taken once they fit with a
+// `hysteresis` margin, so objects near a threshold do not flicker
+// between two levels every frame.
+std::uint32_t selectLod(std::span<const MeshLod> lods, float pixelsPerUnit,
+                        std::uint32_t current, float maxPixelError = 1.0f,
+                        float hysteresis = 0.25f);
+
+#endif
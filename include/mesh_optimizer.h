@@ -0,0 +1,78 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include "glad/gl.h"
+#include "mesh_import.h"
+#include "utility.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Index of primitive restart in 32-bit strips. Narrowed to 16 bits it
+// becomes 0xFFFF, which is why strips need one vertex of headroom.
+constexpr std::uint32_t stripRestartIndex = 0xFFFFFFFF;
+
+// Post-transform cache behaviour of an index buffer under a FIFO cache
+struct VertexCacheStats {
+  std::size_t triangles = 0;
+  // Vertex shader invocations
+  std::size_t transformed = 0;
+  // Average cache miss ratio, transformed per triangle. 0.5 is the
+  // ideal for large regular meshes, 3 is no reuse at all.
+  float acmr = 0.0f;
+  // Average transform to vertex ratio, 1 is ideal
+  float atvr = 0.0f;
+};
+
+// `mode` is GL_TRIANGLES or GL_TRIANGLE_STRIP with stripRestartIndex
+VertexCacheStats analyzeVertexCache(std::span<const std::uint32_t> indices,
+                                    std::size_t vertexCount,
+                                    unsigned cacheSize = 16,
+                                    GLenum mode = GL_TRIANGLES);
+
+enum class VertexCacheAlgorithm {
+  // Forsyth's scoring: cache position plus remaining valence. Good on any
+  // cache size.
+  Forsyth,
+  // Sander et al. fanning, tuned to `cacheSize`. Linear time, faster to
+  // run, cluster boundaries fall out for the overdraw pass.
+  Tipsify,
+};
+
+// Reorders triangles in place for post-transform cache reuse
+void optimizeVertexCache(std::span<std::uint32_t> indices,
+                         std::size_t vertexCount,
+                         VertexCacheAlgorithm algorithm =
+                             VertexCacheAlgorithm::Forsyth,
+                         unsigned cacheSize = 16);
+
+// Splits the cache-ordered triangles into clusters, as long as each stays
+// within `threshold` times its ACMR, and sorts the clusters so the
+// outward-facing ones draw first and occlude the rest
+void optimizeOverdraw(std::span<std::uint32_t> indices,
+                      std::span<const Vertex> vertices,
+                      float threshold = 1.05f, unsigned cacheSize = 16);
+
+// Renumbers vertices in order of first use so vertex fetch streams
+// through memory. Unreferenced vertices are dropped.
+void optimizeVertexFetch(Mesh &mesh);
+
+// Greedy strips over the triangle order as given, so run it after the
+// cache optimizations. Restarts are marked with stripRestartIndex and
+// need glPrimitiveRestartIndex, core since 3.1.
+void buildTriangleStrips(std::span<const std::uint32_t> indices,
+                         std::vector<std::uint32_t> &strip);
+
+struct MeshOptimizerOptions {
+  VertexCacheAlgorithm algorithm = VertexCacheAlgorithm::Forsyth;
+  unsigned cacheSize = 16;
+  // <= 0 skips the overdraw pass
+  float overdrawThreshold = 1.05f;
+};
+
+// Cache order, then overdraw, then fetch order
+void optimizeMesh(Mesh &mesh, const MeshOptimizerOptions &options = {});
+
+#endif
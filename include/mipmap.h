@@ -0,0 +1,42 @@
+#ifndef MIPMAP_H
+#define MIPMAP_H
+
+#include "glad/gl.h"
+#include "image.h"
+#include "thread_pool.h"
+
+#include <span>
+#include <vector>
+
+enum class MipFilter {
+  // 2x2 average, what glGenerateMipmap usually does
+  Box,
+  // Kaiser windowed sinc, 3 lobes, alpha 4. Sharp with little ringing.
+  Kaiser,
+  // Lanczos 3, sharpest, rings the most
+  Lanczos,
+};
+
+struct MipOptions {
+  MipFilter filter = MipFilter::Kaiser;
+  // Color channels are sRGB encoded and get filtered in linear light.
+  // Alpha is always linear.
+  bool srgb = true;
+  // When >= 0, alpha of every level is rescaled so the fraction of texels
+  // with alpha above this reference matches level 0. Keeps alpha-tested
+  // foliage and fences from thinning out in the distance.
+  float alphaCoverageReference = -1.0f;
+};
+
+// Fills `levels` with the full chain down to 1x1, levels[0] being a copy
+// of `base`. Level rows are filtered in parallel bands on `pool`, the
+// conversion back to 8 bits runs in parallel across levels.
+void generateMipChain(const Image &base, const MipOptions &options,
+                      std::vector<Image> &levels, ThreadPool *pool = nullptr);
+
+// Uploads every level to the bound texture and sets GL_TEXTURE_MAX_LEVEL.
+// Rows are flipped into GL order on the way.
+void uploadMipChain(GLenum target, std::span<const Image> levels,
+                    GLenum internalFormat = GL_RGBA8);
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef OCCLUSION_QUERIES_H
+#define OCCLUSION_QUERIES_H
+
+#include "glad/gl.h"
+#include "gl_handles.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+struct OcclusionStats {
+  // Drawn unconditionally as visible last time they were tested
+  std::size_t visible = 0;
+  // Of those, drawn inside a query to see whether they still are
+  std::size_t retested = 0;
+  // Proxy tested and drawn under conditional rendering
+  std::size_t conditional = 0;
+  // Conditional draws the GPU skipped, counted by collect() as their proxy
+  // results arrive, so a frame or two behind the others
+  std::size_t hidden = 0;
+};
+
+// GL_ANY_SAMPLES_PASSED occlusion culling with temporal coherence.
+//
+// Items visible at their last test are drawn first, unconditionally, and
+// serve as occluders. Every `retestInterval` frames one is drawn inside a
+// query instead, which tests it for free. The rest get their proxy (a
+// bounding box) drawn inside a query with color and depth writes off, and
+// their real draw gated on that query with conditional rendering, so the
+// CPU never waits on a result. Results are picked up whenever they have
+// arrived and decide the item's side next frame.
+class OcclusionQueries {
+public:
+  explicit OcclusionQueries(unsigned retestInterval = 8);
+
+  OcclusionQueries(const OcclusionQueries &) = delete;
+  OcclusionQueries &operator=(const OcclusionQueries &) = delete;
+
+  // One query per item; new items start out visible
+  void resize(std::size_t itemCount);
+  // Reads the results that are available, without waiting for the rest
+  void collect();
+
+  // Draws `items`, already frustum culled and ideally front to back.
+  // Callbacks bind whatever they need. Proxies are drawn without face
+  // culling, so a box around the camera still passes on its back faces.
+  template <class DrawProxy, class Draw>
+  void render(std::span<const std::uint32_t> items,
+              const DrawProxy &drawProxy, const Draw &draw) {
+    renderItems(items, ItemCallback(drawProxy), ItemCallback(draw));
+  }
+
+  bool visible(std::uint32_t item) const { return visibleItems[item]; }
+  const OcclusionStats &stats() const { return lastStats; }
+
+private:
+  // Borrows a callable for the length of render(); a std::function would
+  // allocate for most lambdas, every frame
+  class ItemCallback {
+  public:
+    template <class Fn>
+    explicit ItemCallback(const Fn &fn)
+        : fn(&fn), call([](const void *fn, std::uint32_t item) {
+            (*static_cast<const Fn *>(fn))(item);
+          }) {}
+
+    void operator()(std::uint32_t item) const { call(fn, item); }
+
+  private:
+    const void *fn;
+    void (*call)(const void *fn, std::uint32_t item);
+  };
+
+  void renderItems(std::span<const std::uint32_t> items,
+                   ItemCallback drawProxy, ItemCallback draw);
+  enum PendingQuery : std::uint8_t { notPending, retestQuery, proxyQuery };
+
+  void begin(std::uint32_t item, PendingQuery query);
+
+  unsigned retestInterval;
+  std::uint64_t frame = 0;
+  std::vector<GLQuery> queries;
+  std::vector<std::uint8_t> visibleItems;
+  std::vector<PendingQuery> pending;
+  std::vector<std::uint32_t> pendingItems;
+  std::vector<std::uint32_t> conditionalItems;
+  OcclusionStats lastStats;
+};
+
+#endif
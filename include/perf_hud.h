@@ -0,0 +1,51 @@
+#ifndef PERF_HUD_H
+#define PERF_HUD_H
+
+#include "gl_counters.h"
+#include "sdf_text.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Overlay of live frame numbers in the top-left corner: a graph of CPU
+// and GPU frame times, and the frame's draw calls, state changes, upload
+// bytes and GPU memory use.
+//
+// The call counts come from installGLCounters(), taken between two
+// draw() calls with the overlay's own calls left out. The overlay is
+// text, graph bars and panels in one TextBatch, so it adds one draw and
+// one streamed vertex upload to the frame.
+class PerfHud {
+public:
+  explicit PerfHud(const SdfFont &font, std::size_t historyFrames = 240);
+
+  bool valid() const { return batch.valid(); }
+
+  // Records the frame and draws the overlay. `cpuMs` is the CPU time of
+  // the frame so far, `gpuMs` the GPU time of the latest finished frame.
+  void draw(glm::vec2 viewportSize, double cpuMs, double gpuMs);
+
+  // Frames between GPU memory queries, which may stall some drivers
+  static constexpr std::uint64_t memoryQueryInterval = 30;
+
+private:
+  void addGraph(glm::vec2 origin, glm::vec2 size);
+
+  const SdfFont &font;
+  TextBatch batch;
+  TextLayoutCache labels;
+  TextRun valueRun;
+  std::vector<float> cpuHistory;
+  std::vector<float> gpuHistory;
+  // Oldest sample, where the next one goes
+  std::size_t next = 0;
+  std::uint64_t frame = 0;
+  // Totals after the previous overlay draw, and the frame's share
+  GLCounters measuredFrom;
+  GLCounters lastFrame;
+  GpuMemoryInfo memory;
+};
+
+#endif
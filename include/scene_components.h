@@ -0,0 +1,54 @@
+#ifndef SCENE_COMPONENTS_H
+#define SCENE_COMPONENTS_H
+
+#include "culling.h"
+#include "ecs.h"
+#include "transform_hierarchy.h"
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Node in the TransformHierarchy placing the entity
+struct Transform {
+  TransformId node;
+};
+
+// World space box and sphere, split so a chunk's bounds are a BoundsView
+struct Bounds {
+  float centerX;
+  float centerY;
+  float centerZ;
+  float extentX;
+  float extentY;
+  float extentZ;
+  float radius;
+
+  static constexpr bool splitFields = true;
+};
+
+struct Renderable {
+  // Index into whatever mesh table the renderer keeps
+  std::uint32_t mesh;
+};
+
+// Box of the local box `center` +- `extent` after `world`, with the
+// sphere around it
+Bounds transformBounds(const glm::mat4 &world, glm::vec3 center,
+                       glm::vec3 extent);
+
+BoundsView boundsView(const ChunkView &chunk);
+
+struct DrawInstance {
+  std::uint32_t mesh;
+  TransformId node;
+};
+
+// Frustum culls every entity with Transform, Bounds and Renderable chunk
+// by chunk, straight off the chunk arrays, and lists what survives in
+// chunk order
+void collectVisible(const World &world, const Frustum &frustum,
+                    std::vector<DrawInstance> &visible,
+                    ThreadPool *pool = nullptr);
+
+#endif
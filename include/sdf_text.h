@@ -0,0 +1,197 @@
+#ifndef SDF_TEXT_H
+#define SDF_TEXT_H
+
+#include "glad/gl.h"
+#include "font.h"
+#include "gl_handles.h"
+#include "texture_atlas.h"
+#include "thread_pool.h"
+#include "utility.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <glm/glm.hpp>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct SdfFontOptions {
+  // Em size the distance fields are rasterized at. Text stays sharp well
+  // past this size, only corners round off.
+  float pixelsPerEm = 48.0f;
+  // Distance in texels from the outline at which the field saturates
+  float spread = 6.0f;
+  int pageSize = 1024;
+  // Printable ASCII when empty
+  std::u32string codepoints;
+};
+
+// One glyph of an SdfFont. Lengths are in ems, y grows downwards from the
+// baseline.
+struct SdfGlyph {
+  // Quad corner relative to the pen position, and its size; 0 for glyphs
+  // with nothing to draw
+  glm::vec2 offset = glm::vec2(0.0f);
+  glm::vec2 size = glm::vec2(0.0f);
+  // Atlas rectangle, GL orientation: uvMax.y is the top of the glyph
+  glm::vec2 uvMin = glm::vec2(0.0f);
+  glm::vec2 uvMax = glm::vec2(0.0f);
+  float advance = 0.0f;
+};
+
+// Signed distance fields of a font's glyphs, packed into one atlas page.
+//
+// Each texel's alpha holds the distance to the nearest outline edge,
+// 0.5 on the edge and growing inwards, so the SDF shader can threshold it
+// with an antialiasing width matched to the screen scale. Glyphs are
+// rasterized in parallel on a ThreadPool.
+class SdfFont {
+public:
+  // Prints why and returns false if a glyph does not parse or the atlas
+  // page is too small
+  bool build(const Font &font, ThreadPool &pool,
+             const SdfFontOptions &options = {});
+  // Uploads the atlas, call on the GL thread before drawing. Changes the
+  // GL_TEXTURE_2D binding of the active texture unit.
+  void upload() { atlas->upload(); }
+  GLuint texture() const { return atlas->pageTexture(0); }
+
+  // Slot of a codepoint's glyph, that of the font's missing glyph if it
+  // was not built
+  std::uint32_t glyphSlot(char32_t codepoint) const;
+  const SdfGlyph &glyph(std::uint32_t slot) const { return glyphs[slot]; }
+  float kerning(std::uint32_t leftSlot, std::uint32_t rightSlot) const;
+
+  float ascent() const { return ascender; }
+  float lineHeight() const { return lineAdvance; }
+  // Inside a block that is entirely covered, for drawing solid rectangles
+  // in the same batch as text
+  glm::vec2 solidTexCoord() const { return solid; }
+
+private:
+  std::unique_ptr<TextureAtlas> atlas;
+  // Slot 0 is the missing glyph
+  std::vector<SdfGlyph> glyphs;
+  std::array<std::uint32_t, 128> asciiSlots = {};
+  std::unordered_map<char32_t, std::uint32_t> otherSlots;
+  // Keyed by left slot << 32 | right slot, nonzero pairs only
+  std::unordered_map<std::uint64_t, float> kerningPairs;
+  float ascender = 0.0f;
+  float lineAdvance = 0.0f;
+  glm::vec2 solid = glm::vec2(0.0f);
+};
+
+// Quad of a laid out glyph, in ems from the top-left of the run, y down
+struct TextQuad {
+  glm::vec2 min;
+  glm::vec2 max;
+  std::uint32_t slot;
+};
+
+struct TextRun {
+  std::vector<TextQuad> quads;
+  // Widest line by the lines' total height, in ems
+  glm::vec2 size = glm::vec2(0.0f);
+};
+
+// Shapes UTF-8 `text` into `run`, reusing its storage: glyph lookup,
+// advances and kerning, and a new line at every '\n'
+void layoutText(const SdfFont &font, std::string_view text, TextRun &run);
+
+// Shaped runs by their text, so labels that repeat every frame are laid
+// out once. Runs a few frames unused are dropped by endFrame().
+//
+// Text that changes every frame, such as a counter, gains nothing from
+// the cache and would fill it; lay it out with layoutText() instead.
+class TextLayoutCache {
+public:
+  explicit TextLayoutCache(const SdfFont &font, unsigned keepFrames = 120);
+
+  // Valid until the run is evicted. Lookups do not allocate.
+  const TextRun &layout(std::string_view text);
+  void endFrame();
+
+  std::size_t size() const { return runs.size(); }
+  std::uint64_t hits() const { return hitCount; }
+  std::uint64_t misses() const { return missCount; }
+
+private:
+  struct Hash {
+    using is_transparent = void;
+    std::size_t operator()(std::string_view text) const {
+      return std::hash<std::string_view>()(text);
+    }
+  };
+  struct Entry {
+    TextRun run;
+    std::uint64_t lastUse = 0;
+  };
+
+  const SdfFont &font;
+  unsigned keepFrames;
+  std::uint64_t frame = 0;
+  std::unordered_map<std::string, Entry, Hash, std::equal_to<>> runs;
+  std::uint64_t hitCount = 0;
+  std::uint64_t missCount = 0;
+};
+
+// Text and solid rectangles of one SdfFont as quads of Vertex, drawn with
+// one glDrawElements. Positions are in pixels from the top-left corner of
+// the viewport.
+//
+// The vertices are streamed into an orphaned buffer every draw, the
+// indices are a fixed quad pattern uploaded again only when the batch
+// outgrows them. Keeps its arrays between draws, so a steady frame does
+// not allocate.
+class TextBatch {
+public:
+  explicit TextBatch(const SdfFont &font);
+  ~TextBatch();
+
+  TextBatch(const TextBatch &) = delete;
+  TextBatch &operator=(const TextBatch &) = delete;
+
+  // False if the SDF shader did not compile
+  bool valid() const { return program != 0; }
+
+  // `pixelSize` is the em size on screen
+  void add(const TextRun &run, glm::vec2 position, float pixelSize,
+           glm::vec4 color);
+  void add(std::string_view text, glm::vec2 position, float pixelSize,
+           glm::vec4 color);
+  void addRect(glm::vec2 min, glm::vec2 max, glm::vec4 color);
+  // Room for batches of up to `quads` quads without allocating
+  void reserve(std::size_t quads);
+
+  // Draws everything added so far and starts over. Binds its own VAO,
+  // program and texture on unit 0, blends, and leaves depth testing and
+  // blending disabled.
+  void draw(glm::vec2 viewportSize);
+
+  std::size_t quadCount() const { return vertices.size() / 4; }
+  // Vertex and index bytes the last draw uploaded
+  std::size_t lastUploadBytes() const { return uploadBytes; }
+
+private:
+  void addQuad(glm::vec2 min, glm::vec2 max, glm::vec2 uvMin,
+               glm::vec2 uvMax, glm::vec4 color);
+
+  const SdfFont &font;
+  GLuint program = 0;
+  GLint viewportSizeLocation = -1;
+  GLVertexArray vao;
+  GLBuffer vbo;
+  GLBuffer ibo;
+  std::size_t vertexCapacity = 0;
+  std::size_t indexQuads = 0;
+  std::vector<Vertex> vertices;
+  std::vector<std::uint32_t> indices;
+  TextRun scratch;
+  std::size_t uploadBytes = 0;
+};
+
+#endif
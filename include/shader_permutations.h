@@ -0,0 +1,63 @@
+#ifndef SHADER_PERMUTATIONS_H
+#define SHADER_PERMUTATIONS_H
+
+#include "glad/gl.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Bit i set enables the i-th feature of a ShaderPermutations
+using ShaderFeatures = std::uint32_t;
+
+// `source` with a `#define` for every feature set in `features` inserted
+// after its #version line, or at the start without one
+std::string injectShaderDefines(std::string_view source,
+                                std::span<const std::string> featureNames,
+                                ShaderFeatures features);
+
+// Programs compiled from one vertex and fragment source, one variant per
+// combination of features.
+//
+// Features are compile time switches: the sources test them with #ifdef,
+// so each variant carries only its own code and no uniform branches.
+// Variants are compiled the first time they are asked for and cached,
+// failures included, so a broken variant is reported once.
+class ShaderPermutations {
+public:
+  // `setup` runs on every newly linked variant, e.g. to bind uniform
+  // blocks; returning false discards the variant
+  ShaderPermutations(std::string name, std::string vertexSource,
+                     std::string fragmentSource,
+                     std::vector<std::string> featureNames,
+                     std::function<bool(GLuint)> setup = nullptr);
+  ~ShaderPermutations();
+
+  ShaderPermutations(const ShaderPermutations &) = delete;
+  ShaderPermutations &operator=(const ShaderPermutations &) = delete;
+
+  // 0 if the variant failed to compile or link
+  GLuint program(ShaderFeatures features);
+
+  std::size_t variantCount() const { return std::size_t(1) << features.size(); }
+  std::size_t compiledCount() const { return compiled; }
+  // Lists the compiled variants by feature names
+  void report(std::ostream &out) const;
+
+private:
+  std::string name;
+  std::string vertexSource;
+  std::string fragmentSource;
+  std::vector<std::string> features;
+  std::function<bool(GLuint)> setup;
+  std::unordered_map<ShaderFeatures, GLuint> variants;
+  std::size_t compiled = 0;
+};
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef SOFTWARE_OCCLUSION_H
+#define SOFTWARE_OCCLUSION_H
+
+#include "culling.h"
+#include "thread_pool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <span>
+#include <vector>
+
+struct SoftwareOcclusionStats {
+  // Occluder triangles left after clipping and back face culling
+  std::size_t triangles = 0;
+  std::size_t tested = 0;
+  std::size_t occluded = 0;
+};
+
+// Depth only software rasterizer for occlusion culling on the CPU.
+//
+// Occluders are drawn at low resolution into a depth buffer split into
+// tiles. Triangles are set up in parallel, binned to the tiles they
+// touch, and every tile is rasterized by one job, eight pixels at a time
+// with AVX2 where available. Each tile keeps its farthest depth as the
+// coarse level of a hierarchical Z buffer. Bounds are tested against the
+// coarse level first and against pixels only in tiles it cannot decide,
+// all within the frame, so nothing waits on the GPU.
+//
+// Occluders are closed meshes with counter-clockwise front faces, like
+// GL's default. Depth is NDC z, smaller is nearer.
+class SoftwareOcclusion {
+public:
+  static constexpr int tileWidth = 32;
+  static constexpr int tileHeight = 16;
+
+  // Rounded up to whole tiles
+  explicit SoftwareOcclusion(int width = 256, int height = 128);
+
+  int width() const { return bufferWidth; }
+  int height() const { return bufferHeight; }
+
+  // Drops the previous frame's occluders
+  void begin(const glm::mat4 &viewProjection);
+  // `vertices` and `indices` must stay alive until render()
+  void addOccluder(std::span<const glm::vec3> vertices,
+                   std::span<const std::uint32_t> indices,
+                   const glm::mat4 &world);
+  // Rasterizes every occluder, in parallel when `pool` is given
+  void render(ThreadPool *pool = nullptr);
+
+  // Whether any part of the box may be in front of the occluders. Boxes
+  // crossing the near plane always are.
+  bool visible(glm::vec3 center, glm::vec3 extent) const;
+  // Removes the occluded boxes from `candidates`, indices into `bounds`
+  void cull(const BoundsView &bounds, std::vector<std::uint32_t> &candidates,
+            ThreadPool *pool = nullptr);
+
+  // Row major, bottom row first, like glReadPixels
+  const std::vector<float> &depth() const { return depthBuffer; }
+  const SoftwareOcclusionStats &stats() const { return frameStats; }
+
+private:
+  struct Occluder {
+    std::span<const glm::vec3> vertices;
+    std::span<const std::uint32_t> indices;
+    glm::mat4 world;
+  };
+  // Screen space triangle, ready to rasterize
+  struct Triangle {
+    // Edge i is edgeA[i] * (x - edgeX[i]) + edgeB[i] * (y - edgeY[i]),
+    // positive inside
+    float edgeA[3];
+    float edgeB[3];
+    float edgeX[3];
+    float edgeY[3];
+    // Depth is depthZ + depthDx * (x - depthX) + depthDy * (y - depthY)
+    float depthZ;
+    float depthDx;
+    float depthDy;
+    float depthX;
+    float depthY;
+    // Pixel bounds, inclusive and clamped to the buffer
+    int minX;
+    int minY;
+    int maxX;
+    int maxY;
+  };
+
+  void setupTriangle(const glm::vec4 &a, const glm::vec4 &b,
+                     const glm::vec4 &c, std::vector<Triangle> &out) const;
+  void setupOccluder(const Occluder &occluder,
+                     std::vector<Triangle> &out) const;
+  void rasterizeTile(int tile);
+
+  int bufferWidth;
+  int bufferHeight;
+  int tilesX;
+  int tilesY;
+  glm::mat4 viewProjection{1.0f};
+  std::vector<float> depthBuffer;
+  // Farthest depth in every tile
+  std::vector<float> tileMaxDepth;
+  std::vector<Occluder> occluders;
+  // Set up triangles of every parallelFor chunk, then all of them
+  std::vector<std::vector<Triangle>> chunkTriangles;
+  std::vector<Triangle> triangles;
+  // Triangles touching tile t are binEntries[binStarts[t], binStarts[t + 1])
+  std::vector<std::uint32_t> binStarts;
+  std::vector<std::uint32_t> binCursors;
+  std::vector<std::uint32_t> binEntries;
+  std::vector<std::uint8_t> occludedFlags;
+  SoftwareOcclusionStats frameStats;
+};
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef TEXTURE_ATLAS_H
+#define TEXTURE_ATLAS_H
+
+#include "glad/gl.h"
+#include "gl_handles.h"
+#include "image.h"
+#include "utility.h"
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <span>
+#include <vector>
+
+using AtlasEntry = std::uint32_t;
+constexpr AtlasEntry invalidAtlasEntry = UINT32_MAX;
+
+struct AtlasRegion {
+  int page = -1;
+  // Texel rectangle of the image itself, padding excluded. GL orientation,
+  // y grows upwards.
+  int x = 0;
+  int y = 0;
+  int width = 0;
+  int height = 0;
+  glm::vec2 uvMin;
+  glm::vec2 uvMax;
+};
+
+// Packs many small images into a few RGBA8 page textures with a skyline
+// packer. Every image is surrounded by `padding` texels of its own
+// extruded edge so linear filtering does not bleed into neighbours.
+//
+// Source images are kept on the CPU. When an insertion does not fit, all
+// live images are repacked tallest first, which reclaims holes left by
+// remove(). A successful repack changes generation(), telling callers to
+// remap their texture coordinates.
+class TextureAtlas {
+public:
+  TextureAtlas(int pageSize = 2048, int padding = 2, int maxPages = 4);
+
+  TextureAtlas(const TextureAtlas &) = delete;
+  TextureAtlas &operator=(const TextureAtlas &) = delete;
+
+  // Returns invalidAtlasEntry if the image does not fit even after
+  // repacking
+  AtlasEntry insert(Image image);
+  void remove(AtlasEntry entry);
+
+  const AtlasRegion &region(AtlasEntry entry) const {
+    return entries[entry].region;
+  }
+  // Maps a texture coordinate of the source image into the atlas page
+  glm::vec2 atlasTexCoord(AtlasEntry entry, glm::vec2 uv) const {
+    const AtlasRegion &r = entries[entry].region;
+    return r.uvMin + (r.uvMax - r.uvMin) * uv;
+  }
+  // Rewrites image-local texCoords of a sprite's vertices in place
+  void remapTexCoords(AtlasEntry entry, std::span<Vertex> vertices) const;
+
+  // Uploads pending images, call on the GL thread before drawing. Changes
+  // the GL_TEXTURE_2D binding of the active texture unit.
+  void upload();
+
+  GLuint pageTexture(int page) const { return pages[page].texture; }
+  int pageCount() const { return pages.size(); }
+  std::uint32_t generation() const { return currentGeneration; }
+  // Fraction of allocated page area covered by live images and padding
+  float occupancy() const;
+
+private:
+  struct Segment {
+    int x;
+    int y;
+    int width;
+  };
+  struct Page {
+    std::vector<Segment> skyline;
+    GLTexture texture;
+  };
+  struct Entry {
+    Image image;
+    AtlasRegion region;
+    bool live = false;
+    bool dirty = false;
+  };
+
+  bool place(Entry &entry);
+  bool placeOnPage(int pageIndex, Entry &entry);
+  void addPage();
+  // Repacks live entries plus `extra`, leaves everything as it was if
+  // they do not fit
+  bool repack(AtlasEntry extra);
+
+  std::vector<Page> pages;
+  std::vector<Entry> entries;
+  std::vector<AtlasEntry> freeEntries;
+  std::vector<std::uint8_t> tile;
+  int pageSize;
+  int padding;
+  int maxPages;
+  std::uint32_t currentGeneration = 0;
+};
+
+#endif
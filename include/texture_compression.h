@@ -0,0 +1,67 @@
+#ifndef TEXTURE_COMPRESSION_H
+#define TEXTURE_COMPRESSION_H
+
+#include "glad/gl.h"
+#include "image.h"
+#include "thread_pool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// S3TC is an extension (EXT_texture_compression_s3tc), our loader only
+// carries core 3.3 enums. RGTC (BC4/BC5) is core since 3.0.
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+enum class BlockFormat {
+  BC1, // RGB, 8 bytes per 4x4 block
+  BC3, // RGBA, 16 bytes
+  BC4, // R, 8 bytes
+  BC5, // RG, 16 bytes
+};
+
+enum class CompressionQuality {
+  // Bounding box endpoints
+  Fast,
+  // Principal axis endpoints
+  Normal,
+  // Principal axis plus least-squares endpoint refinement, and both BC4
+  // interpolation modes tried
+  High,
+};
+
+// Blocks are stored in GL row order: the first block row holds the bottom
+// four rows of the source image, the same orientation the other upload
+// paths produce.
+struct CompressedImage {
+  BlockFormat format = BlockFormat::BC1;
+  int width = 0;
+  int height = 0;
+  std::vector<std::uint8_t> data;
+};
+
+const char *blockFormatName(BlockFormat format);
+std::size_t blockFormatBlockSize(BlockFormat format);
+GLenum blockFormatInternalFormat(BlockFormat format);
+// BC4/BC5 are always available on 3.3, BC1/BC3 need the S3TC extension
+bool blockFormatSupported(BlockFormat format);
+
+// Blocks are encoded in parallel on `pool` when one is given
+void compressImage(const Image &image, BlockFormat format,
+                   CompressionQuality quality, CompressedImage &out,
+                   ThreadPool *pool = nullptr);
+void decompressImage(const CompressedImage &compressed, Image &out);
+
+// Peak signal-to-noise ratio over the channels the format stores
+double compressionPsnr(const Image &original, const Image &decoded,
+                       BlockFormat format);
+
+void uploadCompressedImage(GLenum target, GLint level,
+                           const CompressedImage &compressed);
+
+#endif
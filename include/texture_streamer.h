@@ -0,0 +1,103 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include "glad/gl.h"
+#include "gl_handles.h"
+#include "image.h"
+#include "mipmap.h"
+#include "thread_pool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+using TextureHandle = std::uint32_t;
+
+// Loads textures without stalling the frame.
+//
+// Files are read and decoded on the thread pool. The GL thread then
+// uploads decoded rows through a ring of pixel unpack buffers, spending at
+// most `uploadBudgetBytes` per update(). Until a texture is fully uploaded
+// texture() returns a shared 1x1 placeholder, so callers can bind the
+// result unconditionally.
+//
+// With `mips` set, the decode job also builds the mip chain on the CPU
+// and every level goes through the same budgeted upload.
+class TextureStreamer {
+public:
+  TextureStreamer(ThreadPool &pool, std::size_t uploadBudgetBytes = 4 << 20,
+                  std::optional<MipOptions> mips = std::nullopt);
+
+  TextureStreamer(const TextureStreamer &) = delete;
+  TextureStreamer &operator=(const TextureStreamer &) = delete;
+
+  TextureHandle load(std::string path);
+
+  GLuint texture(TextureHandle handle) const {
+    GLuint name = entries[handle].texture;
+    return name != 0 ? name : placeholder;
+  }
+  bool isResident(TextureHandle handle) const {
+    return entries[handle].texture != 0;
+  }
+  // Size of the decoded image, 0x0 until decoding finished
+  int width(TextureHandle handle) const { return entries[handle].width; }
+  int height(TextureHandle handle) const { return entries[handle].height; }
+
+  // Call once per frame on the GL thread. Changes the GL_TEXTURE_2D
+  // binding of the active texture unit.
+  void update();
+
+  std::size_t pendingCount() const { return pending; }
+  std::size_t uploadedBytesLastUpdate() const { return uploadedBytes; }
+
+private:
+  struct Decoded {
+    TextureHandle handle;
+    bool ok;
+    std::vector<Image> levels;
+  };
+  // Shared with in-flight decode jobs, which may finish after the streamer
+  // is gone
+  struct Inbox {
+    std::mutex mutex;
+    std::deque<Decoded> decoded;
+  };
+  struct Entry {
+    GLTexture texture;
+    GLTexture staging;
+    int width = 0;
+    int height = 0;
+    int uploadLevel = 0;
+    int uploadedRows = 0;
+    std::vector<Image> levels;
+  };
+  struct Chunk {
+    TextureHandle handle;
+    int level;
+    int firstRow;
+    int rowCount;
+    std::size_t offset;
+  };
+
+  ThreadPool &pool;
+  std::shared_ptr<Inbox> inbox;
+  std::vector<Entry> entries;
+  // Decoded textures waiting for upload, front one is partially uploaded
+  std::deque<TextureHandle> uploadQueue;
+  std::vector<Chunk> chunks;
+  GLBuffer pbos[3];
+  unsigned nextPbo = 0;
+  GLTexture placeholder;
+  std::size_t uploadBudget;
+  std::optional<MipOptions> mips;
+  std::size_t pending = 0;
+  std::size_t uploadedBytes = 0;
+};
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+class ThreadPool {
+public:
+  // 0 picks std::thread::hardware_concurrency() - 1, leaving a core for
+  // the GL thread
+  explicit ThreadPool(unsigned threadCount = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  void submit(std::function<void()> job);
+
+  // Calls fn(begin, end) over [0, count) in chunks of at most `grain`
+  // and returns once all chunks ran. The calling thread takes chunks as
+  // well, so this is safe to call from inside a job. Nothing is
+  // allocated: the fork lives on the caller's stack until it returns.
+  template <class Fn>
+  void parallelFor(std::size_t count, std::size_t grain, Fn &&fn) {
+    using Callable = std::remove_reference_t<Fn>;
+    forkJoin(count, grain,
+             [](void *context, std::size_t begin, std::size_t end) {
+               (*static_cast<Callable *>(context))(begin, end);
+             },
+             const_cast<void *>(static_cast<const void *>(&fn)));
+  }
+
+  unsigned size() const { return workers.size(); }
+
+private:
+  using ChunkFn = void (*)(void *context, std::size_t begin,
+                           std::size_t end);
+
+  // One parallelFor call, queued until enough helpers joined it
+  struct Fork {
+    ChunkFn run;
+    void *context;
+    std::size_t count;
+    std::size_t grain;
+    std::atomic<std::size_t> next = 0;
+    // Helpers wanted, and those that joined, under `mutex`
+    std::size_t helpers;
+    std::size_t joined = 0;
+    // Helpers still touching the fork
+    std::atomic<std::size_t> active = 0;
+    Fork *older = nullptr;
+    Fork *newer = nullptr;
+  };
+
+  void forkJoin(std::size_t count, std::size_t grain, ChunkFn run,
+                void *context);
+  static void runChunks(Fork &fork);
+  void unlink(Fork &fork);
+  void workerLoop(unsigned index);
+
+  std::mutex mutex;
+  std::condition_variable wake;
+  // Workers past their allocating setup, under `mutex`
+  unsigned started = 0;
+  std::condition_variable allStarted;
+  std::deque<std::function<void()>> jobs;
+  // Forks waiting for helpers, joined oldest first
+  Fork *oldestFork = nullptr;
+  Fork *newestFork = nullptr;
+  std::vector<std::thread> workers;
+  bool stopping = false;
+};
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef TLSF_ALLOCATOR_H
+#define TLSF_ALLOCATOR_H
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+struct TlsfAllocation {
+  static constexpr std::uint32_t none = 0xFFFFFFFF;
+
+  std::uint32_t offset = 0;
+  std::uint32_t size = 0;
+  // Handed back to free()
+  std::uint32_t block = none;
+
+  bool valid() const { return block != none; }
+};
+
+struct TlsfStats {
+  std::uint64_t capacity = 0;
+  std::uint64_t usedUnits = 0;
+  std::uint64_t freeUnits = 0;
+  std::uint32_t allocations = 0;
+  std::uint32_t freeBlocks = 0;
+  std::uint64_t largestFree = 0;
+  // 0 when all free space is one block, towards 1 as it splinters
+  float fragmentation = 0.0f;
+};
+
+// Two-level segregated fit allocator (Masset et al.) over a range of
+// `capacity` abstract units, such as vertices in a GL buffer.
+//
+// Free blocks sit in lists by size class: a power of two, split into 16
+// linear steps. Two levels of bitmaps find a list holding a block at
+// least as large as asked for with a few bit scans, so allocate() and
+// free() run in constant time whatever the number of blocks. Freed
+// blocks merge with free neighbours at once. Rounding requests up to a
+// whole class can miss a block that would just fit, so only when that
+// fails is the request's own list searched.
+//
+// Block headers live in a side table rather than in the managed range,
+// which is never touched and may well be GPU memory.
+class TlsfAllocator {
+public:
+  explicit TlsfAllocator(std::uint32_t capacity);
+
+  // Invalid if no free block is large enough
+  TlsfAllocation allocate(std::uint32_t size);
+  void free(TlsfAllocation &allocation);
+
+  std::uint32_t capacity() const { return totalSize; }
+  TlsfStats stats() const;
+
+private:
+  static constexpr unsigned slLog2 = 4;
+  static constexpr unsigned slCount = 1 << slLog2;
+  static constexpr unsigned flCount = 32;
+
+  struct Block {
+    std::uint32_t offset;
+    std::uint32_t size;
+    // Neighbours in the range, by offset
+    std::uint32_t prevPhysical;
+    std::uint32_t nextPhysical;
+    // Neighbours in the free list of the block's size class
+    std::uint32_t prevFree;
+    std::uint32_t nextFree;
+    bool free;
+  };
+
+  // Size class of `size` units: fl picks the power of two, sl one of its
+  // slCount linear steps. Sizes below slCount get a list each.
+  static void mapping(std::uint64_t size, unsigned &fl, unsigned &sl);
+  std::uint32_t newBlock(std::uint32_t offset, std::uint32_t size);
+  void releaseBlock(std::uint32_t block);
+  void insertFree(std::uint32_t block);
+  void removeFree(std::uint32_t block);
+  // The first list whose blocks all hold at least `size` units
+  bool findFree(std::uint32_t size, unsigned &fl, unsigned &sl) const;
+
+  std::uint32_t totalSize;
+  std::uint32_t used = 0;
+  std::uint32_t allocationCount = 0;
+  std::uint32_t freeCount = 0;
+  std::vector<Block> blocks;
+  // Unused entries of `blocks`
+  std::vector<std::uint32_t> spareBlocks;
+  std::uint32_t flBitmap = 0;
+  std::array<std::uint32_t, flCount> slBitmaps{};
+  std::array<std::array<std::uint32_t, slCount>, flCount> freeHeads;
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+
+// Time on the shared CPU timeline used by every trace producer, in
+// nanoseconds since an arbitrary epoch (std::chrono::steady_clock).
+std::uint64_t traceNowNs();
+
+// A single complete ("ph":"X") event on the trace timeline.
+// `name` is not copied and has to outlive the trace, string literals are
+// the intended use.
+struct TraceEvent {
+  const char *name;
+  std::uint64_t beginNs;
+  std::uint64_t endNs;
+  std::uint32_t tid;
+  std::uint32_t depth;
+};
+
+struct TraceThread {
+  std::uint32_t tid;
+  std::string name;
+};
+
+// Thread id under which GPU timestamps are reported
+constexpr std::uint32_t gpuTraceThreadId = 0xFFFF;
+
+// Writes events in the Chrome trace-event JSON format
+// (chrome://tracing, ui.perfetto.dev).
+bool writeChromeTrace(std::string_view path,
+                      std::span<const TraceEvent> events,
+                      std::span<const TraceThread> threads);
+
+#endif
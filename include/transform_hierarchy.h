@@ -0,0 +1,85 @@
+#ifndef TRANSFORM_HIERARCHY_H
+#define TRANSFORM_HIERARCHY_H
+
+#include "glad/gl.h"
+#include "thread_pool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <span>
+#include <vector>
+
+using TransformId = std::uint32_t;
+constexpr TransformId noTransform = 0xFFFFFFFF;
+
+// Scene graph transforms as flat arrays.
+//
+// Nodes live in slots sorted by depth, and within a depth by parent, so
+// every level is one contiguous range and every node's children are one
+// contiguous range of the next level. update() walks the levels in
+// order: nodes whose local matrix was set since the last update, then the
+// children of anything that changed, so the cost follows the number of
+// changed nodes rather than the size of the tree. Each level is split
+// across the thread pool.
+//
+// World matrices are kept in slot order, ready to go to the GPU as they
+// are; upload() only rewrites the runs that changed.
+class TransformHierarchy {
+public:
+  // `parent` must already exist, so parents always precede children.
+  // Returns noTransform otherwise.
+  TransformId add(TransformId parent, const glm::mat4 &local);
+  void setLocal(TransformId id, const glm::mat4 &local);
+
+  const glm::mat4 &local(TransformId id) const;
+  // As of the last update()
+  const glm::mat4 &world(TransformId id) const;
+  TransformId parent(TransformId id) const { return parents[id]; }
+  std::size_t size() const { return parents.size(); }
+
+  void update(ThreadPool *pool = nullptr);
+
+  // Position of `id` in worldMatrices(). Adding nodes reorders slots on
+  // the next update().
+  std::uint32_t slot(TransformId id) const { return slots[id]; }
+  TransformId id(std::uint32_t slot) const { return ids[slot]; }
+  std::span<const glm::mat4> worldMatrices() const { return worlds; }
+  // Slots whose world matrix the last update() rewrote
+  std::span<const std::uint32_t> changed() const { return changedSlots; }
+
+  // Brings `buffer` up to date with worldMatrices(), reallocating it when
+  // the layout changed and otherwise writing only what changed since the
+  // previous upload. Leaves `buffer` bound to `target`.
+  void upload(GLuint buffer, GLenum target = GL_TEXTURE_BUFFER);
+
+private:
+  void rebuild();
+
+  // By id
+  std::vector<TransformId> parents;
+  std::vector<std::uint32_t> depths;
+  std::vector<std::uint32_t> slots;
+
+  // By slot
+  std::vector<TransformId> ids;
+  std::vector<glm::mat4> locals;
+  std::vector<glm::mat4> worlds;
+  std::vector<std::uint32_t> parentSlots;
+  std::vector<std::uint32_t> firstChild;
+  std::vector<std::uint32_t> childCount;
+  std::vector<std::uint8_t> dirty;
+  // First slot of every depth, plus the end
+  std::vector<std::uint32_t> levelStarts;
+
+  // Slots set through setLocal, per depth
+  std::vector<std::vector<std::uint32_t>> pending;
+  std::vector<std::uint32_t> changedSlots;
+  // Changed since the last upload, unordered, may repeat
+  std::vector<std::uint32_t> unuploaded;
+  bool layoutChanged = false;
+  bool uploadAll = true;
+  std::size_t uploadedSize = 0;
+};
+
+#endif
@@ -0,0 +1,177 @@
+#ifndef UNIFORM_LAYOUT_H
+#define UNIFORM_LAYOUT_H
+
+#include "glad/gl.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <span>
+#include <string_view>
+#include <type_traits>
+
+// Compile time checks that a C++ struct has the exact layout of a GLSL
+// std140 or std430 block, so blocks are uploaded with one memcpy.
+//
+// The struct spells out the GLSL padding with members of its own, then
+// lists the members GLSL sees, in GLSL order:
+//
+//   struct CameraBlock {
+//     glm::mat4 viewProjection;
+//     float time;
+//     float padding[3];
+//   };
+//   constexpr UniformField cameraFields[] = {
+//       UNIFORM_FIELD(CameraBlock, viewProjection),
+//       UNIFORM_FIELD(CameraBlock, time),
+//   };
+//   static_assert(uniformLayoutMatches<CameraBlock>(UniformLayout::Std140,
+//                                                   cameraFields));
+//
+// Members may be 32-bit scalars, glm vectors of them, glm::mat4, or
+// arrays of those. std140 arrays step by 16 bytes, so arrays of anything
+// smaller take UniformPadded elements; so do vec3 arrays in std430.
+// GLSL bool, mat3 and nested structs have no C++ match and are rejected.
+
+enum class UniformLayout { Std140, Std430 };
+
+// Array element padded out to the std140 stride
+template <class T> struct alignas(16) UniformPadded {
+  T value;
+};
+
+struct UniformTypeLayout {
+  std::size_t alignment;
+  std::size_t size;
+};
+
+struct UniformField {
+  const char *name;
+  std::size_t offset;
+  // Of the C++ member
+  std::size_t size;
+  UniformTypeLayout std140;
+  UniformTypeLayout std430;
+};
+
+namespace uniform_layout_detail {
+
+template <class T> constexpr bool isPadded = false;
+template <class T> constexpr bool isPadded<UniformPadded<T>> = true;
+
+template <class T> constexpr bool dependentFalse = false;
+
+constexpr std::size_t alignUp(std::size_t value, std::size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+// Scalars, vectors and matrices, the same in both layouts
+template <class T> constexpr UniformTypeLayout basicType() {
+  if constexpr (std::is_same_v<T, float> ||
+                std::is_same_v<T, std::int32_t> ||
+                std::is_same_v<T, std::uint32_t>) {
+    return {4, 4};
+  } else if constexpr (std::is_same_v<T, glm::vec2> ||
+                       std::is_same_v<T, glm::ivec2> ||
+                       std::is_same_v<T, glm::uvec2>) {
+    return {8, 8};
+  } else if constexpr (std::is_same_v<T, glm::vec3> ||
+                       std::is_same_v<T, glm::ivec3> ||
+                       std::is_same_v<T, glm::uvec3>) {
+    return {16, 12};
+  } else if constexpr (std::is_same_v<T, glm::vec4> ||
+                       std::is_same_v<T, glm::ivec4> ||
+                       std::is_same_v<T, glm::uvec4>) {
+    return {16, 16};
+  } else if constexpr (std::is_same_v<T, glm::mat4>) {
+    // Four vec4 columns
+    return {16, 64};
+  } else {
+    static_assert(dependentFalse<T>, "not a type with a GLSL block layout");
+    return {0, 0};
+  }
+}
+
+template <class T>
+constexpr UniformTypeLayout typeLayout(UniformLayout layout) {
+  if constexpr (std::is_array_v<T>) {
+    using Element = std::remove_extent_t<T>;
+    std::size_t count = std::extent_v<T>;
+    UniformTypeLayout element;
+    if constexpr (isPadded<Element>) {
+      element = basicType<decltype(Element::value)>();
+    } else {
+      element = basicType<Element>();
+    }
+    // std140 rounds array elements up to a vec4, std430 does not
+    std::size_t alignment = layout == UniformLayout::Std140
+                                ? alignUp(element.alignment, 16)
+                                : element.alignment;
+    return {alignment, alignUp(element.size, alignment) * count};
+  } else {
+    static_assert(!isPadded<T>, "UniformPadded is for array elements");
+    return basicType<T>();
+  }
+}
+
+} // namespace uniform_layout_detail
+
+template <class T>
+constexpr UniformField uniformField(const char *name, std::size_t offset) {
+  using namespace uniform_layout_detail;
+  return {name, offset, sizeof(T), typeLayout<T>(UniformLayout::Std140),
+          typeLayout<T>(UniformLayout::Std430)};
+}
+
+#define UNIFORM_FIELD(Struct, member)                                          \
+  uniformField<decltype(Struct::member)>(#member, offsetof(Struct, member))
+
+// Calls fn(index, offset) with the offset GLSL gives every field, in
+// turn, and returns the size of the block
+template <class Fn>
+constexpr std::size_t
+forEachUniformOffset(UniformLayout layout,
+                     std::span<const UniformField> fields, Fn &&fn) {
+  using uniform_layout_detail::alignUp;
+  std::size_t cursor = 0;
+  // std140 blocks are padded to a vec4, like std140 structs
+  std::size_t blockAlignment = layout == UniformLayout::Std140 ? 16 : 4;
+  for (std::size_t i = 0; i < fields.size(); i++) {
+    UniformTypeLayout type =
+        layout == UniformLayout::Std140 ? fields[i].std140 : fields[i].std430;
+    cursor = alignUp(cursor, type.alignment);
+    fn(i, cursor);
+    cursor += type.size;
+    blockAlignment = std::max(blockAlignment, type.alignment);
+  }
+  return alignUp(cursor, blockAlignment);
+}
+
+// Whether `Struct` holds `fields` where GLSL puts them, each as large as
+// GLSL makes it, and is exactly as large as the block
+template <class Struct>
+constexpr bool uniformLayoutMatches(UniformLayout layout,
+                                    std::span<const UniformField> fields) {
+  static_assert(std::is_trivially_copyable_v<Struct> &&
+                    std::is_standard_layout_v<Struct>,
+                "uniform blocks are uploaded with memcpy");
+  bool matches = true;
+  auto check = [&](std::size_t i, std::size_t offset) {
+    const UniformField &field = fields[i];
+    UniformTypeLayout type =
+        layout == UniformLayout::Std140 ? field.std140 : field.std430;
+    matches = matches && field.offset == offset && field.size == type.size;
+  };
+  std::size_t blockSize = forEachUniformOffset(layout, fields, check);
+  return matches && sizeof(Struct) == blockSize;
+}
+
+// Compares the C++ offsets of the block `blockName` in a linked program
+// against the GL's own, as a check that the static layout rules agree
+// with the driver. Prints every mismatch and returns false if any.
+bool checkUniformBlockLayout(GLuint program, std::string_view blockName,
+                             std::span<const UniformField> fields,
+                             std::size_t structSize);
+
+#endif
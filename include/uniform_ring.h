@@ -0,0 +1,85 @@
+#ifndef UNIFORM_RING_H
+#define UNIFORM_RING_H
+
+#include "glad/gl.h"
+#include "gl_handles.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+struct UniformAllocation {
+  // 0 when the allocation did not fit; bind() skips those
+  GLuint buffer = 0;
+  GLintptr offset = 0;
+  GLsizeiptr size = 0;
+  // Where to write the block, until UniformRing::upload()
+  void *data = nullptr;
+};
+
+// Per-frame suballocator for std140 uniform blocks.
+//
+// One GL_UNIFORM_BUFFER is split into `framesInFlight` regions used in
+// turn. A region is mapped unsynchronized at beginFrame(), after its fence
+// from `framesInFlight` frames ago has signalled, so writing never waits
+// on draws still reading it. Allocations are pointer bumps rounded up to
+// GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, bound per draw with
+// glBindBufferRange.
+//
+// A frame writes all its blocks, calls upload(), then binds and draws:
+// GL 3.3 cannot draw from a buffer while it is mapped.
+class UniformRing {
+public:
+  explicit UniformRing(std::size_t frameBytes = 256 << 10,
+                       unsigned framesInFlight = 3);
+  ~UniformRing();
+
+  UniformRing(const UniformRing &) = delete;
+  UniformRing &operator=(const UniformRing &) = delete;
+
+  void beginFrame();
+  UniformAllocation allocate(std::size_t size);
+  template <class T> UniformAllocation push(const T &block) {
+    UniformAllocation allocation = allocate(sizeof(T));
+    std::memcpy(allocation.data, &block, sizeof(T));
+    return allocation;
+  }
+  // Makes the frame's allocations visible to the GPU
+  void upload();
+  // Fences the frame's region, after its last draw
+  void endFrame();
+
+  static void bind(GLuint binding, const UniformAllocation &allocation);
+
+  std::size_t alignment() const { return offsetAlignment; }
+  std::size_t usedBytes() const { return used; }
+  // Frames whose region was still being read when they began
+  std::uint64_t stalledFrames() const { return stalls; }
+
+private:
+  GLBuffer buffer;
+  std::size_t frameBytes;
+  std::size_t offsetAlignment = 256;
+  std::vector<GLsync> fences;
+  unsigned current = 0;
+  std::size_t used = 0;
+  std::byte *mapped = nullptr;
+  // Written instead, and uploaded with glBufferSubData, if mapping fails
+  std::vector<std::byte> fallback;
+  // Scratch for allocations past the end of the region, never uploaded
+  std::vector<std::byte> overflow;
+  // Between beginFrame() and upload()
+  bool inFrame = false;
+  bool mapFailureReported = false;
+  bool overflowReported = false;
+  std::uint64_t stalls = 0;
+};
+
+// Points the program's uniform block `name` at binding point `binding`.
+// Returns false if the program has no such block.
+bool setUniformBlockBinding(GLuint program, std::string_view name,
+                            GLuint binding);
+
+#endif
@@ -3,9 +3,9 @@
 
 #include "glad/gl.h"
 
-#include <functional>
 #include <glm/glm.hpp>
 #include <string_view>
+#include <utility>
 
 void glClearError();
 void glPrintErrors();
@@ -31,11 +31,16 @@ void printShaderInfoLog(GLuint shader, GLenum shaderKind);
 GLuint compileProgram(const std::string_view vertexSource,
                       const std::string_view fragmentSource);
 
-struct Defer {
-  Defer(std::function<void()> func) : deffered(func) {}
+// Runs `func` at the end of the scope. The callable is stored as its own
+// type, so the call inlines and nothing is allocated.
+template <class Func> struct Defer {
+  Defer(Func func) : deffered(std::move(func)) {}
   ~Defer() { deffered(); }
 
-  std::function<void()> deffered;
+  Defer(const Defer &) = delete;
+  Defer &operator=(const Defer &) = delete;
+
+  Func deffered;
 };
 
 #endif
@@ -0,0 +1,731 @@
+#include "mesh_import.h"
+#include "cpu_profiler.h"
+#include "image.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <string>
+
+namespace {
+
+// Face corner as written in the file. Negative OBJ indices count back from
+// the last element seen so far, which is only known per chunk while
+// parsing, so those are kept chunk relative until the chunk bases are.
+struct ObjCorner {
+  std::int32_t position;
+  std::int32_t texCoord;
+  std::uint32_t relative;
+};
+
+struct ObjChunk {
+  const char *begin;
+  const char *end;
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec2> texCoords;
+  std::vector<ObjCorner> corners;
+  std::size_t positionBase = 0;
+  std::size_t texCoordBase = 0;
+  std::size_t cornerBase = 0;
+  bool ok = true;
+};
+
+constexpr std::uint32_t relativePosition = 1;
+constexpr std::uint32_t relativeTexCoord = 2;
+constexpr std::int32_t noTexCoord = INT32_MIN;
+
+// Just enough JSON for the glTF scene description. Strings are kept as
+// raw views, glTF keys and the values we read never need unescaping.
+struct JsonValue {
+  enum class Type { Null, Bool, Number, String, Array, Object };
+  Type type = Type::Null;
+  double number = 0.0;
+  std::string_view string;
+  std::vector<JsonValue> items;
+  std::vector<std::pair<std::string_view, JsonValue>> members;
+
+  const JsonValue *get(std::string_view key) const {
+    for (const auto &[name, value] : members) {
+      if (name == key) {
+        return &value;
+      }
+    }
+    return nullptr;
+  }
+  const JsonValue *at(std::size_t index) const {
+    return index < items.size() ? &items[index] : nullptr;
+  }
+  std::optional<std::size_t> index(std::string_view key) const {
+    const JsonValue *value = get(key);
+    if (value == nullptr || value->type != Type::Number ||
+        value->number < 0) {
+      return std::nullopt;
+    }
+    return std::size_t(value->number);
+  }
+};
+
+struct JsonParser {
+  const char *cursor;
+  const char *end;
+  int depth = 0;
+
+  void skipSpace() {
+    while (cursor < end && (*cursor == ' ' || *cursor == '\t' ||
+                            *cursor == '\n' || *cursor == '\r')) {
+      cursor++;
+    }
+  }
+
+  bool literal(std::string_view word) {
+    if (std::size_t(end - cursor) < word.size() ||
+        std::string_view(cursor, word.size()) != word) {
+      return false;
+    }
+    cursor += word.size();
+    return true;
+  }
+
+  bool string(std::string_view &out) {
+    if (cursor == end || *cursor != '"') {
+      return false;
+    }
+    const char *begin = ++cursor;
+    while (cursor < end && *cursor != '"') {
+      cursor += *cursor == '\\' ? 2 : 1;
+    }
+    if (cursor >= end) {
+      return false;
+    }
+    out = std::string_view(begin, cursor - begin);
+    cursor++;
+    return true;
+  }
+
+  bool value(JsonValue &out) {
+    skipSpace();
+    if (cursor == end || ++depth > 64) {
+      return false;
+    }
+    bool ok = true;
+    switch (*cursor) {
+    case '{':
+      out.type = JsonValue::Type::Object;
+      cursor++;
+      skipSpace();
+      if (cursor < end && *cursor == '}') {
+        cursor++;
+        break;
+      }
+      while (ok) {
+        skipSpace();
+        auto &[key, member] = out.members.emplace_back();
+        ok = string(key);
+        skipSpace();
+        ok = ok && cursor < end && *cursor++ == ':' && value(member);
+        skipSpace();
+        if (ok && cursor < end && *cursor == '}') {
+          cursor++;
+          break;
+        }
+        ok = ok && cursor < end && *cursor++ == ',';
+      }
+      break;
+    case '[':
+      out.type = JsonValue::Type::Array;
+      cursor++;
+      skipSpace();
+      if (cursor < end && *cursor == ']') {
+        cursor++;
+        break;
+      }
+      while (ok) {
+        ok = value(out.items.emplace_back());
+        skipSpace();
+        if (ok && cursor < end && *cursor == ']') {
+          cursor++;
+          break;
+        }
+        ok = ok && cursor < end && *cursor++ == ',';
+      }
+      break;
+    case '"':
+      out.type = JsonValue::Type::String;
+      ok = string(out.string);
+      break;
+    case 't':
+    case 'f':
+      out.type = JsonValue::Type::Bool;
+      out.number = *cursor == 't';
+      ok = literal(*cursor == 't' ? "true" : "false");
+      break;
+    case 'n':
+      ok = literal("null");
+      break;
+    default: {
+      // Doubles, byte offsets and counts go past float precision
+      out.type = JsonValue::Type::Number;
+      auto [next, error] = std::from_chars(cursor, end, out.number);
+      ok = error == std::errc();
+      cursor = next;
+    }
+    }
+    depth--;
+    return ok;
+  }
+};
+
+} // namespace
+
+static bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+const char *parseFloat(const char *begin, const char *end, float &value) {
+  static constexpr double powersOf10[] = {
+      1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+  const char *p = begin;
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p++ == '-';
+  }
+  // Up to 19 significant digits fit the mantissa, the rest only scale it
+  std::uint64_t mantissa = 0;
+  int exponent = 0;
+  bool anyDigits = false;
+  for (; p < end && isDigit(*p); p++) {
+    anyDigits = true;
+    if (mantissa < 1000000000000000000ull) {
+      mantissa = mantissa * 10 + (*p - '0');
+    } else {
+      exponent++;
+    }
+  }
+  if (p < end && *p == '.') {
+    for (p++; p < end && isDigit(*p); p++) {
+      anyDigits = true;
+      if (mantissa < 1000000000000000000ull) {
+        mantissa = mantissa * 10 + (*p - '0');
+        exponent--;
+      }
+    }
+  }
+  if (!anyDigits) {
+    // inf, nan and friends are rare enough for the library
+    const char *start = begin < end && *begin == '+' ? begin + 1 : begin;
+    auto [next, error] = std::from_chars(start, end, value);
+    return error == std::errc() ? next : begin;
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char *exponentBegin = p++;
+    bool negativeExponent = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+      negativeExponent = *p++ == '-';
+    }
+    if (p < end && isDigit(*p)) {
+      int written = 0;
+      for (; p < end && isDigit(*p); p++) {
+        written = std::min(written * 10 + (*p - '0'), 10000);
+      }
+      exponent += negativeExponent ? -written : written;
+    } else {
+      p = exponentBegin;
+    }
+  }
+  double result = double(mantissa);
+  if (mantissa == 0) {
+    result = 0.0;
+  } else if (exponent >= 0 && exponent <= 22) {
+    result *= powersOf10[exponent];
+  } else if (exponent < 0 && exponent >= -22) {
+    result /= powersOf10[-exponent];
+  } else {
+    result *= std::pow(10.0, exponent);
+  }
+  value = float(negative ? -result : result);
+  return p;
+}
+
+static const char *parseInt(const char *p, const char *end, int &value,
+                            bool &found) {
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p++ == '-';
+  }
+  found = p < end && isDigit(*p);
+  long long result = 0;
+  for (; p < end && isDigit(*p); p++) {
+    result = std::min<long long>(result * 10 + (*p - '0'), INT32_MAX);
+  }
+  value = negative ? -result : result;
+  return p;
+}
+
+static const char *skipSpaces(const char *p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+    p++;
+  }
+  return p;
+}
+
+static const char *nextLine(const char *p, const char *end) {
+  const char *newline =
+      static_cast<const char *>(std::memchr(p, '\n', end - p));
+  return newline != nullptr ? newline + 1 : end;
+}
+
+static void parseObjChunk(ObjChunk &chunk) {
+  CPU_ZONE("Parse OBJ chunk");
+  const char *end = chunk.end;
+  std::vector<ObjCorner> face;
+  for (const char *line = chunk.begin; line < end;
+       line = nextLine(line, end)) {
+    const char *p = skipSpaces(line, end);
+    if (end - p < 2) {
+      continue;
+    }
+    if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+      glm::vec3 &position = chunk.positions.emplace_back(0.0f);
+      for (int axis = 0; axis < 3; axis++) {
+        p = parseFloat(skipSpaces(p + (axis == 0), end), end, position[axis]);
+      }
+    } else if (p[0] == 'v' && p[1] == 't') {
+      glm::vec2 &texCoord = chunk.texCoords.emplace_back(0.0f);
+      p += 2;
+      for (int axis = 0; axis < 2; axis++) {
+        p = parseFloat(skipSpaces(p, end), end, texCoord[axis]);
+      }
+    } else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+      face.clear();
+      p++;
+      while (true) {
+        p = skipSpaces(p, end);
+        ObjCorner corner = {0, noTexCoord, 0};
+        bool found = false;
+        p = parseInt(p, end, corner.position, found);
+        if (!found) {
+          break;
+        }
+        if (p < end && *p == '/') {
+          int texCoord = 0;
+          p = parseInt(p + 1, end, texCoord, found);
+          if (found) {
+            corner.texCoord = texCoord;
+          }
+          // Normals are not part of Vertex
+          if (p < end && *p == '/') {
+            p = parseInt(p + 1, end, texCoord, found);
+          }
+        }
+        if (corner.position < 0) {
+          corner.position += chunk.positions.size();
+          corner.relative |= relativePosition;
+        } else {
+          corner.position--;
+        }
+        if (corner.texCoord != noTexCoord && corner.texCoord < 0) {
+          corner.texCoord += chunk.texCoords.size();
+          corner.relative |= relativeTexCoord;
+        } else if (corner.texCoord != noTexCoord) {
+          corner.texCoord--;
+        }
+        face.push_back(corner);
+      }
+      if (face.size() < 3) {
+        chunk.ok = false;
+      }
+      for (std::size_t i = 2; i < face.size(); i++) {
+        chunk.corners.insert(chunk.corners.end(),
+                             {face[0], face[i - 1], face[i]});
+      }
+    }
+  }
+}
+
+static void runParallel(ThreadPool *pool, std::size_t count,
+                        const std::function<void(std::size_t)> &fn) {
+  auto range = [&](std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; i++) {
+      fn(i);
+    }
+  };
+  if (pool != nullptr) {
+    pool->parallelFor(count, 1, range);
+  } else {
+    range(0, count);
+  }
+}
+
+bool importObj(std::span<const std::uint8_t> data, Mesh &mesh,
+               ThreadPool *pool) {
+  CPU_ZONE("importObj");
+  const char *text = reinterpret_cast<const char *>(data.data());
+  const char *end = text + data.size();
+
+  // A few chunks per thread keeps everyone busy when line density varies
+  constexpr std::size_t minChunkBytes = 64 << 10;
+  std::size_t threads = pool != nullptr ? pool->size() + 1 : 1;
+  std::size_t chunkCount = std::clamp<std::size_t>(
+      data.size() / minChunkBytes, 1, threads * 4);
+  std::vector<ObjChunk> chunks(chunkCount);
+  const char *begin = text;
+  for (std::size_t i = 0; i < chunkCount; i++) {
+    const char *split =
+        i + 1 == chunkCount ? end
+                            : std::max(begin, text + data.size() * (i + 1) /
+                                                         chunkCount);
+    split = split == end ? end : nextLine(split, end);
+    chunks[i].begin = begin;
+    chunks[i].end = split;
+    begin = split;
+  }
+  runParallel(pool, chunkCount, [&](std::size_t i) {
+    parseObjChunk(chunks[i]);
+  });
+
+  std::size_t positionCount = 0;
+  std::size_t texCoordCount = 0;
+  std::size_t cornerCount = 0;
+  for (auto &chunk : chunks) {
+    if (!chunk.ok) {
+      std::cerr << "OBJ: face with fewer than 3 corners" << std::endl;
+      return false;
+    }
+    chunk.positionBase = positionCount;
+    chunk.texCoordBase = texCoordCount;
+    chunk.cornerBase = cornerCount;
+    positionCount += chunk.positions.size();
+    texCoordCount += chunk.texCoords.size();
+    cornerCount += chunk.corners.size();
+  }
+
+  // Faces may reference attributes of any chunk, so gather them into one
+  // array first
+  std::vector<glm::vec3> positions(positionCount);
+  std::vector<glm::vec2> texCoords(texCoordCount);
+  runParallel(pool, chunkCount, [&](std::size_t i) {
+    std::copy(chunks[i].positions.begin(), chunks[i].positions.end(),
+              positions.begin() + chunks[i].positionBase);
+    std::copy(chunks[i].texCoords.begin(), chunks[i].texCoords.end(),
+              texCoords.begin() + chunks[i].texCoordBase);
+  });
+
+  std::vector<Vertex> corners(cornerCount);
+  std::atomic<bool> badIndex = false;
+  runParallel(pool, chunkCount, [&](std::size_t i) {
+    CPU_ZONE("Resolve OBJ corners");
+    const ObjChunk &chunk = chunks[i];
+    for (std::size_t c = 0; c < chunk.corners.size(); c++) {
+      const ObjCorner &corner = chunk.corners[c];
+      std::int64_t position = corner.position;
+      std::int64_t texCoord = corner.texCoord;
+      if (corner.relative & relativePosition) {
+        position += chunk.positionBase;
+      }
+      if (corner.relative & relativeTexCoord) {
+        texCoord += chunk.texCoordBase;
+      }
+      bool hasTexCoord = corner.texCoord != noTexCoord;
+      if (position < 0 || position >= std::int64_t(positionCount) ||
+          (hasTexCoord &&
+           (texCoord < 0 || texCoord >= std::int64_t(texCoordCount)))) {
+        badIndex = true;
+        return;
+      }
+      Vertex &vertex = corners[chunk.cornerBase + c];
+      vertex.pos = positions[position];
+      vertex.color = glm::vec4(1.0f);
+      vertex.texCoord = hasTexCoord ? texCoords[texCoord] : glm::vec2(0.0f);
+    }
+  });
+  if (badIndex) {
+    std::cerr << "OBJ: face index out of range" << std::endl;
+    return false;
+  }
+  weldVertices(corners, mesh);
+  return true;
+}
+
+static std::uint32_t hashVertex(const Vertex &vertex) {
+  std::uint32_t words[sizeof(Vertex) / 4];
+  std::memcpy(words, &vertex, sizeof(words));
+  std::uint64_t hash = 0;
+  for (std::uint32_t word : words) {
+    hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+  }
+  return hash >> 32;
+}
+
+void weldVertices(std::span<const Vertex> corners, Mesh &mesh) {
+  CPU_ZONE("weldVertices");
+  constexpr std::uint32_t empty = UINT32_MAX;
+  // Open addressing at most half full, probes stay short
+  std::size_t tableSize = 16;
+  while (tableSize < corners.size() * 2) {
+    tableSize *= 2;
+  }
+  std::vector<std::uint32_t> table(tableSize, empty);
+  std::size_t mask = tableSize - 1;
+
+  mesh.vertices.clear();
+  mesh.indices.resize(corners.size());
+  for (std::size_t i = 0; i < corners.size(); i++) {
+    const Vertex &corner = corners[i];
+    std::size_t slot = hashVertex(corner) & mask;
+    while (true) {
+      std::uint32_t index = table[slot];
+      if (index == empty) {
+        index = mesh.vertices.size();
+        table[slot] = index;
+        mesh.vertices.push_back(corner);
+        mesh.indices[i] = index;
+        break;
+      }
+      if (std::memcmp(&mesh.vertices[index], &corner, sizeof(Vertex)) == 0) {
+        mesh.indices[i] = index;
+        break;
+      }
+      slot = (slot + 1) & mask;
+    }
+  }
+  mesh.vertices.shrink_to_fit();
+}
+
+// Reads the first `components` components of every element, normalizing
+// integer components the way glTF defines. Doubles keep 32-bit indices
+// exact. Returns false on anything malformed.
+static bool readAccessor(const JsonValue &root,
+                         std::span<const std::uint8_t> binary,
+                         const JsonValue &accessor, std::size_t components,
+                         std::vector<double> &out, std::size_t &count) {
+  const JsonValue *bufferViews = root.get("bufferViews");
+  auto viewIndex = accessor.index("bufferView");
+  auto componentType = accessor.index("componentType");
+  auto countValue = accessor.index("count");
+  const JsonValue *type = accessor.get("type");
+  if (bufferViews == nullptr || !viewIndex || !componentType ||
+      !countValue || type == nullptr || accessor.get("sparse") != nullptr) {
+    return false;
+  }
+  const JsonValue *view = bufferViews->at(*viewIndex);
+  if (view == nullptr || view->index("buffer").value_or(1) != 0) {
+    return false;
+  }
+  std::size_t typeComponents = type->string == "SCALAR" ? 1
+                               : type->string == "VEC2" ? 2
+                               : type->string == "VEC3" ? 3
+                               : type->string == "VEC4" ? 4
+                                                        : 0;
+  std::size_t componentSize = 0;
+  double scale = 1.0;
+  bool normalized = false;
+  if (const JsonValue *value = accessor.get("normalized")) {
+    normalized = value->number != 0.0;
+  }
+  switch (*componentType) {
+  case GL_FLOAT:
+  case GL_UNSIGNED_INT:
+    componentSize = 4;
+    break;
+  case GL_UNSIGNED_SHORT:
+    componentSize = 2;
+    scale = normalized ? 1.0 / 65535.0 : 1.0;
+    break;
+  case GL_UNSIGNED_BYTE:
+    componentSize = 1;
+    scale = normalized ? 1.0 / 255.0 : 1.0;
+    break;
+  default:
+    return false;
+  }
+  if (typeComponents == 0 || typeComponents < components) {
+    return false;
+  }
+  count = *countValue;
+  std::size_t elementSize = componentSize * typeComponents;
+  std::size_t stride = view->index("byteStride").value_or(elementSize);
+  std::size_t offset = view->index("byteOffset").value_or(0) +
+                       accessor.index("byteOffset").value_or(0);
+  std::size_t viewEnd = view->index("byteOffset").value_or(0) +
+                        view->index("byteLength").value_or(0);
+  if (viewEnd > binary.size() ||
+      (count > 0 && offset + (count - 1) * stride + elementSize > viewEnd)) {
+    return false;
+  }
+  out.resize(count * components);
+  for (std::size_t i = 0; i < count; i++) {
+    const std::uint8_t *element = binary.data() + offset + i * stride;
+    for (std::size_t c = 0; c < components; c++) {
+      const std::uint8_t *component = element + c * componentSize;
+      double value = 0.0;
+      if (*componentType == GL_FLOAT) {
+        float number;
+        std::memcpy(&number, component, 4);
+        value = number;
+      } else if (componentSize == 4) {
+        std::uint32_t integer;
+        std::memcpy(&integer, component, 4);
+        value = integer;
+      } else if (componentSize == 2) {
+        std::uint16_t integer;
+        std::memcpy(&integer, component, 2);
+        value = integer * scale;
+      } else {
+        value = *component * scale;
+      }
+      out[i * components + c] = value;
+    }
+  }
+  return true;
+}
+
+static std::uint32_t readLe32(const std::uint8_t *p) {
+  return p[0] | p[1] << 8 | p[2] << 16 | std::uint32_t(p[3]) << 24;
+}
+
+bool importGlb(std::span<const std::uint8_t> data, Mesh &mesh,
+               ThreadPool *pool) {
+  CPU_ZONE("importGlb");
+  constexpr std::uint32_t chunkJson = 0x4E4F534A;
+  constexpr std::uint32_t chunkBinary = 0x004E4942;
+  if (data.size() < 20 || std::memcmp(data.data(), "glTF", 4) != 0 ||
+      readLe32(&data[4]) != 2) {
+    std::cerr << "GLB: not a glTF 2.0 binary" << std::endl;
+    return false;
+  }
+  std::string_view json;
+  std::span<const std::uint8_t> binary;
+  std::size_t offset = 12;
+  std::size_t length = std::min<std::size_t>(readLe32(&data[8]), data.size());
+  while (offset + 8 <= length) {
+    std::size_t chunkLength = readLe32(&data[offset]);
+    std::uint32_t chunkType = readLe32(&data[offset + 4]);
+    offset += 8;
+    if (chunkLength > length - offset) {
+      break;
+    }
+    if (chunkType == chunkJson) {
+      json = std::string_view(
+          reinterpret_cast<const char *>(&data[offset]), chunkLength);
+    } else if (chunkType == chunkBinary && binary.empty()) {
+      binary = data.subspan(offset, chunkLength);
+    }
+    offset += chunkLength;
+  }
+
+  JsonValue root;
+  JsonParser parser{json.data(), json.data() + json.size()};
+  const JsonValue *meshes = nullptr;
+  const JsonValue *accessors = nullptr;
+  if (json.empty() || !parser.value(root) ||
+      (meshes = root.get("meshes")) == nullptr ||
+      (accessors = root.get("accessors")) == nullptr) {
+    std::cerr << "GLB: malformed scene description" << std::endl;
+    return false;
+  }
+
+  // Expanded to corners so welding also catches exporters that duplicate
+  // vertices across primitives
+  struct Primitive {
+    const JsonValue *json;
+    std::vector<Vertex> corners;
+    bool ok = true;
+  };
+  std::vector<Primitive> primitives;
+  for (const auto &gltfMesh : meshes->items) {
+    const JsonValue *list = gltfMesh.get("primitives");
+    for (std::size_t i = 0; list != nullptr && i < list->items.size(); i++) {
+      // Only triangle lists, mode defaults to 4
+      if (list->items[i].index("mode").value_or(GL_TRIANGLES) ==
+          GL_TRIANGLES) {
+        primitives.push_back({&list->items[i], {}});
+      }
+    }
+  }
+  runParallel(pool, primitives.size(), [&](std::size_t p) {
+    Primitive &primitive = primitives[p];
+    const JsonValue *attributes = primitive.json->get("attributes");
+    auto accessor = [&](const JsonValue *owner,
+                        std::string_view key) -> const JsonValue * {
+      auto index = owner != nullptr ? owner->index(key) : std::nullopt;
+      return index ? accessors->at(*index) : nullptr;
+    };
+    const JsonValue *position = accessor(attributes, "POSITION");
+    const JsonValue *texCoord = accessor(attributes, "TEXCOORD_0");
+    const JsonValue *color = accessor(attributes, "COLOR_0");
+    const JsonValue *indexAccessor = accessor(primitive.json, "indices");
+
+    std::vector<double> positions, texCoords, colors, indices;
+    std::size_t vertexCount = 0, count = 0;
+    primitive.ok =
+        position != nullptr &&
+        readAccessor(root, binary, *position, 3, positions, vertexCount) &&
+        (texCoord == nullptr ||
+         (readAccessor(root, binary, *texCoord, 2, texCoords, count) &&
+          count == vertexCount)) &&
+        (color == nullptr ||
+         (readAccessor(root, binary, *color, 3, colors, count) &&
+          count == vertexCount)) &&
+        (indexAccessor == nullptr ||
+         readAccessor(root, binary, *indexAccessor, 1, indices, count));
+    if (!primitive.ok) {
+      return;
+    }
+    std::size_t cornerCount =
+        indexAccessor != nullptr ? indices.size() : vertexCount;
+    cornerCount -= cornerCount % 3;
+    primitive.corners.resize(cornerCount);
+    for (std::size_t c = 0; c < cornerCount; c++) {
+      std::size_t v = indexAccessor != nullptr ? std::size_t(indices[c]) : c;
+      if (v >= vertexCount) {
+        primitive.ok = false;
+        return;
+      }
+      Vertex &vertex = primitive.corners[c];
+      vertex.pos = glm::vec3(positions[v * 3], positions[v * 3 + 1],
+                             positions[v * 3 + 2]);
+      vertex.color = color != nullptr
+                         ? glm::vec4(colors[v * 3], colors[v * 3 + 1],
+                                     colors[v * 3 + 2], 1.0f)
+                         : glm::vec4(1.0f);
+      // glTF puts the texture origin top left, GL bottom left
+      vertex.texCoord = texCoord != nullptr
+                            ? glm::vec2(texCoords[v * 2],
+                                        1.0f - texCoords[v * 2 + 1])
+                            : glm::vec2(0.0f);
+    }
+  });
+
+  std::vector<Vertex> corners;
+  for (const auto &primitive : primitives) {
+    if (!primitive.ok) {
+      std::cerr << "GLB: unsupported or malformed primitive" << std::endl;
+      return false;
+    }
+    corners.insert(corners.end(), primitive.corners.begin(),
+                   primitive.corners.end());
+  }
+  weldVertices(corners, mesh);
+  return true;
+}
+
+bool importMesh(std::string_view path, Mesh &mesh, ThreadPool *pool) {
+  std::vector<std::uint8_t> data;
+  {
+    CPU_ZONE("Read mesh file");
+    if (!readFile(path, data)) {
+      std::cerr << "Failed to read mesh " << path << std::endl;
+      return false;
+    }
+  }
+  bool ok = data.size() >= 4 && std::memcmp(data.data(), "glTF", 4) == 0
+                ? importGlb(data, mesh, pool)
+                : importObj(data, mesh, pool);
+  if (!ok) {
+    std::cerr << "Failed to import mesh " << path << std::endl;
+  }
+  return ok;
+}
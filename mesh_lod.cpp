@@ -0,0 +1,386 @@
+#include "mesh_lod.h"
+#include "cpu_profiler.h"
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace {
+
+// Symmetric 4x4 error quadric, upper triangle
+struct Quadric {
+  double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+  double b0 = 0, b1 = 0, b2 = 0;
+  double c = 0;
+
+  // Squared distance to the plane n.p + d = 0, times `weight`
+  static Quadric plane(glm::vec3 n, double d, double weight) {
+    Quadric q;
+    q.a00 = weight * n.x * n.x;
+    q.a01 = weight * n.x * n.y;
+    q.a02 = weight * n.x * n.z;
+    q.a11 = weight * n.y * n.y;
+    q.a12 = weight * n.y * n.z;
+    q.a22 = weight * n.z * n.z;
+    q.b0 = weight * n.x * d;
+    q.b1 = weight * n.y * d;
+    q.b2 = weight * n.z * d;
+    q.c = weight * d * d;
+    return q;
+  }
+
+  void operator+=(const Quadric &o) {
+    a00 += o.a00;
+    a01 += o.a01;
+    a02 += o.a02;
+    a11 += o.a11;
+    a12 += o.a12;
+    a22 += o.a22;
+    b0 += o.b0;
+    b1 += o.b1;
+    b2 += o.b2;
+    c += o.c;
+  }
+
+  double error(glm::vec3 p) const {
+    double x = p.x, y = p.y, z = p.z;
+    double result = a00 * x * x + a11 * y * y + a22 * z * z +
+                    2 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+                    2 * (b0 * x + b1 * y + b2 * z) + c;
+    return std::max(result, 0.0);
+  }
+};
+
+enum class VertexKind : std::uint8_t {
+  Interior,
+  // On an open edge, only slides along the border
+  Border,
+  // Shares its position with another vertex (texture or color seam)
+  Locked,
+};
+
+struct Collapse {
+  std::uint32_t from;
+  std::uint32_t to;
+  double cost;
+};
+
+} // namespace
+
+// Border planes are weighted well above surface planes so silhouettes of
+// open meshes survive
+static constexpr double borderWeight = 10.0;
+
+static glm::vec3 triangleNormal(glm::vec3 a, glm::vec3 b, glm::vec3 c) {
+  return glm::cross(b - a, c - a);
+}
+
+static std::uint64_t edgeKey(std::uint32_t a, std::uint32_t b) {
+  return a < b ? std::uint64_t(a) << 32 | b : std::uint64_t(b) << 32 | a;
+}
+
+// Triangles around each vertex of the current index list
+static void buildAdjacency(std::span<const std::uint32_t> indices,
+                           std::size_t vertexCount,
+                           std::vector<std::uint32_t> &offsets,
+                           std::vector<std::uint32_t> &triangles) {
+  offsets.assign(vertexCount + 1, 0);
+  for (std::uint32_t index : indices) {
+    offsets[index + 1]++;
+  }
+  for (std::size_t v = 0; v < vertexCount; v++) {
+    offsets[v + 1] += offsets[v];
+  }
+  triangles.resize(indices.size());
+  std::vector<std::uint32_t> fill(offsets.begin(), offsets.end() - 1);
+  for (std::size_t i = 0; i < indices.size(); i++) {
+    triangles[fill[indices[i]]++] = i / 3;
+  }
+}
+
+// Undirected edge use counts, 1 means open border
+static void countEdges(std::span<const std::uint32_t> indices,
+                       std::unordered_map<std::uint64_t, int> &edges) {
+  edges.clear();
+  edges.reserve(indices.size());
+  for (std::size_t t = 0; t + 2 < indices.size(); t += 3) {
+    for (int k = 0; k < 3; k++) {
+      edges[edgeKey(indices[t + k], indices[t + (k + 1) % 3])]++;
+    }
+  }
+}
+
+static void classifyVertices(const Mesh &mesh, std::vector<VertexKind> &kinds,
+                             std::unordered_map<std::uint64_t, int> &edges) {
+  std::size_t vertexCount = mesh.vertices.size();
+  kinds.assign(vertexCount, VertexKind::Interior);
+
+  struct PositionHash {
+    std::size_t operator()(const glm::vec3 &p) const {
+      std::uint32_t words[3];
+      std::memcpy(words, &p, sizeof(words));
+      return (words[0] * 73856093u) ^ (words[1] * 19349663u) ^
+             (words[2] * 83492791u);
+    }
+  };
+  struct PositionEqual {
+    bool operator()(const glm::vec3 &a, const glm::vec3 &b) const {
+      return a.x == b.x && a.y == b.y && a.z == b.z;
+    }
+  };
+  std::unordered_map<glm::vec3, std::uint32_t, PositionHash, PositionEqual>
+      firstAtPosition;
+  firstAtPosition.reserve(vertexCount);
+  for (std::uint32_t v = 0; v < vertexCount; v++) {
+    auto [it, inserted] = firstAtPosition.try_emplace(mesh.vertices[v].pos, v);
+    if (!inserted) {
+      kinds[v] = VertexKind::Locked;
+      kinds[it->second] = VertexKind::Locked;
+    }
+  }
+
+  countEdges(mesh.indices, edges);
+  for (const auto &[key, count] : edges) {
+    if (count != 1) {
+      continue;
+    }
+    for (std::uint32_t v : {std::uint32_t(key >> 32), std::uint32_t(key)}) {
+      if (kinds[v] == VertexKind::Interior) {
+        kinds[v] = VertexKind::Border;
+      }
+    }
+  }
+}
+
+// Moving `from` onto `to` must not turn any surviving triangle around
+static bool flipsTriangles(const Mesh &mesh,
+                           std::span<const std::uint32_t> indices,
+                           std::span<const std::uint32_t> around,
+                           std::uint32_t from, std::uint32_t to) {
+  glm::vec3 target = mesh.vertices[to].pos;
+  for (std::uint32_t t : around) {
+    const std::uint32_t *triangle = &indices[t * 3];
+    if (triangle[0] == to || triangle[1] == to || triangle[2] == to) {
+      continue;
+    }
+    glm::vec3 p[3];
+    glm::vec3 q[3];
+    for (int k = 0; k < 3; k++) {
+      p[k] = mesh.vertices[triangle[k]].pos;
+      q[k] = triangle[k] == from ? target : p[k];
+    }
+    glm::vec3 before = triangleNormal(p[0], p[1], p[2]);
+    glm::vec3 after = triangleNormal(q[0], q[1], q[2]);
+    if (glm::dot(before, after) <= 0.0f) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void generateLodChain(Mesh &mesh, std::vector<MeshLod> &lods,
+                      const LodOptions &options) {
+  CPU_ZONE("generateLodChain");
+  std::size_t vertexCount = mesh.vertices.size();
+  lods.clear();
+  lods.push_back({0, std::uint32_t(mesh.indices.size()), 0.0f});
+  if (vertexCount == 0 || mesh.indices.empty()) {
+    return;
+  }
+
+  glm::vec3 lower = mesh.vertices[0].pos;
+  glm::vec3 upper = lower;
+  for (const auto &vertex : mesh.vertices) {
+    lower = glm::min(lower, vertex.pos);
+    upper = glm::max(upper, vertex.pos);
+  }
+  glm::vec3 halfExtent = (upper - lower) * 0.5f;
+  double radius = std::sqrt(glm::dot(halfExtent, halfExtent));
+  double maxCost = std::pow(options.maxError * radius, 2.0);
+
+  std::vector<VertexKind> kinds;
+  std::unordered_map<std::uint64_t, int> edges;
+  classifyVertices(mesh, kinds, edges);
+
+  // Quadrics accumulate for the whole chain, so coarser levels measure
+  // their error against the original surface
+  std::vector<Quadric> quadrics(vertexCount);
+  for (std::size_t t = 0; t + 2 < mesh.indices.size(); t += 3) {
+    const std::uint32_t *triangle = &mesh.indices[t];
+    glm::vec3 p[3];
+    for (int k = 0; k < 3; k++) {
+      p[k] = mesh.vertices[triangle[k]].pos;
+    }
+    glm::vec3 normal = triangleNormal(p[0], p[1], p[2]);
+    float length = std::sqrt(glm::dot(normal, normal));
+    if (length == 0.0f) {
+      continue;
+    }
+    normal /= length;
+    Quadric plane = Quadric::plane(normal, -glm::dot(normal, p[0]), 1.0);
+    for (int k = 0; k < 3; k++) {
+      quadrics[triangle[k]] += plane;
+    }
+    for (int k = 0; k < 3; k++) {
+      std::uint32_t a = triangle[k];
+      std::uint32_t b = triangle[(k + 1) % 3];
+      if (edges[edgeKey(a, b)] != 1) {
+        continue;
+      }
+      // Plane through the border edge, perpendicular to the surface
+      glm::vec3 edge = p[(k + 1) % 3] - p[k];
+      glm::vec3 side = glm::cross(edge, normal);
+      float sideLength = std::sqrt(glm::dot(side, side));
+      if (sideLength == 0.0f) {
+        continue;
+      }
+      side /= sideLength;
+      Quadric border = Quadric::plane(side, -glm::dot(side, p[k]),
+                                      borderWeight);
+      quadrics[a] += border;
+      quadrics[b] += border;
+    }
+  }
+
+  std::vector<std::uint32_t> current = mesh.indices;
+  std::vector<std::uint32_t> remap(vertexCount);
+  std::vector<bool> touched(vertexCount);
+  std::vector<std::uint32_t> offsets;
+  std::vector<std::uint32_t> around;
+  std::vector<Collapse> collapses;
+  double chainCost = 0.0;
+  std::size_t triangleCount = current.size() / 3;
+
+  while (lods.size() < options.maxLevels) {
+    std::size_t target =
+        std::size_t(lods.back().indexCount / 3 * options.ratio);
+    if (target < options.minTriangles) {
+      break;
+    }
+    // Passes of independent collapses, cheapest first, until the level's
+    // triangle budget is met or nothing affordable is left
+    bool progress = true;
+    while (triangleCount > target && progress) {
+      progress = false;
+      buildAdjacency(current, vertexCount, offsets, around);
+      // Border edges change as the border gets simplified
+      countEdges(current, edges);
+      collapses.clear();
+      for (std::size_t t = 0; t < current.size(); t += 3) {
+        for (int k = 0; k < 3; k++) {
+          std::uint32_t a = current[t + k];
+          std::uint32_t b = current[t + (k + 1) % 3];
+          for (auto [from, to] : {std::pair(a, b), std::pair(b, a)}) {
+            VertexKind kind = kinds[from];
+            if (kind == VertexKind::Locked ||
+                (kind == VertexKind::Border &&
+                 (kinds[to] == VertexKind::Interior ||
+                  edges[edgeKey(from, to)] != 1))) {
+              continue;
+            }
+            Quadric merged = quadrics[from];
+            merged += quadrics[to];
+            double cost = merged.error(mesh.vertices[to].pos);
+            if (cost <= maxCost) {
+              collapses.push_back({from, to, cost});
+            }
+          }
+        }
+      }
+      std::sort(collapses.begin(), collapses.end(),
+                [](const Collapse &a, const Collapse &b) {
+                  return a.cost < b.cost;
+                });
+
+      for (std::uint32_t v = 0; v < vertexCount; v++) {
+        remap[v] = v;
+      }
+      std::fill(touched.begin(), touched.end(), false);
+      std::size_t removed = 0;
+      for (const Collapse &collapse : collapses) {
+        if (triangleCount - removed <= target) {
+          break;
+        }
+        if (touched[collapse.from] || touched[collapse.to]) {
+          continue;
+        }
+        std::span<const std::uint32_t> ring(
+            &around[offsets[collapse.from]],
+            offsets[collapse.from + 1] - offsets[collapse.from]);
+        if (flipsTriangles(mesh, current, ring, collapse.from, collapse.to)) {
+          continue;
+        }
+        // Untouched vertices keep their triangle rings intact for the
+        // flip test of later collapses in this pass
+        for (std::uint32_t t : ring) {
+          for (int k = 0; k < 3; k++) {
+            std::uint32_t vertex = current[t * 3 + k];
+            touched[vertex] = true;
+            removed += vertex == collapse.to;
+          }
+        }
+        remap[collapse.from] = collapse.to;
+        quadrics[collapse.to] += quadrics[collapse.from];
+        chainCost = std::max(chainCost, collapse.cost);
+        progress = true;
+      }
+
+      std::size_t out = 0;
+      for (std::size_t t = 0; t < current.size(); t += 3) {
+        std::uint32_t a = remap[current[t]];
+        std::uint32_t b = remap[current[t + 1]];
+        std::uint32_t c = remap[current[t + 2]];
+        if (a != b && b != c && a != c) {
+          current[out++] = a;
+          current[out++] = b;
+          current[out++] = c;
+        }
+      }
+      current.resize(out);
+      triangleCount = out / 3;
+    }
+    if (triangleCount * 3 >= lods.back().indexCount) {
+      break;
+    }
+
+    std::vector<std::uint32_t> level = current;
+    optimizeVertexCache(level, vertexCount);
+    lods.push_back({std::uint32_t(mesh.indices.size()),
+                    std::uint32_t(level.size()),
+                    float(std::sqrt(chainCost))});
+    mesh.indices.insert(mesh.indices.end(), level.begin(), level.end());
+    if (triangleCount > target) {
+      // Ran out of affordable collapses
+      break;
+    }
+  }
+}
+
+float lodPixelsPerUnit(float distance, float fovY, float viewportHeight) {
+  return viewportHeight /
+         (2.0f * std::max(distance, 1e-6f) * std::tan(fovY * 0.5f));
+}
+
+std::uint32_t selectLod(std::span<const MeshLod> lods, float pixelsPerUnit,
+                        std::uint32_t current, float maxPixelError,
+                        float hysteresis) {
+  if (lods.empty()) {
+    return 0;
+  }
+  current = std::min<std::uint32_t>(current, lods.size() - 1);
+  auto coarsestWithin = [&](float limit) {
+    std::uint32_t level = 0;
+    for (std::uint32_t i = 1; i < lods.size(); i++) {
+      if (lods[i].error * pixelsPerUnit <= limit) {
+        level = i;
+      }
+    }
+    return level;
+  };
+  if (lods[current].error * pixelsPerUnit > maxPixelError) {
+    return coarsestWithin(maxPixelError);
+  }
+  return std::max(current, coarsestWithin(maxPixelError * (1 - hysteresis)));
+}
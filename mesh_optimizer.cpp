@@ -0,0 +1,487 @@
+#include "mesh_optimizer.h"
+#include "cpu_profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace {
+
+// Triangles around every vertex, compressed rows. The first `live[v]`
+// entries of a row are the triangles not emitted yet.
+struct Adjacency {
+  std::vector<std::uint32_t> offsets;
+  std::vector<std::uint32_t> triangles;
+  std::vector<std::uint32_t> live;
+
+  Adjacency(std::span<const std::uint32_t> indices, std::size_t vertexCount)
+      : offsets(vertexCount + 1, 0), triangles(indices.size()),
+        live(vertexCount, 0) {
+    for (std::uint32_t index : indices) {
+      live[index]++;
+    }
+    for (std::size_t v = 0; v < vertexCount; v++) {
+      offsets[v + 1] = offsets[v] + live[v];
+    }
+    std::vector<std::uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (std::size_t i = 0; i < indices.size(); i++) {
+      triangles[fill[indices[i]]++] = i / 3;
+    }
+  }
+
+  std::span<std::uint32_t> liveTriangles(std::uint32_t vertex) {
+    return std::span(&triangles[offsets[vertex]], live[vertex]);
+  }
+
+  void remove(std::uint32_t vertex, std::uint32_t triangle) {
+    auto list = liveTriangles(vertex);
+    auto it = std::find(list.begin(), list.end(), triangle);
+    std::swap(*it, list.back());
+    live[vertex]--;
+  }
+};
+
+// FIFO post-transform cache by insertion timestamp: a vertex is cached
+// when it was inserted within the last `size` misses
+struct FifoCache {
+  std::vector<std::uint32_t> inserted;
+  std::uint32_t time;
+  std::uint32_t size;
+
+  FifoCache(std::size_t vertexCount, std::uint32_t size)
+      : inserted(vertexCount, 0), time(size + 1), size(size) {}
+
+  // Returns true on a miss
+  bool access(std::uint32_t vertex) {
+    if (time - inserted[vertex] <= size) {
+      return false;
+    }
+    inserted[vertex] = time++;
+    return true;
+  }
+  void reset() { time += size + 1; }
+};
+
+} // namespace
+
+VertexCacheStats analyzeVertexCache(std::span<const std::uint32_t> indices,
+                                    std::size_t vertexCount,
+                                    unsigned cacheSize, GLenum mode) {
+  VertexCacheStats stats;
+  FifoCache cache(vertexCount, cacheSize);
+  std::vector<bool> used(vertexCount, false);
+  std::size_t usedCount = 0;
+  std::size_t run = 0;
+  for (std::uint32_t index : indices) {
+    if (mode == GL_TRIANGLE_STRIP && index == stripRestartIndex) {
+      run = 0;
+      continue;
+    }
+    stats.transformed += cache.access(index);
+    usedCount += !used[index];
+    used[index] = true;
+    if (mode == GL_TRIANGLE_STRIP && ++run >= 3) {
+      stats.triangles++;
+    }
+  }
+  if (mode != GL_TRIANGLE_STRIP) {
+    stats.triangles = indices.size() / 3;
+  }
+  stats.acmr = stats.triangles > 0 ? float(stats.transformed) / stats.triangles
+                                   : 0.0f;
+  stats.atvr = usedCount > 0 ? float(stats.transformed) / usedCount : 0.0f;
+  return stats;
+}
+
+// Forsyth, "Linear-Speed Vertex Cache Optimisation"
+static void forsythOrder(std::span<std::uint32_t> indices,
+                         std::size_t vertexCount) {
+  // The scoring cache is larger than the hardware one on purpose, the
+  // tail only nudges scores
+  constexpr int scoringCacheSize = 32;
+  constexpr int maxValence = 64;
+  float cacheScores[scoringCacheSize];
+  float valenceScores[maxValence + 1];
+  for (int i = 0; i < scoringCacheSize; i++) {
+    // The last triangle's vertices get a fixed score so the next
+    // triangle does not just reuse its most recent edge
+    cacheScores[i] =
+        i < 3 ? 0.75f
+              : std::pow(1.0f - float(i - 3) / (scoringCacheSize - 3), 1.5f);
+  }
+  valenceScores[0] = 0.0f;
+  for (int i = 1; i <= maxValence; i++) {
+    valenceScores[i] = 2.0f / std::sqrt(float(i));
+  }
+  auto vertexScore = [&](int cachePosition, std::uint32_t valence) {
+    if (valence == 0) {
+      return -1.0f;
+    }
+    float score = cachePosition >= 0 ? cacheScores[cachePosition] : 0.0f;
+    return score + valenceScores[std::min<std::uint32_t>(valence,
+                                                         maxValence)];
+  };
+
+  std::size_t triangleCount = indices.size() / 3;
+  Adjacency adjacency(indices, vertexCount);
+  std::vector<float> vertexScores(vertexCount);
+  std::vector<float> triangleScores(triangleCount, 0.0f);
+  std::vector<bool> emitted(triangleCount, false);
+  for (std::size_t v = 0; v < vertexCount; v++) {
+    vertexScores[v] = vertexScore(-1, adjacency.live[v]);
+    for (std::uint32_t t : adjacency.liveTriangles(v)) {
+      triangleScores[t] += vertexScores[v];
+    }
+  }
+
+  std::vector<std::uint32_t> output(indices.size());
+  std::vector<std::uint32_t> cache;
+  std::vector<std::uint32_t> nextCache;
+  std::size_t inputCursor = 0;
+  std::int64_t best = -1;
+  for (std::size_t emittedCount = 0; emittedCount < triangleCount;
+       emittedCount++) {
+    if (best < 0) {
+      // Nothing in the cache has triangles left, restart from the input
+      while (emitted[inputCursor]) {
+        inputCursor++;
+      }
+      best = inputCursor;
+    }
+    const std::uint32_t *triangle = &indices[best * 3];
+    std::copy(triangle, triangle + 3, &output[emittedCount * 3]);
+    emitted[best] = true;
+    for (int k = 0; k < 3; k++) {
+      adjacency.remove(triangle[k], best);
+    }
+
+    nextCache.assign(triangle, triangle + 3);
+    for (std::uint32_t vertex : cache) {
+      if (vertex != triangle[0] && vertex != triangle[1] &&
+          vertex != triangle[2]) {
+        nextCache.push_back(vertex);
+      }
+    }
+    // Rescore everything that moved, including what just fell out
+    best = -1;
+    float bestScore = -1.0f;
+    for (std::size_t i = 0; i < nextCache.size(); i++) {
+      std::uint32_t vertex = nextCache[i];
+      int position = i < scoringCacheSize ? int(i) : -1;
+      float score = vertexScore(position, adjacency.live[vertex]);
+      float delta = score - vertexScores[vertex];
+      vertexScores[vertex] = score;
+      for (std::uint32_t t : adjacency.liveTriangles(vertex)) {
+        triangleScores[t] += delta;
+        if (position >= 0 && triangleScores[t] > bestScore) {
+          bestScore = triangleScores[t];
+          best = t;
+        }
+      }
+    }
+    nextCache.resize(std::min<std::size_t>(nextCache.size(),
+                                           scoringCacheSize));
+    std::swap(cache, nextCache);
+  }
+  std::copy(output.begin(), output.end(), indices.begin());
+}
+
+// Sander, Nehab, Barczak, "Fast Triangle Reordering for Vertex Locality
+// and Reduced Overdraw"
+static void tipsifyOrder(std::span<std::uint32_t> indices,
+                         std::size_t vertexCount, unsigned cacheSize) {
+  std::size_t triangleCount = indices.size() / 3;
+  Adjacency adjacency(indices, vertexCount);
+  // Remaining valence
+  std::vector<std::uint32_t> &live = adjacency.live;
+  std::vector<std::uint32_t> cacheTime(vertexCount, 0);
+  std::vector<bool> emitted(triangleCount, false);
+  std::vector<std::uint32_t> deadEnds;
+  std::vector<std::uint32_t> candidates;
+  std::vector<std::uint32_t> output;
+  output.reserve(indices.size());
+  std::uint32_t time = cacheSize + 1;
+  std::size_t cursor = 0;
+
+  std::vector<std::uint32_t> fanTriangles;
+  std::int64_t fan = vertexCount > 0 ? 0 : -1;
+  while (fan >= 0) {
+    candidates.clear();
+    // Rows get reordered by remove(), walk a copy
+    auto row = adjacency.liveTriangles(fan);
+    fanTriangles.assign(row.begin(), row.end());
+    for (std::uint32_t t : fanTriangles) {
+      if (emitted[t]) {
+        continue;
+      }
+      emitted[t] = true;
+      for (int k = 0; k < 3; k++) {
+        std::uint32_t vertex = indices[t * 3 + k];
+        output.push_back(vertex);
+        deadEnds.push_back(vertex);
+        candidates.push_back(vertex);
+        adjacency.remove(vertex, t);
+        if (time - cacheTime[vertex] > cacheSize) {
+          cacheTime[vertex] = time++;
+        }
+      }
+    }
+
+    // Next fan: the candidate that stays longest in the cache while its
+    // remaining triangles are emitted
+    fan = -1;
+    std::int64_t bestPriority = -1;
+    for (std::uint32_t vertex : candidates) {
+      if (live[vertex] == 0) {
+        continue;
+      }
+      std::int64_t priority = 0;
+      if (time - cacheTime[vertex] + 2 * live[vertex] <= cacheSize) {
+        priority = time - cacheTime[vertex];
+      }
+      if (priority > bestPriority) {
+        bestPriority = priority;
+        fan = vertex;
+      }
+    }
+    if (fan >= 0) {
+      continue;
+    }
+    // Dead end: back up through recently used vertices, then the input
+    while (!deadEnds.empty() && fan < 0) {
+      std::uint32_t vertex = deadEnds.back();
+      deadEnds.pop_back();
+      if (live[vertex] > 0) {
+        fan = vertex;
+      }
+    }
+    for (; fan < 0 && cursor < vertexCount; cursor++) {
+      if (live[cursor] > 0) {
+        fan = cursor;
+      }
+    }
+  }
+  std::copy(output.begin(), output.end(), indices.begin());
+}
+
+void optimizeVertexCache(std::span<std::uint32_t> indices,
+                         std::size_t vertexCount,
+                         VertexCacheAlgorithm algorithm, unsigned cacheSize) {
+  CPU_ZONE("optimizeVertexCache");
+  if (algorithm == VertexCacheAlgorithm::Tipsify) {
+    tipsifyOrder(indices, vertexCount, cacheSize);
+  } else {
+    forsythOrder(indices, vertexCount);
+  }
+}
+
+void optimizeOverdraw(std::span<std::uint32_t> indices,
+                      std::span<const Vertex> vertices, float threshold,
+                      unsigned cacheSize) {
+  CPU_ZONE("optimizeOverdraw");
+  std::size_t triangleCount = indices.size() / 3;
+  if (triangleCount == 0) {
+    return;
+  }
+  auto triangleMisses = [&](FifoCache &cache, std::size_t t) {
+    return int(cache.access(indices[t * 3])) +
+           cache.access(indices[t * 3 + 1]) +
+           cache.access(indices[t * 3 + 2]);
+  };
+
+  // Hard boundaries where the cache order already starts over, every
+  // vertex missing
+  std::vector<std::size_t> hard = {0};
+  FifoCache cache(vertices.size(), cacheSize);
+  for (std::size_t t = 0; t < triangleCount; t++) {
+    if (triangleMisses(cache, t) == 3 && t > 0) {
+      hard.push_back(t);
+    }
+  }
+  hard.push_back(triangleCount);
+
+  // Soft boundaries: cut a hard cluster as soon as the part so far is
+  // within `threshold` of the cluster's own ACMR. Every cut flushes the
+  // cache, which is what the threshold pays for.
+  std::vector<std::size_t> clusters;
+  for (std::size_t h = 0; h + 1 < hard.size(); h++) {
+    std::size_t begin = hard[h];
+    std::size_t end = hard[h + 1];
+    cache.reset();
+    int misses = 0;
+    for (std::size_t t = begin; t < end; t++) {
+      misses += triangleMisses(cache, t);
+    }
+    float clusterAcmr = float(misses) / (end - begin);
+    clusters.push_back(begin);
+    cache.reset();
+    misses = 0;
+    std::size_t start = begin;
+    for (std::size_t t = begin; t < end; t++) {
+      misses += triangleMisses(cache, t);
+      if (t + 1 < end &&
+          float(misses) / (t + 1 - start) <= clusterAcmr * threshold) {
+        clusters.push_back(t + 1);
+        start = t + 1;
+        misses = 0;
+        cache.reset();
+      }
+    }
+  }
+  clusters.push_back(triangleCount);
+
+  // Sort key: how far the cluster faces out from the mesh center
+  std::size_t clusterCount = clusters.size() - 1;
+  std::vector<glm::vec3> centroids(clusterCount, glm::vec3(0.0f));
+  std::vector<glm::vec3> normals(clusterCount, glm::vec3(0.0f));
+  std::vector<float> areas(clusterCount, 0.0f);
+  glm::vec3 meshCentroid(0.0f);
+  float meshArea = 0.0f;
+  for (std::size_t c = 0; c < clusterCount; c++) {
+    for (std::size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+      glm::vec3 a = vertices[indices[t * 3]].pos;
+      glm::vec3 b = vertices[indices[t * 3 + 1]].pos;
+      glm::vec3 c2 = vertices[indices[t * 3 + 2]].pos;
+      glm::vec3 normal = glm::cross(b - a, c2 - a);
+      float area = std::sqrt(glm::dot(normal, normal));
+      centroids[c] += (a + b + c2) * (area / 3.0f);
+      normals[c] += normal;
+      areas[c] += area;
+    }
+    meshCentroid += centroids[c];
+    meshArea += areas[c];
+  }
+  meshCentroid /= std::max(meshArea, 1e-30f);
+  std::vector<float> keys(clusterCount);
+  for (std::size_t c = 0; c < clusterCount; c++) {
+    glm::vec3 centroid = centroids[c] / std::max(areas[c], 1e-30f);
+    float length = std::sqrt(glm::dot(normals[c], normals[c]));
+    keys[c] = length > 0.0f
+                  ? glm::dot(centroid - meshCentroid, normals[c] / length)
+                  : 0.0f;
+  }
+  std::vector<std::size_t> order(clusterCount);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](std::size_t a,
+                                                   std::size_t b) {
+    return keys[a] > keys[b];
+  });
+
+  std::vector<std::uint32_t> sorted;
+  sorted.reserve(indices.size());
+  for (std::size_t c : order) {
+    sorted.insert(sorted.end(), indices.begin() + clusters[c] * 3,
+                  indices.begin() + clusters[c + 1] * 3);
+  }
+  std::copy(sorted.begin(), sorted.end(), indices.begin());
+}
+
+void optimizeVertexFetch(Mesh &mesh) {
+  CPU_ZONE("optimizeVertexFetch");
+  constexpr std::uint32_t unused = UINT32_MAX;
+  std::vector<std::uint32_t> remap(mesh.vertices.size(), unused);
+  std::vector<Vertex> vertices;
+  vertices.reserve(mesh.vertices.size());
+  for (std::uint32_t &index : mesh.indices) {
+    if (remap[index] == unused) {
+      remap[index] = vertices.size();
+      vertices.push_back(mesh.vertices[index]);
+    }
+    index = remap[index];
+  }
+  mesh.vertices = std::move(vertices);
+}
+
+// The vertex completing triangle `t` across the directed edge from -> to,
+// or -1 when `t` does not have that edge
+static std::int64_t oppositeVertex(std::span<const std::uint32_t> indices,
+                                   std::size_t t, std::uint32_t from,
+                                   std::uint32_t to) {
+  for (int k = 0; k < 3; k++) {
+    if (indices[t * 3 + k] == from && indices[t * 3 + (k + 1) % 3] == to) {
+      return indices[t * 3 + (k + 2) % 3];
+    }
+  }
+  return -1;
+}
+
+void buildTriangleStrips(std::span<const std::uint32_t> indices,
+                         std::vector<std::uint32_t> &strip) {
+  CPU_ZONE("buildTriangleStrips");
+  // Continuations are looked for among this many upcoming triangles,
+  // which keeps the cache order mostly intact
+  constexpr std::size_t window = 16;
+  std::size_t triangleCount = indices.size() / 3;
+  std::vector<bool> used(triangleCount, false);
+  strip.clear();
+  std::size_t cursor = 0;
+  std::size_t run = 0;
+
+  // Finds an unused triangle in the window with the directed edge
+  auto findContinuation = [&](std::uint32_t from, std::uint32_t to,
+                              std::size_t &found) -> std::int64_t {
+    std::size_t seen = 0;
+    for (std::size_t t = cursor; t < triangleCount && seen < window; t++) {
+      if (used[t]) {
+        continue;
+      }
+      seen++;
+      std::int64_t vertex = oppositeVertex(indices, t, from, to);
+      if (vertex >= 0) {
+        found = t;
+        return vertex;
+      }
+    }
+    return -1;
+  };
+
+  for (std::size_t emitted = 0; emitted < triangleCount; emitted++) {
+    while (used[cursor]) {
+      cursor++;
+    }
+    if (run >= 3) {
+      // Even triangles keep the strip's winding, odd ones flip it
+      std::uint32_t a = strip[strip.size() - 2];
+      std::uint32_t b = strip.back();
+      bool even = (run - 2) % 2 == 0;
+      std::size_t found = 0;
+      std::int64_t next = even ? findContinuation(a, b, found)
+                               : findContinuation(b, a, found);
+      if (next >= 0) {
+        used[found] = true;
+        strip.push_back(next);
+        run++;
+        continue;
+      }
+      strip.push_back(stripRestartIndex);
+    }
+
+    // New run. Rotate the first triangle so the one after it can attach
+    // to its last edge, reversed since that triangle is odd.
+    const std::uint32_t *triangle = &indices[cursor * 3];
+    used[cursor] = true;
+    int rotation = 0;
+    for (int r = 0; r < 3; r++) {
+      std::size_t found = 0;
+      if (findContinuation(triangle[(r + 2) % 3], triangle[(r + 1) % 3],
+                           found) >= 0) {
+        rotation = r;
+        break;
+      }
+    }
+    for (int k = 0; k < 3; k++) {
+      strip.push_back(triangle[(rotation + k) % 3]);
+    }
+    run = 3;
+  }
+}
+
+void optimizeMesh(Mesh &mesh, const MeshOptimizerOptions &options) {
+  optimizeVertexCache(mesh.indices, mesh.vertices.size(), options.algorithm,
+                      options.cacheSize);
+  if (options.overdrawThreshold > 0.0f) {
+    optimizeOverdraw(mesh.indices, mesh.vertices, options.overdrawThreshold,
+                     options.cacheSize);
+  }
+  optimizeVertexFetch(mesh);
+}
@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "mesh_import.h"
+#include "mesh_optimizer.h"
+#include "thread_pool.h"
+
+// UV sphere with its triangles shuffled, the worst case exporters and
+// naive importers produce
+static Mesh shuffledSphere(int rings, int segments) {
+  Mesh mesh;
+  for (int ring = 0; ring <= rings; ring++) {
+    float theta = 3.14159265f * ring / rings;
+    for (int segment = 0; segment <= segments; segment++) {
+      float phi = 6.28318531f * segment / segments;
+      Vertex &vertex = mesh.vertices.emplace_back();
+      vertex.pos = glm::vec3(std::sin(theta) * std::cos(phi),
+                             std::cos(theta),
+                             std::sin(theta) * std::sin(phi));
+      vertex.color = glm::vec4(1.0f);
+      vertex.texCoord = glm::vec2(float(segment) / segments,
+                                  1.0f - float(ring) / rings);
+    }
+  }
+  for (int ring = 0; ring < rings; ring++) {
+    for (int segment = 0; segment < segments; segment++) {
+      std::uint32_t a = ring * (segments + 1) + segment;
+      std::uint32_t b = a + segments + 1;
+      mesh.indices.insert(mesh.indices.end(), {a, b, a + 1, a + 1, b, b + 1});
+    }
+  }
+  std::vector<std::array<std::uint32_t, 3>> triangles(mesh.indices.size() /
+                                                      3);
+  std::memcpy(triangles.data(), mesh.indices.data(),
+              mesh.indices.size() * sizeof(std::uint32_t));
+  std::shuffle(triangles.begin(), triangles.end(), std::mt19937(1234));
+  std::memcpy(mesh.indices.data(), triangles.data(),
+              mesh.indices.size() * sizeof(std::uint32_t));
+  return mesh;
+}
+
+static void report(const char *name, std::span<const std::uint32_t> indices,
+                   std::size_t vertexCount, std::size_t baseline,
+                   double ms, GLenum mode = GL_TRIANGLES) {
+  VertexCacheStats fifo16 = analyzeVertexCache(indices, vertexCount, 16,
+                                               mode);
+  VertexCacheStats fifo32 = analyzeVertexCache(indices, vertexCount, 32,
+                                               mode);
+  double saved = 100.0 * (1.0 - double(fifo16.transformed) / baseline);
+  std::printf("  %-22s %7.3f %7.3f %7.3f %7.3f %12zu %7.1f%% %9.1f\n", name,
+              fifo16.acmr, fifo16.atvr, fifo32.acmr, fifo32.atvr,
+              fifo16.transformed, saved, ms);
+}
+
+static void benchmark(const std::string &name, const Mesh &source) {
+  std::printf("%s: %zu triangles, %zu vertices\n", name.c_str(),
+              source.indices.size() / 3, source.vertices.size());
+  std::printf("  %-22s %7s %7s %7s %7s %12s %8s %9s\n", "", "ACMR16",
+              "ATVR16", "ACMR32", "ATVR32", "VS calls", "saved", "ms");
+  std::size_t baseline =
+      analyzeVertexCache(source.indices, source.vertices.size()).transformed;
+  report("input", source.indices, source.vertices.size(), baseline, 0.0);
+
+  auto timed = [](const std::function<void()> &fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+  };
+  const std::pair<const char *, VertexCacheAlgorithm> algorithms[] = {
+      {"forsyth", VertexCacheAlgorithm::Forsyth},
+      {"tipsify", VertexCacheAlgorithm::Tipsify}};
+  for (const auto &[algorithmName, algorithm] : algorithms) {
+    Mesh mesh = source;
+    double ms = timed([&]() {
+      optimizeVertexCache(mesh.indices, mesh.vertices.size(), algorithm);
+    });
+    report(algorithmName, mesh.indices, mesh.vertices.size(), baseline, ms);
+
+    ms = timed([&]() { optimizeOverdraw(mesh.indices, mesh.vertices); });
+    std::string label = std::string(algorithmName) + " + overdraw";
+    report(label.c_str(), mesh.indices, mesh.vertices.size(), baseline, ms);
+
+    std::vector<std::uint32_t> strip;
+    ms = timed([&]() { buildTriangleStrips(mesh.indices, strip); });
+    label = std::string(algorithmName) + " strips";
+    report(label.c_str(), strip, mesh.vertices.size(), baseline, ms,
+           GL_TRIANGLE_STRIP);
+    std::printf("  %-22s %zu indices instead of %zu\n", "", strip.size(),
+                mesh.indices.size());
+  }
+}
+
+int main(int argc, char **argv) {
+  ThreadPool pool;
+  if (argc < 2) {
+    benchmark("shuffled sphere", shuffledSphere(256, 512));
+    return 0;
+  }
+  for (int i = 1; i < argc; i++) {
+    Mesh mesh;
+    if (!importMesh(argv[i], mesh, &pool)) {
+      return 1;
+    }
+    benchmark(argv[i], mesh);
+  }
+  return 0;
+}
@@ -0,0 +1,350 @@
+#include "mipmap.h"
+#include "cpu_profiler.h"
+#include "utility.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MIPMAP_SSE2
+#endif
+
+namespace {
+
+// RGBA float pixels, row major
+struct FloatImage {
+  int width = 0;
+  int height = 0;
+  std::vector<float> pixels;
+};
+
+// Taps of one output texel along one axis
+struct FilterTaps {
+  int first;
+  int count;
+  int weightOffset;
+};
+
+struct FilterKernel {
+  std::vector<FilterTaps> taps;
+  std::vector<float> weights;
+};
+
+} // namespace
+
+static constexpr int linearToSrgbLutSize = 4096;
+
+static float srgbToLinear(float value) {
+  return value <= 0.04045f ? value / 12.92f
+                           : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linearToSrgb(float value) {
+  return value <= 0.0031308f ? value * 12.92f
+                             : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+static const float *srgbDecodeLut() {
+  static const auto lut = []() {
+    std::vector<float> table(256);
+    for (int i = 0; i < 256; i++) {
+      table[i] = srgbToLinear(i / 255.0f);
+    }
+    return table;
+  }();
+  return lut.data();
+}
+
+static const std::uint8_t *srgbEncodeLut() {
+  static const auto lut = []() {
+    std::vector<std::uint8_t> table(linearToSrgbLutSize + 1);
+    for (int i = 0; i <= linearToSrgbLutSize; i++) {
+      table[i] = std::lround(
+          linearToSrgb(float(i) / linearToSrgbLutSize) * 255.0f);
+    }
+    return table;
+  }();
+  return lut.data();
+}
+
+static double besselI0(double x) {
+  double sum = 1.0;
+  double term = 1.0;
+  for (int k = 1; k < 32; k++) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+    if (term < sum * 1e-12) {
+      break;
+    }
+  }
+  return sum;
+}
+
+static double sinc(double x) {
+  if (std::fabs(x) < 1e-8) {
+    return 1.0;
+  }
+  x *= 3.14159265358979323846;
+  return std::sin(x) / x;
+}
+
+static double filterSupport(MipFilter filter) {
+  return filter == MipFilter::Box ? 0.5 : 3.0;
+}
+
+static double filterWeight(MipFilter filter, double x) {
+  x = std::fabs(x);
+  switch (filter) {
+  case MipFilter::Box:
+    return x <= 0.5 ? 1.0 : 0.0;
+  case MipFilter::Kaiser: {
+    constexpr double alpha = 4.0;
+    if (x >= 3.0) {
+      return 0.0;
+    }
+    double t = x / 3.0;
+    return sinc(x) * besselI0(alpha * std::sqrt(1.0 - t * t)) /
+           besselI0(alpha);
+  }
+  case MipFilter::Lanczos:
+    return x < 3.0 ? sinc(x) * sinc(x / 3.0) : 0.0;
+  }
+  return 0.0;
+}
+
+// Resampling weights from `inSize` to `outSize` texels, edges clamped
+static FilterKernel buildKernel(MipFilter filter, int inSize, int outSize) {
+  FilterKernel kernel;
+  double scale = double(inSize) / outSize;
+  double support = filterSupport(filter) * scale;
+  for (int i = 0; i < outSize; i++) {
+    double center = (i + 0.5) * scale;
+    int first = int(std::floor(center - support));
+    int last = int(std::ceil(center + support));
+    FilterTaps taps;
+    taps.first = first;
+    taps.count = last - first + 1;
+    taps.weightOffset = kernel.weights.size();
+    double total = 0.0;
+    for (int j = first; j <= last; j++) {
+      double weight = filterWeight(filter, (j + 0.5 - center) / scale);
+      kernel.weights.push_back(weight);
+      total += weight;
+    }
+    for (int k = 0; k < taps.count; k++) {
+      kernel.weights[taps.weightOffset + k] /= total;
+    }
+    kernel.taps.push_back(taps);
+  }
+  return kernel;
+}
+
+static void runRows(ThreadPool *pool, int rows,
+                    const std::function<void(std::size_t, std::size_t)> &fn) {
+  if (pool != nullptr) {
+    pool->parallelFor(rows, 16, fn);
+  } else {
+    fn(0, rows);
+  }
+}
+
+// out = sum(weight * pixel) over the taps, one RGBA pixel per SSE register
+static inline void accumulateTaps(const float *const *sources,
+                                  const float *weights, int count,
+                                  float *out) {
+#ifdef MIPMAP_SSE2
+  __m128 sum = _mm_setzero_ps();
+  for (int k = 0; k < count; k++) {
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(sources[k]),
+                                     _mm_set1_ps(weights[k])));
+  }
+  _mm_storeu_ps(out, sum);
+#else
+  float sum[4] = {};
+  for (int k = 0; k < count; k++) {
+    for (int c = 0; c < 4; c++) {
+      sum[c] += sources[k][c] * weights[k];
+    }
+  }
+  std::memcpy(out, sum, sizeof(sum));
+#endif
+}
+
+// out[i] += weight * in[i] over a whole row
+static inline void accumulateRow(float *out, const float *in, float weight,
+                                 std::size_t count) {
+  std::size_t i = 0;
+#ifdef MIPMAP_SSE2
+  __m128 w = _mm_set1_ps(weight);
+  for (; i + 4 <= count; i += 4) {
+    _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i),
+                                      _mm_mul_ps(_mm_loadu_ps(in + i), w)));
+  }
+#endif
+  for (; i < count; i++) {
+    out[i] += in[i] * weight;
+  }
+}
+
+static void downsample(const FloatImage &in, FloatImage &out,
+                       MipFilter filter, ThreadPool *pool) {
+  out.width = std::max(1, in.width / 2);
+  out.height = std::max(1, in.height / 2);
+  out.pixels.resize(std::size_t(out.width) * out.height * 4);
+  FilterKernel horizontal = buildKernel(filter, in.width, out.width);
+  FilterKernel vertical = buildKernel(filter, in.height, out.height);
+
+  // Horizontal pass into a out.width x in.height scratch image
+  std::vector<float> scratch(std::size_t(out.width) * in.height * 4);
+  runRows(pool, in.height, [&](std::size_t begin, std::size_t end) {
+    std::vector<const float *> sources;
+    for (std::size_t y = begin; y < end; y++) {
+      const float *row = &in.pixels[y * in.width * 4];
+      for (int x = 0; x < out.width; x++) {
+        const FilterTaps &taps = horizontal.taps[x];
+        sources.resize(taps.count);
+        for (int k = 0; k < taps.count; k++) {
+          sources[k] = row + std::clamp(taps.first + k, 0, in.width - 1) * 4;
+        }
+        accumulateTaps(sources.data(),
+                       &horizontal.weights[taps.weightOffset], taps.count,
+                       &scratch[(y * out.width + x) * 4]);
+      }
+    }
+  });
+
+  // Vertical pass streams whole scratch rows
+  std::size_t rowFloats = std::size_t(out.width) * 4;
+  runRows(pool, out.height, [&](std::size_t begin, std::size_t end) {
+    for (std::size_t y = begin; y < end; y++) {
+      const FilterTaps &taps = vertical.taps[y];
+      float *outRow = &out.pixels[y * rowFloats];
+      std::fill(outRow, outRow + rowFloats, 0.0f);
+      for (int k = 0; k < taps.count; k++) {
+        int row = std::clamp(taps.first + k, 0, in.height - 1);
+        accumulateRow(outRow, &scratch[row * rowFloats],
+                      vertical.weights[taps.weightOffset + k], rowFloats);
+      }
+    }
+  });
+}
+
+static float alphaCoverage(const FloatImage &image, float reference,
+                           float scale) {
+  std::size_t covered = 0;
+  std::size_t pixelCount = std::size_t(image.width) * image.height;
+  for (std::size_t i = 0; i < pixelCount; i++) {
+    covered += image.pixels[i * 4 + 3] * scale > reference;
+  }
+  return float(covered) / pixelCount;
+}
+
+// Scale for alpha so that coverage at `reference` matches `target`
+static float coverageScale(const FloatImage &image, float reference,
+                           float target) {
+  float low = 0.0f;
+  float high = 4.0f;
+  for (int iteration = 0; iteration < 12; iteration++) {
+    float middle = (low + high) / 2.0f;
+    if (alphaCoverage(image, reference, middle) < target) {
+      low = middle;
+    } else {
+      high = middle;
+    }
+  }
+  return (low + high) / 2.0f;
+}
+
+static void toFloat(const Image &image, bool srgb, FloatImage &out) {
+  const float *decode = srgbDecodeLut();
+  out.width = image.width;
+  out.height = image.height;
+  out.pixels.resize(image.pixels.size());
+  for (std::size_t i = 0; i < image.pixels.size(); i++) {
+    bool color = (i & 3) != 3;
+    out.pixels[i] = srgb && color ? decode[image.pixels[i]]
+                                  : image.pixels[i] / 255.0f;
+  }
+}
+
+static void toImage(const FloatImage &image, bool srgb, float alphaScale,
+                    Image &out) {
+  const std::uint8_t *encode = srgbEncodeLut();
+  out.width = image.width;
+  out.height = image.height;
+  out.pixels.resize(image.pixels.size());
+  for (std::size_t i = 0; i < image.pixels.size(); i++) {
+    // Negative lobes can push values slightly out of range
+    float value = image.pixels[i];
+    if ((i & 3) == 3) {
+      value = std::clamp(value * alphaScale, 0.0f, 1.0f);
+      out.pixels[i] = std::lround(value * 255.0f);
+    } else if (srgb) {
+      value = std::clamp(value, 0.0f, 1.0f);
+      out.pixels[i] = encode[int(value * linearToSrgbLutSize + 0.5f)];
+    } else {
+      out.pixels[i] = std::lround(std::clamp(value, 0.0f, 1.0f) * 255.0f);
+    }
+  }
+}
+
+void generateMipChain(const Image &base, const MipOptions &options,
+                      std::vector<Image> &levels, ThreadPool *pool) {
+  CPU_ZONE("generateMipChain");
+  int levelCount = 1;
+  for (int size = std::max(base.width, base.height); size > 1; size /= 2) {
+    levelCount++;
+  }
+  std::vector<FloatImage> linear(levelCount);
+  toFloat(base, options.srgb, linear[0]);
+  for (int level = 1; level < levelCount; level++) {
+    downsample(linear[level - 1], linear[level], options.filter, pool);
+  }
+
+  bool preserveCoverage = options.alphaCoverageReference >= 0.0f;
+  float baseCoverage =
+      preserveCoverage
+          ? alphaCoverage(linear[0], options.alphaCoverageReference, 1.0f)
+          : 0.0f;
+
+  levels.resize(levelCount);
+  levels[0] = base;
+  auto convertLevels = [&](std::size_t begin, std::size_t end) {
+    for (std::size_t level = std::max<std::size_t>(begin, 1); level < end;
+         level++) {
+      float alphaScale =
+          preserveCoverage ? coverageScale(linear[level],
+                                           options.alphaCoverageReference,
+                                           baseCoverage)
+                           : 1.0f;
+      toImage(linear[level], options.srgb, alphaScale, levels[level]);
+    }
+  };
+  if (pool != nullptr) {
+    pool->parallelFor(levelCount, 1, convertLevels);
+  } else {
+    convertLevels(0, levelCount);
+  }
+}
+
+void uploadMipChain(GLenum target, std::span<const Image> levels,
+                    GLenum internalFormat) {
+  std::vector<std::uint8_t> flipped;
+  GLCall(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+  for (std::size_t level = 0; level < levels.size(); level++) {
+    const Image &image = levels[level];
+    std::size_t rowBytes = std::size_t(image.width) * 4;
+    flipped.resize(rowBytes * image.height);
+    for (int y = 0; y < image.height; y++) {
+      std::memcpy(&flipped[y * rowBytes],
+                  &image.pixels[(image.height - 1 - y) * rowBytes], rowBytes);
+    }
+    GLCall(glTexImage2D(target, level, internalFormat, image.width,
+                        image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                        flipped.data()));
+  }
+  GLCall(glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0));
+  GLCall(glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, levels.size() - 1));
+}
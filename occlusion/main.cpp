@@ -0,0 +1,499 @@
+#include "glad/gl.h"
+
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "alloc_tracker.h"
+#include "cpu_profiler.h"
+#include "culling.h"
+#include "debug_output.h"
+#include "frame_arena.h"
+#include "gl_handles.h"
+#include "gpu_profiler.h"
+#include "occlusion_queries.h"
+#include "software_occlusion.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include "utility.h"
+
+namespace {
+
+// Box or sphere placed by its center and half size
+struct Instance {
+  glm::vec3 center;
+  glm::vec3 halfExtent;
+};
+
+constexpr std::size_t instanceStride = sizeof(Instance);
+
+// Unit cube, for buildings and proxies
+const Vertex cubeVertices[] = {
+    {{-1.0f, -1.0f, -1.0f}, {0.35f, 0.35f, 0.4f, 1.0f}, {0.0f, 0.0f}},
+    {{1.0f, -1.0f, -1.0f}, {0.4f, 0.4f, 0.45f, 1.0f}, {1.0f, 0.0f}},
+    {{1.0f, 1.0f, -1.0f}, {0.6f, 0.6f, 0.65f, 1.0f}, {1.0f, 1.0f}},
+    {{-1.0f, 1.0f, -1.0f}, {0.55f, 0.55f, 0.6f, 1.0f}, {0.0f, 1.0f}},
+    {{-1.0f, -1.0f, 1.0f}, {0.3f, 0.3f, 0.35f, 1.0f}, {0.0f, 0.0f}},
+    {{1.0f, -1.0f, 1.0f}, {0.35f, 0.35f, 0.4f, 1.0f}, {1.0f, 0.0f}},
+    {{1.0f, 1.0f, 1.0f}, {0.7f, 0.7f, 0.75f, 1.0f}, {1.0f, 1.0f}},
+    {{-1.0f, 1.0f, 1.0f}, {0.6f, 0.6f, 0.65f, 1.0f}, {0.0f, 1.0f}},
+};
+
+const GLuint cubeIndices[] = {
+    0, 2, 1, 0, 3, 2, 4, 5, 6, 4, 6, 7, 0, 1, 5, 0, 5, 4,
+    3, 6, 2, 3, 7, 6, 0, 4, 7, 0, 7, 3, 1, 2, 6, 1, 6, 5,
+};
+
+enum class OcclusionMode { Off, Queries, Software };
+
+const char *const occlusionModeNames[] = {"off", "GPU queries",
+                                          "software rasterizer"};
+
+// UV sphere of radius 1, dense enough that drawing it costs something
+void buildSphere(int rings, int segments, std::vector<Vertex> &vertices,
+                 std::vector<GLuint> &indices) {
+  GLuint base = vertices.size();
+  for (int ring = 0; ring <= rings; ring++) {
+    float theta = glm::radians(180.0f) * ring / rings;
+    for (int segment = 0; segment <= segments; segment++) {
+      float phi = glm::radians(360.0f) * segment / segments;
+      glm::vec3 pos(std::sin(theta) * std::cos(phi), std::cos(theta),
+                    std::sin(theta) * std::sin(phi));
+      vertices.push_back({pos, glm::vec4(pos * 0.5f + glm::vec3(0.5f), 1.0f),
+                          glm::vec2(float(segment) / segments,
+                                    float(ring) / rings)});
+    }
+  }
+  for (int ring = 0; ring < rings; ring++) {
+    for (int segment = 0; segment < segments; segment++) {
+      GLuint a = base + ring * (segments + 1) + segment;
+      GLuint b = a + segments + 1;
+      indices.insert(indices.end(), {a, a + 1, b, b, a + 1, b + 1});
+    }
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  cpuProfilerSetThreadName("Main");
+
+  // City of side x side blocks, each a building with a cluster of
+  // spheres in its courtyard that the buildings mostly hide
+  int side = argc > 1 ? std::atoi(argv[1]) : 40;
+  if (side <= 0) {
+    std::cerr << "Usage: " << argv[0] << " [city side]" << std::endl;
+    return 1;
+  }
+
+  glfwSetErrorCallback([](int errorCode, const char *errorMsg) {
+    std::cerr << "GLFW: " << errorMsg << std::endl;
+  });
+  if (!glfwInit()) {
+    std::cerr << "Failed to initialize GLFW" << std::endl;
+    return 2;
+  }
+  Defer deferGLFWterminate([]() { glfwTerminate(); });
+
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GLFW_FALSE);
+  glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
+
+  GLFWwindow *window =
+      glfwCreateWindow(800, 600, "glsandbox occlusion", nullptr, nullptr);
+  if (window == nullptr) {
+    std::cerr << "Failed to create GLFW window" << std::endl;
+    return 2;
+  }
+  Defer deferGLFWwindowDestroy([&window]() { glfwDestroyWindow(window); });
+  glfwMakeContextCurrent(window);
+  {
+    int glversion = gladLoadGL(glfwGetProcAddress);
+    if (glversion == 0) {
+      std::cerr << "Failed to initialize OpenGL context" << std::endl;
+      return 2;
+    }
+    std::cerr << "Loaded OpenGL " << GLAD_VERSION_MAJOR(glversion) << '.'
+              << GLAD_VERSION_MINOR(glversion) << std::endl;
+  }
+  // Runs after every GL handle below is gone, while the context lives
+  Defer deferGLNamePools([]() { clearGLNamePools(); });
+  DebugOutput debugOutput(debugOutputOptionsFromEnv());
+  WindowUserData windowUserData;
+  glfwGetWindowSize(window, &windowUserData.width, &windowUserData.height);
+  glfwSetWindowUserPointer(window, &windowUserData);
+
+  glfwSwapInterval(0);
+  glClearColor(0.5f, 0.6f, 0.75f, 1.0f);
+
+  bool shouldClose = false;
+  glfwSetWindowSizeCallback(
+      window, [](GLFWwindow *window, int width, int height) {
+        auto *windowUserData =
+            static_cast<WindowUserData *>(glfwGetWindowUserPointer(window));
+        if (windowUserData == nullptr) {
+          return;
+        }
+        windowUserData->width = width;
+        windowUserData->height = height;
+        windowUserData->shouldResizeViewport = true;
+      });
+
+  // clang-format off
+  GLuint program = compileProgram(
+  R"(
+    #version 330 core
+
+    layout (location = 0) in vec3 pos;
+    layout (location = 1) in vec4 color;
+    layout (location = 3) in vec3 center;
+    layout (location = 4) in vec3 halfExtent;
+
+    uniform mat4 viewProjection;
+
+    out vec4 fColor;
+
+    void main(){
+      gl_Position = viewProjection * vec4(center + pos * halfExtent, 1.0);
+      fColor = color;
+    }
+  )",
+  R"(
+    #version 330 core
+
+    in vec4 fColor;
+
+    out vec4 FragColor;
+
+    void main() {
+      FragColor = fColor;
+    }
+  )");
+  // clang-format on
+  if (program == 0) {
+    std::cerr << "Shader compilation failed!" << std::endl;
+    return 2;
+  }
+  GLint viewProjectionLocation =
+      glGetUniformLocation(program, "viewProjection");
+
+  // Cube first, then the sphere
+  std::vector<Vertex> vertices(std::begin(cubeVertices),
+                               std::end(cubeVertices));
+  std::vector<GLuint> indices(std::begin(cubeIndices), std::end(cubeIndices));
+  GLsizei cubeIndexCount = indices.size();
+  buildSphere(48, 96, vertices, indices);
+  GLsizei sphereIndexCount = indices.size() - cubeIndexCount;
+
+  const float blockSpacing = 20.0f;
+  const float buildingHalfSize = 7.0f;
+  const int spheresPerSide = 4;
+  const float sphereRadius = 0.8f;
+  float origin = -0.5f * blockSpacing * side;
+  std::vector<Instance> buildings;
+  // The buildings again, as occluders of the software rasterizer
+  std::vector<glm::mat4> buildingWorlds;
+  std::vector<glm::vec3> cubePositions;
+  for (const Vertex &vertex : cubeVertices) {
+    cubePositions.push_back(vertex.pos);
+  }
+  // spheresPerSide^2 spheres per block, block after block
+  std::vector<Instance> spheres;
+  // Box around each block's spheres, the proxy of its occlusion query
+  std::vector<Instance> proxies;
+  BoundsArrays bounds;
+  {
+    CPU_ZONE("Build city");
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> height(8.0f, 40.0f);
+    for (int z = 0; z < side; z++) {
+      for (int x = 0; x < side; x++) {
+        glm::vec3 block(origin + x * blockSpacing, 0.0f,
+                        origin + z * blockSpacing);
+        float halfHeight = 0.5f * height(rng);
+        buildings.push_back(
+            {block + glm::vec3(0.0f, halfHeight, 0.0f),
+             glm::vec3(buildingHalfSize, halfHeight, buildingHalfSize)});
+        buildingWorlds.push_back(
+            glm::scale(glm::translate(glm::mat4(1.0f), buildings.back().center),
+                       buildings.back().halfExtent));
+        // Courtyard on the far corner of the building, inside its block
+        glm::vec3 corner =
+            block + glm::vec3(buildingHalfSize - 3.0f * sphereRadius *
+                                                     spheresPerSide,
+                              sphereRadius, buildingHalfSize + 0.5f);
+        glm::vec3 low(1e30f), high(-1e30f);
+        for (int sz = 0; sz < spheresPerSide; sz++) {
+          for (int sx = 0; sx < spheresPerSide; sx++) {
+            glm::vec3 center =
+                corner + glm::vec3(3.0f * sphereRadius * sx,
+                                   1.5f * sphereRadius * (sx ^ sz),
+                                   0.6f * sphereRadius * sz);
+            spheres.push_back({center, glm::vec3(sphereRadius)});
+            low = glm::min(low, center - glm::vec3(sphereRadius));
+            high = glm::max(high, center + glm::vec3(sphereRadius));
+          }
+        }
+        proxies.push_back({0.5f * (low + high), 0.5f * (high - low)});
+        bounds.add(0.5f * (low + high), 0.5f * (high - low));
+      }
+    }
+  }
+  std::uint32_t blockCount = proxies.size();
+  std::cerr << blockCount << " blocks, " << spheres.size() << " spheres of "
+            << sphereIndexCount / 3 << " triangles" << std::endl;
+
+  GLVertexArray vao = GLVertexArray::create();
+  GLBuffer buffers[5];
+  createGLHandles(buffers);
+  GLBuffer &vbo = buffers[0];
+  GLBuffer &ibo = buffers[1];
+  GLBuffer &buildingBuffer = buffers[2];
+  GLBuffer &sphereBuffer = buffers[3];
+  GLBuffer &proxyBuffer = buffers[4];
+  GLCall(glBindVertexArray(vao));
+
+  GLCall(glBindBuffer(GL_ARRAY_BUFFER, vbo));
+  GLCall(glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex),
+                      vertices.data(), GL_STATIC_DRAW));
+  GLCall(glEnableVertexAttribArray(0));
+  GLCall(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                               (const void *)offsetof(Vertex, pos)));
+  GLCall(glEnableVertexAttribArray(1));
+  GLCall(glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                               (const void *)offsetof(Vertex, color)));
+  GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo));
+  GLCall(glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint),
+                      indices.data(), GL_STATIC_DRAW));
+  auto upload = [](GLuint buffer, const std::vector<Instance> &instances) {
+    GLCall(glBindBuffer(GL_ARRAY_BUFFER, buffer));
+    GLCall(glBufferData(GL_ARRAY_BUFFER, instances.size() * instanceStride,
+                        instances.data(), GL_STATIC_DRAW));
+  };
+  upload(buildingBuffer, buildings);
+  upload(sphereBuffer, spheres);
+  upload(proxyBuffer, proxies);
+  GLCall(glEnableVertexAttribArray(3));
+  GLCall(glVertexAttribDivisor(3, 1));
+  GLCall(glEnableVertexAttribArray(4));
+  GLCall(glVertexAttribDivisor(4, 1));
+  // Points the instance attributes at `first` in `buffer`. Without base
+  // instance in 3.3, that is how one block is drawn on its own.
+  auto bindInstances = [](GLuint buffer, std::size_t first) {
+    std::size_t offset = first * instanceStride;
+    GLCall(glBindBuffer(GL_ARRAY_BUFFER, buffer));
+    GLCall(glVertexAttribPointer(
+        3, 3, GL_FLOAT, GL_FALSE, instanceStride,
+        (const void *)(offset + offsetof(Instance, center))));
+    GLCall(glVertexAttribPointer(
+        4, 3, GL_FLOAT, GL_FALSE, instanceStride,
+        (const void *)(offset + offsetof(Instance, halfExtent))));
+  };
+
+  GLCall(glEnable(GL_DEPTH_TEST));
+  GLCall(glEnable(GL_CULL_FACE));
+  GLCall(glUseProgram(program));
+
+  ThreadPool threadPool;
+  OcclusionQueries occlusion;
+  occlusion.resize(blockCount);
+  SoftwareOcclusion softwareOcclusion;
+  GpuProfiler gpuProfiler;
+
+  const char *tracePath = std::getenv("GLSANDBOX_TRACE");
+  std::vector<TraceEvent> traceEvents;
+  if (tracePath == nullptr) {
+    // Nobody reads them, and the growing list would allocate every so often
+    gpuProfiler.maxTraceEvents = 0;
+  }
+
+  // O cycles through no occlusion culling, GPU queries and the software
+  // rasterizer
+  OcclusionMode occlusionMode = OcclusionMode::Queries;
+  bool occlusionKeyDown = false;
+  std::vector<std::uint32_t> visible;
+  std::vector<float> distances(blockCount);
+  std::size_t frustumBlocks = 0;
+  std::size_t drawnBlocks = 0;
+  // Conditional draws the GPU turned out to skip, reported a frame late
+  std::size_t skippedBlocks = 0;
+  double gpuMs = 0.0;
+  double softwareMs = 0.0;
+  int statFrames = 0;
+  double statStart = glfwGetTime();
+
+  auto drawProxy = [&](std::uint32_t block) {
+    bindInstances(proxyBuffer, block);
+    GLCall(glDrawElementsInstanced(GL_TRIANGLES, cubeIndexCount,
+                                   GL_UNSIGNED_INT, nullptr, 1));
+  };
+  auto drawBlock = [&](std::uint32_t block) {
+    bindInstances(sphereBuffer, block * spheresPerSide * spheresPerSide);
+    GLCall(glDrawElementsInstanced(
+        GL_TRIANGLES, sphereIndexCount, GL_UNSIGNED_INT,
+        (const void *)(cubeIndexCount * sizeof(GLuint)),
+        spheresPerSide * spheresPerSide));
+  };
+
+  // GLSANDBOX_BENCHMARK and GLSANDBOX_ALLOC_STRICT runs
+  AllocationMonitor allocationMonitor(allocationMonitorOptionsFromEnv());
+  while (!shouldClose) {
+    CPU_ZONE("Frame");
+    {
+      CPU_ZONE("glfwPollEvents");
+      glfwPollEvents();
+    }
+    if (glfwWindowShouldClose(window)) {
+      shouldClose = true;
+    }
+    if (windowUserData.shouldResizeViewport) {
+      const auto &windowWidth = windowUserData.width;
+      const auto &windowHeight = windowUserData.height;
+      GLCall(glViewport(0, 0, windowWidth, windowHeight));
+      windowUserData.shouldResizeViewport = false;
+    }
+    bool occlusionKey = glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS;
+    if (occlusionKey && !occlusionKeyDown) {
+      occlusionMode = OcclusionMode((int(occlusionMode) + 1) % 3);
+      std::cerr << "Occlusion culling "
+                << occlusionModeNames[int(occlusionMode)] << std::endl;
+    }
+    occlusionKeyDown = occlusionKey;
+
+    // Walk down a street at head height, turning slowly, so buildings
+    // hide almost everything but the street ahead
+    float time = glfwGetTime();
+    float street = origin + 0.5f * blockSpacing;
+    glm::vec3 eye(street, 1.7f,
+                  origin + std::fmod(time * 8.0f, blockSpacing * side));
+    glm::vec3 ahead(0.4f * std::sin(time * 0.3f), 0.0f, 1.0f);
+    float aspect = float(windowUserData.width) /
+                   float(std::max(windowUserData.height, 1));
+    glm::mat4 viewProjection =
+        glm::perspective(glm::radians(60.0f), aspect, 0.1f, 2000.0f) *
+        glm::lookAt(eye, eye + ahead, glm::vec3(0.0f, 1.0f, 0.0f));
+
+    {
+      CPU_ZONE("Cull");
+      cullFrustum(extractFrustum(viewProjection), bounds.view(), visible);
+      // Front to back, so near blocks land in the depth buffer before
+      // far ones are tested against it
+      for (std::uint32_t block : visible) {
+        glm::vec3 center(bounds.centerX[block], bounds.centerY[block],
+                         bounds.centerZ[block]);
+        distances[block] = glm::dot(center - eye, center - eye);
+      }
+      std::sort(visible.begin(), visible.end(),
+                [&](std::uint32_t a, std::uint32_t b) {
+                  return distances[a] < distances[b];
+                });
+      frustumBlocks = visible.size();
+    }
+    if (occlusionMode == OcclusionMode::Queries) {
+      occlusion.collect();
+    } else if (occlusionMode == OcclusionMode::Software) {
+      // Decided on the CPU in this frame, before anything is submitted
+      CPU_ZONE("Software occlusion");
+      auto start = std::chrono::steady_clock::now();
+      softwareOcclusion.begin(viewProjection);
+      for (const glm::mat4 &world : buildingWorlds) {
+        softwareOcclusion.addOccluder(cubePositions, cubeIndices, world);
+      }
+      softwareOcclusion.render(&threadPool);
+      softwareOcclusion.cull(bounds.view(), visible, &threadPool);
+      softwareMs += std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+    }
+    /// ==== DRAW
+
+    gpuProfiler.beginFrame();
+    GLCall(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+    GLCall(glUniformMatrix4fv(viewProjectionLocation, 1, GL_FALSE,
+                              glm::value_ptr(viewProjection)));
+    {
+      CPU_ZONE("Draw buildings");
+      gpuProfiler.pushScope("Buildings");
+      bindInstances(buildingBuffer, 0);
+      GLCall(glDrawElementsInstanced(GL_TRIANGLES, cubeIndexCount,
+                                     GL_UNSIGNED_INT, nullptr,
+                                     buildings.size()));
+      gpuProfiler.popScope();
+    }
+    {
+      CPU_ZONE("Draw blocks");
+      gpuProfiler.pushScope("Blocks");
+      if (occlusionMode == OcclusionMode::Queries) {
+        occlusion.render(visible, drawProxy, drawBlock);
+        const OcclusionStats &stats = occlusion.stats();
+        drawnBlocks += stats.visible + stats.conditional;
+        skippedBlocks += stats.hidden;
+      } else {
+        for (std::uint32_t block : visible) {
+          drawBlock(block);
+        }
+        drawnBlocks += visible.size();
+      }
+      gpuProfiler.popScope();
+    }
+    gpuProfiler.endFrame();
+    /// ==== END DRAW
+
+    {
+      CPU_ZONE("glfwSwapBuffers");
+      glfwSwapBuffers(window);
+    }
+    // Frame scratch from two frames ago may be reused from here on
+    frameArenaEndFrame();
+    if (!allocationMonitor.endFrame(gpuProfiler.lastFrameGpuNs() * 1e-6)) {
+      shouldClose = true;
+    }
+    if (tracePath != nullptr) {
+      cpuProfilerCollect(traceEvents);
+    }
+
+    gpuMs += gpuProfiler.lastFrameGpuNs() / 1e6;
+    statFrames++;
+    double now = glfwGetTime();
+    if (now - statStart >= 1.0) {
+      char title[160];
+      std::snprintf(title, sizeof(title),
+                    "glsandbox occlusion - %zu / %zu blocks drawn, gpu %.3f "
+                    "ms, software %.3f ms, %d fps",
+                    (drawnBlocks - std::min(skippedBlocks, drawnBlocks)) /
+                        statFrames,
+                    frustumBlocks,
+                    gpuMs / statFrames, softwareMs / statFrames,
+                    int(statFrames / (now - statStart)));
+      glfwSetWindowTitle(window, title);
+      drawnBlocks = 0;
+      skippedBlocks = 0;
+      gpuMs = 0.0;
+      softwareMs = 0.0;
+      statFrames = 0;
+      statStart = now;
+    }
+  }
+
+  if (tracePath != nullptr) {
+    cpuProfilerCollect(traceEvents);
+    const auto &gpuEvents = gpuProfiler.traceEvents();
+    traceEvents.insert(traceEvents.end(), gpuEvents.begin(), gpuEvents.end());
+    auto threads = cpuProfilerThreads();
+    threads.push_back({gpuTraceThreadId, "GPU"});
+    writeChromeTrace(tracePath, traceEvents, threads);
+  }
+
+  return allocationMonitor.exitCode();
+}
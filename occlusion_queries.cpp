@@ -0,0 +1,112 @@
+#include "occlusion_queries.h"
+#include "cpu_profiler.h"
+#include "utility.h"
+
+OcclusionQueries::OcclusionQueries(unsigned retestInterval)
+    : retestInterval(retestInterval == 0 ? 1 : retestInterval) {}
+
+void OcclusionQueries::resize(std::size_t itemCount) {
+  std::size_t oldCount = queries.size();
+  if (itemCount < oldCount) {
+    std::erase_if(pendingItems,
+                  [&](std::uint32_t item) { return item >= itemCount; });
+  }
+  queries.resize(itemCount);
+  visibleItems.resize(itemCount, 1);
+  pending.resize(itemCount, notPending);
+  // At most every item each, so render() never grows them
+  pendingItems.reserve(itemCount);
+  conditionalItems.reserve(itemCount);
+  // Only the new, empty handles are filled
+  createGLHandles(queries);
+}
+
+void OcclusionQueries::collect() {
+  CPU_ZONE("OcclusionQueries::collect");
+  lastStats.hidden = 0;
+  std::size_t kept = 0;
+  for (std::uint32_t item : pendingItems) {
+    GLuint available = GL_FALSE;
+    GLCall(glGetQueryObjectuiv(queries[item], GL_QUERY_RESULT_AVAILABLE,
+                               &available));
+    if (!available) {
+      pendingItems[kept++] = item;
+      continue;
+    }
+    GLuint anySamples = GL_FALSE;
+    GLCall(glGetQueryObjectuiv(queries[item], GL_QUERY_RESULT, &anySamples));
+    visibleItems[item] = anySamples != GL_FALSE;
+    // The conditional draw gated on this query was skipped
+    lastStats.hidden += pending[item] == proxyQuery && !anySamples;
+    pending[item] = notPending;
+  }
+  pendingItems.resize(kept);
+}
+
+void OcclusionQueries::begin(std::uint32_t item, PendingQuery query) {
+  // Reissuing a query still in flight only drops its older result
+  if (pending[item] == notPending) {
+    pendingItems.push_back(item);
+  }
+  pending[item] = query;
+  GLCall(glBeginQuery(GL_ANY_SAMPLES_PASSED, queries[item]));
+}
+
+void OcclusionQueries::renderItems(std::span<const std::uint32_t> items,
+                                   ItemCallback drawProxy,
+                                   ItemCallback draw) {
+  CPU_ZONE("OcclusionQueries::render");
+  // hidden is counted by collect()
+  lastStats.visible = lastStats.retested = lastStats.conditional = 0;
+  conditionalItems.clear();
+  {
+    CPU_ZONE("Visible items");
+    for (std::uint32_t item : items) {
+      if (!visibleItems[item]) {
+        conditionalItems.push_back(item);
+        continue;
+      }
+      lastStats.visible++;
+      // Staggered, so the retests spread evenly over the frames
+      if ((item + frame) % retestInterval == 0) {
+        lastStats.retested++;
+        begin(item, retestQuery);
+        draw(item);
+        GLCall(glEndQuery(GL_ANY_SAMPLES_PASSED));
+      } else {
+        draw(item);
+      }
+    }
+  }
+  frame++;
+  if (conditionalItems.empty()) {
+    return;
+  }
+
+  {
+    CPU_ZONE("Proxies");
+    GLboolean cullFace = glIsEnabled(GL_CULL_FACE);
+    GLCall(glDisable(GL_CULL_FACE));
+    GLCall(glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE));
+    GLCall(glDepthMask(GL_FALSE));
+    for (std::uint32_t item : conditionalItems) {
+      begin(item, proxyQuery);
+      drawProxy(item);
+      GLCall(glEndQuery(GL_ANY_SAMPLES_PASSED));
+    }
+    GLCall(glDepthMask(GL_TRUE));
+    GLCall(glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE));
+    if (cullFace) {
+      GLCall(glEnable(GL_CULL_FACE));
+    }
+  }
+  {
+    CPU_ZONE("Conditional items");
+    for (std::uint32_t item : conditionalItems) {
+      lastStats.conditional++;
+      GLCall(glBeginConditionalRender(queries[item], GL_QUERY_WAIT));
+      draw(item);
+      GLCall(glEndConditionalRender());
+    }
+  }
+}
@@ -0,0 +1,161 @@
+#include "perf_hud.h"
+#include "cpu_profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+
+constexpr float textPixels = 15.0f;
+constexpr float margin = 8.0f;
+constexpr float padding = 6.0f;
+// Label column width, values start after it
+constexpr float labelWidth = 64.0f;
+constexpr float graphHeight = 64.0f;
+constexpr float frameMs60 = 1000.0f / 60.0f;
+// The graph's scale in 60 Hz frames; slower frames are cut off at the top
+constexpr float minGraphFrames = 2.0f;
+constexpr float maxGraphFrames = 8.0f;
+// Rows and the longest value the snprintf buffer holds
+constexpr std::size_t rowCount = 6;
+constexpr std::size_t labelChars = 8;
+constexpr std::size_t valueChars = 64;
+
+const glm::vec4 panelColor(0.0f, 0.0f, 0.0f, 0.65f);
+const glm::vec4 graphColor(1.0f, 1.0f, 1.0f, 0.06f);
+const glm::vec4 gridColor(1.0f, 1.0f, 1.0f, 0.25f);
+const glm::vec4 labelColor(0.7f, 0.7f, 0.7f, 1.0f);
+const glm::vec4 valueColor(1.0f, 1.0f, 1.0f, 1.0f);
+const glm::vec4 cpuColor(1.0f, 0.6f, 0.2f, 0.9f);
+const glm::vec4 gpuColor(0.3f, 0.8f, 1.0f, 1.0f);
+
+void formatBytes(char *out, std::size_t size, std::uint64_t bytes) {
+  if (bytes < 1024) {
+    std::snprintf(out, size, "%llu B", (unsigned long long)bytes);
+  } else if (bytes < (1u << 20)) {
+    std::snprintf(out, size, "%.1f KiB", bytes / 1024.0);
+  } else if (bytes < (1u << 30)) {
+    std::snprintf(out, size, "%.1f MiB", bytes / double(1u << 20));
+  } else {
+    std::snprintf(out, size, "%.2f GiB", bytes / double(1u << 30));
+  }
+}
+
+} // namespace
+
+PerfHud::PerfHud(const SdfFont &font, std::size_t historyFrames)
+    : font(font), batch(font), labels(font),
+      cpuHistory(std::max<std::size_t>(historyFrames, 2), 0.0f),
+      gpuHistory(cpuHistory.size(), 0.0f), measuredFrom(glCounters()) {
+  // Panel, graph background and grid lines, two bars a frame, and the
+  // rows' text, so a full history never grows the batch
+  batch.reserve(2 + std::size_t(maxGraphFrames) + 2 * cpuHistory.size() +
+                rowCount * (labelChars + valueChars));
+  valueRun.quads.reserve(valueChars);
+}
+
+void PerfHud::addGraph(glm::vec2 origin, glm::vec2 size) {
+  float peakMs = 0.0f;
+  for (std::size_t i = 0; i < cpuHistory.size(); i++) {
+    peakMs = std::max({peakMs, cpuHistory[i], gpuHistory[i]});
+  }
+  // Whole 60 Hz frames. Capped, since a bogus timer reading would
+  // otherwise ask for a grid line every frame's worth of it.
+  float scaleMs = std::clamp(std::ceil(peakMs / frameMs60), minGraphFrames,
+                             maxGraphFrames) *
+                  frameMs60;
+  float pixelsPerMs = size.y / scaleMs;
+  float bottom = origin.y + size.y;
+
+  batch.addRect(origin, origin + size, graphColor);
+  for (float ms = frameMs60; ms < scaleMs; ms += frameMs60) {
+    float y = std::round(bottom - ms * pixelsPerMs);
+    batch.addRect({origin.x, y}, {origin.x + size.x, y + 1.0f}, gridColor);
+  }
+  // Oldest on the left, a pixel column per frame
+  std::size_t count = cpuHistory.size();
+  for (std::size_t i = 0; i < count; i++) {
+    std::size_t sample = (next + i) % count;
+    float x = origin.x + i;
+    float cpu = std::min(cpuHistory[sample] * pixelsPerMs, size.y);
+    float gpu = std::min(gpuHistory[sample] * pixelsPerMs, size.y);
+    if (cpu > 0.0f) {
+      batch.addRect({x, bottom - cpu}, {x + 1.0f, bottom}, cpuColor);
+    }
+    if (gpu > 0.0f) {
+      float y = std::max(bottom - gpu - 1.0f, origin.y);
+      batch.addRect({x, y}, {x + 1.0f, y + 2.0f}, gpuColor);
+    }
+  }
+}
+
+void PerfHud::draw(glm::vec2 viewportSize, double cpuMs, double gpuMs) {
+  CPU_ZONE("PerfHud::draw");
+  lastFrame = glCounters() - measuredFrom;
+  cpuHistory[next] = cpuMs;
+  gpuHistory[next] = gpuMs;
+  next = (next + 1) % cpuHistory.size();
+  if (frame % memoryQueryInterval == 0) {
+    memory = queryGpuMemory();
+  }
+  frame++;
+
+  float cpuPeak = *std::max_element(cpuHistory.begin(), cpuHistory.end());
+  float gpuPeak = *std::max_element(gpuHistory.begin(), gpuHistory.end());
+  float rowHeight = std::ceil(textPixels * font.lineHeight());
+  float graphWidth = cpuHistory.size();
+  glm::vec2 origin(margin + padding);
+  glm::vec2 panelSize(graphWidth + 2.0f * padding,
+                      rowCount * rowHeight + graphHeight + 3.0f * padding);
+  batch.addRect(glm::vec2(margin), glm::vec2(margin) + panelSize, panelColor);
+
+  char value[valueChars];
+  glm::vec2 row = origin;
+  auto addRow = [&](const char *label, glm::vec4 labelTint) {
+    batch.add(labels.layout(label), row, textPixels, labelTint);
+    layoutText(font, value, valueRun);
+    batch.add(valueRun, row + glm::vec2(labelWidth, 0.0f), textPixels,
+              valueColor);
+    row.y += rowHeight;
+  };
+
+  std::snprintf(value, sizeof(value), "%6.2f ms  max %6.2f", cpuMs, cpuPeak);
+  addRow("CPU", cpuColor);
+  std::snprintf(value, sizeof(value), "%6.2f ms  max %6.2f", gpuMs, gpuPeak);
+  addRow("GPU", gpuColor);
+  addGraph(row, glm::vec2(graphWidth, graphHeight));
+  row.y += graphHeight + padding;
+
+  std::snprintf(value, sizeof(value), "%llu",
+                (unsigned long long)lastFrame.drawCalls);
+  addRow("Draws", labelColor);
+  std::snprintf(value, sizeof(value), "%llu",
+                (unsigned long long)lastFrame.stateChanges);
+  addRow("State", labelColor);
+  formatBytes(value, sizeof(value), lastFrame.uploadBytes);
+  addRow("Upload", labelColor);
+  if (!memory.available) {
+    std::snprintf(value, sizeof(value), "not reported");
+  } else {
+    char freeBytes[24];
+    formatBytes(freeBytes, sizeof(freeBytes), memory.freeBytes);
+    if (memory.totalBytes == 0) {
+      std::snprintf(value, sizeof(value), "%s free", freeBytes);
+    } else {
+      char usedBytes[24];
+      formatBytes(usedBytes, sizeof(usedBytes),
+                  memory.totalBytes - std::min(memory.freeBytes,
+                                               memory.totalBytes));
+      char totalBytes[24];
+      formatBytes(totalBytes, sizeof(totalBytes), memory.totalBytes);
+      std::snprintf(value, sizeof(value), "%s / %s", usedBytes, totalBytes);
+    }
+  }
+  addRow("VRAM", labelColor);
+
+  batch.draw(viewportSize);
+  // Leaves the overlay's own calls out of the next frame
+  measuredFrom = glCounters();
+  labels.endFrame();
+}
@@ -1,15 +1,29 @@
 #include "glad/gl.h"
 
 #include <GLFW/glfw3.h>
+#include <chrono>
+#include <cstdlib>
 #include <functional>
 #include <glm/glm.hpp>
 #include <iostream>
 #include <string_view>
 #include <vector>
 
+#include "alloc_tracker.h"
+#include "cpu_profiler.h"
+#include "debug_output.h"
+#include "font.h"
+#include "frame_arena.h"
+#include "gl_counters.h"
+#include "gl_handles.h"
+#include "gpu_profiler.h"
+#include "perf_hud.h"
+#include "shader_permutations.h"
+#include "thread_pool.h"
 #include "utility.h"
 
 int main() {
+  cpuProfilerSetThreadName("Main");
 
   glfwSetErrorCallback([](int errorCode, const char *errorMsg) {
     std::cerr << "GLFW: " << errorMsg << std::endl;
@@ -42,17 +56,12 @@ int main() {
     }
     std::cerr << "Loaded OpenGL " << GLAD_VERSION_MAJOR(glversion) << '.'
               << GLAD_VERSION_MINOR(glversion) << std::endl;
-    glEnable(GL_DEBUG_OUTPUT);
-    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
-    glDebugMessageCallback(
-        [](GLenum source, GLenum type, GLuint id, GLenum severity,
-           GLsizei length, const GLchar *message, const void *) {
-          std::cerr << "GL_DEBUG: "
-                    << (type == GL_DEBUG_TYPE_ERROR ? "GL_ERROR" : "")
-                    << message << std::endl;
-        },
-        nullptr);
   }
+  // Counted from here on, for the HUD
+  installGLCounters();
+  // Runs after every GL handle below is gone, while the context lives
+  Defer deferGLNamePools([]() { clearGLNamePools(); });
+  DebugOutput debugOutput(debugOutputOptionsFromEnv());
   WindowUserData windowUserData;
   glfwGetWindowSize(window, &windowUserData.width, &windowUserData.height);
   glfwSetWindowUserPointer(window, &windowUserData);
@@ -74,7 +83,7 @@ int main() {
       });
 
   // clang-format off
-  GLuint quadProgram = compileProgram(
+  ShaderPermutations quadShaders("quad",
   R"(
     #version 330 core
     
@@ -97,18 +106,21 @@ int main() {
     in vec4 fColor;
     in vec2 fTexCoord;
 
+    #ifdef TEXTURED
     uniform sampler2D tex;
-    uniform bool enableTex;
+    #endif
 
     out vec4 FragColor;
 
     void main() {
+    #ifdef TEXTURED
+      FragColor = texture(tex, fTexCoord);
+    #else
       FragColor = fColor;
-      if(enableTex) {
-        FragColor = texture(tex, fTexCoord);
-      }
+    #endif
     }
-  )");
+  )",
+  {"TEXTURED"});
   // clang-format on
   // clang-format off
   GLuint grayscaleProgram = compileProgram(
@@ -143,6 +155,8 @@ int main() {
     }
   )");
   // clang-format on
+  // The scene is vertex colored
+  GLuint quadProgram = quadShaders.program(0);
   if (quadProgram == 0) {
     std::cerr << "Quad shader compilation failed!" << std::endl;
     return 2;
@@ -152,16 +166,13 @@ int main() {
     return 2;
   }
 
-  GLuint vao = 0;
-  GLuint vbo = 0;
-  GLuint ibo = 0;
-  GLuint postProcessFbo = 0;
-  GLuint postProcessDepthRbo = 0;
-  GLuint postProcessColorTex = 0;
-  GLCall(glGenVertexArrays(1, &vao));
+  GLVertexArray vao = GLVertexArray::create();
+  GLBuffer vbo = GLBuffer::create();
+  GLBuffer ibo = GLBuffer::create();
+  GLFramebuffer postProcessFbo = GLFramebuffer::create();
+  GLRenderbuffer postProcessDepthRbo = GLRenderbuffer::create();
+  GLTexture postProcessColorTex = GLTexture::create();
   GLCall(glBindVertexArray(vao));
-  GLCall(glGenBuffers(1, &vbo));
-  GLCall(glGenBuffers(1, &ibo));
 
   GLCall(glBindBuffer(GL_ARRAY_BUFFER, vbo));
   GLCall(glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * 1, nullptr,
@@ -181,19 +192,16 @@ int main() {
   GLCall(glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * 1, nullptr,
                       GL_DYNAMIC_DRAW));
   GLCall(glBindVertexArray(0));
-  GLCall(glGenTextures(1, &postProcessColorTex));
   GLCall(glBindTexture(GL_TEXTURE_2D, postProcessColorTex));
   GLCall(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, windowUserData.width,
                       windowUserData.height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
                       nullptr));
   GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
   GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
-  GLCall(glGenRenderbuffers(1, &postProcessDepthRbo));
   GLCall(glBindRenderbuffer(GL_RENDERBUFFER, postProcessDepthRbo));
   GLCall(glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8,
                                windowUserData.width, windowUserData.height));
 
-  GLCall(glGenFramebuffers(1, &postProcessFbo));
   GLCall(glBindFramebuffer(GL_FRAMEBUFFER, postProcessFbo));
   GLCall(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
                                 GL_TEXTURE_2D, postProcessColorTex, 0));
@@ -230,9 +238,41 @@ int main() {
 
   GLuint quadIndexBuffer[] = {0, 1, 2, 2, 3, 0};
 
-  GLCall(glBindVertexArray(vao));
+  // HUD font, GLSANDBOX_FONT or a common system font. The sample runs
+  // without the HUD if neither loads.
+  const char *fontPath = std::getenv("GLSANDBOX_FONT");
+  if (fontPath == nullptr) {
+    fontPath = "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf";
+  }
+  ThreadPool pool;
+  Font font;
+  SdfFont sdfFont;
+  bool hudEnabled = font.load(fontPath) && sdfFont.build(font, pool);
+  if (hudEnabled) {
+    sdfFont.upload();
+  } else {
+    std::cerr << "No font, drawing without the HUD" << std::endl;
+  }
+  PerfHud perfHud(sdfFont);
+  hudEnabled = hudEnabled && perfHud.valid();
+
+  GpuProfiler gpuProfiler;
+  const char *tracePath = std::getenv("GLSANDBOX_TRACE");
+  std::vector<TraceEvent> traceEvents;
+  if (tracePath == nullptr) {
+    // Nobody reads them, and the growing list would allocate every so often
+    gpuProfiler.maxTraceEvents = 0;
+  }
+
+  // GLSANDBOX_BENCHMARK and GLSANDBOX_ALLOC_STRICT runs
+  AllocationMonitor allocationMonitor(allocationMonitorOptionsFromEnv());
   while (!shouldClose) {
-    glfwPollEvents();
+    CPU_ZONE("Frame");
+    auto frameStart = std::chrono::steady_clock::now();
+    {
+      CPU_ZONE("glfwPollEvents");
+      glfwPollEvents();
+    }
     if (glfwWindowShouldClose(window)) {
       shouldClose = true;
     }
@@ -249,42 +289,92 @@ int main() {
       windowUserData.shouldResizeViewport = false;
     }
     /// ==== DRAW
+    gpuProfiler.beginFrame();
 
+    gpuProfiler.pushScope("Scene");
     glBindFramebuffer(GL_FRAMEBUFFER, postProcessFbo);
     GLCall(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
     GLCall(glEnable(GL_DEPTH_TEST));
 
-    GLCall(glBindBuffer(GL_ARRAY_BUFFER, vbo));
-    GLCall(glBufferData(GL_ARRAY_BUFFER, sizeof(triangleVertexBuffer),
-                        triangleVertexBuffer, GL_DYNAMIC_DRAW));
-    GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo));
-    GLCall(glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(triangleIndexBuffer),
-                        triangleIndexBuffer, GL_DYNAMIC_DRAW));
-    GLCall(glUseProgram(quadProgram));
-    GLCall(glDrawElements(GL_TRIANGLES,
-                          sizeof(triangleIndexBuffer) / sizeof(GLuint),
-                          GL_UNSIGNED_INT, nullptr));
+    {
+      CPU_ZONE("Upload triangles");
+      // The text batch binds its own
+      GLCall(glBindVertexArray(vao));
+      GLCall(glBindBuffer(GL_ARRAY_BUFFER, vbo));
+      GLCall(glBufferData(GL_ARRAY_BUFFER, sizeof(triangleVertexBuffer),
+                          triangleVertexBuffer, GL_DYNAMIC_DRAW));
+      GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo));
+      GLCall(glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(triangleIndexBuffer),
+                          triangleIndexBuffer, GL_DYNAMIC_DRAW));
+    }
+    {
+      CPU_ZONE("Draw triangles");
+      GLCall(glUseProgram(quadProgram));
+      GLCall(glDrawElements(GL_TRIANGLES,
+                            sizeof(triangleIndexBuffer) / sizeof(GLuint),
+                            GL_UNSIGNED_INT, nullptr));
+    }
     GLCall(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+    gpuProfiler.popScope();
 
+    gpuProfiler.pushScope("Grayscale");
     GLCall(glActiveTexture(GL_TEXTURE0));
     GLCall(glBindTexture(GL_TEXTURE_2D, postProcessColorTex));
 
     GLCall(glDisable(GL_DEPTH_TEST));
-    GLCall(glBindBuffer(GL_ARRAY_BUFFER, vbo));
-    GLCall(glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertexBuffer),
-                        quadVertexBuffer, GL_DYNAMIC_DRAW));
-    GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo));
-    GLCall(glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(quadIndexBuffer),
-                        quadIndexBuffer, GL_DYNAMIC_DRAW));
-    GLCall(glUseProgram(grayscaleProgram));
-    GLCall(glUniform1i(glGetUniformLocation(grayscaleProgram, "tex"), 0));
-    GLCall(glDrawElements(GL_TRIANGLES,
-                          sizeof(quadIndexBuffer) / sizeof(GLuint),
-                          GL_UNSIGNED_INT, nullptr));
+    {
+      CPU_ZONE("Upload quad");
+      GLCall(glBindBuffer(GL_ARRAY_BUFFER, vbo));
+      GLCall(glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertexBuffer),
+                          quadVertexBuffer, GL_DYNAMIC_DRAW));
+      GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo));
+      GLCall(glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(quadIndexBuffer),
+                          quadIndexBuffer, GL_DYNAMIC_DRAW));
+    }
+    {
+      CPU_ZONE("Draw grayscale");
+      GLCall(glUseProgram(grayscaleProgram));
+      GLCall(glUniform1i(glGetUniformLocation(grayscaleProgram, "tex"), 0));
+      GLCall(glDrawElements(GL_TRIANGLES,
+                            sizeof(quadIndexBuffer) / sizeof(GLuint),
+                            GL_UNSIGNED_INT, nullptr));
+    }
+    gpuProfiler.popScope();
+
+    if (hudEnabled) {
+      gpuProfiler.pushScope("HUD");
+      std::chrono::duration<double, std::milli> cpuMs =
+          std::chrono::steady_clock::now() - frameStart;
+      perfHud.draw(glm::vec2(windowUserData.width, windowUserData.height),
+                   cpuMs.count(), gpuProfiler.lastFrameGpuNs() * 1e-6);
+      gpuProfiler.popScope();
+    }
+
+    gpuProfiler.endFrame();
     /// ==== END DRAW
 
-    glfwSwapBuffers(window);
+    {
+      CPU_ZONE("glfwSwapBuffers");
+      glfwSwapBuffers(window);
+    }
+    // Frame scratch from two frames ago may be reused from here on
+    frameArenaEndFrame();
+    if (!allocationMonitor.endFrame(gpuProfiler.lastFrameGpuNs() * 1e-6)) {
+      shouldClose = true;
+    }
+    if (tracePath != nullptr) {
+      cpuProfilerCollect(traceEvents);
+    }
+  }
+
+  if (tracePath != nullptr) {
+    cpuProfilerCollect(traceEvents);
+    const auto &gpuEvents = gpuProfiler.traceEvents();
+    traceEvents.insert(traceEvents.end(), gpuEvents.begin(), gpuEvents.end());
+    auto threads = cpuProfilerThreads();
+    threads.push_back({gpuTraceThreadId, "GPU"});
+    writeChromeTrace(tracePath, traceEvents, threads);
   }
 
-  return 0;
+  return allocationMonitor.exitCode();
 }
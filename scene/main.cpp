@@ -0,0 +1,451 @@
+#include "glad/gl.h"
+
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <span>
+#include <vector>
+
+#include "alloc_tracker.h"
+#include "cpu_profiler.h"
+#include "debug_output.h"
+#include "ecs.h"
+#include "frame_arena.h"
+#include "gl_handles.h"
+#include "scene_components.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include "transform_hierarchy.h"
+#include "utility.h"
+
+// Unit cube and pyramid in one buffer, each drawn once per visible
+// object with its world matrix
+static const Vertex meshVertices[] = {
+    {{-1.0f, -1.0f, -1.0f}, {0.3f, 0.3f, 0.3f, 1.0f}, {0.0f, 0.0f}},
+    {{1.0f, -1.0f, -1.0f}, {0.5f, 0.3f, 0.3f, 1.0f}, {1.0f, 0.0f}},
+    {{1.0f, 1.0f, -1.0f}, {0.7f, 0.7f, 0.3f, 1.0f}, {1.0f, 1.0f}},
+    {{-1.0f, 1.0f, -1.0f}, {0.3f, 0.5f, 0.3f, 1.0f}, {0.0f, 1.0f}},
+    {{-1.0f, -1.0f, 1.0f}, {0.3f, 0.3f, 0.5f, 1.0f}, {0.0f, 0.0f}},
+    {{1.0f, -1.0f, 1.0f}, {0.5f, 0.3f, 0.5f, 1.0f}, {1.0f, 0.0f}},
+    {{1.0f, 1.0f, 1.0f}, {0.9f, 0.9f, 0.9f, 1.0f}, {1.0f, 1.0f}},
+    {{-1.0f, 1.0f, 1.0f}, {0.3f, 0.7f, 0.7f, 1.0f}, {0.0f, 1.0f}},
+    {{-1.0f, -1.0f, -1.0f}, {0.6f, 0.2f, 0.2f, 1.0f}, {0.0f, 0.0f}},
+    {{1.0f, -1.0f, -1.0f}, {0.6f, 0.4f, 0.2f, 1.0f}, {1.0f, 0.0f}},
+    {{1.0f, -1.0f, 1.0f}, {0.6f, 0.2f, 0.4f, 1.0f}, {1.0f, 1.0f}},
+    {{-1.0f, -1.0f, 1.0f}, {0.4f, 0.2f, 0.2f, 1.0f}, {0.0f, 1.0f}},
+    {{0.0f, 1.0f, 0.0f}, {1.0f, 0.8f, 0.4f, 1.0f}, {0.5f, 0.5f}},
+};
+
+static const GLuint meshIndices[] = {
+    // Cube
+    0, 2, 1, 0, 3, 2, 4, 5, 6, 4, 6, 7, 0, 1, 5, 0, 5, 4,
+    3, 6, 2, 3, 7, 6, 0, 4, 7, 0, 7, 3, 1, 2, 6, 1, 6, 5,
+    // Pyramid
+    8, 9, 10, 8, 10, 11, 8, 12, 9, 9, 12, 10, 10, 12, 11, 11, 12, 8,
+};
+
+// Index ranges of meshIndices, by Renderable::mesh
+struct MeshRange {
+  GLsizei indexCount;
+  GLuint firstIndex;
+};
+static const MeshRange meshRanges[] = {{36, 0}, {18, 36}};
+constexpr std::uint32_t meshCount = std::size(meshRanges);
+
+int main(int argc, char **argv) {
+  cpuProfilerSetThreadName("Main");
+
+  // Objects on a square grid, 1M by default
+  int side = argc > 1 ? std::atoi(argv[1]) : 1000;
+  if (side <= 0) {
+    std::cerr << "Usage: " << argv[0] << " [grid side]" << std::endl;
+    return 1;
+  }
+
+  glfwSetErrorCallback([](int errorCode, const char *errorMsg) {
+    std::cerr << "GLFW: " << errorMsg << std::endl;
+  });
+  if (!glfwInit()) {
+    std::cerr << "Failed to initialize GLFW" << std::endl;
+    return 2;
+  }
+  Defer deferGLFWterminate([]() { glfwTerminate(); });
+
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GLFW_FALSE);
+  glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
+
+  GLFWwindow *window =
+      glfwCreateWindow(800, 600, "glsandbox scene", nullptr, nullptr);
+  if (window == nullptr) {
+    std::cerr << "Failed to create GLFW window" << std::endl;
+    return 2;
+  }
+  Defer deferGLFWwindowDestroy([&window]() { glfwDestroyWindow(window); });
+  glfwMakeContextCurrent(window);
+  {
+    int glversion = gladLoadGL(glfwGetProcAddress);
+    if (glversion == 0) {
+      std::cerr << "Failed to initialize OpenGL context" << std::endl;
+      return 2;
+    }
+    std::cerr << "Loaded OpenGL " << GLAD_VERSION_MAJOR(glversion) << '.'
+              << GLAD_VERSION_MINOR(glversion) << std::endl;
+  }
+  // Runs after every GL handle below is gone, while the context lives
+  Defer deferGLNamePools([]() { clearGLNamePools(); });
+  DebugOutput debugOutput(debugOutputOptionsFromEnv());
+  WindowUserData windowUserData;
+  glfwGetWindowSize(window, &windowUserData.width, &windowUserData.height);
+  glfwSetWindowUserPointer(window, &windowUserData);
+
+  glfwSwapInterval(0);
+  glClearColor(0.05f, 0.05f, 0.08f, 1.0f);
+
+  bool shouldClose = false;
+  glfwSetWindowSizeCallback(
+      window, [](GLFWwindow *window, int width, int height) {
+        auto *windowUserData =
+            static_cast<WindowUserData *>(glfwGetWindowUserPointer(window));
+        if (windowUserData == nullptr) {
+          return;
+        }
+        windowUserData->width = width;
+        windowUserData->height = height;
+        windowUserData->shouldResizeViewport = true;
+      });
+
+  // clang-format off
+  GLuint cubeProgram = compileProgram(
+  R"(
+    #version 330 core
+
+    layout (location = 0) in vec3 pos;
+    layout (location = 1) in vec4 color;
+    layout (location = 3) in uint worldSlot;
+
+    uniform mat4 viewProjection;
+    // Four texels per world matrix, one per column
+    uniform samplerBuffer worlds;
+
+    out vec4 fColor;
+
+    void main(){
+      int texel = int(worldSlot) * 4;
+      mat4 world = mat4(texelFetch(worlds, texel),
+                        texelFetch(worlds, texel + 1),
+                        texelFetch(worlds, texel + 2),
+                        texelFetch(worlds, texel + 3));
+      gl_Position = viewProjection * world * vec4(pos, 1.0);
+      fColor = color;
+    }
+  )",
+  R"(
+    #version 330 core
+
+    in vec4 fColor;
+
+    out vec4 FragColor;
+
+    void main() {
+      FragColor = fColor;
+    }
+  )");
+  // clang-format on
+  if (cubeProgram == 0) {
+    std::cerr << "Cube shader compilation failed!" << std::endl;
+    return 2;
+  }
+  GLint viewProjectionLocation =
+      glGetUniformLocation(cubeProgram, "viewProjection");
+  GLint worldsLocation = glGetUniformLocation(cubeProgram, "worlds");
+
+  ThreadPool threadPool;
+
+  // Cubes are grouped into square tiles of tileSide x tileSide, each tile
+  // a node that the cubes hang off. Every spinTile-th tile turns, moving
+  // all of its cubes through the hierarchy.
+  const int tileSide = 10;
+  const int spinTile = 64;
+  const float spacing = 4.0f;
+  int tilesPerSide = (side + tileSide - 1) / tileSide;
+  float tileExtent = spacing * tileSide;
+  float origin = -0.5f * spacing * side;
+  auto tileCenter = [&](int tile) {
+    return glm::vec3(origin + (tile % tilesPerSide + 0.5f) * tileExtent, 0.0f,
+                     origin + (tile / tilesPerSide + 0.5f) * tileExtent);
+  };
+
+  // Every object is an entity with its node, bounds and mesh; the cull
+  // pass reads all three straight from the entity chunks
+  TransformHierarchy hierarchy;
+  World world;
+  std::vector<Entity> objectEntities;
+  TransformId firstCube = 0;
+  {
+    CPU_ZONE("Build scene");
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> jitter(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> size(0.3f, 1.2f);
+    for (int tile = 0; tile < tilesPerSide * tilesPerSide; tile++) {
+      hierarchy.add(noTransform,
+                    glm::translate(glm::mat4(1.0f), tileCenter(tile)));
+    }
+    firstCube = hierarchy.size();
+    objectEntities.reserve(std::size_t(side) * side);
+    for (int z = 0; z < side; z++) {
+      for (int x = 0; x < side; x++) {
+        int tile = (z / tileSide) * tilesPerSide + x / tileSide;
+        float halfSize = size(rng);
+        glm::vec3 center(origin + x * spacing + jitter(rng),
+                         halfSize + 2.0f * std::fabs(jitter(rng)),
+                         origin + z * spacing + jitter(rng));
+        glm::mat4 local = glm::scale(
+            glm::translate(glm::mat4(1.0f), center - tileCenter(tile)),
+            glm::vec3(halfSize));
+        TransformId node = hierarchy.add(tile, local);
+        // Bounds are filled in from the world matrices on the first update
+        std::uint32_t mesh = (x + z) % 5 == 0 ? 1 : 0;
+        objectEntities.push_back(
+            world.create(Transform{node}, Bounds{}, Renderable{mesh}));
+      }
+    }
+  }
+  std::cerr << world.size() << " objects in " << hierarchy.size()
+            << " transforms" << std::endl;
+
+  GLVertexArray vao = GLVertexArray::create();
+  GLBuffer buffers[4];
+  createGLHandles(buffers);
+  GLBuffer &vbo = buffers[0];
+  GLBuffer &ibo = buffers[1];
+  GLBuffer &instanceBuffer = buffers[2];
+  GLBuffer &worldBuffer = buffers[3];
+  GLTexture worldTexture = GLTexture::create();
+  GLCall(glBindVertexArray(vao));
+
+  GLCall(glBindBuffer(GL_ARRAY_BUFFER, vbo));
+  GLCall(glBufferData(GL_ARRAY_BUFFER, sizeof(meshVertices), meshVertices,
+                      GL_STATIC_DRAW));
+  GLCall(glEnableVertexAttribArray(0));
+  GLCall(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                               (const void *)offsetof(Vertex, pos)));
+  GLCall(glEnableVertexAttribArray(1));
+  GLCall(glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                               (const void *)offsetof(Vertex, color)));
+  GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo));
+  GLCall(glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(meshIndices),
+                      meshIndices, GL_STATIC_DRAW));
+  // World matrix slot of each drawn object, refilled every frame
+  GLCall(glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer));
+  GLCall(glEnableVertexAttribArray(3));
+  GLCall(glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(GLuint),
+                                nullptr));
+  GLCall(glVertexAttribDivisor(3, 1));
+  // A uniform block tops out at a thousand or so matrices, a texture
+  // buffer holds all of them
+  GLCall(glBindBuffer(GL_TEXTURE_BUFFER, worldBuffer));
+  GLCall(glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::mat4), nullptr,
+                      GL_DYNAMIC_DRAW));
+  GLCall(glBindTexture(GL_TEXTURE_BUFFER, worldTexture));
+  GLCall(glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, worldBuffer));
+
+  GLCall(glEnable(GL_DEPTH_TEST));
+  GLCall(glEnable(GL_CULL_FACE));
+  GLCall(glUseProgram(cubeProgram));
+  GLCall(glUniform1i(worldsLocation, 0));
+
+  const char *tracePath = std::getenv("GLSANDBOX_TRACE");
+  std::vector<TraceEvent> traceEvents;
+
+  // C toggles culling, to compare against submitting everything
+  bool cullingEnabled = true;
+  bool cullKeyDown = false;
+  Frustum frustum;
+  // Planes every bound is inside of, for drawing with culling off
+  Frustum everything;
+  for (auto &plane : everything.planes) {
+    plane = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+  }
+  std::vector<DrawInstance> visible;
+  std::vector<GLuint> instances;
+  // Every object with culling off, so gathering never grows it
+  instances.reserve(world.size());
+  std::uint32_t meshInstances[meshCount + 1];
+  double cullMs = 0.0;
+  int statFrames = 0;
+  double statStart = glfwGetTime();
+
+  SystemScheduler systems;
+  systems.add(
+      "Update bounds", componentMask<Transform>(), componentMask<Bounds>(),
+      [&](World &world) {
+        // Only objects that moved: the unit box under the world matrix
+        std::span<const std::uint32_t> changed = hierarchy.changed();
+        threadPool.parallelFor(
+            changed.size(), 4096, [&](std::size_t begin, std::size_t end) {
+              for (std::size_t i = begin; i < end; i++) {
+                TransformId node = hierarchy.id(changed[i]);
+                if (node < firstCube) {
+                  continue;
+                }
+                world.set(objectEntities[node - firstCube],
+                          transformBounds(hierarchy.worldMatrices()[changed[i]],
+                                          glm::vec3(0.0f), glm::vec3(1.0f)));
+              }
+            });
+      });
+  systems.add("Cull",
+              componentMask<Transform, Bounds, Renderable>(), 0,
+              [&](World &world) {
+                auto start = std::chrono::steady_clock::now();
+                collectVisible(world, cullingEnabled ? frustum : everything,
+                               visible, &threadPool);
+                cullMs += std::chrono::duration<double, std::milli>(
+                              std::chrono::steady_clock::now() - start)
+                              .count();
+              });
+
+  // GLSANDBOX_BENCHMARK and GLSANDBOX_ALLOC_STRICT runs
+  AllocationMonitor allocationMonitor(allocationMonitorOptionsFromEnv());
+  while (!shouldClose) {
+    CPU_ZONE("Frame");
+    {
+      CPU_ZONE("glfwPollEvents");
+      glfwPollEvents();
+    }
+    if (glfwWindowShouldClose(window)) {
+      shouldClose = true;
+    }
+    if (windowUserData.shouldResizeViewport) {
+      const auto &windowWidth = windowUserData.width;
+      const auto &windowHeight = windowUserData.height;
+      GLCall(glViewport(0, 0, windowWidth, windowHeight));
+      windowUserData.shouldResizeViewport = false;
+    }
+    bool cullKey = glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS;
+    if (cullKey && !cullKeyDown) {
+      cullingEnabled = !cullingEnabled;
+      std::cerr << "Culling " << (cullingEnabled ? "on" : "off")
+                << std::endl;
+    }
+    cullKeyDown = cullKey;
+
+    // Fly in a slow circle over the field, looking ahead and down
+    float time = glfwGetTime();
+    float orbit = 0.25f * side;
+    glm::vec3 eye(orbit * std::cos(time * 0.05f), 40.0f,
+                  orbit * std::sin(time * 0.05f));
+    glm::vec3 ahead(-std::sin(time * 0.05f), -0.3f, std::cos(time * 0.05f));
+    float aspect = float(windowUserData.width) /
+                   float(std::max(windowUserData.height, 1));
+    glm::mat4 viewProjection =
+        glm::perspective(glm::radians(60.0f), aspect, 0.5f, 1000.0f) *
+        glm::lookAt(eye, eye + ahead, glm::vec3(0.0f, 1.0f, 0.0f));
+
+    {
+      CPU_ZONE("Animate");
+      for (int tile = 0; tile < tilesPerSide * tilesPerSide;
+           tile += spinTile) {
+        hierarchy.setLocal(
+            tile, glm::rotate(glm::translate(glm::mat4(1.0f),
+                                             tileCenter(tile)),
+                              time * (1.0f + tile % 3),
+                              glm::vec3(0.0f, 1.0f, 0.0f)));
+      }
+      hierarchy.update(&threadPool);
+      hierarchy.upload(worldBuffer);
+    }
+    frustum = extractFrustum(viewProjection);
+    systems.run(world, &threadPool);
+    {
+      CPU_ZONE("Gather instances");
+      // Grouped by mesh, so each mesh is one instanced draw
+      std::fill(std::begin(meshInstances), std::end(meshInstances), 0);
+      for (const DrawInstance &instance : visible) {
+        meshInstances[instance.mesh + 1]++;
+      }
+      for (std::uint32_t mesh = 0; mesh < meshCount; mesh++) {
+        meshInstances[mesh + 1] += meshInstances[mesh];
+      }
+      std::uint32_t cursor[meshCount];
+      std::copy(meshInstances, meshInstances + meshCount, cursor);
+      instances.resize(visible.size());
+      for (const DrawInstance &instance : visible) {
+        instances[cursor[instance.mesh]++] = hierarchy.slot(instance.node);
+      }
+    }
+    /// ==== DRAW
+
+    GLCall(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+    {
+      CPU_ZONE("Draw visible");
+      GLCall(glUniformMatrix4fv(viewProjectionLocation, 1, GL_FALSE,
+                                glm::value_ptr(viewProjection)));
+      // Orphan the previous frame's instances instead of waiting on them
+      GLCall(glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer));
+      GLCall(glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(GLuint),
+                          instances.data(), GL_STREAM_DRAW));
+      for (std::uint32_t mesh = 0; mesh < meshCount; mesh++) {
+        GLsizei count = meshInstances[mesh + 1] - meshInstances[mesh];
+        if (count == 0) {
+          continue;
+        }
+        GLCall(glVertexAttribIPointer(
+            3, 1, GL_UNSIGNED_INT, sizeof(GLuint),
+            (const void *)(meshInstances[mesh] * sizeof(GLuint))));
+        GLCall(glDrawElementsInstanced(
+            GL_TRIANGLES, meshRanges[mesh].indexCount, GL_UNSIGNED_INT,
+            (const void *)(meshRanges[mesh].firstIndex * sizeof(GLuint)),
+            count));
+      }
+    }
+    /// ==== END DRAW
+
+    {
+      CPU_ZONE("glfwSwapBuffers");
+      glfwSwapBuffers(window);
+    }
+    // Frame scratch from two frames ago may be reused from here on
+    frameArenaEndFrame();
+    if (!allocationMonitor.endFrame()) {
+      shouldClose = true;
+    }
+    if (tracePath != nullptr) {
+      cpuProfilerCollect(traceEvents);
+    }
+
+    statFrames++;
+    double now = glfwGetTime();
+    if (now - statStart >= 1.0) {
+      char title[128];
+      std::snprintf(title, sizeof(title),
+                    "glsandbox scene - %zu / %zu visible, cull %.3f ms, "
+                    "%d fps",
+                    visible.size(), world.size(), cullMs / statFrames,
+                    int(statFrames / (now - statStart)));
+      glfwSetWindowTitle(window, title);
+      cullMs = 0.0;
+      statFrames = 0;
+      statStart = now;
+    }
+  }
+
+  if (tracePath != nullptr) {
+    cpuProfilerCollect(traceEvents);
+    writeChromeTrace(tracePath, traceEvents, cpuProfilerThreads());
+  }
+
+  return allocationMonitor.exitCode();
+}
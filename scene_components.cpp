@@ -0,0 +1,77 @@
+#include "scene_components.h"
+#include "cpu_profiler.h"
+#include "frame_arena.h"
+
+#include <cstring>
+
+namespace {
+
+// Chunks per parallelFor job
+constexpr std::size_t cullChunkGrain = 8;
+
+} // namespace
+
+Bounds transformBounds(const glm::mat4 &world, glm::vec3 center,
+                       glm::vec3 extent) {
+  glm::vec3 worldCenter = glm::vec3(world * glm::vec4(center, 1.0f));
+  glm::vec3 worldExtent = glm::abs(glm::vec3(world[0])) * extent.x +
+                          glm::abs(glm::vec3(world[1])) * extent.y +
+                          glm::abs(glm::vec3(world[2])) * extent.z;
+  return {worldCenter.x, worldCenter.y, worldCenter.z, worldExtent.x,
+          worldExtent.y, worldExtent.z, glm::length(worldExtent)};
+}
+
+BoundsView boundsView(const ChunkView &chunk) {
+  return {chunk.field<Bounds>(0), chunk.field<Bounds>(1),
+          chunk.field<Bounds>(2), chunk.field<Bounds>(3),
+          chunk.field<Bounds>(4), chunk.field<Bounds>(5),
+          chunk.field<Bounds>(6), chunk.size()};
+}
+
+void collectVisible(const World &world, const Frustum &frustum,
+                    std::vector<DrawInstance> &visible, ThreadPool *pool) {
+  CPU_ZONE("collectVisible");
+  // Scratch comes from the calling thread's frame arena
+  std::pmr::vector<ChunkView> chunks = world.chunks(
+      componentMask<Transform, Bounds, Renderable>(), frameResource());
+  // Every chunk writes at its first entity's position, then the runs
+  // close ranks
+  std::pmr::vector<std::size_t> firsts(chunks.size() + 1, 0,
+                                       frameResource());
+  for (std::size_t i = 0; i < chunks.size(); i++) {
+    firsts[i + 1] = firsts[i] + chunks[i].size();
+  }
+  std::pmr::vector<std::size_t> counts(chunks.size(), frameResource());
+  visible.resize(firsts.back());
+  auto cullChunks = [&](std::size_t begin, std::size_t end) {
+    // Every row holds a Bounds, so no chunk has more rows than this. On
+    // the stack, as a job's scratch would add up in the arena of a thread
+    // that happens to take more jobs than ever before.
+    std::uint32_t rows[entityChunkBytes / sizeof(Bounds)];
+    for (std::size_t i = begin; i < end; i++) {
+      const ChunkView &chunk = chunks[i];
+      std::size_t count = cullFrustum(frustum, boundsView(chunk), 0, rows);
+      const Transform *transforms = chunk.array<const Transform>();
+      const Renderable *renderables = chunk.array<const Renderable>();
+      DrawInstance *out = visible.data() + firsts[i];
+      for (std::size_t k = 0; k < count; k++) {
+        out[k] = {renderables[rows[k]].mesh, transforms[rows[k]].node};
+      }
+      counts[i] = count;
+    }
+  };
+  if (pool == nullptr) {
+    cullChunks(0, chunks.size());
+  } else {
+    pool->parallelFor(chunks.size(), cullChunkGrain, cullChunks);
+  }
+  std::size_t total = 0;
+  for (std::size_t i = 0; i < chunks.size(); i++) {
+    if (total != firsts[i]) {
+      std::memmove(visible.data() + total, visible.data() + firsts[i],
+                   counts[i] * sizeof(DrawInstance));
+    }
+    total += counts[i];
+  }
+  visible.resize(total);
+}
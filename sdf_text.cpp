@@ -0,0 +1,494 @@
+#include "sdf_text.h"
+#include "cpu_profiler.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <iostream>
+
+namespace {
+
+// clang-format off
+constexpr std::string_view textVertexShader = R"(
+  #version 330 core
+
+  layout (location = 0) in vec3 pos;
+  layout (location = 1) in vec4 color;
+  layout (location = 2) in vec2 texCoord;
+
+  uniform vec2 viewportSize;
+
+  out vec4 fColor;
+  out vec2 fTexCoord;
+
+  void main() {
+    vec2 ndc = pos.xy / viewportSize * 2.0 - 1.0;
+    gl_Position = vec4(ndc.x, -ndc.y, 0.0, 1.0);
+    fColor = color;
+    fTexCoord = texCoord;
+  }
+)";
+
+constexpr std::string_view textFragmentShader = R"(
+  #version 330 core
+
+  in vec4 fColor;
+  in vec2 fTexCoord;
+
+  uniform sampler2D atlas;
+
+  out vec4 FragColor;
+
+  void main() {
+    // 0.5 is the outline. Blending over the distance one screen pixel
+    // covers keeps the edge a pixel wide at any scale.
+    float distance = texture(atlas, fTexCoord).a;
+    float width = max(fwidth(distance) * 0.5, 1.0 / 255.0);
+    float coverage = smoothstep(0.5 - width, 0.5 + width, distance);
+    FragColor = vec4(fColor.rgb, fColor.a * coverage);
+  }
+)";
+// clang-format on
+
+// Outline edge in glyph image pixels, y down
+struct Edge {
+  glm::vec2 a;
+  glm::vec2 b;
+};
+
+// Largest distance in pixels the flattened curves stray from the outline
+constexpr float flattenTolerance = 0.05f;
+
+// Scales the outline into the image and flattens its curves
+void flattenOutline(std::span<const OutlineSegment> segments, float scale,
+                    int left, int top, std::vector<Edge> &edges) {
+  auto toImage = [&](glm::vec2 p) {
+    return glm::vec2(p.x * scale - left, top - p.y * scale);
+  };
+  edges.clear();
+  for (const auto &segment : segments) {
+    glm::vec2 from = toImage(segment.from);
+    glm::vec2 to = toImage(segment.to);
+    if (!segment.curve) {
+      edges.push_back({from, to});
+      continue;
+    }
+    glm::vec2 control = toImage(segment.control);
+    // A quadratic strays a quarter of this from its chord, and n pieces
+    // cut that by n squared
+    float deviation = glm::length(from - control * 2.0f + to) * 0.25f;
+    int steps = std::clamp(
+        int(std::ceil(std::sqrt(deviation / flattenTolerance))), 1, 32);
+    glm::vec2 previous = from;
+    for (int step = 1; step <= steps; step++) {
+      float t = float(step) / steps;
+      float s = 1.0f - t;
+      glm::vec2 point = from * (s * s) + control * (2.0f * s * t) +
+                        to * (t * t);
+      edges.push_back({previous, point});
+      previous = point;
+    }
+  }
+}
+
+float distanceToEdge(glm::vec2 p, const Edge &edge) {
+  glm::vec2 along = edge.b - edge.a;
+  float lengthSquared = glm::dot(along, along);
+  float t = lengthSquared > 0.0f
+                ? std::clamp(glm::dot(p - edge.a, along) / lengthSquared,
+                             0.0f, 1.0f)
+                : 0.0f;
+  return glm::length(p - (edge.a + along * t));
+}
+
+// Alpha is 0.5 on the outline, rising inside and falling outside until
+// `spread` pixels away. Inside follows the nonzero winding rule.
+Image rasterizeSdf(std::span<const Edge> edges, int width, int height,
+                   float spread) {
+  Image image;
+  image.width = width;
+  image.height = height;
+  image.pixels.resize(std::size_t(width) * height * 4);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      glm::vec2 p(x + 0.5f, y + 0.5f);
+      float nearest = spread;
+      int winding = 0;
+      for (const auto &edge : edges) {
+        nearest = std::min(nearest, distanceToEdge(p, edge));
+        // Crossings of a ray from p towards +x
+        if ((edge.a.y <= p.y) != (edge.b.y <= p.y)) {
+          float t = (p.y - edge.a.y) / (edge.b.y - edge.a.y);
+          if (edge.a.x + (edge.b.x - edge.a.x) * t > p.x) {
+            winding += edge.b.y > edge.a.y ? 1 : -1;
+          }
+        }
+      }
+      float distance = winding != 0 ? nearest : -nearest;
+      float value = std::clamp(0.5f + distance / (2.0f * spread), 0.0f, 1.0f);
+      std::uint8_t *pixel = &image.pixels[(std::size_t(y) * width + x) * 4];
+      pixel[0] = 255;
+      pixel[1] = 255;
+      pixel[2] = 255;
+      pixel[3] = std::uint8_t(std::lround(value * 255.0f));
+    }
+  }
+  return image;
+}
+
+// Decodes the UTF-8 sequence at `at` and moves past it. A malformed byte
+// decodes to U+FFFD on its own.
+char32_t nextCodepoint(std::string_view text, std::size_t &at) {
+  std::uint8_t lead = text[at++];
+  if (lead < 0x80) {
+    return lead;
+  }
+  int extra;
+  char32_t codepoint;
+  if ((lead & 0xE0) == 0xC0) {
+    extra = 1;
+    codepoint = lead & 0x1F;
+  } else if ((lead & 0xF0) == 0xE0) {
+    extra = 2;
+    codepoint = lead & 0x0F;
+  } else if ((lead & 0xF8) == 0xF0) {
+    extra = 3;
+    codepoint = lead & 0x07;
+  } else {
+    return 0xFFFD;
+  }
+  if (at + extra > text.size()) {
+    return 0xFFFD;
+  }
+  for (int i = 0; i < extra; i++) {
+    std::uint8_t continuation = text[at + i];
+    if ((continuation & 0xC0) != 0x80) {
+      return 0xFFFD;
+    }
+    codepoint = codepoint << 6 | (continuation & 0x3F);
+  }
+  at += extra;
+  return codepoint;
+}
+
+} // namespace
+
+bool SdfFont::build(const Font &font, ThreadPool &pool,
+                    const SdfFontOptions &options) {
+  CPU_ZONE("SdfFont::build");
+  std::u32string codepoints = options.codepoints;
+  if (codepoints.empty()) {
+    for (char32_t c = 0x20; c < 0x7F; c++) {
+      codepoints.push_back(c);
+    }
+  }
+
+  // Slot 0 is the missing glyph, then every codepoint the font maps
+  struct Job {
+    char32_t codepoint;
+    std::uint32_t fontGlyph;
+    SdfGlyph glyph;
+    Image image;
+    bool ok = true;
+  };
+  std::vector<Job> jobs;
+  jobs.push_back({0, 0, {}, {}});
+  for (char32_t codepoint : codepoints) {
+    if (std::uint32_t glyph = font.glyphIndex(codepoint); glyph != 0) {
+      jobs.push_back({codepoint, glyph, {}, {}});
+    }
+  }
+
+  float unitsPerEm = font.unitsPerEm();
+  float scale = options.pixelsPerEm / unitsPerEm;
+  float spread = options.spread;
+  glm::vec2 texelEms(1.0f / options.pixelsPerEm);
+  {
+    CPU_ZONE("Rasterize glyphs");
+    pool.parallelFor(jobs.size(), 4, [&](std::size_t begin, std::size_t end) {
+      std::vector<OutlineSegment> segments;
+      std::vector<Edge> edges;
+      for (std::size_t i = begin; i < end; i++) {
+        Job &job = jobs[i];
+        GlyphMetrics metrics = font.metrics(job.fontGlyph);
+        job.glyph.advance = metrics.advance / unitsPerEm;
+        segments.clear();
+        if (!font.outline(job.fontGlyph, segments)) {
+          job.ok = false;
+          continue;
+        }
+        if (segments.empty()) {
+          continue;
+        }
+        int left = int(std::floor(metrics.xMin * scale - spread));
+        int right = int(std::ceil(metrics.xMax * scale + spread));
+        int bottom = int(std::floor(metrics.yMin * scale - spread));
+        int top = int(std::ceil(metrics.yMax * scale + spread));
+        flattenOutline(segments, scale, left, top, edges);
+        job.image = rasterizeSdf(edges, right - left, top - bottom, spread);
+        job.glyph.offset = glm::vec2(left, -top) * texelEms;
+        job.glyph.size = glm::vec2(right - left, top - bottom) * texelEms;
+      }
+    });
+  }
+
+  // One texel of padding, extruded by the atlas, keeps linear filtering at
+  // a glyph's border from reading its neighbour
+  atlas = std::make_unique<TextureAtlas>(options.pageSize, 1, 1);
+  std::vector<AtlasEntry> entries(jobs.size(), invalidAtlasEntry);
+  for (std::size_t i = 0; i < jobs.size(); i++) {
+    if (!jobs[i].ok) {
+      std::cerr << "SdfFont: malformed outline of glyph "
+                << jobs[i].fontGlyph << std::endl;
+      return false;
+    }
+    if (jobs[i].image.width == 0) {
+      continue;
+    }
+    entries[i] = atlas->insert(std::move(jobs[i].image));
+    if (entries[i] == invalidAtlasEntry) {
+      std::cerr << "SdfFont: " << jobs.size() << " glyphs at "
+                << options.pixelsPerEm << " pixels per em do not fit a "
+                << options.pageSize << " page" << std::endl;
+      return false;
+    }
+  }
+  Image solidImage;
+  solidImage.width = 4;
+  solidImage.height = 4;
+  solidImage.pixels.assign(4 * 4 * 4, 255);
+  AtlasEntry solidEntry = atlas->insert(std::move(solidImage));
+  if (solidEntry == invalidAtlasEntry) {
+    std::cerr << "SdfFont: no room for the solid block" << std::endl;
+    return false;
+  }
+
+  // Inserting may have repacked, so regions are read once all are in
+  glyphs.resize(jobs.size());
+  asciiSlots.fill(0);
+  otherSlots.clear();
+  for (std::uint32_t slot = 0; slot < jobs.size(); slot++) {
+    glyphs[slot] = jobs[slot].glyph;
+    if (entries[slot] != invalidAtlasEntry) {
+      glyphs[slot].uvMin = atlas->region(entries[slot]).uvMin;
+      glyphs[slot].uvMax = atlas->region(entries[slot]).uvMax;
+    }
+    char32_t codepoint = jobs[slot].codepoint;
+    if (slot == 0) {
+      continue;
+    }
+    if (codepoint < asciiSlots.size()) {
+      asciiSlots[codepoint] = slot;
+    } else {
+      otherSlots[codepoint] = slot;
+    }
+  }
+  solid = atlas->atlasTexCoord(solidEntry, glm::vec2(0.5f));
+
+  kerningPairs.clear();
+  for (std::uint32_t left = 0; left < jobs.size(); left++) {
+    for (std::uint32_t right = 0; right < jobs.size(); right++) {
+      int kerning = font.kerning(jobs[left].fontGlyph, jobs[right].fontGlyph);
+      if (kerning != 0) {
+        kerningPairs[std::uint64_t(left) << 32 | right] =
+            kerning / unitsPerEm;
+      }
+    }
+  }
+
+  ascender = font.ascent() / unitsPerEm;
+  lineAdvance = (font.ascent() - font.descent() + font.lineGap()) / unitsPerEm;
+  return true;
+}
+
+std::uint32_t SdfFont::glyphSlot(char32_t codepoint) const {
+  if (codepoint < asciiSlots.size()) {
+    return asciiSlots[codepoint];
+  }
+  auto it = otherSlots.find(codepoint);
+  return it != otherSlots.end() ? it->second : 0;
+}
+
+float SdfFont::kerning(std::uint32_t leftSlot, std::uint32_t rightSlot) const {
+  if (kerningPairs.empty()) {
+    return 0.0f;
+  }
+  auto it = kerningPairs.find(std::uint64_t(leftSlot) << 32 | rightSlot);
+  return it != kerningPairs.end() ? it->second : 0.0f;
+}
+
+void layoutText(const SdfFont &font, std::string_view text, TextRun &run) {
+  run.quads.clear();
+  float x = 0.0f;
+  float baseline = font.ascent();
+  float width = 0.0f;
+  int lines = 1;
+  std::uint32_t previous = UINT32_MAX;
+  for (std::size_t at = 0; at < text.size();) {
+    char32_t codepoint = nextCodepoint(text, at);
+    if (codepoint == '\n') {
+      width = std::max(width, x);
+      x = 0.0f;
+      baseline += font.lineHeight();
+      lines++;
+      previous = UINT32_MAX;
+      continue;
+    }
+    std::uint32_t slot = font.glyphSlot(codepoint);
+    if (previous != UINT32_MAX) {
+      x += font.kerning(previous, slot);
+    }
+    const SdfGlyph &glyph = font.glyph(slot);
+    if (glyph.size.x > 0.0f) {
+      glm::vec2 min(x + glyph.offset.x, baseline + glyph.offset.y);
+      run.quads.push_back({min, min + glyph.size, slot});
+    }
+    x += glyph.advance;
+    previous = slot;
+  }
+  run.size = glm::vec2(std::max(width, x), lines * font.lineHeight());
+}
+
+TextLayoutCache::TextLayoutCache(const SdfFont &font, unsigned keepFrames)
+    : font(font), keepFrames(std::max(keepFrames, 1u)) {}
+
+const TextRun &TextLayoutCache::layout(std::string_view text) {
+  auto it = runs.find(text);
+  if (it == runs.end()) {
+    missCount++;
+    it = runs.try_emplace(std::string(text)).first;
+    layoutText(font, text, it->second.run);
+  } else {
+    hitCount++;
+  }
+  it->second.lastUse = frame;
+  return it->second.run;
+}
+
+void TextLayoutCache::endFrame() {
+  frame++;
+  // Swept once every keepFrames frames, so an unused run lives between
+  // one and two periods
+  if (frame % keepFrames != 0) {
+    return;
+  }
+  std::erase_if(runs, [&](const auto &item) {
+    return frame - item.second.lastUse > keepFrames;
+  });
+}
+
+TextBatch::TextBatch(const SdfFont &font)
+    : font(font), vao(GLVertexArray::create()), vbo(GLBuffer::create()),
+      ibo(GLBuffer::create()) {
+  program = compileProgram(textVertexShader, textFragmentShader);
+  if (program == 0) {
+    std::cerr << "TextBatch: SDF shader compilation failed" << std::endl;
+    return;
+  }
+  viewportSizeLocation = glGetUniformLocation(program, "viewportSize");
+  GLCall(glUseProgram(program));
+  GLCall(glUniform1i(glGetUniformLocation(program, "atlas"), 0));
+
+  GLCall(glBindVertexArray(vao));
+  GLCall(glBindBuffer(GL_ARRAY_BUFFER, vbo));
+  GLCall(glEnableVertexAttribArray(0));
+  GLCall(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                               (const void *)offsetof(Vertex, pos)));
+  GLCall(glEnableVertexAttribArray(1));
+  GLCall(glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                               (const void *)offsetof(Vertex, color)));
+  GLCall(glEnableVertexAttribArray(2));
+  GLCall(glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                               (const void *)offsetof(Vertex, texCoord)));
+  GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo));
+  GLCall(glBindVertexArray(0));
+}
+
+TextBatch::~TextBatch() { glDeleteProgram(program); }
+
+void TextBatch::addQuad(glm::vec2 min, glm::vec2 max, glm::vec2 uvMin,
+                        glm::vec2 uvMax, glm::vec4 color) {
+  vertices.push_back({{min.x, min.y, 0.0f}, color, {uvMin.x, uvMax.y}});
+  vertices.push_back({{max.x, min.y, 0.0f}, color, {uvMax.x, uvMax.y}});
+  vertices.push_back({{max.x, max.y, 0.0f}, color, {uvMax.x, uvMin.y}});
+  vertices.push_back({{min.x, max.y, 0.0f}, color, {uvMin.x, uvMin.y}});
+}
+
+void TextBatch::add(const TextRun &run, glm::vec2 position, float pixelSize,
+                    glm::vec4 color) {
+  for (const auto &quad : run.quads) {
+    const SdfGlyph &glyph = font.glyph(quad.slot);
+    addQuad(position + quad.min * pixelSize, position + quad.max * pixelSize,
+            glyph.uvMin, glyph.uvMax, color);
+  }
+}
+
+void TextBatch::add(std::string_view text, glm::vec2 position,
+                    float pixelSize, glm::vec4 color) {
+  layoutText(font, text, scratch);
+  add(scratch, position, pixelSize, color);
+}
+
+void TextBatch::addRect(glm::vec2 min, glm::vec2 max, glm::vec4 color) {
+  glm::vec2 uv = font.solidTexCoord();
+  addQuad(min, max, uv, uv, color);
+}
+
+void TextBatch::reserve(std::size_t quads) {
+  vertices.reserve(quads * 4);
+  indices.reserve(quads * 6);
+}
+
+void TextBatch::draw(glm::vec2 viewportSize) {
+  CPU_ZONE("TextBatch::draw");
+  std::size_t quads = quadCount();
+  uploadBytes = 0;
+  if (quads == 0 || program == 0) {
+    vertices.clear();
+    return;
+  }
+  GLCall(glBindVertexArray(vao));
+  if (quads > indexQuads) {
+    // Straight to the reserved size, which then never grows
+    indexQuads = std::max<std::size_t>(
+        {quads, indexQuads * 2, 256, indices.capacity() / 6});
+    indices.resize(indexQuads * 6);
+    for (std::size_t quad = 0; quad < indexQuads; quad++) {
+      std::uint32_t first = quad * 4;
+      std::uint32_t *out = &indices[quad * 6];
+      // Counter-clockwise once y is flipped, so face culling keeps them
+      out[0] = first;
+      out[1] = first + 3;
+      out[2] = first + 2;
+      out[3] = first + 2;
+      out[4] = first + 1;
+      out[5] = first;
+    }
+    std::size_t indexBytes = indices.size() * sizeof(std::uint32_t);
+    GLCall(glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, indices.data(),
+                        GL_STATIC_DRAW));
+    uploadBytes += indexBytes;
+  }
+
+  std::size_t vertexBytes = vertices.size() * sizeof(Vertex);
+  vertexCapacity = std::max(vertexCapacity, vertexBytes);
+  GLCall(glBindBuffer(GL_ARRAY_BUFFER, vbo));
+  // Orphaning hands the driver fresh storage, so the upload never waits
+  // for the previous draw to finish reading
+  GLCall(glBufferData(GL_ARRAY_BUFFER, vertexCapacity, nullptr,
+                      GL_STREAM_DRAW));
+  GLCall(glBufferSubData(GL_ARRAY_BUFFER, 0, vertexBytes, vertices.data()));
+  uploadBytes += vertexBytes;
+
+  GLCall(glUseProgram(program));
+  GLCall(glUniform2f(viewportSizeLocation, viewportSize.x, viewportSize.y));
+  GLCall(glActiveTexture(GL_TEXTURE0));
+  GLCall(glBindTexture(GL_TEXTURE_2D, font.texture()));
+  GLCall(glDisable(GL_DEPTH_TEST));
+  GLCall(glEnable(GL_BLEND));
+  GLCall(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
+  GLCall(glDrawElements(GL_TRIANGLES, GLsizei(quads * 6), GL_UNSIGNED_INT,
+                        nullptr));
+  GLCall(glDisable(GL_BLEND));
+  vertices.clear();
+}
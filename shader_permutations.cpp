@@ -0,0 +1,101 @@
+#include "shader_permutations.h"
+#include "cpu_profiler.h"
+#include "utility.h"
+
+#include <algorithm>
+#include <iostream>
+
+std::string injectShaderDefines(std::string_view source,
+                                std::span<const std::string> featureNames,
+                                ShaderFeatures features) {
+  std::string defines;
+  for (std::size_t i = 0; i < featureNames.size(); i++) {
+    if (features & (ShaderFeatures(1) << i)) {
+      defines += "#define " + featureNames[i] + "\n";
+    }
+  }
+  // #version must stay the first thing in the source
+  std::size_t insertAt = 0;
+  std::size_t version = source.find("#version");
+  if (version != std::string_view::npos) {
+    std::size_t lineEnd = source.find('\n', version);
+    insertAt = lineEnd == std::string_view::npos ? source.size() : lineEnd + 1;
+  }
+  std::string result(source.substr(0, insertAt));
+  if (insertAt == source.size() && insertAt != 0 && source.back() != '\n') {
+    result += '\n';
+  }
+  result += defines;
+  result += source.substr(insertAt);
+  return result;
+}
+
+ShaderPermutations::ShaderPermutations(std::string name,
+                                       std::string vertexSource,
+                                       std::string fragmentSource,
+                                       std::vector<std::string> featureNames,
+                                       std::function<bool(GLuint)> setup)
+    : name(std::move(name)), vertexSource(std::move(vertexSource)),
+      fragmentSource(std::move(fragmentSource)),
+      features(std::move(featureNames)), setup(std::move(setup)) {
+  if (features.size() > sizeof(ShaderFeatures) * 8) {
+    std::cerr << this->name << ": " << features.size()
+              << " features, only the first " << sizeof(ShaderFeatures) * 8
+              << " can be enabled" << std::endl;
+    features.resize(sizeof(ShaderFeatures) * 8);
+  }
+}
+
+ShaderPermutations::~ShaderPermutations() {
+  for (const auto &[key, program] : variants) {
+    if (program != 0) {
+      glDeleteProgram(program);
+    }
+  }
+}
+
+GLuint ShaderPermutations::program(ShaderFeatures features) {
+  auto found = variants.find(features);
+  if (found != variants.end()) {
+    return found->second;
+  }
+  CPU_ZONE("Compile shader variant");
+  GLuint program = compileProgram(
+      injectShaderDefines(vertexSource, this->features, features),
+      injectShaderDefines(fragmentSource, this->features, features));
+  if (program != 0 && setup && !setup(program)) {
+    glDeleteProgram(program);
+    program = 0;
+  }
+  if (program == 0) {
+    std::cerr << name << ": variant 0x" << std::hex << features << std::dec
+              << " failed to build" << std::endl;
+  } else {
+    compiled++;
+  }
+  variants.emplace(features, program);
+  return program;
+}
+
+void ShaderPermutations::report(std::ostream &out) const {
+  out << name << ": " << compiled << " of " << variantCount()
+      << " variants compiled" << std::endl;
+  std::vector<ShaderFeatures> keys;
+  for (const auto &[key, program] : variants) {
+    if (program != 0) {
+      keys.push_back(key);
+    }
+  }
+  std::sort(keys.begin(), keys.end());
+  for (ShaderFeatures key : keys) {
+    out << "  ";
+    bool any = false;
+    for (std::size_t i = 0; i < features.size(); i++) {
+      if (key & (ShaderFeatures(1) << i)) {
+        out << (any ? " " : "") << features[i];
+        any = true;
+      }
+    }
+    out << (any ? "" : "(no features)") << std::endl;
+  }
+}
@@ -0,0 +1,449 @@
+#include "software_occlusion.h"
+#include "cpu_profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define SOFTWARE_OCCLUSION_AVX2
+#endif
+
+namespace {
+
+// Occluders per setup job
+constexpr std::size_t setupGrain = 32;
+// Boxes per test job
+constexpr std::size_t testGrain = 256;
+
+// Depth of the cleared buffer, the far plane
+constexpr float farDepth = 1.0f;
+
+void rasterizeSpanScalar(const float *edgeRow, const float *edgeA,
+                         float depthRow, float depthDx, float *depth, int x0,
+                         int x1) {
+  for (int x = x0; x < x1; x++) {
+    float px = x + 0.5f;
+    bool inside = edgeA[0] * px + edgeRow[0] >= 0.0f &&
+                  edgeA[1] * px + edgeRow[1] >= 0.0f &&
+                  edgeA[2] * px + edgeRow[2] >= 0.0f;
+    float z = depthDx * px + depthRow;
+    if (inside && z < depth[x]) {
+      depth[x] = z;
+    }
+  }
+}
+
+bool anyFartherScalar(const float *depth, int x0, int x1, float z) {
+  for (int x = x0; x < x1; x++) {
+    if (depth[x] > z) {
+      return true;
+    }
+  }
+  return false;
+}
+
+#ifdef SOFTWARE_OCCLUSION_AVX2
+
+// `x0` and `x1` are multiples of eight
+__attribute__((target("avx2"))) void
+rasterizeSpanAvx2(const float *edgeRow, const float *edgeA, float depthRow,
+                  float depthDx, float *depth, int x0, int x1) {
+  __m256 laneX = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f,
+                                7.5f);
+  __m256 a0 = _mm256_set1_ps(edgeA[0]);
+  __m256 a1 = _mm256_set1_ps(edgeA[1]);
+  __m256 a2 = _mm256_set1_ps(edgeA[2]);
+  __m256 row0 = _mm256_set1_ps(edgeRow[0]);
+  __m256 row1 = _mm256_set1_ps(edgeRow[1]);
+  __m256 row2 = _mm256_set1_ps(edgeRow[2]);
+  __m256 dzdx = _mm256_set1_ps(depthDx);
+  __m256 zRow = _mm256_set1_ps(depthRow);
+  __m256 zero = _mm256_setzero_ps();
+  for (int x = x0; x < x1; x += 8) {
+    __m256 px = _mm256_add_ps(_mm256_set1_ps(float(x)), laneX);
+    __m256 e0 = _mm256_add_ps(_mm256_mul_ps(a0, px), row0);
+    __m256 e1 = _mm256_add_ps(_mm256_mul_ps(a1, px), row1);
+    __m256 e2 = _mm256_add_ps(_mm256_mul_ps(a2, px), row2);
+    __m256 inside = _mm256_and_ps(
+        _mm256_and_ps(_mm256_cmp_ps(e0, zero, _CMP_GE_OQ),
+                      _mm256_cmp_ps(e1, zero, _CMP_GE_OQ)),
+        _mm256_cmp_ps(e2, zero, _CMP_GE_OQ));
+    if (_mm256_movemask_ps(inside) == 0) {
+      continue;
+    }
+    __m256 z = _mm256_add_ps(_mm256_mul_ps(dzdx, px), zRow);
+    __m256 old = _mm256_loadu_ps(depth + x);
+    __m256 write = _mm256_and_ps(inside, _mm256_cmp_ps(z, old, _CMP_LT_OQ));
+    _mm256_storeu_ps(depth + x, _mm256_blendv_ps(old, z, write));
+  }
+}
+
+// `x0` and `x1` are multiples of eight
+__attribute__((target("avx2"))) bool anyFartherAvx2(const float *depth, int x0,
+                                                    int x1, float z) {
+  __m256 boxZ = _mm256_set1_ps(z);
+  for (int x = x0; x < x1; x += 8) {
+    __m256 farther =
+        _mm256_cmp_ps(_mm256_loadu_ps(depth + x), boxZ, _CMP_GT_OQ);
+    if (_mm256_movemask_ps(farther) != 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool cpuHasAvx2() {
+  static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+  return hasAvx2;
+}
+
+#endif
+
+} // namespace
+
+SoftwareOcclusion::SoftwareOcclusion(int width, int height)
+    : bufferWidth((std::max(width, 1) + tileWidth - 1) / tileWidth *
+                  tileWidth),
+      bufferHeight((std::max(height, 1) + tileHeight - 1) / tileHeight *
+                   tileHeight),
+      tilesX(bufferWidth / tileWidth), tilesY(bufferHeight / tileHeight) {
+  depthBuffer.assign(std::size_t(bufferWidth) * bufferHeight, farDepth);
+  tileMaxDepth.assign(std::size_t(tilesX) * tilesY, farDepth);
+  binStarts.resize(std::size_t(tilesX) * tilesY + 1);
+  binCursors.resize(std::size_t(tilesX) * tilesY);
+}
+
+void SoftwareOcclusion::begin(const glm::mat4 &viewProjection) {
+  this->viewProjection = viewProjection;
+  occluders.clear();
+  frameStats = {};
+}
+
+void SoftwareOcclusion::addOccluder(std::span<const glm::vec3> vertices,
+                                    std::span<const std::uint32_t> indices,
+                                    const glm::mat4 &world) {
+  occluders.push_back({vertices, indices, world});
+}
+
+void SoftwareOcclusion::setupTriangle(const glm::vec4 &a, const glm::vec4 &b,
+                                      const glm::vec4 &c,
+                                      std::vector<Triangle> &out) const {
+  glm::vec3 p[3];
+  const glm::vec4 *clip[3] = {&a, &b, &c};
+  for (int i = 0; i < 3; i++) {
+    float invW = 1.0f / clip[i]->w;
+    p[i] = glm::vec3((clip[i]->x * invW * 0.5f + 0.5f) * bufferWidth,
+                     (clip[i]->y * invW * 0.5f + 0.5f) * bufferHeight,
+                     clip[i]->z * invW);
+  }
+  glm::vec3 u = p[1] - p[0];
+  glm::vec3 v = p[2] - p[0];
+  float area = u.x * v.y - u.y * v.x;
+  // Back facing or degenerate
+  if (!(area > 0.0f)) {
+    return;
+  }
+  Triangle triangle;
+  float minX = std::min({p[0].x, p[1].x, p[2].x});
+  float minY = std::min({p[0].y, p[1].y, p[2].y});
+  float maxX = std::max({p[0].x, p[1].x, p[2].x});
+  float maxY = std::max({p[0].y, p[1].y, p[2].y});
+  // Pixels whose centers may be inside, clamped before the conversions
+  // so far off screen vertices cannot overflow them
+  float width = bufferWidth, height = bufferHeight;
+  triangle.minX = int(std::ceil(std::clamp(minX - 0.5f, 0.0f, width)));
+  triangle.minY = int(std::ceil(std::clamp(minY - 0.5f, 0.0f, height)));
+  triangle.maxX = int(std::floor(std::clamp(maxX - 0.5f, -1.0f, width - 1)));
+  triangle.maxY = int(std::floor(std::clamp(maxY - 0.5f, -1.0f, height - 1)));
+  if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) {
+    return;
+  }
+  for (int i = 0; i < 3; i++) {
+    const glm::vec3 &from = p[i];
+    const glm::vec3 &to = p[(i + 1) % 3];
+    triangle.edgeA[i] = from.y - to.y;
+    triangle.edgeB[i] = to.x - from.x;
+    triangle.edgeX[i] = from.x;
+    triangle.edgeY[i] = from.y;
+  }
+  triangle.depthZ = p[0].z;
+  triangle.depthDx = (u.z * v.y - u.y * v.z) / area;
+  triangle.depthDy = (u.x * v.z - u.z * v.x) / area;
+  triangle.depthX = p[0].x;
+  triangle.depthY = p[0].y;
+  out.push_back(triangle);
+}
+
+void SoftwareOcclusion::setupOccluder(const Occluder &occluder,
+                                      std::vector<Triangle> &out) const {
+  glm::mat4 toClip = viewProjection * occluder.world;
+  std::size_t indexCount = occluder.indices.size() / 3 * 3;
+  for (std::size_t i = 0; i < indexCount; i += 3) {
+    glm::vec4 corners[3];
+    int behind = 0;
+    for (int k = 0; k < 3; k++) {
+      corners[k] =
+          toClip * glm::vec4(occluder.vertices[occluder.indices[i + k]], 1.0f);
+      behind += corners[k].z < -corners[k].w;
+    }
+    if (behind == 3) {
+      continue;
+    }
+    if (behind == 0) {
+      setupTriangle(corners[0], corners[1], corners[2], out);
+      continue;
+    }
+    // Clip against the near plane, z + w >= 0, into a triangle or a quad
+    glm::vec4 polygon[4];
+    int count = 0;
+    for (int k = 0; k < 3; k++) {
+      const glm::vec4 &from = corners[k];
+      const glm::vec4 &to = corners[(k + 1) % 3];
+      float fromDistance = from.z + from.w;
+      float toDistance = to.z + to.w;
+      if (fromDistance >= 0.0f) {
+        polygon[count++] = from;
+      }
+      if ((fromDistance >= 0.0f) != (toDistance >= 0.0f)) {
+        float t = fromDistance / (fromDistance - toDistance);
+        polygon[count++] = from + (to - from) * t;
+      }
+    }
+    for (int k = 2; k < count; k++) {
+      setupTriangle(polygon[0], polygon[k - 1], polygon[k], out);
+    }
+  }
+}
+
+void SoftwareOcclusion::rasterizeTile(int tile) {
+  int tileX0 = tile % tilesX * tileWidth;
+  int tileY0 = tile / tilesX * tileHeight;
+  int tileX1 = tileX0 + tileWidth;
+  int tileY1 = tileY0 + tileHeight;
+  for (int y = tileY0; y < tileY1; y++) {
+    float *row = depthBuffer.data() + std::size_t(y) * bufferWidth;
+    std::fill(row + tileX0, row + tileX1, farDepth);
+  }
+#ifdef SOFTWARE_OCCLUSION_AVX2
+  bool avx2 = cpuHasAvx2();
+#endif
+  for (std::uint32_t entry = binStarts[tile]; entry < binStarts[tile + 1];
+       entry++) {
+    const Triangle &triangle = triangles[binEntries[entry]];
+    int x0 = std::max(triangle.minX, tileX0);
+    int x1 = std::min(triangle.maxX + 1, tileX1);
+    int y0 = std::max(triangle.minY, tileY0);
+    int y1 = std::min(triangle.maxY + 1, tileY1);
+    for (int y = y0; y < y1; y++) {
+      float py = y + 0.5f;
+      // Everything but the x terms, per row
+      float edgeRow[3];
+      for (int i = 0; i < 3; i++) {
+        edgeRow[i] = triangle.edgeB[i] * (py - triangle.edgeY[i]) -
+                     triangle.edgeA[i] * triangle.edgeX[i];
+      }
+      float depthRow = triangle.depthZ +
+                       triangle.depthDy * (py - triangle.depthY) -
+                       triangle.depthDx * triangle.depthX;
+      float *row = depthBuffer.data() + std::size_t(y) * bufferWidth;
+#ifdef SOFTWARE_OCCLUSION_AVX2
+      if (avx2) {
+        // Whole blocks of eight, the edges reject the extra pixels
+        rasterizeSpanAvx2(edgeRow, triangle.edgeA, depthRow,
+                          triangle.depthDx, row, x0 & ~7, (x1 + 7) & ~7);
+        continue;
+      }
+#endif
+      rasterizeSpanScalar(edgeRow, triangle.edgeA, depthRow,
+                          triangle.depthDx, row, x0, x1);
+    }
+  }
+  float maxDepth = 0.0f;
+  for (int y = tileY0; y < tileY1; y++) {
+    const float *row = depthBuffer.data() + std::size_t(y) * bufferWidth;
+    maxDepth = std::max(maxDepth, *std::max_element(row + tileX0,
+                                                    row + tileX1));
+  }
+  tileMaxDepth[tile] = maxDepth;
+}
+
+void SoftwareOcclusion::render(ThreadPool *pool) {
+  CPU_ZONE("SoftwareOcclusion::render");
+  std::size_t chunkCount = (occluders.size() + setupGrain - 1) / setupGrain;
+  if (chunkTriangles.size() < chunkCount) {
+    chunkTriangles.resize(chunkCount);
+  }
+  auto setup = [&](std::size_t begin, std::size_t end) {
+    CPU_ZONE("Setup occluders");
+    std::vector<Triangle> &out = chunkTriangles[begin / setupGrain];
+    out.clear();
+    // Near plane clipping makes two triangles of one at most. Reserving
+    // that keeps views that clip more than before from growing the list.
+    std::size_t most = 0;
+    for (std::size_t i = begin; i < end; i++) {
+      most += occluders[i].indices.size() / 3 * 2;
+    }
+    out.reserve(most);
+    for (std::size_t i = begin; i < end; i++) {
+      setupOccluder(occluders[i], out);
+    }
+  };
+  if (pool == nullptr) {
+    for (std::size_t begin = 0; begin < occluders.size();
+         begin += setupGrain) {
+      setup(begin, std::min(begin + setupGrain, occluders.size()));
+    }
+  } else {
+    pool->parallelFor(occluders.size(), setupGrain, setup);
+  }
+
+  {
+    CPU_ZONE("Bin triangles");
+    triangles.clear();
+    std::size_t most = 0;
+    for (std::size_t chunk = 0; chunk < chunkCount; chunk++) {
+      most += chunkTriangles[chunk].capacity();
+    }
+    triangles.reserve(most);
+    for (std::size_t chunk = 0; chunk < chunkCount; chunk++) {
+      triangles.insert(triangles.end(), chunkTriangles[chunk].begin(),
+                       chunkTriangles[chunk].end());
+    }
+    // Counted first, then filled, so all bins share one list that only
+    // grows when the view covers more tiles than it ever has
+    auto forEachTile = [&](const Triangle &triangle, auto &&fn) {
+      for (int ty = triangle.minY / tileHeight;
+           ty <= triangle.maxY / tileHeight; ty++) {
+        for (int tx = triangle.minX / tileWidth;
+             tx <= triangle.maxX / tileWidth; tx++) {
+          fn(ty * tilesX + tx);
+        }
+      }
+    };
+    std::fill(binStarts.begin(), binStarts.end(), 0);
+    for (const Triangle &triangle : triangles) {
+      forEachTile(triangle, [&](int tile) { binStarts[tile + 1]++; });
+    }
+    for (std::size_t tile = 0; tile < binCursors.size(); tile++) {
+      binStarts[tile + 1] += binStarts[tile];
+      binCursors[tile] = binStarts[tile];
+    }
+    binEntries.resize(binStarts.back());
+    for (std::uint32_t i = 0; i < triangles.size(); i++) {
+      forEachTile(triangles[i],
+                  [&](int tile) { binEntries[binCursors[tile]++] = i; });
+    }
+    frameStats.triangles = triangles.size();
+  }
+
+  auto rasterize = [&](std::size_t begin, std::size_t end) {
+    CPU_ZONE("Rasterize tiles");
+    for (std::size_t tile = begin; tile < end; tile++) {
+      rasterizeTile(tile);
+    }
+  };
+  if (pool == nullptr) {
+    rasterize(0, binCursors.size());
+  } else {
+    pool->parallelFor(binCursors.size(), 1, rasterize);
+  }
+}
+
+bool SoftwareOcclusion::visible(glm::vec3 center, glm::vec3 extent) const {
+  constexpr float infinity = std::numeric_limits<float>::infinity();
+  float minX = infinity, minY = infinity, minZ = infinity;
+  float maxX = -infinity, maxY = -infinity;
+  for (int corner = 0; corner < 8; corner++) {
+    glm::vec3 sign((corner & 1) ? 1.0f : -1.0f, (corner & 2) ? 1.0f : -1.0f,
+                   (corner & 4) ? 1.0f : -1.0f);
+    glm::vec4 clip = viewProjection * glm::vec4(center + sign * extent, 1.0f);
+    if (clip.z < -clip.w) {
+      return true;
+    }
+    float invW = 1.0f / clip.w;
+    float x = (clip.x * invW * 0.5f + 0.5f) * bufferWidth;
+    float y = (clip.y * invW * 0.5f + 0.5f) * bufferHeight;
+    minX = std::min(minX, x);
+    minY = std::min(minY, y);
+    maxX = std::max(maxX, x);
+    maxY = std::max(maxY, y);
+    minZ = std::min(minZ, clip.z * invW);
+  }
+  // Every pixel the box touches, clamped to the buffer before the
+  // conversions
+  float width = bufferWidth, height = bufferHeight;
+  int x0 = int(std::floor(std::clamp(minX, 0.0f, width)));
+  int y0 = int(std::floor(std::clamp(minY, 0.0f, height)));
+  int x1 = int(std::ceil(std::clamp(maxX, 0.0f, width)));
+  int y1 = int(std::ceil(std::clamp(maxY, 0.0f, height)));
+  if (x0 >= x1 || y0 >= y1) {
+    return false;
+  }
+#ifdef SOFTWARE_OCCLUSION_AVX2
+  bool avx2 = cpuHasAvx2();
+#endif
+  for (int ty = y0 / tileHeight; ty <= (y1 - 1) / tileHeight; ty++) {
+    for (int tx = x0 / tileWidth; tx <= (x1 - 1) / tileWidth; tx++) {
+      // Nothing in the tile is farther than the box's nearest point
+      if (tileMaxDepth[ty * tilesX + tx] <= minZ) {
+        continue;
+      }
+      int tileX0 = std::max(x0, tx * tileWidth);
+      int tileX1 = std::min(x1, (tx + 1) * tileWidth);
+      int tileY0 = std::max(y0, ty * tileHeight);
+      int tileY1 = std::min(y1, (ty + 1) * tileHeight);
+      for (int y = tileY0; y < tileY1; y++) {
+        const float *row = depthBuffer.data() + std::size_t(y) * bufferWidth;
+#ifdef SOFTWARE_OCCLUSION_AVX2
+        // Rounding out to blocks of eight stays in the tile and only ever
+        // finds more visible
+        if (avx2) {
+          if (anyFartherAvx2(row, tileX0 & ~7, (tileX1 + 7) & ~7, minZ)) {
+            return true;
+          }
+          continue;
+        }
+#endif
+        if (anyFartherScalar(row, tileX0, tileX1, minZ)) {
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+void SoftwareOcclusion::cull(const BoundsView &bounds,
+                             std::vector<std::uint32_t> &candidates,
+                             ThreadPool *pool) {
+  CPU_ZONE("SoftwareOcclusion::cull");
+  // Candidates come out of `bounds`, so this never grows past the first run
+  occludedFlags.reserve(bounds.count);
+  occludedFlags.resize(candidates.size());
+  auto test = [&](std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; i++) {
+      std::uint32_t index = candidates[i];
+      occludedFlags[i] = !visible(
+          glm::vec3(bounds.centerX[index], bounds.centerY[index],
+                    bounds.centerZ[index]),
+          glm::vec3(bounds.extentX[index], bounds.extentY[index],
+                    bounds.extentZ[index]));
+    }
+  };
+  if (pool == nullptr) {
+    test(0, candidates.size());
+  } else {
+    pool->parallelFor(candidates.size(), testGrain, test);
+  }
+  std::size_t kept = 0;
+  for (std::size_t i = 0; i < candidates.size(); i++) {
+    if (!occludedFlags[i]) {
+      candidates[kept++] = candidates[i];
+    }
+  }
+  frameStats.tested += candidates.size();
+  frameStats.occluded += candidates.size() - kept;
+  candidates.resize(kept);
+}
@@ -0,0 +1,261 @@
+#include "texture_atlas.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <iostream>
+
+TextureAtlas::TextureAtlas(int pageSize, int padding, int maxPages)
+    : pageSize(pageSize), padding(padding), maxPages(maxPages) {}
+
+void TextureAtlas::addPage() {
+  Page page;
+  page.skyline.push_back({0, 0, pageSize});
+  pages.push_back(std::move(page));
+}
+
+bool TextureAtlas::placeOnPage(int pageIndex, Entry &entry) {
+  auto &skyline = pages[pageIndex].skyline;
+  int width = entry.image.width + 2 * padding;
+  int height = entry.image.height + 2 * padding;
+
+  // Bottom-left rule: lowest resulting top edge, then leftmost
+  std::size_t bestIndex = SIZE_MAX;
+  int bestX = 0;
+  int bestY = 0;
+  int bestTop = INT_MAX;
+  for (std::size_t i = 0; i < skyline.size(); i++) {
+    int x = skyline[i].x;
+    if (x + width > pageSize) {
+      break;
+    }
+    int y = 0;
+    int widthLeft = width;
+    for (std::size_t j = i; widthLeft > 0; j++) {
+      y = std::max(y, skyline[j].y);
+      widthLeft -= skyline[j].width;
+    }
+    if (y + height <= pageSize && y + height < bestTop) {
+      bestIndex = i;
+      bestX = x;
+      bestY = y;
+      bestTop = y + height;
+    }
+  }
+  if (bestIndex == SIZE_MAX) {
+    return false;
+  }
+
+  skyline.insert(skyline.begin() + bestIndex, {bestX, bestTop, width});
+  for (std::size_t i = bestIndex + 1; i < skyline.size();) {
+    const Segment &previous = skyline[i - 1];
+    int overlap = previous.x + previous.width - skyline[i].x;
+    if (overlap <= 0) {
+      break;
+    }
+    skyline[i].x += overlap;
+    skyline[i].width -= overlap;
+    if (skyline[i].width > 0) {
+      break;
+    }
+    skyline.erase(skyline.begin() + i);
+  }
+  for (std::size_t i = 1; i < skyline.size();) {
+    if (skyline[i - 1].y == skyline[i].y) {
+      skyline[i - 1].width += skyline[i].width;
+      skyline.erase(skyline.begin() + i);
+    } else {
+      i++;
+    }
+  }
+
+  AtlasRegion &region = entry.region;
+  region.page = pageIndex;
+  region.x = bestX + padding;
+  region.y = bestY + padding;
+  region.width = entry.image.width;
+  region.height = entry.image.height;
+  region.uvMin = glm::vec2(float(region.x) / pageSize,
+                           float(region.y) / pageSize);
+  region.uvMax = glm::vec2(float(region.x + region.width) / pageSize,
+                           float(region.y + region.height) / pageSize);
+  entry.dirty = true;
+  return true;
+}
+
+bool TextureAtlas::place(Entry &entry) {
+  for (int page = 0; page < pageCount(); page++) {
+    if (placeOnPage(page, entry)) {
+      return true;
+    }
+  }
+  if (pageCount() >= maxPages) {
+    return false;
+  }
+  addPage();
+  return placeOnPage(pageCount() - 1, entry);
+}
+
+bool TextureAtlas::repack(AtlasEntry extra) {
+  std::vector<AtlasEntry> order;
+  for (AtlasEntry i = 0; i < entries.size(); i++) {
+    if (entries[i].live || i == extra) {
+      order.push_back(i);
+    }
+  }
+  std::sort(order.begin(), order.end(), [this](AtlasEntry a, AtlasEntry b) {
+    return entries[a].image.height > entries[b].image.height;
+  });
+
+  // Tallest-first can still do worse than the incremental layout, keep
+  // that one to roll back to
+  std::vector<std::vector<Segment>> previousSkylines;
+  previousSkylines.reserve(pages.size());
+  for (const auto &page : pages) {
+    previousSkylines.push_back(page.skyline);
+  }
+  std::vector<AtlasRegion> previousRegions;
+  previousRegions.reserve(order.size());
+  for (AtlasEntry i : order) {
+    previousRegions.push_back(entries[i].region);
+  }
+
+  for (auto &page : pages) {
+    page.skyline.assign(1, {0, 0, pageSize});
+  }
+  for (AtlasEntry i : order) {
+    if (!place(entries[i])) {
+      // Pages added since have no texture yet
+      pages.resize(previousSkylines.size());
+      for (std::size_t j = 0; j < pages.size(); j++) {
+        pages[j].skyline = std::move(previousSkylines[j]);
+      }
+      for (std::size_t j = 0; j < order.size(); j++) {
+        entries[order[j]].region = previousRegions[j];
+      }
+      return false;
+    }
+  }
+  // Everything moved, so everything is uploaded again
+  for (AtlasEntry i : order) {
+    entries[i].dirty = true;
+  }
+  currentGeneration++;
+  return true;
+}
+
+AtlasEntry TextureAtlas::insert(Image image) {
+  if (image.width + 2 * padding > pageSize ||
+      image.height + 2 * padding > pageSize) {
+    std::cerr << "TextureAtlas: " << image.width << "x" << image.height
+              << " image does not fit a " << pageSize << " page" << std::endl;
+    return invalidAtlasEntry;
+  }
+  AtlasEntry handle;
+  if (!freeEntries.empty()) {
+    handle = freeEntries.back();
+    freeEntries.pop_back();
+  } else {
+    handle = entries.size();
+    entries.emplace_back();
+  }
+  Entry &entry = entries[handle];
+  entry.image = std::move(image);
+  entry.region = AtlasRegion();
+  if (place(entry)) {
+    entry.live = true;
+    return handle;
+  }
+
+  if (repack(handle)) {
+    entries[handle].live = true;
+    return handle;
+  }
+  entries[handle].image = Image();
+  freeEntries.push_back(handle);
+  return invalidAtlasEntry;
+}
+
+void TextureAtlas::remove(AtlasEntry entry) {
+  if (entry >= entries.size() || !entries[entry].live) {
+    return;
+  }
+  entries[entry].live = false;
+  entries[entry].dirty = false;
+  entries[entry].image = Image();
+  freeEntries.push_back(entry);
+}
+
+void TextureAtlas::remapTexCoords(AtlasEntry entry,
+                                  std::span<Vertex> vertices) const {
+  for (auto &vertex : vertices) {
+    vertex.texCoord = atlasTexCoord(entry, vertex.texCoord);
+  }
+}
+
+float TextureAtlas::occupancy() const {
+  if (pages.empty()) {
+    return 0.0f;
+  }
+  double used = 0.0;
+  for (const auto &entry : entries) {
+    if (entry.live) {
+      used += double(entry.image.width + 2 * padding) *
+              (entry.image.height + 2 * padding);
+    }
+  }
+  return used / (double(pageSize) * pageSize * pages.size());
+}
+
+void TextureAtlas::upload() {
+  for (auto &page : pages) {
+    if (page.texture) {
+      continue;
+    }
+    page.texture = GLTexture::create();
+    GLCall(glBindTexture(GL_TEXTURE_2D, page.texture));
+    GLCall(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, pageSize, pageSize, 0,
+                        GL_RGBA, GL_UNSIGNED_BYTE, nullptr));
+    GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+    GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+    GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+    GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+  }
+
+  GLCall(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+  int boundPage = -1;
+  for (auto &entry : entries) {
+    if (!entry.live || !entry.dirty) {
+      continue;
+    }
+    const Image &image = entry.image;
+    int tileWidth = image.width + 2 * padding;
+    int tileHeight = image.height + 2 * padding;
+    tile.resize(std::size_t(tileWidth) * tileHeight * 4);
+
+    // Tile row 0 is the bottom row in GL, the last image row. Padding
+    // texels repeat the nearest edge texel.
+    for (int ty = 0; ty < tileHeight; ty++) {
+      int imageY = std::clamp(tileHeight - 1 - ty - padding, 0,
+                              image.height - 1);
+      const std::uint8_t *sourceRow =
+          &image.pixels[std::size_t(imageY) * image.width * 4];
+      std::uint8_t *tileRow = &tile[std::size_t(ty) * tileWidth * 4];
+      for (int tx = 0; tx < padding; tx++) {
+        std::memcpy(tileRow + tx * 4, sourceRow, 4);
+        std::memcpy(tileRow + (padding + image.width + tx) * 4,
+                    sourceRow + (image.width - 1) * 4, 4);
+      }
+      std::memcpy(tileRow + padding * 4, sourceRow, image.width * 4);
+    }
+
+    if (boundPage != entry.region.page) {
+      boundPage = entry.region.page;
+      GLCall(glBindTexture(GL_TEXTURE_2D, pages[boundPage].texture));
+    }
+    GLCall(glTexSubImage2D(GL_TEXTURE_2D, 0, entry.region.x - padding,
+                           entry.region.y - padding, tileWidth, tileHeight,
+                           GL_RGBA, GL_UNSIGNED_BYTE, tile.data()));
+    entry.dirty = false;
+  }
+}
@@ -0,0 +1,653 @@
+#include "texture_compression.h"
+#include "cpu_profiler.h"
+#include "utility.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string_view>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TEXTURE_COMPRESSION_SSE2
+#endif
+
+namespace {
+
+// One 4x4 block as structure of arrays, so four pixels fit an SSE register
+struct Block {
+  alignas(16) float channel[4][16];
+};
+
+struct Rgb {
+  float r;
+  float g;
+  float b;
+};
+
+} // namespace
+
+const char *blockFormatName(BlockFormat format) {
+  switch (format) {
+  case BlockFormat::BC1:
+    return "BC1";
+  case BlockFormat::BC3:
+    return "BC3";
+  case BlockFormat::BC4:
+    return "BC4";
+  case BlockFormat::BC5:
+    return "BC5";
+  }
+  return "";
+}
+
+std::size_t blockFormatBlockSize(BlockFormat format) {
+  return format == BlockFormat::BC1 || format == BlockFormat::BC4 ? 8 : 16;
+}
+
+GLenum blockFormatInternalFormat(BlockFormat format) {
+  switch (format) {
+  case BlockFormat::BC1:
+    return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+  case BlockFormat::BC3:
+    return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+  case BlockFormat::BC4:
+    return GL_COMPRESSED_RED_RGTC1;
+  case BlockFormat::BC5:
+    return GL_COMPRESSED_RG_RGTC2;
+  }
+  return GL_NONE;
+}
+
+bool blockFormatSupported(BlockFormat format) {
+  if (format == BlockFormat::BC4 || format == BlockFormat::BC5) {
+    return true;
+  }
+  GLint extensionCount = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+  for (GLint i = 0; i < extensionCount; i++) {
+    const auto *name =
+        reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, i));
+    if (name != nullptr &&
+        std::string_view(name) == "GL_EXT_texture_compression_s3tc") {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Block rows go bottom to top like GL texture rows, partial blocks repeat
+// the edge texels
+static void fetchBlock(const Image &image, int blockX, int blockY,
+                       Block &block) {
+  for (int y = 0; y < 4; y++) {
+    int glRow = std::min(blockY * 4 + y, image.height - 1);
+    int imageRow = image.height - 1 - glRow;
+    for (int x = 0; x < 4; x++) {
+      int column = std::min(blockX * 4 + x, image.width - 1);
+      const std::uint8_t *pixel =
+          &image.pixels[(std::size_t(imageRow) * image.width + column) * 4];
+      for (int c = 0; c < 4; c++) {
+        block.channel[c][y * 4 + x] = pixel[c];
+      }
+    }
+  }
+}
+
+static void storeBlock(Image &image, int blockX, int blockY,
+                       const std::uint8_t texels[16][4]) {
+  for (int y = 0; y < 4; y++) {
+    int glRow = blockY * 4 + y;
+    if (glRow >= image.height) {
+      break;
+    }
+    int imageRow = image.height - 1 - glRow;
+    for (int x = 0; x < 4; x++) {
+      int column = blockX * 4 + x;
+      if (column >= image.width) {
+        break;
+      }
+      std::memcpy(
+          &image.pixels[(std::size_t(imageRow) * image.width + column) * 4],
+          texels[y * 4 + x], 4);
+    }
+  }
+}
+
+// ==== Palette selection
+
+// For every pixel picks the nearest of `count` RGB palette entries and
+// returns the summed squared error
+static float selectRgb(const Block &block, const Rgb *palette, int count,
+                       std::uint8_t selectors[16]) {
+#ifdef TEXTURE_COMPRESSION_SSE2
+  __m128 total = _mm_setzero_ps();
+  for (int i = 0; i < 16; i += 4) {
+    __m128 r = _mm_load_ps(&block.channel[0][i]);
+    __m128 g = _mm_load_ps(&block.channel[1][i]);
+    __m128 b = _mm_load_ps(&block.channel[2][i]);
+    __m128 best = _mm_set1_ps(1e30f);
+    __m128i bestIndex = _mm_setzero_si128();
+    for (int k = 0; k < count; k++) {
+      __m128 dr = _mm_sub_ps(r, _mm_set1_ps(palette[k].r));
+      __m128 dg = _mm_sub_ps(g, _mm_set1_ps(palette[k].g));
+      __m128 db = _mm_sub_ps(b, _mm_set1_ps(palette[k].b));
+      __m128 distance = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)),
+          _mm_mul_ps(db, db));
+      __m128i closer = _mm_castps_si128(_mm_cmplt_ps(distance, best));
+      best = _mm_min_ps(distance, best);
+      bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(k)),
+                               _mm_andnot_si128(closer, bestIndex));
+    }
+    total = _mm_add_ps(total, best);
+    alignas(16) std::int32_t indices[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(indices), bestIndex);
+    for (int j = 0; j < 4; j++) {
+      selectors[i + j] = indices[j];
+    }
+  }
+  alignas(16) float lanes[4];
+  _mm_store_ps(lanes, total);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#else
+  float total = 0.0f;
+  for (int i = 0; i < 16; i++) {
+    float best = 1e30f;
+    for (int k = 0; k < count; k++) {
+      float dr = block.channel[0][i] - palette[k].r;
+      float dg = block.channel[1][i] - palette[k].g;
+      float db = block.channel[2][i] - palette[k].b;
+      float distance = dr * dr + dg * dg + db * db;
+      if (distance < best) {
+        best = distance;
+        selectors[i] = k;
+      }
+    }
+    total += best;
+  }
+  return total;
+#endif
+}
+
+// Single channel variant of selectRgb for BC4 style blocks
+static float selectScalar(const float values[16], const float *palette,
+                          int count, std::uint8_t selectors[16]) {
+#ifdef TEXTURE_COMPRESSION_SSE2
+  __m128 total = _mm_setzero_ps();
+  for (int i = 0; i < 16; i += 4) {
+    __m128 v = _mm_loadu_ps(&values[i]);
+    __m128 best = _mm_set1_ps(1e30f);
+    __m128i bestIndex = _mm_setzero_si128();
+    for (int k = 0; k < count; k++) {
+      __m128 d = _mm_sub_ps(v, _mm_set1_ps(palette[k]));
+      __m128 distance = _mm_mul_ps(d, d);
+      __m128i closer = _mm_castps_si128(_mm_cmplt_ps(distance, best));
+      best = _mm_min_ps(distance, best);
+      bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(k)),
+                               _mm_andnot_si128(closer, bestIndex));
+    }
+    total = _mm_add_ps(total, best);
+    alignas(16) std::int32_t indices[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(indices), bestIndex);
+    for (int j = 0; j < 4; j++) {
+      selectors[i + j] = indices[j];
+    }
+  }
+  alignas(16) float lanes[4];
+  _mm_store_ps(lanes, total);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#else
+  float total = 0.0f;
+  for (int i = 0; i < 16; i++) {
+    float best = 1e30f;
+    for (int k = 0; k < count; k++) {
+      float d = values[i] - palette[k];
+      if (d * d < best) {
+        best = d * d;
+        selectors[i] = k;
+      }
+    }
+    total += best;
+  }
+  return total;
+#endif
+}
+
+// ==== BC1
+
+static std::uint16_t packRgb565(Rgb color) {
+  auto quantize = [](float value, int maxValue) {
+    int q = int(std::lround(std::clamp(value, 0.0f, 255.0f) * maxValue /
+                            255.0f));
+    return std::clamp(q, 0, maxValue);
+  };
+  return (quantize(color.r, 31) << 11) | (quantize(color.g, 63) << 5) |
+         quantize(color.b, 31);
+}
+
+static Rgb unpackRgb565(std::uint16_t packed) {
+  int r = (packed >> 11) & 31;
+  int g = (packed >> 5) & 63;
+  int b = packed & 31;
+  return {float((r << 3) | (r >> 2)), float((g << 2) | (g >> 4)),
+          float((b << 3) | (b >> 2))};
+}
+
+static void bc1Palette(std::uint16_t c0, std::uint16_t c1, Rgb palette[4]) {
+  Rgb p0 = unpackRgb565(c0);
+  Rgb p1 = unpackRgb565(c1);
+  palette[0] = p0;
+  palette[1] = p1;
+  palette[2] = {(2 * p0.r + p1.r) / 3, (2 * p0.g + p1.g) / 3,
+                (2 * p0.b + p1.b) / 3};
+  palette[3] = {(p0.r + 2 * p1.r) / 3, (p0.g + 2 * p1.g) / 3,
+                (p0.b + 2 * p1.b) / 3};
+}
+
+struct Bc1Candidate {
+  std::uint16_t c0;
+  std::uint16_t c1;
+  std::uint8_t selectors[16];
+  float error;
+};
+
+// Always four-color mode (c0 > c1), which BC3 requires
+static Bc1Candidate evaluateBc1(const Block &block, Rgb e0, Rgb e1) {
+  Bc1Candidate candidate;
+  candidate.c0 = packRgb565(e0);
+  candidate.c1 = packRgb565(e1);
+  if (candidate.c0 < candidate.c1) {
+    std::swap(candidate.c0, candidate.c1);
+  }
+  Rgb palette[4];
+  bc1Palette(candidate.c0, candidate.c1, palette);
+  if (candidate.c0 == candidate.c1) {
+    candidate.error = selectRgb(block, palette, 1, candidate.selectors);
+  } else {
+    candidate.error = selectRgb(block, palette, 4, candidate.selectors);
+  }
+  return candidate;
+}
+
+static void bc1Endpoints(const Block &block, CompressionQuality quality,
+                         Rgb &e0, Rgb &e1) {
+  float minimum[3] = {255.0f, 255.0f, 255.0f};
+  float maximum[3] = {0.0f, 0.0f, 0.0f};
+  float mean[3] = {0.0f, 0.0f, 0.0f};
+  for (int c = 0; c < 3; c++) {
+    for (int i = 0; i < 16; i++) {
+      minimum[c] = std::min(minimum[c], block.channel[c][i]);
+      maximum[c] = std::max(maximum[c], block.channel[c][i]);
+      mean[c] += block.channel[c][i];
+    }
+    mean[c] /= 16.0f;
+  }
+
+  if (quality == CompressionQuality::Fast) {
+    // Inset the box so the interpolated colors land inside the block
+    float inset[3];
+    for (int c = 0; c < 3; c++) {
+      inset[c] = (maximum[c] - minimum[c]) / 16.0f;
+    }
+    e0 = {maximum[0] - inset[0], maximum[1] - inset[1], maximum[2] - inset[2]};
+    e1 = {minimum[0] + inset[0], minimum[1] + inset[1], minimum[2] + inset[2]};
+    return;
+  }
+
+  // Principal axis of the color covariance by power iteration
+  float cov[6] = {};
+  for (int i = 0; i < 16; i++) {
+    float r = block.channel[0][i] - mean[0];
+    float g = block.channel[1][i] - mean[1];
+    float b = block.channel[2][i] - mean[2];
+    cov[0] += r * r;
+    cov[1] += r * g;
+    cov[2] += r * b;
+    cov[3] += g * g;
+    cov[4] += g * b;
+    cov[5] += b * b;
+  }
+  float axis[3] = {maximum[0] - minimum[0], maximum[1] - minimum[1],
+                   maximum[2] - minimum[2]};
+  for (int iteration = 0; iteration < 8; iteration++) {
+    float next[3] = {cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+                     cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+                     cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2]};
+    float length = std::max({std::fabs(next[0]), std::fabs(next[1]),
+                             std::fabs(next[2])});
+    if (length < 1e-6f) {
+      break;
+    }
+    for (int c = 0; c < 3; c++) {
+      axis[c] = next[c] / length;
+    }
+  }
+  float axisLength2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+  if (axisLength2 < 1e-12f) {
+    e0 = e1 = {mean[0], mean[1], mean[2]};
+    return;
+  }
+
+  float tMin = 1e30f;
+  float tMax = -1e30f;
+  for (int i = 0; i < 16; i++) {
+    float t = ((block.channel[0][i] - mean[0]) * axis[0] +
+               (block.channel[1][i] - mean[1]) * axis[1] +
+               (block.channel[2][i] - mean[2]) * axis[2]) /
+              axisLength2;
+    tMin = std::min(tMin, t);
+    tMax = std::max(tMax, t);
+  }
+  float inset = (tMax - tMin) / 16.0f;
+  tMin += inset;
+  tMax -= inset;
+  e0 = {mean[0] + axis[0] * tMax, mean[1] + axis[1] * tMax,
+        mean[2] + axis[2] * tMax};
+  e1 = {mean[0] + axis[0] * tMin, mean[1] + axis[1] * tMin,
+        mean[2] + axis[2] * tMin};
+}
+
+// Least-squares endpoints for fixed selectors
+static bool refineBc1(const Block &block, const Bc1Candidate &candidate,
+                      Rgb &e0, Rgb &e1) {
+  static constexpr float weight0[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+  float aa = 0.0f;
+  float ab = 0.0f;
+  float bb = 0.0f;
+  float ax[3] = {};
+  float bx[3] = {};
+  for (int i = 0; i < 16; i++) {
+    float a = weight0[candidate.selectors[i]];
+    float b = 1.0f - a;
+    aa += a * a;
+    ab += a * b;
+    bb += b * b;
+    for (int c = 0; c < 3; c++) {
+      ax[c] += a * block.channel[c][i];
+      bx[c] += b * block.channel[c][i];
+    }
+  }
+  float determinant = aa * bb - ab * ab;
+  if (std::fabs(determinant) < 1e-6f) {
+    return false;
+  }
+  float out0[3];
+  float out1[3];
+  for (int c = 0; c < 3; c++) {
+    out0[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+    out1[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+  }
+  e0 = {out0[0], out0[1], out0[2]};
+  e1 = {out1[0], out1[1], out1[2]};
+  return true;
+}
+
+static void encodeBc1Block(const Block &block, CompressionQuality quality,
+                           std::uint8_t *out) {
+  Rgb e0;
+  Rgb e1;
+  bc1Endpoints(block, quality, e0, e1);
+  Bc1Candidate best = evaluateBc1(block, e0, e1);
+  if (quality == CompressionQuality::High) {
+    for (int iteration = 0; iteration < 2 && best.error > 0.0f; iteration++) {
+      if (!refineBc1(block, best, e0, e1)) {
+        break;
+      }
+      Bc1Candidate refined = evaluateBc1(block, e0, e1);
+      if (refined.error >= best.error) {
+        break;
+      }
+      best = refined;
+    }
+  }
+
+  out[0] = best.c0 & 0xFF;
+  out[1] = best.c0 >> 8;
+  out[2] = best.c1 & 0xFF;
+  out[3] = best.c1 >> 8;
+  std::uint32_t indices = 0;
+  for (int i = 0; i < 16; i++) {
+    indices |= std::uint32_t(best.selectors[i]) << (2 * i);
+  }
+  std::memcpy(out + 4, &indices, 4);
+}
+
+static void decodeBc1Block(const std::uint8_t *in, std::uint8_t texels[16][4],
+                           bool writeAlpha) {
+  std::uint16_t c0 = in[0] | (in[1] << 8);
+  std::uint16_t c1 = in[2] | (in[3] << 8);
+  Rgb palette[4];
+  bc1Palette(c0, c1, palette);
+  bool transparent = false;
+  if (c0 <= c1 && writeAlpha) {
+    // Three-color mode, only produced by other encoders
+    palette[2] = {(palette[0].r + palette[1].r) / 2,
+                  (palette[0].g + palette[1].g) / 2,
+                  (palette[0].b + palette[1].b) / 2};
+    palette[3] = {0.0f, 0.0f, 0.0f};
+    transparent = true;
+  }
+  std::uint32_t indices;
+  std::memcpy(&indices, in + 4, 4);
+  for (int i = 0; i < 16; i++) {
+    int index = (indices >> (2 * i)) & 3;
+    texels[i][0] = std::lround(palette[index].r);
+    texels[i][1] = std::lround(palette[index].g);
+    texels[i][2] = std::lround(palette[index].b);
+    if (writeAlpha) {
+      texels[i][3] = transparent && index == 3 ? 0 : 255;
+    }
+  }
+}
+
+// ==== BC4 (also the alpha half of BC3 and both halves of BC5)
+
+static void bc4Palette(int r0, int r1, float palette[8]) {
+  palette[0] = r0;
+  palette[1] = r1;
+  if (r0 > r1) {
+    for (int k = 1; k < 7; k++) {
+      palette[k + 1] = float((7 - k) * r0 + k * r1) / 7.0f;
+    }
+  } else {
+    for (int k = 1; k < 5; k++) {
+      palette[k + 1] = float((5 - k) * r0 + k * r1) / 5.0f;
+    }
+    palette[6] = 0.0f;
+    palette[7] = 255.0f;
+  }
+}
+
+static float evaluateBc4(const float values[16], int r0, int r1,
+                         std::uint8_t selectors[16]) {
+  float palette[8];
+  bc4Palette(r0, r1, palette);
+  return selectScalar(values, palette, 8, selectors);
+}
+
+static void encodeBc4Block(const float values[16], CompressionQuality quality,
+                           std::uint8_t *out) {
+  float minimum = 255.0f;
+  float maximum = 0.0f;
+  float innerMinimum = 255.0f;
+  float innerMaximum = 0.0f;
+  for (int i = 0; i < 16; i++) {
+    minimum = std::min(minimum, values[i]);
+    maximum = std::max(maximum, values[i]);
+    if (values[i] > 0.0f && values[i] < 255.0f) {
+      innerMinimum = std::min(innerMinimum, values[i]);
+      innerMaximum = std::max(innerMaximum, values[i]);
+    }
+  }
+
+  int bestR0 = int(maximum);
+  int bestR1 = int(minimum);
+  std::uint8_t best[16];
+  float bestError = evaluateBc4(values, bestR0, bestR1, best);
+
+  if (quality == CompressionQuality::High && bestError > 0.0f) {
+    auto tryEndpoints = [&](int r0, int r1) {
+      r0 = std::clamp(r0, 0, 255);
+      r1 = std::clamp(r1, 0, 255);
+      std::uint8_t selectors[16];
+      float error = evaluateBc4(values, r0, r1, selectors);
+      if (error < bestError) {
+        bestError = error;
+        bestR0 = r0;
+        bestR1 = r1;
+        std::memcpy(best, selectors, 16);
+      }
+    };
+    // Six-value mode, 0 and 255 come for free
+    if (innerMinimum <= innerMaximum) {
+      tryEndpoints(int(innerMinimum), int(innerMaximum));
+    }
+    // Pulling the endpoints in trades the extremes for finer steps
+    for (int inset = 1; inset <= 4; inset++) {
+      if (bestR0 - bestR1 > 2 * inset) {
+        tryEndpoints(int(maximum) - inset, int(minimum) + inset);
+      }
+    }
+  }
+
+  out[0] = bestR0;
+  out[1] = bestR1;
+  std::uint64_t indices = 0;
+  for (int i = 0; i < 16; i++) {
+    indices |= std::uint64_t(best[i]) << (3 * i);
+  }
+  for (int i = 0; i < 6; i++) {
+    out[2 + i] = (indices >> (8 * i)) & 0xFF;
+  }
+}
+
+static void decodeBc4Block(const std::uint8_t *in, std::uint8_t texels[16][4],
+                           int channel) {
+  float palette[8];
+  bc4Palette(in[0], in[1], palette);
+  std::uint64_t indices = 0;
+  for (int i = 0; i < 6; i++) {
+    indices |= std::uint64_t(in[2 + i]) << (8 * i);
+  }
+  for (int i = 0; i < 16; i++) {
+    texels[i][channel] = std::lround(palette[(indices >> (3 * i)) & 7]);
+  }
+}
+
+// ==== Image level
+
+static void encodeBlock(const Block &block, BlockFormat format,
+                        CompressionQuality quality, std::uint8_t *out) {
+  switch (format) {
+  case BlockFormat::BC1:
+    encodeBc1Block(block, quality, out);
+    break;
+  case BlockFormat::BC3:
+    encodeBc4Block(block.channel[3], quality, out);
+    encodeBc1Block(block, quality, out + 8);
+    break;
+  case BlockFormat::BC4:
+    encodeBc4Block(block.channel[0], quality, out);
+    break;
+  case BlockFormat::BC5:
+    encodeBc4Block(block.channel[0], quality, out);
+    encodeBc4Block(block.channel[1], quality, out + 8);
+    break;
+  }
+}
+
+void compressImage(const Image &image, BlockFormat format,
+                   CompressionQuality quality, CompressedImage &out,
+                   ThreadPool *pool) {
+  CPU_ZONE("compressImage");
+  int blocksX = (image.width + 3) / 4;
+  int blocksY = (image.height + 3) / 4;
+  std::size_t blockSize = blockFormatBlockSize(format);
+  out.format = format;
+  out.width = image.width;
+  out.height = image.height;
+  out.data.resize(std::size_t(blocksX) * blocksY * blockSize);
+
+  auto encodeRows = [&](std::size_t begin, std::size_t end) {
+    Block block;
+    for (std::size_t by = begin; by < end; by++) {
+      for (int bx = 0; bx < blocksX; bx++) {
+        fetchBlock(image, bx, by, block);
+        encodeBlock(block, format, quality,
+                    &out.data[(by * blocksX + bx) * blockSize]);
+      }
+    }
+  };
+  if (pool != nullptr) {
+    pool->parallelFor(blocksY, 4, encodeRows);
+  } else {
+    encodeRows(0, blocksY);
+  }
+}
+
+void decompressImage(const CompressedImage &compressed, Image &out) {
+  out.width = compressed.width;
+  out.height = compressed.height;
+  out.pixels.assign(std::size_t(out.width) * out.height * 4, 0);
+  int blocksX = (compressed.width + 3) / 4;
+  int blocksY = (compressed.height + 3) / 4;
+  std::size_t blockSize = blockFormatBlockSize(compressed.format);
+  for (int by = 0; by < blocksY; by++) {
+    for (int bx = 0; bx < blocksX; bx++) {
+      const std::uint8_t *in =
+          &compressed.data[(std::size_t(by) * blocksX + bx) * blockSize];
+      std::uint8_t texels[16][4];
+      for (auto &texel : texels) {
+        texel[0] = texel[1] = texel[2] = 0;
+        texel[3] = 255;
+      }
+      switch (compressed.format) {
+      case BlockFormat::BC1:
+        decodeBc1Block(in, texels, true);
+        break;
+      case BlockFormat::BC3:
+        decodeBc4Block(in, texels, 3);
+        decodeBc1Block(in + 8, texels, false);
+        break;
+      case BlockFormat::BC4:
+        decodeBc4Block(in, texels, 0);
+        break;
+      case BlockFormat::BC5:
+        decodeBc4Block(in, texels, 0);
+        decodeBc4Block(in + 8, texels, 1);
+        break;
+      }
+      storeBlock(out, bx, by, texels);
+    }
+  }
+}
+
+double compressionPsnr(const Image &original, const Image &decoded,
+                       BlockFormat format) {
+  int channels = format == BlockFormat::BC1   ? 3
+                 : format == BlockFormat::BC3 ? 4
+                 : format == BlockFormat::BC4 ? 1
+                                              : 2;
+  double squaredError = 0.0;
+  std::size_t pixelCount = std::size_t(original.width) * original.height;
+  for (std::size_t i = 0; i < pixelCount; i++) {
+    for (int c = 0; c < channels; c++) {
+      double d = double(original.pixels[i * 4 + c]) - decoded.pixels[i * 4 + c];
+      squaredError += d * d;
+    }
+  }
+  double mse = squaredError / (double(pixelCount) * channels);
+  if (mse == 0.0) {
+    return INFINITY;
+  }
+  return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+void uploadCompressedImage(GLenum target, GLint level,
+                           const CompressedImage &compressed) {
+  GLCall(glCompressedTexImage2D(
+      target, level, blockFormatInternalFormat(compressed.format),
+      compressed.width, compressed.height, 0, compressed.data.size(),
+      compressed.data.data()));
+}
@@ -0,0 +1,94 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "image.h"
+#include "texture_compression.h"
+#include "thread_pool.h"
+
+// Smooth gradients with a noisy band and a soft alpha disc, so every
+// format has some structure to lose
+static Image syntheticImage(int size) {
+  Image image;
+  image.width = size;
+  image.height = size;
+  image.pixels.resize(std::size_t(size) * size * 4);
+  std::uint32_t seed = 12345;
+  for (int y = 0; y < size; y++) {
+    for (int x = 0; x < size; x++) {
+      seed = seed * 1664525u + 1013904223u;
+      int noise = (y > size / 2 && y < size * 3 / 4) ? (seed >> 24) % 48 : 0;
+      float dx = x - size / 2.0f;
+      float dy = y - size / 2.0f;
+      float distance = std::sqrt(dx * dx + dy * dy) / (size / 2.0f);
+      std::uint8_t *pixel = &image.pixels[(std::size_t(y) * size + x) * 4];
+      pixel[0] = std::min(255, x * 255 / size + noise);
+      pixel[1] = std::min(255, y * 255 / size + noise);
+      pixel[2] = std::min(255, (x + y) * 127 / size + noise);
+      pixel[3] = std::clamp(int((1.2f - distance) * 255.0f), 0, 255);
+    }
+  }
+  return image;
+}
+
+static void benchmark(const std::string &name, const Image &image,
+                      ThreadPool &pool) {
+  const BlockFormat formats[] = {BlockFormat::BC1, BlockFormat::BC3,
+                                 BlockFormat::BC4, BlockFormat::BC5};
+  const CompressionQuality qualities[] = {CompressionQuality::Fast,
+                                          CompressionQuality::Normal,
+                                          CompressionQuality::High};
+  const char *qualityNames[] = {"fast", "normal", "high"};
+  double texels = double(image.width) * image.height;
+
+  std::printf("%s (%dx%d, %u threads)\n", name.c_str(), image.width,
+              image.height, pool.size() + 1);
+  std::printf("  %-6s %-7s %12s %12s %9s %7s\n", "format", "quality",
+              "MTexel/s", "MTexel/s x1", "PSNR dB", "ratio");
+  for (BlockFormat format : formats) {
+    for (int q = 0; q < 3; q++) {
+      CompressedImage compressed;
+      double best = 1e30;
+      double bestSingle = 1e30;
+      for (int run = 0; run < 3; run++) {
+        auto start = std::chrono::steady_clock::now();
+        compressImage(image, format, qualities[q], compressed, &pool);
+        auto middle = std::chrono::steady_clock::now();
+        compressImage(image, format, qualities[q], compressed, nullptr);
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(
+            best, std::chrono::duration<double>(middle - start).count());
+        bestSingle = std::min(
+            bestSingle, std::chrono::duration<double>(end - middle).count());
+      }
+      Image decoded;
+      decompressImage(compressed, decoded);
+      double psnr = compressionPsnr(image, decoded, format);
+      double ratio = double(image.pixels.size()) / compressed.data.size();
+      std::printf("  %-6s %-7s %12.1f %12.1f %9.2f %6.1fx\n",
+                  blockFormatName(format), qualityNames[q],
+                  texels / best / 1e6, texels / bestSingle / 1e6, psnr,
+                  ratio);
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  ThreadPool pool;
+  if (argc < 2) {
+    benchmark("synthetic", syntheticImage(1024), pool);
+    return 0;
+  }
+  for (int i = 1; i < argc; i++) {
+    Image image;
+    if (!loadImage(argv[i], image)) {
+      return 1;
+    }
+    benchmark(argv[i], image, pool);
+  }
+  return 0;
+}
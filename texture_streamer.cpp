@@ -0,0 +1,176 @@
+#include "texture_streamer.h"
+#include "cpu_profiler.h"
+#include "utility.h"
+
+#include <cstring>
+#include <iostream>
+
+TextureStreamer::TextureStreamer(ThreadPool &pool,
+                                 std::size_t uploadBudgetBytes,
+                                 std::optional<MipOptions> mips)
+    : pool(pool), inbox(std::make_shared<Inbox>()),
+      uploadBudget(uploadBudgetBytes), mips(mips) {
+  const std::uint8_t placeholderPixel[4] = {128, 128, 128, 255};
+  placeholder = GLTexture::create();
+  GLCall(glBindTexture(GL_TEXTURE_2D, placeholder));
+  GLCall(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA,
+                      GL_UNSIGNED_BYTE, placeholderPixel));
+  GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+  GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+
+  createGLHandles(pbos);
+}
+
+TextureHandle TextureStreamer::load(std::string path) {
+  TextureHandle handle = entries.size();
+  entries.emplace_back();
+  pending++;
+  pool.submit([inbox = inbox, mips = mips, handle, path = std::move(path)]() {
+    CPU_ZONE("Decode texture");
+    Decoded decoded;
+    decoded.handle = handle;
+    Image image;
+    decoded.ok = loadImage(path, image);
+    if (decoded.ok && mips) {
+      // Already on a worker, and other textures keep the rest busy
+      generateMipChain(image, *mips, decoded.levels, nullptr);
+    } else {
+      decoded.levels.push_back(std::move(image));
+    }
+    std::lock_guard lock(inbox->mutex);
+    inbox->decoded.push_back(std::move(decoded));
+  });
+  return handle;
+}
+
+void TextureStreamer::update() {
+  CPU_ZONE("TextureStreamer::update");
+  uploadedBytes = 0;
+  {
+    std::lock_guard lock(inbox->mutex);
+    while (!inbox->decoded.empty()) {
+      Decoded &decoded = inbox->decoded.front();
+      Entry &entry = entries[decoded.handle];
+      if (decoded.ok) {
+        entry.width = decoded.levels[0].width;
+        entry.height = decoded.levels[0].height;
+        entry.levels = std::move(decoded.levels);
+        uploadQueue.push_back(decoded.handle);
+      } else {
+        // Keeps the placeholder forever, loadImage already reported why
+        pending--;
+      }
+      inbox->decoded.pop_front();
+    }
+  }
+  if (uploadQueue.empty()) {
+    return;
+  }
+
+  // Plan this frame's row ranges, level by level. A texture that does not
+  // fit the remaining budget is continued next frame, at least one row
+  // always makes it in.
+  chunks.clear();
+  std::size_t total = 0;
+  bool budgetLeft = true;
+  for (TextureHandle handle : uploadQueue) {
+    Entry &entry = entries[handle];
+    int firstRow = entry.uploadedRows;
+    for (int level = entry.uploadLevel;
+         budgetLeft && level < int(entry.levels.size()); level++) {
+      const Image &image = entry.levels[level];
+      std::size_t rowBytes = std::size_t(image.width) * 4;
+      int rowsLeft = image.height - firstRow;
+      std::size_t budgetRows =
+          (uploadBudget - std::min(total, uploadBudget)) / rowBytes;
+      int rows = std::min<std::size_t>(rowsLeft, budgetRows);
+      if (rows == 0 && chunks.empty()) {
+        rows = 1;
+      }
+      if (rows == 0) {
+        budgetLeft = false;
+        break;
+      }
+      chunks.push_back({handle, level, firstRow, rows, total});
+      total += rows * rowBytes;
+      budgetLeft = rows == rowsLeft;
+      firstRow = 0;
+    }
+    if (!budgetLeft) {
+      break;
+    }
+  }
+
+  // Orphaning the buffer lets the driver hand out fresh storage instead of
+  // waiting for last frame's transfer from the same PBO
+  GLuint pbo = pbos[nextPbo];
+  nextPbo = (nextPbo + 1) % std::size(pbos);
+  GLCall(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo));
+  GLCall(glBufferData(GL_PIXEL_UNPACK_BUFFER, total, nullptr, GL_STREAM_DRAW));
+  auto *mapped = static_cast<std::uint8_t *>(glMapBufferRange(
+      GL_PIXEL_UNPACK_BUFFER, 0, total,
+      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+  if (mapped == nullptr) {
+    std::cerr << "TextureStreamer: glMapBufferRange failed" << std::endl;
+    GLCall(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+    return;
+  }
+  for (const auto &chunk : chunks) {
+    const Image &image = entries[chunk.handle].levels[chunk.level];
+    std::size_t rowBytes = std::size_t(image.width) * 4;
+    // GL rows go bottom to top, Image rows top to bottom
+    for (int row = 0; row < chunk.rowCount; row++) {
+      int sourceRow = image.height - 1 - (chunk.firstRow + row);
+      std::memcpy(mapped + chunk.offset + row * rowBytes,
+                  &image.pixels[sourceRow * rowBytes], rowBytes);
+    }
+  }
+  GLCall(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER));
+
+  GLCall(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+  for (const auto &chunk : chunks) {
+    Entry &entry = entries[chunk.handle];
+    if (!entry.staging) {
+      int levelCount = entry.levels.size();
+      entry.staging = GLTexture::create();
+      GLCall(glBindTexture(GL_TEXTURE_2D, entry.staging));
+      for (int level = 0; level < levelCount; level++) {
+        GLCall(glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8,
+                            entry.levels[level].width,
+                            entry.levels[level].height, 0, GL_RGBA,
+                            GL_UNSIGNED_BYTE, nullptr));
+      }
+      GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL,
+                             levelCount - 1));
+      GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                             levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR
+                                            : GL_LINEAR));
+      GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+      GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,
+                             GL_CLAMP_TO_EDGE));
+      GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,
+                             GL_CLAMP_TO_EDGE));
+    } else {
+      GLCall(glBindTexture(GL_TEXTURE_2D, entry.staging));
+    }
+    const Image &image = entry.levels[chunk.level];
+    GLCall(glTexSubImage2D(GL_TEXTURE_2D, chunk.level, 0, chunk.firstRow,
+                           image.width, chunk.rowCount, GL_RGBA,
+                           GL_UNSIGNED_BYTE, (const void *)chunk.offset));
+    entry.uploadedRows = chunk.firstRow + chunk.rowCount;
+    if (entry.uploadedRows < image.height) {
+      continue;
+    }
+    entry.uploadLevel = chunk.level + 1;
+    entry.uploadedRows = 0;
+    if (entry.uploadLevel == int(entry.levels.size())) {
+      entry.texture = std::move(entry.staging);
+      entry.levels.clear();
+      entry.levels.shrink_to_fit();
+      uploadQueue.pop_front();
+      pending--;
+    }
+  }
+  GLCall(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+  uploadedBytes = total;
+}
@@ -0,0 +1,354 @@
+#include "glad/gl.h"
+
+#include <GLFW/glfw3.h>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <glm/glm.hpp>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "alloc_tracker.h"
+#include "cpu_profiler.h"
+#include "debug_output.h"
+#include "frame_arena.h"
+#include "gl_handles.h"
+#include "shader_permutations.h"
+#include "texture_atlas.h"
+#include "texture_streamer.h"
+#include "thread_pool.h"
+#include "utility.h"
+
+int main(int argc, char **argv) {
+  cpuProfilerSetThreadName("Main");
+
+  // --atlas packs every image into shared pages and draws one call per page
+  // instead of binding a texture per quad
+  bool useAtlas = argc > 1 && std::string_view(argv[1]) == "--atlas";
+  int firstImageArg = useAtlas ? 2 : 1;
+  if (argc <= firstImageArg) {
+    std::cerr << "Usage: " << argv[0] << " [--atlas] <image.qoi|.tga|.ppm>..."
+              << std::endl;
+    return 1;
+  }
+
+  glfwSetErrorCallback([](int errorCode, const char *errorMsg) {
+    std::cerr << "GLFW: " << errorMsg << std::endl;
+  });
+  if (!glfwInit()) {
+    std::cerr << "Failed to initialize GLFW" << std::endl;
+    return 2;
+  }
+  Defer deferGLFWterminate([]() { glfwTerminate(); });
+
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GLFW_FALSE);
+  glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
+
+  GLFWwindow *window =
+      glfwCreateWindow(800, 600, "glsandobx", nullptr, nullptr);
+  if (window == nullptr) {
+    std::cerr << "Failed to create GLFW window" << std::endl;
+    return 2;
+  }
+  Defer deferGLFWwindowDestroy([&window]() { glfwDestroyWindow(window); });
+  glfwMakeContextCurrent(window);
+  {
+    int glversion = gladLoadGL(glfwGetProcAddress);
+    if (glversion == 0) {
+      std::cerr << "Failed to initialize OpenGL context" << std::endl;
+      return 2;
+    }
+    std::cerr << "Loaded OpenGL " << GLAD_VERSION_MAJOR(glversion) << '.'
+              << GLAD_VERSION_MINOR(glversion) << std::endl;
+  }
+  // Runs after every GL handle below is gone, while the context lives
+  Defer deferGLNamePools([]() { clearGLNamePools(); });
+  DebugOutput debugOutput(debugOutputOptionsFromEnv());
+  WindowUserData windowUserData;
+  glfwGetWindowSize(window, &windowUserData.width, &windowUserData.height);
+  glfwSetWindowUserPointer(window, &windowUserData);
+
+  glfwSwapInterval(1);
+  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+  bool shouldClose = false;
+  glfwSetWindowSizeCallback(
+      window, [](GLFWwindow *window, int width, int height) {
+        auto *windowUserData =
+            static_cast<WindowUserData *>(glfwGetWindowUserPointer(window));
+        if (windowUserData == nullptr) {
+          return;
+        }
+        windowUserData->width = width;
+        windowUserData->height = height;
+        windowUserData->shouldResizeViewport = true;
+      });
+
+  // clang-format off
+  ShaderPermutations quadShaders("quad",
+  R"(
+    #version 330 core
+
+    layout (location = 0) in vec3 pos;
+    layout (location = 1) in vec4 color;
+    layout (location = 2) in vec2 texCoord;
+
+    out vec4 fColor;
+    out vec2 fTexCoord;
+
+    void main(){
+      gl_Position = vec4(pos.xyz, 1.0);
+      fColor = color;
+      fTexCoord = texCoord;
+    }
+  )",
+  R"(
+    #version 330 core
+
+    in vec4 fColor;
+    in vec2 fTexCoord;
+
+    #ifdef TEXTURED
+    uniform sampler2D tex;
+    #endif
+
+    out vec4 FragColor;
+
+    void main() {
+    #ifdef TEXTURED
+      FragColor = texture(tex, fTexCoord);
+    #else
+      FragColor = fColor;
+    #endif
+    }
+  )",
+  {"TEXTURED"});
+  // clang-format on
+  // Every quad is textured
+  const ShaderFeatures quadTextured = 1 << 0;
+  GLuint quadProgram = quadShaders.program(quadTextured);
+  if (quadProgram == 0) {
+    std::cerr << "Quad shader compilation failed!" << std::endl;
+    return 2;
+  }
+
+  // Declared before the pool, so decode jobs still running at exit finish
+  // before these go away
+  std::mutex decodedMutex;
+  std::vector<std::pair<std::size_t, Image>> decodedImages;
+
+  ThreadPool threadPool;
+  TextureStreamer textureStreamer(threadPool, 4 << 20, MipOptions{});
+  TextureAtlas atlas;
+
+  std::vector<TextureHandle> textures;
+  std::vector<AtlasEntry> atlasEntries;
+  for (int i = firstImageArg; i < argc; i++) {
+    if (!useAtlas) {
+      textures.push_back(textureStreamer.load(argv[i]));
+      continue;
+    }
+    std::size_t quad = atlasEntries.size();
+    atlasEntries.push_back(invalidAtlasEntry);
+    threadPool.submit([&, quad, path = std::string(argv[i])]() {
+      // A failed load is reported as an empty image
+      Image image;
+      loadImage(path, image);
+      std::lock_guard lock(decodedMutex);
+      decodedImages.emplace_back(quad, std::move(image));
+    });
+  }
+  std::size_t quadCount = useAtlas ? atlasEntries.size() : textures.size();
+
+  // One quad per texture, laid out in a grid covering the window
+  int columns = std::ceil(std::sqrt(float(quadCount)));
+  int rows = (quadCount + columns - 1) / columns;
+  float cellWidth = 2.0f / columns;
+  float cellHeight = 2.0f / rows;
+  std::vector<Vertex> quadVertexBuffer;
+  std::vector<GLuint> quadIndexBuffer;
+  for (std::size_t i = 0; i < quadCount; i++) {
+    float left = -1.0f + (i % columns) * cellWidth;
+    float top = 1.0f - (i / columns) * cellHeight;
+    float right = left + cellWidth * 0.95f;
+    float bottom = top - cellHeight * 0.95f;
+    GLuint base = quadVertexBuffer.size();
+    quadVertexBuffer.push_back(
+        {{left, top, 0.0f}, {1.0f, 1.0f, 1.0f, 1.0f}, {0.0f, 1.0f}});
+    quadVertexBuffer.push_back(
+        {{right, top, 0.0f}, {1.0f, 1.0f, 1.0f, 1.0f}, {1.0f, 1.0f}});
+    quadVertexBuffer.push_back(
+        {{right, bottom, 0.0f}, {1.0f, 1.0f, 1.0f, 1.0f}, {1.0f, 0.0f}});
+    quadVertexBuffer.push_back(
+        {{left, bottom, 0.0f}, {1.0f, 1.0f, 1.0f, 1.0f}, {0.0f, 0.0f}});
+    for (GLuint index : {0u, 1u, 2u, 2u, 3u, 0u}) {
+      quadIndexBuffer.push_back(base + index);
+    }
+  }
+  // Image-local texture coordinates, remapped into the atlas when it changes
+  const std::vector<Vertex> quadVertexTemplate = quadVertexBuffer;
+  std::vector<std::pair<GLsizei, std::size_t>> atlasPageDraws;
+  std::uint32_t atlasGeneration = atlas.generation();
+
+  GLVertexArray vao = GLVertexArray::create();
+  GLBuffer vbo = GLBuffer::create();
+  GLBuffer ibo = GLBuffer::create();
+  GLCall(glBindVertexArray(vao));
+
+  GLCall(glBindBuffer(GL_ARRAY_BUFFER, vbo));
+  GLCall(glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * quadVertexBuffer.size(),
+                      quadVertexBuffer.data(), GL_DYNAMIC_DRAW));
+
+  GLCall(glEnableVertexAttribArray(0));
+  GLCall(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                               (const void *)offsetof(Vertex, pos)));
+  GLCall(glEnableVertexAttribArray(1));
+  GLCall(glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                               (const void *)offsetof(Vertex, color)));
+  GLCall(glEnableVertexAttribArray(2));
+  GLCall(glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                               (const void *)offsetof(Vertex, texCoord)));
+
+  GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo));
+  GLCall(glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                      sizeof(GLuint) * quadIndexBuffer.size(),
+                      quadIndexBuffer.data(), GL_DYNAMIC_DRAW));
+
+  GLCall(glUseProgram(quadProgram));
+  GLCall(glUniform1i(glGetUniformLocation(quadProgram, "tex"), 0));
+  GLCall(glActiveTexture(GL_TEXTURE0));
+
+  const char *tracePath = std::getenv("GLSANDBOX_TRACE");
+  std::vector<TraceEvent> traceEvents;
+  std::size_t lastPending = quadCount;
+
+  // GLSANDBOX_BENCHMARK and GLSANDBOX_ALLOC_STRICT runs
+  AllocationMonitor allocationMonitor(allocationMonitorOptionsFromEnv());
+  while (!shouldClose) {
+    CPU_ZONE("Frame");
+    {
+      CPU_ZONE("glfwPollEvents");
+      glfwPollEvents();
+    }
+    if (glfwWindowShouldClose(window)) {
+      shouldClose = true;
+    }
+    if (windowUserData.shouldResizeViewport) {
+      const auto &windowWidth = windowUserData.width;
+      const auto &windowHeight = windowUserData.height;
+      GLCall(glViewport(0, 0, windowWidth, windowHeight));
+      windowUserData.shouldResizeViewport = false;
+    }
+
+    if (useAtlas) {
+      CPU_ZONE("Update atlas");
+      std::vector<std::pair<std::size_t, Image>> decoded;
+      {
+        std::lock_guard lock(decodedMutex);
+        decoded.swap(decodedImages);
+      }
+      for (auto &[quad, image] : decoded) {
+        if (image.width > 0) {
+          atlasEntries[quad] = atlas.insert(std::move(image));
+        }
+        lastPending--;
+      }
+      if (!decoded.empty() || atlas.generation() != atlasGeneration) {
+        atlasGeneration = atlas.generation();
+        // Regroup the quads by page so each page is one contiguous draw
+        quadIndexBuffer.clear();
+        atlasPageDraws.clear();
+        for (int page = 0; page < atlas.pageCount(); page++) {
+          std::size_t first = quadIndexBuffer.size();
+          for (std::size_t quad = 0; quad < quadCount; quad++) {
+            AtlasEntry entry = atlasEntries[quad];
+            if (entry == invalidAtlasEntry ||
+                atlas.region(entry).page != page) {
+              continue;
+            }
+            for (std::size_t v = quad * 4; v < quad * 4 + 4; v++) {
+              quadVertexBuffer[v].texCoord =
+                  atlas.atlasTexCoord(entry, quadVertexTemplate[v].texCoord);
+            }
+            for (GLuint index : {0u, 1u, 2u, 2u, 3u, 0u}) {
+              quadIndexBuffer.push_back(quad * 4 + index);
+            }
+          }
+          atlasPageDraws.emplace_back(quadIndexBuffer.size() - first, first);
+        }
+        GLCall(glBufferSubData(GL_ARRAY_BUFFER, 0,
+                               sizeof(Vertex) * quadVertexBuffer.size(),
+                               quadVertexBuffer.data()));
+        GLCall(glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0,
+                               sizeof(GLuint) * quadIndexBuffer.size(),
+                               quadIndexBuffer.data()));
+        if (lastPending == 0) {
+          std::cerr << "All " << quadCount << " images packed into "
+                    << atlas.pageCount() << " atlas pages, "
+                    << int(atlas.occupancy() * 100.0f) << "% occupied"
+                    << std::endl;
+        }
+      }
+      atlas.upload();
+    } else {
+      textureStreamer.update();
+      if (textureStreamer.pendingCount() != lastPending) {
+        lastPending = textureStreamer.pendingCount();
+        if (lastPending == 0) {
+          std::cerr << "All " << textures.size() << " textures resident"
+                    << std::endl;
+        }
+      }
+    }
+    /// ==== DRAW
+
+    GLCall(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+    if (useAtlas) {
+      CPU_ZONE("Draw atlas pages");
+      for (int page = 0; page < int(atlasPageDraws.size()); page++) {
+        auto [count, first] = atlasPageDraws[page];
+        if (count == 0) {
+          continue;
+        }
+        GLCall(glBindTexture(GL_TEXTURE_2D, atlas.pageTexture(page)));
+        GLCall(glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT,
+                              (const void *)(first * sizeof(GLuint))));
+      }
+    } else {
+      CPU_ZONE("Draw quads");
+      for (std::size_t i = 0; i < textures.size(); i++) {
+        GLCall(glBindTexture(GL_TEXTURE_2D,
+                             textureStreamer.texture(textures[i])));
+        GLCall(glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT,
+                              (const void *)(i * 6 * sizeof(GLuint))));
+      }
+    }
+    /// ==== END DRAW
+
+    {
+      CPU_ZONE("glfwSwapBuffers");
+      glfwSwapBuffers(window);
+    }
+    // Frame scratch from two frames ago may be reused from here on
+    frameArenaEndFrame();
+    if (!allocationMonitor.endFrame()) {
+      shouldClose = true;
+    }
+    if (tracePath != nullptr) {
+      cpuProfilerCollect(traceEvents);
+    }
+  }
+
+  if (tracePath != nullptr) {
+    cpuProfilerCollect(traceEvents);
+    writeChromeTrace(tracePath, traceEvents, cpuProfilerThreads());
+  }
+
+  return allocationMonitor.exitCode();
+}
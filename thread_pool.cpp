@@ -0,0 +1,138 @@
+#include "thread_pool.h"
+#include "cpu_profiler.h"
+#include "frame_arena.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned threadCount) {
+  if (threadCount == 0) {
+    unsigned hardware = std::thread::hardware_concurrency();
+    threadCount = hardware > 1 ? hardware - 1 : 1;
+  }
+  workers.reserve(threadCount);
+  for (unsigned i = 0; i < threadCount; i++) {
+    workers.emplace_back(&ThreadPool::workerLoop, this, i);
+  }
+  // So their setup never lands in a frame the allocation monitor counts
+  std::unique_lock lock(mutex);
+  allStarted.wait(lock, [&]() { return started == threadCount; });
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+void ThreadPool::submit(std::function<void()> job) {
+  {
+    std::lock_guard lock(mutex);
+    jobs.push_back(std::move(job));
+  }
+  wake.notify_one();
+}
+
+void ThreadPool::workerLoop(unsigned index) {
+  cpuProfilerSetThreadName("Worker " + std::to_string(index));
+  // Up front, or the first chunk a worker happens to take allocates
+  registerFrameArenaThread();
+  {
+    std::lock_guard lock(mutex);
+    started++;
+  }
+  allStarted.notify_one();
+  for (;;) {
+    std::function<void()> job;
+    Fork *fork = nullptr;
+    {
+      std::unique_lock lock(mutex);
+      wake.wait(lock, [this]() {
+        return stopping || oldestFork != nullptr || !jobs.empty();
+      });
+      if (oldestFork != nullptr) {
+        // Forks first, their callers are waiting on them
+        fork = oldestFork;
+        fork->active.fetch_add(1, std::memory_order_relaxed);
+        if (++fork->joined == fork->helpers) {
+          unlink(*fork);
+        }
+      } else if (jobs.empty()) {
+        return;
+      } else {
+        job = std::move(jobs.front());
+        jobs.pop_front();
+      }
+    }
+    if (fork != nullptr) {
+      runChunks(*fork);
+      // The last touch, the caller may return right after
+      fork->active.fetch_sub(1, std::memory_order_release);
+    } else {
+      job();
+    }
+  }
+}
+
+void ThreadPool::runChunks(Fork &fork) {
+  for (;;) {
+    std::size_t chunk = fork.next.fetch_add(1, std::memory_order_relaxed);
+    std::size_t begin = chunk * fork.grain;
+    if (begin >= fork.count) {
+      return;
+    }
+    fork.run(fork.context, begin, std::min(begin + fork.grain, fork.count));
+  }
+}
+
+void ThreadPool::unlink(Fork &fork) {
+  (fork.older != nullptr ? fork.older->newer : oldestFork) = fork.newer;
+  (fork.newer != nullptr ? fork.newer->older : newestFork) = fork.older;
+  fork.older = nullptr;
+  fork.newer = nullptr;
+}
+
+void ThreadPool::forkJoin(std::size_t count, std::size_t grain, ChunkFn run,
+                          void *context) {
+  if (count == 0) {
+    return;
+  }
+  grain = std::max<std::size_t>(grain, 1);
+  std::size_t chunks = (count + grain - 1) / grain;
+  std::size_t helpers = std::min<std::size_t>(workers.size(), chunks - 1);
+  if (helpers == 0) {
+    run(context, 0, count);
+    return;
+  }
+
+  Fork fork;
+  fork.run = run;
+  fork.context = context;
+  fork.count = count;
+  fork.grain = grain;
+  fork.helpers = helpers;
+  {
+    std::lock_guard lock(mutex);
+    fork.older = newestFork;
+    (newestFork != nullptr ? newestFork->newer : oldestFork) = &fork;
+    newestFork = &fork;
+  }
+  for (std::size_t i = 0; i < helpers; i++) {
+    wake.notify_one();
+  }
+  runChunks(fork);
+  {
+    // Helpers that have not joined yet never will
+    std::lock_guard lock(mutex);
+    if (fork.joined < fork.helpers) {
+      unlink(fork);
+    }
+  }
+  while (fork.active.load(std::memory_order_acquire) != 0) {
+    std::this_thread::yield();
+  }
+}
@@ -0,0 +1,216 @@
+#include "tlsf_allocator.h"
+
+#include <algorithm>
+#include <bit>
+
+namespace {
+
+constexpr std::uint32_t none = TlsfAllocation::none;
+
+} // namespace
+
+TlsfAllocator::TlsfAllocator(std::uint32_t capacity) : totalSize(capacity) {
+  for (auto &heads : freeHeads) {
+    heads.fill(none);
+  }
+  if (capacity > 0) {
+    insertFree(newBlock(0, capacity));
+  }
+}
+
+std::uint32_t TlsfAllocator::newBlock(std::uint32_t offset,
+                                      std::uint32_t size) {
+  std::uint32_t index;
+  if (!spareBlocks.empty()) {
+    index = spareBlocks.back();
+    spareBlocks.pop_back();
+  } else {
+    index = std::uint32_t(blocks.size());
+    blocks.emplace_back();
+  }
+  blocks[index] = {offset, size, none, none, none, none, false};
+  return index;
+}
+
+void TlsfAllocator::releaseBlock(std::uint32_t block) {
+  spareBlocks.push_back(block);
+}
+
+void TlsfAllocator::mapping(std::uint64_t size, unsigned &fl,
+                            unsigned &sl) {
+  if (size < slCount) {
+    fl = 0;
+    sl = unsigned(size);
+    return;
+  }
+  unsigned top = unsigned(std::bit_width(size)) - 1;
+  sl = unsigned((size >> (top - slLog2)) ^ slCount);
+  fl = top - slLog2 + 1;
+}
+
+void TlsfAllocator::insertFree(std::uint32_t block) {
+  unsigned fl, sl;
+  mapping(blocks[block].size, fl, sl);
+  std::uint32_t head = freeHeads[fl][sl];
+  blocks[block].free = true;
+  blocks[block].prevFree = none;
+  blocks[block].nextFree = head;
+  if (head != none) {
+    blocks[head].prevFree = block;
+  }
+  freeHeads[fl][sl] = block;
+  flBitmap |= 1u << fl;
+  slBitmaps[fl] |= 1u << sl;
+  freeCount++;
+}
+
+void TlsfAllocator::removeFree(std::uint32_t block) {
+  Block &b = blocks[block];
+  if (b.prevFree != none) {
+    blocks[b.prevFree].nextFree = b.nextFree;
+  } else {
+    unsigned fl, sl;
+    mapping(b.size, fl, sl);
+    freeHeads[fl][sl] = b.nextFree;
+    if (b.nextFree == none) {
+      slBitmaps[fl] &= ~(1u << sl);
+      if (slBitmaps[fl] == 0) {
+        flBitmap &= ~(1u << fl);
+      }
+    }
+  }
+  if (b.nextFree != none) {
+    blocks[b.nextFree].prevFree = b.prevFree;
+  }
+  b.free = false;
+  b.prevFree = none;
+  b.nextFree = none;
+  freeCount--;
+}
+
+bool TlsfAllocator::findFree(std::uint32_t size, unsigned &fl,
+                             unsigned &sl) const {
+  // Round up to the next class boundary: any block of that class is then
+  // large enough, and the list head can be taken without searching it
+  std::uint64_t rounded = size;
+  if (rounded >= slCount) {
+    unsigned top = unsigned(std::bit_width(rounded)) - 1;
+    rounded += (std::uint64_t(1) << (top - slLog2)) - 1;
+  }
+  mapping(rounded, fl, sl);
+  if (fl >= flCount) {
+    return false;
+  }
+  std::uint32_t slMap = slBitmaps[fl] & (~0u << sl);
+  if (slMap == 0) {
+    std::uint32_t flMap = fl + 1 < flCount ? flBitmap & (~0u << (fl + 1)) : 0;
+    if (flMap == 0) {
+      return false;
+    }
+    fl = unsigned(std::countr_zero(flMap));
+    slMap = slBitmaps[fl];
+  }
+  sl = unsigned(std::countr_zero(slMap));
+  return true;
+}
+
+TlsfAllocation TlsfAllocator::allocate(std::uint32_t size) {
+  if (size == 0) {
+    return {};
+  }
+  unsigned fl, sl;
+  std::uint32_t block = none;
+  if (findFree(size, fl, sl)) {
+    block = freeHeads[fl][sl];
+  } else {
+    // Only the list of size's own class can still hold a block that
+    // fits; searching it is the one step that is not constant time, and
+    // only taken when the allocator is nearly full
+    mapping(size, fl, sl);
+    for (std::uint32_t b = freeHeads[fl][sl]; b != none;
+         b = blocks[b].nextFree) {
+      if (blocks[b].size >= size) {
+        block = b;
+        break;
+      }
+    }
+    if (block == none) {
+      return {};
+    }
+  }
+  removeFree(block);
+  if (blocks[block].size > size) {
+    // The tail goes back as a free block of its own
+    std::uint32_t rest = newBlock(blocks[block].offset + size,
+                                  blocks[block].size - size);
+    blocks[rest].prevPhysical = block;
+    blocks[rest].nextPhysical = blocks[block].nextPhysical;
+    if (blocks[rest].nextPhysical != none) {
+      blocks[blocks[rest].nextPhysical].prevPhysical = rest;
+    }
+    blocks[block].nextPhysical = rest;
+    blocks[block].size = size;
+    insertFree(rest);
+  }
+  used += size;
+  allocationCount++;
+  return {blocks[block].offset, size, block};
+}
+
+void TlsfAllocator::free(TlsfAllocation &allocation) {
+  if (!allocation.valid()) {
+    return;
+  }
+  std::uint32_t block = allocation.block;
+  allocation = {};
+  used -= blocks[block].size;
+  allocationCount--;
+
+  std::uint32_t prev = blocks[block].prevPhysical;
+  if (prev != none && blocks[prev].free) {
+    removeFree(prev);
+    blocks[prev].size += blocks[block].size;
+    blocks[prev].nextPhysical = blocks[block].nextPhysical;
+    if (blocks[prev].nextPhysical != none) {
+      blocks[blocks[prev].nextPhysical].prevPhysical = prev;
+    }
+    releaseBlock(block);
+    block = prev;
+  }
+  std::uint32_t next = blocks[block].nextPhysical;
+  if (next != none && blocks[next].free) {
+    removeFree(next);
+    blocks[block].size += blocks[next].size;
+    blocks[block].nextPhysical = blocks[next].nextPhysical;
+    if (blocks[block].nextPhysical != none) {
+      blocks[blocks[block].nextPhysical].prevPhysical = block;
+    }
+    releaseBlock(next);
+  }
+  insertFree(block);
+}
+
+TlsfStats TlsfAllocator::stats() const {
+  TlsfStats stats;
+  stats.capacity = totalSize;
+  stats.usedUnits = used;
+  stats.freeUnits = totalSize - used;
+  stats.allocations = allocationCount;
+  stats.freeBlocks = freeCount;
+  if (flBitmap != 0) {
+    // The largest block is in the highest non-empty list, though not
+    // necessarily at its head
+    unsigned fl = unsigned(std::bit_width(flBitmap)) - 1;
+    unsigned sl = unsigned(std::bit_width(slBitmaps[fl])) - 1;
+    for (std::uint32_t b = freeHeads[fl][sl]; b != none;
+         b = blocks[b].nextFree) {
+      stats.largestFree = std::max<std::uint64_t>(stats.largestFree,
+                                                  blocks[b].size);
+    }
+  }
+  if (stats.freeUnits > 0) {
+    stats.fragmentation =
+        1.0f - float(stats.largestFree) / float(stats.freeUnits);
+  }
+  return stats;
+}
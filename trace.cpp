@@ -0,0 +1,87 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+std::uint64_t traceNowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static void writeJsonString(std::FILE *file, std::string_view str) {
+  std::fputc('"', file);
+  for (char c : str) {
+    switch (c) {
+    case '"':
+      std::fputs("\\\"", file);
+      break;
+    case '\\':
+      std::fputs("\\\\", file);
+      break;
+    case '\n':
+      std::fputs("\\n", file);
+      break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        std::fprintf(file, "\\u%04x", c);
+      } else {
+        std::fputc(c, file);
+      }
+      break;
+    }
+  }
+  std::fputc('"', file);
+}
+
+bool writeChromeTrace(std::string_view path,
+                      std::span<const TraceEvent> events,
+                      std::span<const TraceThread> threads) {
+  std::FILE *file = std::fopen(std::string(path).c_str(), "wb");
+  if (file == nullptr) {
+    std::cerr << "Failed to open trace file " << path << std::endl;
+    return false;
+  }
+
+  // Chrome trace timestamps are microseconds, rebase them so the trace
+  // starts near zero and keeps sub-microsecond precision in a double.
+  std::uint64_t originNs = UINT64_MAX;
+  for (const auto &event : events) {
+    originNs = std::min(originNs, event.beginNs);
+  }
+  if (events.empty()) {
+    originNs = 0;
+  }
+
+  std::fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", file);
+  bool first = true;
+  for (const auto &thread : threads) {
+    std::fprintf(file,
+                 "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                 "\"tid\":%u,\"args\":{\"name\":",
+                 first ? "" : ",\n", thread.tid);
+    writeJsonString(file, thread.name);
+    std::fputs("}}", file);
+    first = false;
+  }
+  for (const auto &event : events) {
+    std::fprintf(file, "%s{\"name\":", first ? "" : ",\n");
+    writeJsonString(file, event.name);
+    std::fprintf(file,
+                 ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,"
+                 "\"dur\":%.3f,\"args\":{\"depth\":%u}}",
+                 event.tid, (event.beginNs - originNs) / 1000.0,
+                 (event.endNs - event.beginNs) / 1000.0, event.depth);
+    first = false;
+  }
+  std::fputs("\n]}\n", file);
+
+  bool ok = std::ferror(file) == 0;
+  std::fclose(file);
+  if (!ok) {
+    std::cerr << "Failed to write trace file " << path << std::endl;
+  }
+  return ok;
+}
@@ -0,0 +1,220 @@
+#include "transform_hierarchy.h"
+#include "cpu_profiler.h"
+#include "utility.h"
+
+#include <algorithm>
+#include <iostream>
+#include <numeric>
+
+namespace {
+
+// Nodes per parallelFor chunk, a matrix product each
+constexpr std::size_t updateGrain = 4096;
+
+// Merging runs closer than this costs less than another glBufferSubData
+constexpr std::uint32_t uploadGap = 16;
+
+template <class Fn>
+void forEachChunk(ThreadPool *pool, std::size_t count, const Fn &fn) {
+  if (pool == nullptr || count <= updateGrain) {
+    fn(0, count);
+  } else {
+    pool->parallelFor(count, updateGrain, fn);
+  }
+}
+
+} // namespace
+
+TransformId TransformHierarchy::add(TransformId parent,
+                                    const glm::mat4 &local) {
+  TransformId id = parents.size();
+  if (parent != noTransform && parent >= id) {
+    std::cerr << "Transform parent " << parent << " does not exist"
+              << std::endl;
+    return noTransform;
+  }
+  parents.push_back(parent);
+  depths.push_back(parent == noTransform ? 0 : depths[parent] + 1);
+  // Appended out of depth order until the next update() sorts it in
+  slots.push_back(ids.size());
+  ids.push_back(id);
+  locals.push_back(local);
+  worlds.push_back(local);
+  parentSlots.push_back(parent == noTransform ? noTransform : slots[parent]);
+  firstChild.push_back(0);
+  childCount.push_back(0);
+  dirty.push_back(0);
+  layoutChanged = true;
+  return id;
+}
+
+void TransformHierarchy::setLocal(TransformId id, const glm::mat4 &local) {
+  std::uint32_t slot = slots[id];
+  locals[slot] = local;
+  // A pending rebuild recomputes everything anyway
+  if (!layoutChanged && !dirty[slot]) {
+    dirty[slot] = 1;
+    pending[depths[id]].push_back(slot);
+  }
+}
+
+const glm::mat4 &TransformHierarchy::local(TransformId id) const {
+  return locals[slots[id]];
+}
+
+const glm::mat4 &TransformHierarchy::world(TransformId id) const {
+  return worlds[slots[id]];
+}
+
+void TransformHierarchy::rebuild() {
+  CPU_ZONE("TransformHierarchy::rebuild");
+  std::size_t count = parents.size();
+  // Children of every id, in id order
+  std::vector<std::uint32_t> childStart(count + 1, 0);
+  for (TransformId parent : parents) {
+    if (parent != noTransform) {
+      childStart[parent + 1]++;
+    }
+  }
+  std::partial_sum(childStart.begin(), childStart.end(), childStart.begin());
+  std::vector<TransformId> children(childStart[count]);
+  std::vector<std::uint32_t> cursor(childStart.begin(), childStart.end() - 1);
+  for (TransformId id = 0; id < count; id++) {
+    if (parents[id] != noTransform) {
+      children[cursor[parents[id]]++] = id;
+    }
+  }
+
+  // Breadth first from all roots at once: depths come out ascending and
+  // siblings adjacent
+  std::vector<TransformId> order;
+  order.reserve(count);
+  for (TransformId id = 0; id < count; id++) {
+    if (parents[id] == noTransform) {
+      order.push_back(id);
+    }
+  }
+  for (std::size_t i = 0; i < order.size(); i++) {
+    TransformId id = order[i];
+    order.insert(order.end(), children.begin() + childStart[id],
+                 children.begin() + childStart[id + 1]);
+  }
+
+  std::vector<glm::mat4> sortedLocals(count);
+  for (std::uint32_t slot = 0; slot < count; slot++) {
+    sortedLocals[slot] = locals[slots[order[slot]]];
+  }
+  locals = std::move(sortedLocals);
+  ids = std::move(order);
+  levelStarts.clear();
+  for (std::uint32_t slot = 0; slot < count; slot++) {
+    slots[ids[slot]] = slot;
+    while (levelStarts.size() <= depths[ids[slot]]) {
+      levelStarts.push_back(slot);
+    }
+  }
+  levelStarts.push_back(count);
+  for (std::uint32_t slot = 0; slot < count; slot++) {
+    TransformId id = ids[slot];
+    parentSlots[slot] =
+        parents[id] == noTransform ? noTransform : slots[parents[id]];
+    childCount[slot] = childStart[id + 1] - childStart[id];
+    firstChild[slot] =
+        childCount[slot] == 0 ? 0 : slots[children[childStart[id]]];
+  }
+  std::fill(dirty.begin(), dirty.end(), 0);
+  pending.assign(levelStarts.size() - 1, {});
+  layoutChanged = false;
+}
+
+void TransformHierarchy::update(ThreadPool *pool) {
+  CPU_ZONE("TransformHierarchy::update");
+  changedSlots.clear();
+  auto computeWorlds = [&](std::size_t first, std::size_t last,
+                           auto slotAt) {
+    forEachChunk(pool, last - first,
+                 [&](std::size_t begin, std::size_t end) {
+                   for (std::size_t i = first + begin; i < first + end; i++) {
+                     std::uint32_t slot = slotAt(i);
+                     std::uint32_t parent = parentSlots[slot];
+                     worlds[slot] = parent == noTransform
+                                        ? locals[slot]
+                                        : worlds[parent] * locals[slot];
+                   }
+                 });
+  };
+
+  if (layoutChanged) {
+    rebuild();
+    for (std::size_t level = 0; level + 1 < levelStarts.size(); level++) {
+      computeWorlds(levelStarts[level], levelStarts[level + 1],
+                    [](std::size_t i) { return std::uint32_t(i); });
+    }
+    changedSlots.resize(size());
+    std::iota(changedSlots.begin(), changedSlots.end(), 0);
+    uploadAll = true;
+    unuploaded.clear();
+    return;
+  }
+
+  std::size_t previousBegin = 0;
+  std::size_t previousEnd = 0;
+  for (std::size_t level = 0; level < pending.size(); level++) {
+    // Nodes set directly, then children of whatever changed above
+    std::size_t levelBegin = changedSlots.size();
+    changedSlots.insert(changedSlots.end(), pending[level].begin(),
+                        pending[level].end());
+    pending[level].clear();
+    for (std::size_t i = previousBegin; i < previousEnd; i++) {
+      std::uint32_t parent = changedSlots[i];
+      std::uint32_t end = firstChild[parent] + childCount[parent];
+      for (std::uint32_t child = firstChild[parent]; child < end; child++) {
+        if (!dirty[child]) {
+          dirty[child] = 1;
+          changedSlots.push_back(child);
+        }
+      }
+    }
+    computeWorlds(levelBegin, changedSlots.size(),
+                  [&](std::size_t i) { return changedSlots[i]; });
+    previousBegin = levelBegin;
+    previousEnd = changedSlots.size();
+  }
+  for (std::uint32_t slot : changedSlots) {
+    dirty[slot] = 0;
+  }
+  if (!uploadAll) {
+    unuploaded.insert(unuploaded.end(), changedSlots.begin(),
+                      changedSlots.end());
+    // Past this the whole buffer is cheaper than sorting the list
+    if (unuploaded.size() > size()) {
+      uploadAll = true;
+      unuploaded.clear();
+    }
+  }
+}
+
+void TransformHierarchy::upload(GLuint buffer, GLenum target) {
+  CPU_ZONE("TransformHierarchy::upload");
+  GLCall(glBindBuffer(target, buffer));
+  if (uploadAll || uploadedSize != worlds.size()) {
+    GLCall(glBufferData(target, worlds.size() * sizeof(glm::mat4),
+                        worlds.data(), GL_DYNAMIC_DRAW));
+    uploadedSize = worlds.size();
+    uploadAll = false;
+    unuploaded.clear();
+    return;
+  }
+  std::sort(unuploaded.begin(), unuploaded.end());
+  for (std::size_t i = 0; i < unuploaded.size();) {
+    std::uint32_t begin = unuploaded[i];
+    std::uint32_t end = begin + 1;
+    for (i++; i < unuploaded.size() && unuploaded[i] <= end + uploadGap;
+         i++) {
+      end = std::max(end, unuploaded[i] + 1);
+    }
+    GLCall(glBufferSubData(target, begin * sizeof(glm::mat4),
+                           (end - begin) * sizeof(glm::mat4), &worlds[begin]));
+  }
+  unuploaded.clear();
+}
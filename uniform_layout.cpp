@@ -0,0 +1,54 @@
+#include "uniform_layout.h"
+#include "utility.h"
+
+#include <iostream>
+#include <string>
+
+bool checkUniformBlockLayout(GLuint program, std::string_view blockName,
+                             std::span<const UniformField> fields,
+                             std::size_t structSize) {
+  std::string block(blockName);
+  GLuint blockIndex = glGetUniformBlockIndex(program, block.c_str());
+  if (blockIndex == GL_INVALID_INDEX) {
+    std::cerr << "Program " << program << " has no uniform block " << block
+              << std::endl;
+    return false;
+  }
+  bool matches = true;
+  GLint dataSize = 0;
+  GLCall(glGetActiveUniformBlockiv(program, blockIndex,
+                                   GL_UNIFORM_BLOCK_DATA_SIZE, &dataSize));
+  if (std::size_t(dataSize) > structSize) {
+    std::cerr << "Uniform block " << block << " is " << dataSize
+              << " bytes, its struct only " << structSize << std::endl;
+    matches = false;
+  }
+  for (const UniformField &field : fields) {
+    // Members of blocks with an instance name go by Block.member
+    GLuint index = GL_INVALID_INDEX;
+    for (const std::string &name :
+         {std::string(field.name), block + "." + field.name}) {
+      const char *names[] = {name.c_str()};
+      GLCall(glGetUniformIndices(program, 1, names, &index));
+      if (index != GL_INVALID_INDEX) {
+        break;
+      }
+    }
+    if (index == GL_INVALID_INDEX) {
+      std::cerr << "Uniform block " << block << " has no member "
+                << field.name << std::endl;
+      matches = false;
+      continue;
+    }
+    GLint offset = -1;
+    GLCall(glGetActiveUniformsiv(program, 1, &index, GL_UNIFORM_OFFSET,
+                                 &offset));
+    if (offset < 0 || std::size_t(offset) != field.offset) {
+      std::cerr << "Uniform block " << block << " has " << field.name
+                << " at offset " << offset << ", its struct at "
+                << field.offset << std::endl;
+      matches = false;
+    }
+  }
+  return matches;
+}
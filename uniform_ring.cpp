@@ -0,0 +1,136 @@
+#include "uniform_ring.h"
+#include "utility.h"
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+namespace {
+
+std::size_t alignUp(std::size_t value, std::size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+UniformRing::UniformRing(std::size_t frameBytes, unsigned framesInFlight) {
+  GLint alignment = 0;
+  GLCall(glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment));
+  if (alignment > 0) {
+    offsetAlignment = alignment;
+  }
+  this->frameBytes = alignUp(std::max<std::size_t>(frameBytes, 1),
+                             offsetAlignment);
+  fences.assign(std::max(framesInFlight, 1u), nullptr);
+  fallback.resize(this->frameBytes);
+  buffer = GLBuffer::create();
+  GLCall(glBindBuffer(GL_UNIFORM_BUFFER, buffer));
+  GLCall(glBufferData(GL_UNIFORM_BUFFER, this->frameBytes * fences.size(),
+                      nullptr, GL_STREAM_DRAW));
+}
+
+UniformRing::~UniformRing() {
+  if (mapped != nullptr) {
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glUnmapBuffer(GL_UNIFORM_BUFFER);
+  }
+  for (GLsync fence : fences) {
+    if (fence != nullptr) {
+      glDeleteSync(fence);
+    }
+  }
+}
+
+void UniformRing::beginFrame() {
+  GLsync &fence = fences[current];
+  if (fence != nullptr) {
+    GLenum status = glClientWaitSync(fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+      stalls++;
+      do {
+        status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                  1000000);
+      } while (status == GL_TIMEOUT_EXPIRED);
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+  }
+  used = 0;
+  // The fence covers the region, so the driver need not synchronize
+  GLCall(glBindBuffer(GL_UNIFORM_BUFFER, buffer));
+  mapped = static_cast<std::byte *>(glMapBufferRange(
+      GL_UNIFORM_BUFFER, current * frameBytes, frameBytes,
+      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+          GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_FLUSH_EXPLICIT_BIT));
+  if (mapped == nullptr && !mapFailureReported) {
+    std::cerr << "UniformRing: glMapBufferRange failed, falling back to "
+                 "glBufferSubData"
+              << std::endl;
+    mapFailureReported = true;
+  }
+  inFrame = true;
+}
+
+UniformAllocation UniformRing::allocate(std::size_t size) {
+  std::size_t aligned = alignUp(size, offsetAlignment);
+  if (used + aligned > frameBytes) {
+    if (!overflowReported) {
+      std::cerr << "UniformRing: more than " << frameBytes
+                << " bytes of uniform blocks in a frame" << std::endl;
+      overflowReported = true;
+    }
+    overflow.resize(std::max(overflow.size(), size));
+    return {0, 0, 0, overflow.data()};
+  }
+  std::byte *base = mapped != nullptr ? mapped : fallback.data();
+  UniformAllocation allocation = {
+      buffer, GLintptr(current * frameBytes + used), GLsizeiptr(size),
+      base + used};
+  used += aligned;
+  return allocation;
+}
+
+void UniformRing::upload() {
+  if (!inFrame) {
+    return;
+  }
+  GLCall(glBindBuffer(GL_UNIFORM_BUFFER, buffer));
+  if (mapped != nullptr) {
+    if (used > 0) {
+      GLCall(glFlushMappedBufferRange(GL_UNIFORM_BUFFER, 0, used));
+    }
+    GLCall(glUnmapBuffer(GL_UNIFORM_BUFFER));
+    mapped = nullptr;
+  } else if (used > 0) {
+    GLCall(glBufferSubData(GL_UNIFORM_BUFFER, current * frameBytes, used,
+                           fallback.data()));
+  }
+  inFrame = false;
+}
+
+void UniformRing::endFrame() {
+  upload();
+  fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  current = (current + 1) % fences.size();
+}
+
+void UniformRing::bind(GLuint binding, const UniformAllocation &allocation) {
+  if (allocation.buffer == 0) {
+    return;
+  }
+  GLCall(glBindBufferRange(GL_UNIFORM_BUFFER, binding, allocation.buffer,
+                           allocation.offset, allocation.size));
+}
+
+bool setUniformBlockBinding(GLuint program, std::string_view name,
+                            GLuint binding) {
+  std::string blockName(name);
+  GLuint index = glGetUniformBlockIndex(program, blockName.c_str());
+  if (index == GL_INVALID_INDEX) {
+    std::cerr << "Program " << program << " has no uniform block "
+              << blockName << std::endl;
+    return false;
+  }
+  GLCall(glUniformBlockBinding(program, index, binding));
+  return true;
+}
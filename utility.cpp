@@ -1,4 +1,6 @@
 #include "utility.h"
+#include "frame_arena.h"
+
 #include <iostream>
 
 void glClearError() {
@@ -26,14 +28,12 @@ void printShaderInfoLog(GLuint shader, GLenum shaderKind) {
   }
   int infoLogLen = 0;
   glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &infoLogLen);
-  char *infoLog = new char[infoLogLen + 1];
+  char *infoLog = frameArena().allocateArray<char>(infoLogLen + 1);
   glGetShaderInfoLog(shader, infoLogLen, nullptr, infoLog);
   infoLog[infoLogLen] = '\0';
 
   std::cerr << shaderName << " shader compilation failed: \n"
             << infoLog << '\n';
-
-  delete[] infoLog;
 }
 
 GLuint compileProgram(const std::string_view vertexSource,
@@ -93,11 +93,11 @@ GLuint compileProgram(const std::string_view vertexSource,
   if (linkStatus == GL_FALSE) {
     int infoLogLen = 0;
     glGetProgramiv(program, GL_INFO_LOG_LENGTH, &infoLogLen);
-    char *infoLog = new char[infoLogLen + 1];
+    char *infoLog = frameArena().allocateArray<char>(infoLogLen + 1);
     glGetProgramInfoLog(program, infoLogLen, nullptr, infoLog);
+    infoLog[infoLogLen] = '\0';
 
     std::cerr << "Program link step failed: \n" << infoLog << std::endl;
-    delete[] infoLog;
     return 0;
   }
   glDetachShader(program, vertexShader);